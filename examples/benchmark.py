@@ -2,6 +2,7 @@ from __future__ import print_function
 import simtk.openmm.app as app
 import simtk.openmm as mm
 import simtk.unit as unit
+from simtk.openmm.app.internal import customgbforces
 import sys
 from datetime import datetime
 from optparse import OptionParser
@@ -17,9 +18,27 @@ def timeIntegration(context, steps, initialSteps):
     elapsed = end -start
     return elapsed.seconds + elapsed.microseconds*1e-6
 
+def replaceWithCustomGB(system, cutoff):
+    """Replace the GBSAOBCForce in a System with the equivalent CustomGBForce model from customgbforces."""
+    for i, force in enumerate(system.getForces()):
+        if isinstance(force, mm.GBSAOBCForce):
+            break
+    params = [force.getParticleParameters(j) for j in range(force.getNumParticles())]
+    charges = [p[0] for p in params]
+    gbparams = [(p[1].value_in_unit(unit.nanometers), p[2]) for p in params]
+    gbparams = customgbforces.convertParameters(gbparams, 'OBC2')
+    custom = customgbforces.GBSAOBC2Force(force.getSolventDielectric(), force.getSoluteDielectric(), 'ACE', cutoff.value_in_unit(unit.nanometers))
+    for q, p in zip(charges, gbparams):
+        custom.addParticle([q.value_in_unit(unit.elementary_charge)]+p)
+    custom.setNonbondedMethod(mm.CustomGBForce.CutoffNonPeriodic)
+    custom.setCutoffDistance(cutoff)
+    system.removeForce(i)
+    system.addForce(custom)
+
 def runOneTest(testName, options):
     """Perform a single benchmarking simulation."""
     explicit = (testName in ('rf', 'pme', 'amoebapme'))
+    customgb = (testName == 'customgb')
     amoeba = (testName in ('amoebagk', 'amoebapme'))
     hydrogenMass = None
     print()
@@ -77,6 +96,8 @@ def runOneTest(testName, options):
             constraints = app.HBonds
             hydrogenMass = None
         system = ff.createSystem(pdb.topology, nonbondedMethod=method, nonbondedCutoff=cutoff, constraints=constraints, hydrogenMass=hydrogenMass)
+        if customgb:
+            replaceWithCustomGB(system, cutoff)
     print('Step Size: %g fs' % dt.value_in_unit(unit.femtoseconds))
     properties = {}
     initialSteps = 5
@@ -120,7 +141,7 @@ def runOneTest(testName, options):
 parser = OptionParser()
 platformNames = [mm.Platform.getPlatform(i).getName() for i in range(mm.Platform.getNumPlatforms())]
 parser.add_option('--platform', dest='platform', choices=platformNames, help='name of the platform to benchmark')
-parser.add_option('--test', dest='test', choices=('gbsa', 'rf', 'pme', 'amoebagk', 'amoebapme'), help='the test to perform: gbsa, rf, pme, amoebagk, or amoebapme [default: all]')
+parser.add_option('--test', dest='test', choices=('gbsa', 'customgb', 'rf', 'pme', 'amoebagk', 'amoebapme'), help='the test to perform: gbsa, customgb, rf, pme, amoebagk, or amoebapme [default: all]')
 parser.add_option('--pme-cutoff', default='0.9', dest='cutoff', type='float', help='direct space cutoff for PME in nm [default: 0.9]')
 parser.add_option('--seconds', default='60', dest='seconds', type='float', help='target simulation length in seconds [default: 60]')
 parser.add_option('--mutual-epsilon', default='1e-4', dest='epsilon', type='float', help='mutual induced epsilon for AMOEBA [default: 1e-4]')
@@ -141,7 +162,7 @@ if options.platform in ('CUDA', 'OpenCL'):
 # Run the simulations.
 
 if options.test is None:
-    for test in ('gbsa', 'rf', 'pme', 'amoebagk', 'amoebapme'):
+    for test in ('gbsa', 'customgb', 'rf', 'pme', 'amoebagk', 'amoebapme'):
         try:
             runOneTest(test, options)
         except Exception as ex:
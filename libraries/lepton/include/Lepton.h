@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include "lepton/CustomFunction.h"
 #include "lepton/ExpressionProgram.h"
 #include "lepton/ExpressionTreeNode.h"
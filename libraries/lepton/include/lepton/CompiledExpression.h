@@ -46,22 +46,37 @@ namespace Lepton {
 
 class Operation;
 class ParsedExpression;
+class JitProgram;
 
 /**
  * A CompiledExpression is a highly optimized representation of an expression for cases when you want to evaluate
  * it many times as quickly as possible.  You should treat it as an opaque object; none of the internal representation
  * is visible.
  * 
- * A CompiledExpression is created by calling createCompiledExpression() on a ParsedExpression.
+ * A CompiledExpression is created by calling createCompiledExpression() on a ParsedExpression.  Alternatively, a
+ * single CompiledExpression can be created from several ParsedExpressions (for example an energy and its derivatives).
+ * All of them are then computed by one call to evaluate(), and any subexpression they have in common is only
+ * evaluated once.
  * 
  * WARNING: CompiledExpression is NOT thread safe.  You should never access a CompiledExpression from two threads at
- * the same time.
+ * the same time.  Different CompiledExpressions (including copies of the same one) may safely be used on different
+ * threads.
+ *
+ * When JIT compilation is used, the generated machine code is cached and shared by every CompiledExpression in the
+ * process that was created from the same expressions.  Only the memory holding variables and intermediate values
+ * is separate for each object.  Copying a CompiledExpression, or compiling an identical expression a second time,
+ * therefore does not repeat the work.  Expressions that involve custom functions are never shared.
  */
 
 class LEPTON_EXPORT CompiledExpression {
 public:
     CompiledExpression();
     CompiledExpression(const CompiledExpression& expression);
+    /**
+     * Create a CompiledExpression that computes several expressions at once.  evaluate() returns the value of the
+     * first one, and the values of all of them can be retrieved afterward by calling getOutputValue().
+     */
+    explicit CompiledExpression(const std::vector<ParsedExpression>& expressions);
     ~CompiledExpression();
     CompiledExpression& operator=(const CompiledExpression& expression);
     /**
@@ -77,13 +92,26 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Get the number of expressions computed by this object.
+     */
+    int getNumOutputs() const;
+    /**
+     * Get the value of one of the expressions computed by the most recent call to evaluate().
+     *
+     * @param index    the index of the expression, in the order they were passed to the constructor
+     */
+    double getOutputValue(int index) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
+    void compileExpressions(const std::vector<ParsedExpression>& expressions);
+    void copyLayout(const CompiledExpression& expression);
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     std::vector<std::vector<int> > arguments;
     std::vector<int> target;
+    std::vector<int> outputIndices;
     std::vector<Operation*> operation;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
@@ -91,11 +119,13 @@ private:
     mutable std::vector<double> argValues;
     std::map<std::string, double> dummyVariables;
     void* jitCode;
+    JitProgram* jitProgram;
 #ifdef LEPTON_USE_JIT
-    void generateJitCode();
+    void generateJitCode(const std::string& key);
+    void releaseJitCode();
     void generateSingleArgCall(asmjit::X86Compiler& c, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, double (*function)(double));
-    std::vector<double> constants;
-    asmjit::JitRuntime runtime;
+    void generateSplineLookup(asmjit::X86Compiler& c, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, const double* data);
+    void generateIntegerPower(asmjit::X86Compiler& c, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, asmjit::X86XmmVar& one, int exponent);
 #endif
 };
 
@@ -0,0 +1,160 @@
+#ifndef LEPTON_COMPILED_VECTOR_EXPRESSION_H_
+#define LEPTON_COMPILED_VECTOR_EXPRESSION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013-2026 Stanford University and the Authors.       *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ExpressionTreeNode.h"
+#include "windowsIncludes.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#ifdef LEPTON_USE_JIT
+    #include "asmjit.h"
+#endif
+
+namespace Lepton {
+
+class Operation;
+class ParsedExpression;
+
+/**
+ * A CompiledVectorExpression is a highly optimized representation of an expression for cases when you want to evaluate
+ * it many times as quickly as possible.  It is similar to CompiledExpression, with the extra feature that it uses the CPU's
+ * vector unit (SSE on x86) to evaluate the expression for several sets of arguments at once.  It also differs from
+ * CompiledExpression in doing its calculations in single precision.
+ * 
+ * A CompiledVectorExpression is created by calling createCompiledVectorExpression() on a ParsedExpression.  When you
+ * create it, you must specify the width of the vectors on which to compute the expression.  The allowed widths are 4
+ * and 8.  Each variable is then represented by an array of that many values, one for each set of arguments.
+ * Alternatively, a single CompiledVectorExpression can be created from several ParsedExpressions (for example an
+ * energy and its derivative), which are then all computed by one call to evaluate().
+ * 
+ * exp, log, sin, cos, tan, erf, and erfc are computed with inline code rather than by calling the C math library.  They are
+ * evaluated in double precision and then rounded, so the results are accurate to within 1 ulp in single precision.
+ * 
+ * WARNING: CompiledVectorExpression is NOT thread safe.  You should never access a CompiledVectorExpression from two
+ * threads at the same time.
+ */
+
+class LEPTON_EXPORT CompiledVectorExpression {
+public:
+    CompiledVectorExpression();
+    CompiledVectorExpression(const CompiledVectorExpression& expression);
+    /**
+     * Create a CompiledVectorExpression that computes several expressions at once.  evaluate() returns the values
+     * of the first one, and the values of all of them can be retrieved afterward by calling getOutputValues().
+     *
+     * @param expressions   the expressions to compute
+     * @param width         the width of the vectors on which to compute them
+     */
+    CompiledVectorExpression(const std::vector<ParsedExpression>& expressions, int width);
+    ~CompiledVectorExpression();
+    CompiledVectorExpression& operator=(const CompiledVectorExpression& expression);
+    /**
+     * Get the width of the vectors on which the expression is computed.
+     */
+    int getWidth() const;
+    /**
+     * Get the names of all variables used by this expression.
+     */
+    const std::set<std::string>& getVariables() const;
+    /**
+     * Get a pointer to the memory location where the values of a particular variable are stored.  This is an
+     * array of getWidth() floats, which should be set before calling evaluate().
+     */
+    float* getVariablePointer(const std::string& name);
+    /**
+     * Evaluate the expression.  The values of all variables should have been set before calling this.  The return
+     * value is a pointer to an array of getWidth() floats containing the results.
+     */
+    const float* evaluate() const;
+    /**
+     * Evaluate the expression for an arbitrary number of sets of arguments.  This is a convenience method that
+     * copies the arguments into the variables getWidth() at a time, calls evaluate(), and copies out the results.
+     * 
+     * @param inputs    inputs[i] is an array of count values for the i'th variable, in the order they are
+     *                  returned by getVariables()
+     * @param output    on exit, this contains the count results
+     * @param count     the number of sets of arguments to evaluate the expression for
+     */
+    void evaluate(const float* const* inputs, float* output, int count);
+    /**
+     * Get the number of expressions computed by this object.
+     */
+    int getNumOutputs() const;
+    /**
+     * Get the values of one of the expressions computed by the most recent call to evaluate().  This is an array
+     * of getWidth() floats.
+     *
+     * @param index    the index of the expression, in the order they were passed to the constructor
+     */
+    const float* getOutputValues(int index) const;
+    /**
+     * Get the list of vector widths that are supported.
+     */
+    static const std::vector<int>& getAllowedWidths();
+private:
+    friend class ParsedExpression;
+    CompiledVectorExpression(const ParsedExpression& expression, int width);
+    void compileExpressions(const std::vector<ParsedExpression>& expressions);
+    void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    int width;
+    std::vector<std::vector<int> > arguments;
+    std::vector<int> target;
+    std::vector<int> outputIndices;
+    std::vector<Operation*> operation;
+    std::map<std::string, int> variableIndices;
+    std::set<std::string> variableNames;
+    int numTemps;
+    mutable std::vector<float> workspace;
+    mutable std::vector<double> argValues;
+    std::map<std::string, double> dummyVariables;
+    void* jitCode;
+#ifdef LEPTON_USE_JIT
+    void generateJitCode();
+    void generateOperationCall(asmjit::X86Compiler& c, std::vector<asmjit::X86XmmVar>& dest, std::vector<std::vector<asmjit::X86XmmVar> >& workspaceVar,
+            const std::vector<int>& args, Operation* op);
+    void generateInlineCall(asmjit::X86Compiler& c, std::vector<asmjit::X86XmmVar>& dest, std::vector<std::vector<asmjit::X86XmmVar> >& workspaceVar,
+            const std::vector<int>& args, Operation* op);
+    void generateIntegerPower(asmjit::X86Compiler& c, std::vector<asmjit::X86XmmVar>& dest, std::vector<asmjit::X86XmmVar>& arg, asmjit::X86XmmVar& one, int exponent);
+    std::vector<float> constants;
+    mutable std::vector<float> argBuffer;
+    mutable std::vector<float> resultBuffer;
+    asmjit::JitRuntime runtime;
+#endif
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_COMPILED_VECTOR_EXPRESSION_H_*/
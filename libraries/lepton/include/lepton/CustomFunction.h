@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "windowsIncludes.h"
+#include <vector>
 
 namespace Lepton {
 
@@ -70,6 +71,22 @@ public:
      * Create a new duplicate of this object on the heap using the "new" operator.
      */
     virtual CustomFunction* clone() const = 0;
+    /**
+     * If this function is a cubic spline of one argument with uniformly spaced knots, get the data describing it.
+     * CompiledExpression uses this to evaluate the function and its first derivative directly in the generated
+     * code, rather than by calling evaluate().  The function must be zero outside the range spanned by the knots.
+     * The default implementation returns false, indicating the function does not have this form.
+     *
+     * @param min           on exit, the position of the first knot
+     * @param max           on exit, the position of the last knot
+     * @param coefficients  on exit, four coefficients for every interval between knots.  On interval i the function
+     *                      equals c[4i] + c[4i+1]*t + c[4i+2]*t^2 + c[4i+3]*t^3, where t is the fractional position
+     *                      within the interval.
+     * @return true if the function is a uniform spline, false otherwise
+     */
+    virtual bool getUniformSpline(double& min, double& max, std::vector<double>& coefficients) const {
+        return false;
+    }
 };
 
 } // namespace Lepton
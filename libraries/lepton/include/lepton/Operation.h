@@ -255,6 +255,9 @@ public:
     const std::vector<int>& getDerivOrder() const {
         return derivOrder;
     }
+    const CustomFunction& getFunction() const {
+        return *function;
+    }
     bool operator!=(const Operation& op) const {
         const Custom* o = dynamic_cast<const Custom*>(&op);
         return (o == NULL || o->name != name || o->isDerivative != isDerivative || o->derivOrder != derivOrder);
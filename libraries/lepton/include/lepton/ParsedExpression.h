@@ -40,6 +40,7 @@
 namespace Lepton {
 
 class CompiledExpression;
+class CompiledVectorExpression;
 class ExpressionProgram;
 
 /**
@@ -102,6 +103,14 @@ public:
      * Create a CompiledExpression that represents the same calculation as this expression.
      */
     CompiledExpression createCompiledExpression() const;
+    /**
+     * Create a CompiledVectorExpression that allows the expression to be evaluated efficiently
+     * using the CPU's vector unit.
+     *
+     * @param width    the width of the vectors to evaluate it on.  The allowed values can be found
+     *                 by calling CompiledVectorExpression::getAllowedWidths().
+     */
+    CompiledVectorExpression createCompiledVectorExpression(int width) const;
     /**
      * Create a new ParsedExpression which is identical to this one, except that the names of some
      * variables have been changed.
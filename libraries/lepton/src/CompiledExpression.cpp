@@ -30,30 +30,152 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/CompiledExpression.h"
+#include "lepton/CustomFunction.h"
 #include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
+#include "JitMath.h"
+#include <cstdlib>
+#include <sstream>
 #include <utility>
+#ifdef LEPTON_USE_JIT
+    #include <pthread.h>
+#endif
 
 using namespace Lepton;
 using namespace std;
 #ifdef LEPTON_USE_JIT
     using namespace asmjit;
+
+/**
+ * This holds the machine code generated for a CompiledExpression, along with a copy of the expression it
+ * was generated from (which owns the Operations the code refers to).  It is shared by all CompiledExpressions
+ * created from the same expressions, and deleted when the last of them no longer needs it.
+ */
+class Lepton::JitProgram {
+public:
+    JitProgram() : code(NULL), layout(NULL), refCount(1) {
+    }
+    ~JitProgram() {
+        delete layout;
+    }
+    JitRuntime runtime;
+    void* code;
+    CompiledExpression* layout;
+    vector<double> constants;
+    vector<double> splineData;
+    string key;
+    int refCount;
+};
+
+static map<string, JitProgram*>* jitCache = NULL;
+static pthread_mutex_t jitCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Append a description of an expression to the key used for looking it up in the cache.  Constants are written
+ * with enough digits to reproduce them exactly.  Custom functions may have arbitrary internal state, so expressions
+ * that use them are never shared.  In that case this returns false.
+ */
+static bool appendToJitCacheKey(const ExpressionTreeNode& node, stringstream& key) {
+    const Operation& op = node.getOperation();
+    key << op.getId();
+    switch (op.getId()) {
+        case Operation::CUSTOM:
+            return false;
+        case Operation::VARIABLE:
+            key << '=' << op.getName();
+            break;
+        case Operation::CONSTANT:
+            key << '=' << dynamic_cast<const Operation::Constant&>(op).getValue();
+            break;
+        case Operation::ADD_CONSTANT:
+            key << '=' << dynamic_cast<const Operation::AddConstant&>(op).getValue();
+            break;
+        case Operation::MULTIPLY_CONSTANT:
+            key << '=' << dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+            break;
+        case Operation::POWER_CONSTANT:
+            key << '=' << dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+            break;
+        default:
+            break;
+    }
+    key << '(';
+    for (int i = 0; i < (int) node.getChildren().size(); i++) {
+        if (!appendToJitCacheKey(node.getChildren()[i], key))
+            return false;
+        key << ',';
+    }
+    key << ')';
+    return true;
+}
+
+/**
+ * Get the key used for looking up a set of expressions in the cache, or an empty string if they cannot be cached.
+ */
+static string getJitCacheKey(const vector<ParsedExpression>& expressions) {
+    stringstream key;
+    key.precision(17);
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        if (!appendToJitCacheKey(expressions[i].getRootNode(), key))
+            return "";
+        key << ';';
+    }
+    return key.str();
+}
 #endif
 
-CompiledExpression::CompiledExpression() : jitCode(NULL) {
+CompiledExpression::CompiledExpression() : jitCode(NULL), jitProgram(NULL) {
+}
+
+CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL), jitProgram(NULL) {
+    compileExpressions(vector<ParsedExpression>(1, expression));
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL), jitProgram(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: No expressions specified");
+    compileExpressions(expressions);
 }
 
-CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL) {
-    ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+void CompiledExpression::compileExpressions(const vector<ParsedExpression>& expressions) {
+#ifdef LEPTON_USE_JIT
+    // If the same expressions have already been compiled, reuse the existing code.
+    
+    string key = getJitCacheKey(expressions);
+    if (key.size() > 0) {
+        pthread_mutex_lock(&jitCacheLock);
+        if (jitCache != NULL) {
+            map<string, JitProgram*>::iterator cached = jitCache->find(key);
+            if (cached != jitCache->end()) {
+                jitProgram = cached->second;
+                jitProgram->refCount++;
+            }
+        }
+        pthread_mutex_unlock(&jitCacheLock);
+        if (jitProgram != NULL) {
+            copyLayout(*jitProgram->layout);
+            jitCode = jitProgram->code;
+            return;
+        }
+    }
+#endif
+
+    // All the expressions share a single list of temporaries, so any subexpression that appears in more
+    // than one of them is only computed once.
+
     vector<pair<ExpressionTreeNode, int> > temps;
-    compileExpression(expr.getRootNode(), temps);
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        outputIndices.push_back(findTempIndex(expr.getRootNode(), temps));
+    }
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
             maxArguments = operation[i]->getNumArguments();
     argValues.resize(maxArguments);
 #ifdef LEPTON_USE_JIT
-    generateJitCode();
+    generateJitCode(key);
 #endif
 }
 
@@ -61,15 +183,43 @@ CompiledExpression::~CompiledExpression() {
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i] != NULL)
             delete operation[i];
+#ifdef LEPTON_USE_JIT
+    releaseJitCode();
+#endif
 }
 
-CompiledExpression::CompiledExpression(const CompiledExpression& expression) : jitCode(NULL) {
+CompiledExpression::CompiledExpression(const CompiledExpression& expression) : jitCode(NULL), jitProgram(NULL) {
     *this = expression;
 }
 
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
+    if (&expression == this)
+        return *this;
+    copyLayout(expression);
+#ifdef LEPTON_USE_JIT
+    // Share the code if it was cached.  Otherwise it might call custom functions, so generate a new copy.
+    
+    releaseJitCode();
+    if (expression.jitProgram != NULL && expression.jitProgram->key.size() > 0) {
+        pthread_mutex_lock(&jitCacheLock);
+        expression.jitProgram->refCount++;
+        pthread_mutex_unlock(&jitCacheLock);
+        jitProgram = expression.jitProgram;
+        jitCode = jitProgram->code;
+    }
+    else if (expression.jitProgram != NULL)
+        generateJitCode("");
+#endif
+    return *this;
+}
+
+void CompiledExpression::copyLayout(const CompiledExpression& expression) {
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
     arguments = expression.arguments;
     target = expression.target;
+    outputIndices = expression.outputIndices;
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
     workspace.resize(expression.workspace.size());
@@ -77,10 +227,6 @@ CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expr
     operation.resize(expression.operation.size());
     for (int i = 0; i < (int) operation.size(); i++)
         operation[i] = expression.operation[i]->clone();
-#ifdef LEPTON_USE_JIT
-    generateJitCode();
-#endif
-    return *this;
 }
 
 void CompiledExpression::compileExpression(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
@@ -145,7 +291,7 @@ double& CompiledExpression::getVariableReference(const string& name) {
 
 double CompiledExpression::evaluate() const {
 #ifdef LEPTON_USE_JIT
-    return ((double (*)()) jitCode)();
+    return ((double (*)(double*, double*)) jitCode)(&workspace[0], &argValues[0]);
 #else
     // Loop over the operations and evaluate each one.
     
@@ -159,26 +305,58 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+    return workspace[outputIndices[0]];
 #endif
 }
 
+int CompiledExpression::getNumOutputs() const {
+    return outputIndices.size();
+}
+
+double CompiledExpression::getOutputValue(int index) const {
+    return workspace[outputIndices[index]];
+}
+
 #ifdef LEPTON_USE_JIT
 static double evaluateOperation(Operation* op, double* args) {
     map<string, double>* dummyVariables = NULL;
     return op->evaluate(args, *dummyVariables);
 }
 
-void CompiledExpression::generateJitCode() {
-    X86Compiler c(&runtime);
-    c.addFunc(kFuncConvHost, FuncBuilder0<double>());
+void CompiledExpression::releaseJitCode() {
+    if (jitProgram == NULL)
+        return;
+    pthread_mutex_lock(&jitCacheLock);
+    bool deleteProgram = (--jitProgram->refCount == 0);
+    if (deleteProgram && jitProgram->key.size() > 0)
+        jitCache->erase(jitProgram->key);
+    pthread_mutex_unlock(&jitCacheLock);
+    if (deleteProgram)
+        delete jitProgram;
+    jitProgram = NULL;
+    jitCode = NULL;
+}
+
+void CompiledExpression::generateJitCode(const string& key) {
+    releaseJitCode();
+    jitProgram = new JitProgram();
+    jitProgram->key = key;
+    jitProgram->layout = new CompiledExpression();
+    jitProgram->layout->copyLayout(*this);
+    vector<double>& constants = jitProgram->constants;
+    
+    // The generated function receives pointers to the workspace and the buffer of arguments for
+    // evaluateOperation(), so it can be used by any CompiledExpression with the same layout.
+    
+    X86Compiler c(&jitProgram->runtime);
+    c.addFunc(kFuncConvHost, FuncBuilder2<double, double*, double*>());
     vector<X86XmmVar> workspaceVar(workspace.size());
     for (int i = 0; i < (int) workspaceVar.size(); i++)
         workspaceVar[i] = c.newXmmVar(kX86VarTypeXmmSd);
-    X86GpVar workspacePointer(c);
-    X86GpVar argsPointer(c);
-    c.mov(workspacePointer, imm_ptr(&workspace[0]));
-    c.mov(argsPointer, imm_ptr(&argValues[0]));
+    X86GpVar workspacePointer(c, kVarTypeIntPtr);
+    X86GpVar argsPointer(c, kVarTypeIntPtr);
+    c.setArg(0, workspacePointer);
+    c.setArg(1, argsPointer);
     
     // Load the arguments into variables.
     
@@ -207,6 +385,8 @@ void CompiledExpression::generateJitCode() {
             value = 1.0;
         else if (op.getId() == Operation::DELTA)
             value = 1.0;
+        else if (op.getId() == Operation::POWER_CONSTANT)
+            value = 1.0;
         else
             continue;
         
@@ -235,6 +415,39 @@ void CompiledExpression::generateJitCode() {
         }
     }
     
+    // Custom functions that are uniform splines can be evaluated inline.  Record the data for each one:
+    // the range, the inverse spacing between knots, the index of the last interval, and the coefficients
+    // for every interval.  For a first derivative, the coefficients are those of the differentiated polynomial.
+    
+    vector<double>& splineData = jitProgram->splineData;
+    vector<int> splineOffset(operation.size(), -1);
+    for (int step = 0; step < (int) operation.size(); step++) {
+        if (operation[step]->getId() != Operation::CUSTOM)
+            continue;
+        const Operation::Custom& custom = dynamic_cast<const Operation::Custom&>(*operation[step]);
+        double min, max;
+        vector<double> coeff;
+        if (custom.getNumArguments() != 1 || custom.getDerivOrder()[0] > 1 || !custom.getFunction().getUniformSpline(min, max, coeff))
+            continue;
+        int numIntervals = coeff.size()/4;
+        double invSpacing = numIntervals/(max-min);
+        splineOffset[step] = splineData.size();
+        splineData.push_back(min);
+        splineData.push_back(max);
+        splineData.push_back(invSpacing);
+        splineData.push_back(numIntervals-1);
+        for (int i = 0; i < numIntervals; i++) {
+            if (custom.getDerivOrder()[0] == 0)
+                splineData.insert(splineData.end(), coeff.begin()+4*i, coeff.begin()+4*i+4);
+            else {
+                splineData.push_back(coeff[4*i+1]*invSpacing);
+                splineData.push_back(2*coeff[4*i+2]*invSpacing);
+                splineData.push_back(3*coeff[4*i+3]*invSpacing);
+                splineData.push_back(0.0);
+            }
+        }
+    }
+
     // Evaluate the operations.
     
     for (int step = 0; step < (int) operation.size(); step++) {
@@ -249,6 +462,15 @@ void CompiledExpression::generateJitCode() {
         
         // Generate instructions to execute this operation.
         
+        int exponent;
+        if (splineOffset[step] != -1) {
+            generateSplineLookup(c, workspaceVar[target[step]], workspaceVar[args[0]], &splineData[splineOffset[step]]);
+            continue;
+        }
+        if (JitMath::isIntegerPower(op, exponent)) {
+            generateIntegerPower(c, workspaceVar[target[step]], workspaceVar[args[0]], constantVar[operationConstantIndex[step]], exponent);
+            continue;
+        }
         switch (op.getId()) {
             case Operation::CONSTANT:
                 c.movsd(workspaceVar[target[step]], constantVar[operationConstantIndex[step]]);
@@ -357,14 +579,42 @@ void CompiledExpression::generateJitCode() {
                 X86GpVar fn(c, kVarTypeIntPtr);
                 c.mov(fn, imm_ptr((void*) evaluateOperation));
                 X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder2<double, Operation*, double*>());
-                call->setArg(0, imm_ptr(&op));
-                call->setArg(1, imm_ptr(&argValues[0]));
+                call->setArg(0, imm_ptr(jitProgram->layout->operation[step]));
+                call->setArg(1, argsPointer);
                 call->setRet(0, workspaceVar[target[step]]);
         }
     }
-    c.ret(workspaceVar[workspace.size()-1]);
+    
+    // Store the outputs so they can be retrieved with getOutputValue(), then return the first one.
+    
+    for (int i = 0; i < (int) outputIndices.size(); i++)
+        c.movsd(x86::ptr(workspacePointer, 8*outputIndices[i], 0), workspaceVar[outputIndices[i]]);
+    c.ret(workspaceVar[outputIndices[0]]);
     c.endFunc();
     jitCode = c.make();
+    jitProgram->code = jitCode;
+    
+    // Add it to the cache.  If another thread generated the same code in the meantime, use that instead.
+    
+    if (key.size() > 0) {
+        pthread_mutex_lock(&jitCacheLock);
+        if (jitCache == NULL)
+            jitCache = new map<string, JitProgram*>();
+        map<string, JitProgram*>::iterator cached = jitCache->find(key);
+        JitProgram* duplicate = NULL;
+        if (cached == jitCache->end())
+            (*jitCache)[key] = jitProgram;
+        else {
+            duplicate = jitProgram;
+            jitProgram = cached->second;
+            jitProgram->refCount++;
+        }
+        pthread_mutex_unlock(&jitCacheLock);
+        if (duplicate != NULL) {
+            delete duplicate;
+            jitCode = jitProgram->code;
+        }
+    }
 }
 
 void CompiledExpression::generateSingleArgCall(X86Compiler& c, X86XmmVar& dest, X86XmmVar& arg, double (*function)(double)) {
@@ -374,4 +624,67 @@ void CompiledExpression::generateSingleArgCall(X86Compiler& c, X86XmmVar& dest,
     call->setArg(0, arg);
     call->setRet(0, dest);
 }
+
+void CompiledExpression::generateSplineLookup(X86Compiler& c, X86XmmVar& dest, X86XmmVar& arg, const double* data) {
+    // Find the interval containing the argument.  The index is clamped to the valid range, so it is safe to
+    // use even when the argument is out of range or NaN.
+    
+    X86GpVar table(c, kVarTypeIntPtr);
+    c.mov(table, imm_ptr((void*) data));
+    X86XmmVar s = c.newXmmVar(kX86VarTypeXmmSd);
+    X86XmmVar clamped = c.newXmmVar(kX86VarTypeXmmSd);
+    c.movsd(s, arg);
+    c.subsd(s, x86::ptr(table, 0, 0));
+    c.mulsd(s, x86::ptr(table, 16, 0));
+    c.xorps(clamped, clamped);
+    c.maxsd(clamped, s);
+    c.minsd(clamped, x86::ptr(table, 24, 0));
+    X86GpVar index(c, kVarTypeIntPtr);
+    c.cvttsd2si(index, clamped);
+    c.cvtsi2sd(clamped, index);
+    c.subsd(s, clamped);
+    
+    // Evaluate the polynomial for that interval.  Each one has four coefficients, which take 32 bytes.
+    
+    c.shl(index, imm(2));
+    c.movsd(dest, x86::ptr(table, index, 3, 56));
+    c.mulsd(dest, s);
+    c.addsd(dest, x86::ptr(table, index, 3, 48));
+    c.mulsd(dest, s);
+    c.addsd(dest, x86::ptr(table, index, 3, 40));
+    c.mulsd(dest, s);
+    c.addsd(dest, x86::ptr(table, index, 3, 32));
+    
+    // The function is zero outside its range.
+    
+    X86XmmVar inRange = c.newXmmVar(kX86VarTypeXmmSd);
+    X86XmmVar belowMax = c.newXmmVar(kX86VarTypeXmmSd);
+    c.movsd(inRange, x86::ptr(table, 0, 0));
+    c.cmpsd(inRange, arg, imm(2)); // min <= x
+    c.movsd(belowMax, arg);
+    c.cmpsd(belowMax, x86::ptr(table, 8, 0), imm(2)); // x <= max
+    c.andps(inRange, belowMax);
+    c.andps(dest, inRange);
+}
+
+void CompiledExpression::generateIntegerPower(X86Compiler& c, X86XmmVar& dest, X86XmmVar& arg, X86XmmVar& one, int exponent) {
+    // Compute the power by repeated squaring.
+    
+    X86XmmVar base = c.newXmmVar(kX86VarTypeXmmSd);
+    X86XmmVar result = c.newXmmVar(kX86VarTypeXmmSd);
+    c.movsd(base, arg);
+    c.movsd(result, one);
+    for (int remaining = abs(exponent); remaining > 0; remaining >>= 1) {
+        if ((remaining&1) != 0)
+            c.mulsd(result, base);
+        if (remaining > 1)
+            c.mulsd(base, base);
+    }
+    if (exponent < 0) {
+        c.movsd(dest, one);
+        c.divsd(dest, result);
+    }
+    else
+        c.movsd(dest, result);
+}
 #endif
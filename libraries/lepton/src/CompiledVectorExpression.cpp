@@ -0,0 +1,538 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013-2026 Stanford University and the Authors.       *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "lepton/CompiledVectorExpression.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include "JitMath.h"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+using namespace Lepton;
+using namespace std;
+#ifdef LEPTON_USE_JIT
+    using namespace asmjit;
+#endif
+
+CompiledVectorExpression::CompiledVectorExpression() : width(4), numTemps(0), jitCode(NULL) {
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const ParsedExpression& expression, int width) : width(width), numTemps(0), jitCode(NULL) {
+    compileExpressions(vector<ParsedExpression>(1, expression));
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const vector<ParsedExpression>& expressions, int width) : width(width), numTemps(0), jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledVectorExpression: No expressions specified");
+    compileExpressions(expressions);
+}
+
+void CompiledVectorExpression::compileExpressions(const vector<ParsedExpression>& expressions) {
+    const vector<int>& allowed = getAllowedWidths();
+    if (find(allowed.begin(), allowed.end(), width) == allowed.end())
+        throw Exception("CompiledVectorExpression: Unsupported width");
+
+    // All the expressions share a single list of temporaries, so any subexpression that appears in more
+    // than one of them is only computed once.
+
+    vector<pair<ExpressionTreeNode, int> > temps;
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        outputIndices.push_back(findTempIndex(expr.getRootNode(), temps));
+    }
+    workspace.resize(width*numTemps, 0.0f);
+    int maxArguments = 1;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getNumArguments() > maxArguments)
+            maxArguments = operation[i]->getNumArguments();
+    argValues.resize(maxArguments);
+#ifdef LEPTON_USE_JIT
+    generateJitCode();
+#endif
+}
+
+CompiledVectorExpression::~CompiledVectorExpression() {
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const CompiledVectorExpression& expression) : width(4), numTemps(0), jitCode(NULL) {
+    *this = expression;
+}
+
+CompiledVectorExpression& CompiledVectorExpression::operator=(const CompiledVectorExpression& expression) {
+    if (&expression == this)
+        return *this;
+    for (int i = 0; i < (int) operation.size(); i++)
+        delete operation[i];
+    width = expression.width;
+    numTemps = expression.numTemps;
+    arguments = expression.arguments;
+    target = expression.target;
+    outputIndices = expression.outputIndices;
+    variableIndices = expression.variableIndices;
+    variableNames = expression.variableNames;
+    workspace.resize(expression.workspace.size());
+    argValues.resize(expression.argValues.size());
+    operation.resize(expression.operation.size());
+    for (int i = 0; i < (int) operation.size(); i++)
+        operation[i] = expression.operation[i]->clone();
+#ifdef LEPTON_USE_JIT
+    if (numTemps > 0)
+        generateJitCode();
+#endif
+    return *this;
+}
+
+const vector<int>& CompiledVectorExpression::getAllowedWidths() {
+    static vector<int> widths;
+    if (widths.size() == 0) {
+        widths.push_back(4);
+        widths.push_back(8);
+    }
+    return widths;
+}
+
+void CompiledVectorExpression::compileExpression(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    if (findTempIndex(node, temps) != -1)
+        return; // We have already processed a node identical to this one.
+    
+    // Process the child nodes.
+    
+    vector<int> args;
+    for (int i = 0; i < node.getChildren().size(); i++) {
+        compileExpression(node.getChildren()[i], temps);
+        args.push_back(findTempIndex(node.getChildren()[i], temps));
+    }
+    
+    // Process this node.  Unlike CompiledExpression, every step records its full list of arguments, since
+    // the values for different temps are not adjacent in the workspace.
+    
+    if (node.getOperation().getId() == Operation::VARIABLE) {
+        variableIndices[node.getOperation().getName()] = numTemps;
+        variableNames.insert(node.getOperation().getName());
+    }
+    else {
+        arguments.push_back(args);
+        target.push_back(numTemps);
+        operation.push_back(node.getOperation().clone());
+    }
+    temps.push_back(make_pair(node, numTemps));
+    numTemps++;
+}
+
+int CompiledVectorExpression::findTempIndex(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    for (int i = 0; i < (int) temps.size(); i++)
+        if (temps[i].first == node)
+            return i;
+    return -1;
+}
+
+int CompiledVectorExpression::getWidth() const {
+    return width;
+}
+
+const set<string>& CompiledVectorExpression::getVariables() const {
+    return variableNames;
+}
+
+float* CompiledVectorExpression::getVariablePointer(const string& name) {
+    map<string, int>::iterator index = variableIndices.find(name);
+    if (index == variableIndices.end())
+        throw Exception("getVariablePointer: Unknown variable '"+name+"'");
+    return &workspace[width*index->second];
+}
+
+const float* CompiledVectorExpression::evaluate() const {
+#ifdef LEPTON_USE_JIT
+    ((void (*)()) jitCode)();
+#else
+    // Loop over the operations and evaluate each one, one vector element at a time.
+    
+    for (int step = 0; step < operation.size(); step++) {
+        const vector<int>& args = arguments[step];
+        float* result = &workspace[width*target[step]];
+        for (int j = 0; j < width; j++) {
+            for (int i = 0; i < args.size(); i++)
+                argValues[i] = workspace[width*args[i]+j];
+            result[j] = (float) operation[step]->evaluate(&argValues[0], dummyVariables);
+        }
+    }
+#endif
+    return &workspace[width*outputIndices[0]];
+}
+
+int CompiledVectorExpression::getNumOutputs() const {
+    return outputIndices.size();
+}
+
+const float* CompiledVectorExpression::getOutputValues(int index) const {
+    return &workspace[width*outputIndices[index]];
+}
+
+void CompiledVectorExpression::evaluate(const float* const* inputs, float* output, int count) {
+    vector<float*> pointers;
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter)
+        pointers.push_back(getVariablePointer(*iter));
+    for (int base = 0; base < count; base += width) {
+        int n = min(width, count-base);
+        for (int i = 0; i < (int) pointers.size(); i++) {
+            // Pad a partial final block by repeating the first value, so the unused elements hold valid arguments.
+            
+            for (int j = 0; j < width; j++)
+                pointers[i][j] = inputs[i][base+(j < n ? j : 0)];
+        }
+        const float* result = evaluate();
+        for (int j = 0; j < n; j++)
+            output[base+j] = result[j];
+    }
+}
+
+#ifdef LEPTON_USE_JIT
+static void evaluateVectorOperation(Operation* op, float* args, float* results, double* argValues, int width) {
+    map<string, double>* dummyVariables = NULL;
+    int numArgs = op->getNumArguments();
+    for (int j = 0; j < width; j++) {
+        for (int i = 0; i < numArgs; i++)
+            argValues[i] = args[width*i+j];
+        results[j] = (float) op->evaluate(argValues, *dummyVariables);
+    }
+}
+
+void CompiledVectorExpression::generateJitCode() {
+    X86Compiler c(&runtime);
+    c.addFunc(kFuncConvHost, FuncBuilder0<void>());
+    
+    // Each temp is held in width/4 SSE registers of four floats each.
+    
+    const int numVectors = width/4;
+    vector<vector<X86XmmVar> > workspaceVar(numTemps, vector<X86XmmVar>(numVectors));
+    for (int i = 0; i < numTemps; i++)
+        for (int k = 0; k < numVectors; k++)
+            workspaceVar[i][k] = c.newXmmVar(kX86VarTypeXmmPs);
+    X86GpVar workspacePointer(c);
+    c.mov(workspacePointer, imm_ptr(&workspace[0]));
+    
+    // Load the arguments into variables.
+    
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter) {
+        map<string, int>::iterator index = variableIndices.find(*iter);
+        for (int k = 0; k < numVectors; k++)
+            c.movups(workspaceVar[index->second][k], x86::ptr(workspacePointer, 4*(width*index->second+4*k), 0));
+    }
+
+    // Make a list of all constants that will be needed for evaluation.
+    
+    constants.clear();
+    vector<int> operationConstantIndex(operation.size(), -1);
+    int maxArguments = 1;
+    for (int step = 0; step < (int) operation.size(); step++) {
+        // Find the constant value (if any) used by this operation.
+        
+        Operation& op = *operation[step];
+        maxArguments = max(maxArguments, op.getNumArguments());
+        float value;
+        if (op.getId() == Operation::CONSTANT)
+            value = (float) dynamic_cast<Operation::Constant&>(op).getValue();
+        else if (op.getId() == Operation::ADD_CONSTANT)
+            value = (float) dynamic_cast<Operation::AddConstant&>(op).getValue();
+        else if (op.getId() == Operation::MULTIPLY_CONSTANT)
+            value = (float) dynamic_cast<Operation::MultiplyConstant&>(op).getValue();
+        else if (op.getId() == Operation::RECIPROCAL)
+            value = 1.0f;
+        else if (op.getId() == Operation::STEP)
+            value = 1.0f;
+        else if (op.getId() == Operation::DELTA)
+            value = 1.0f;
+        else if (op.getId() == Operation::POWER_CONSTANT)
+            value = 1.0f;
+        else
+            continue;
+        
+        // See if we already have a variable for this constant.  Each one is stored as four copies, so it can be
+        // loaded directly into a register.
+        
+        for (int i = 0; i < (int) constants.size(); i += 4)
+            if (value == constants[i]) {
+                operationConstantIndex[step] = i/4;
+                break;
+            }
+        if (operationConstantIndex[step] == -1) {
+            operationConstantIndex[step] = constants.size()/4;
+            for (int j = 0; j < 4; j++)
+                constants.push_back(value);
+        }
+    }
+    argBuffer.resize(width*maxArguments);
+    resultBuffer.resize(width);
+    
+    // Load constants into variables.
+    
+    vector<X86XmmVar> constantVar(constants.size()/4);
+    if (constants.size() > 0) {
+        X86GpVar constantsPointer(c);
+        c.mov(constantsPointer, imm_ptr(&constants[0]));
+        for (int i = 0; i < (int) constantVar.size(); i++) {
+            constantVar[i] = c.newXmmVar(kX86VarTypeXmmPs);
+            c.movups(constantVar[i], x86::ptr(constantsPointer, 16*i, 0));
+        }
+    }
+    
+    // Evaluate the operations.
+    
+    for (int step = 0; step < (int) operation.size(); step++) {
+        Operation& op = *operation[step];
+        const vector<int>& args = arguments[step];
+        vector<X86XmmVar>& dest = workspaceVar[target[step]];
+        
+        // Generate instructions to execute this operation.
+        
+        int exponent;
+        if (JitMath::isIntegerPower(op, exponent)) {
+            generateIntegerPower(c, dest, workspaceVar[args[0]], constantVar[operationConstantIndex[step]], exponent);
+            continue;
+        }
+        if (JitMath::hasInlineImplementation(op)) {
+            generateInlineCall(c, dest, workspaceVar, args, &op);
+            continue;
+        }
+        switch (op.getId()) {
+            case Operation::CONSTANT:
+                for (int k = 0; k < numVectors; k++)
+                    c.movaps(dest[k], constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::ADD:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.addps(dest[k], workspaceVar[args[1]][k]);
+                }
+                break;
+            case Operation::SUBTRACT:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.subps(dest[k], workspaceVar[args[1]][k]);
+                }
+                break;
+            case Operation::MULTIPLY:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.mulps(dest[k], workspaceVar[args[1]][k]);
+                }
+                break;
+            case Operation::DIVIDE:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.divps(dest[k], workspaceVar[args[1]][k]);
+                }
+                break;
+            case Operation::NEGATE:
+                for (int k = 0; k < numVectors; k++) {
+                    c.xorps(dest[k], dest[k]);
+                    c.subps(dest[k], workspaceVar[args[0]][k]);
+                }
+                break;
+            case Operation::SQRT:
+                for (int k = 0; k < numVectors; k++)
+                    c.sqrtps(dest[k], workspaceVar[args[0]][k]);
+                break;
+            case Operation::STEP:
+                for (int k = 0; k < numVectors; k++) {
+                    c.xorps(dest[k], dest[k]);
+                    c.cmpps(dest[k], workspaceVar[args[0]][k], imm(2)); // Comparison mode is _CMP_LE_OS = 2
+                    c.andps(dest[k], constantVar[operationConstantIndex[step]]);
+                }
+                break;
+            case Operation::DELTA:
+                for (int k = 0; k < numVectors; k++) {
+                    c.xorps(dest[k], dest[k]);
+                    c.cmpps(dest[k], workspaceVar[args[0]][k], imm(0)); // Comparison mode is _CMP_EQ_OQ = 0
+                    c.andps(dest[k], constantVar[operationConstantIndex[step]]);
+                }
+                break;
+            case Operation::SQUARE:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.mulps(dest[k], workspaceVar[args[0]][k]);
+                }
+                break;
+            case Operation::CUBE:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.mulps(dest[k], workspaceVar[args[0]][k]);
+                    c.mulps(dest[k], workspaceVar[args[0]][k]);
+                }
+                break;
+            case Operation::RECIPROCAL:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], constantVar[operationConstantIndex[step]]);
+                    c.divps(dest[k], workspaceVar[args[0]][k]);
+                }
+                break;
+            case Operation::ADD_CONSTANT:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.addps(dest[k], constantVar[operationConstantIndex[step]]);
+                }
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.mulps(dest[k], constantVar[operationConstantIndex[step]]);
+                }
+                break;
+            case Operation::MIN:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.minps(dest[k], workspaceVar[args[1]][k]);
+                }
+                break;
+            case Operation::MAX:
+                for (int k = 0; k < numVectors; k++) {
+                    c.movaps(dest[k], workspaceVar[args[0]][k]);
+                    c.maxps(dest[k], workspaceVar[args[1]][k]);
+                }
+                break;
+            case Operation::ABS:
+                // abs(x) = max(x, -x)
+                
+                for (int k = 0; k < numVectors; k++) {
+                    c.xorps(dest[k], dest[k]);
+                    c.subps(dest[k], workspaceVar[args[0]][k]);
+                    c.maxps(dest[k], workspaceVar[args[0]][k]);
+                }
+                break;
+            default:
+                generateOperationCall(c, dest, workspaceVar, args, &op);
+        }
+    }
+    
+    // Store the outputs back into the workspace.
+    
+    for (int i = 0; i < (int) outputIndices.size(); i++)
+        for (int k = 0; k < numVectors; k++)
+            c.movups(x86::ptr(workspacePointer, 4*(width*outputIndices[i]+4*k), 0), workspaceVar[outputIndices[i]][k]);
+    c.ret();
+    c.endFunc();
+    jitCode = c.make();
+}
+
+void CompiledVectorExpression::generateOperationCall(X86Compiler& c, vector<X86XmmVar>& dest, vector<vector<X86XmmVar> >& workspaceVar, const vector<int>& args, Operation* op) {
+    // Copy the arguments into a buffer, invoke evaluateVectorOperation(), and load the results.
+    
+    const int numVectors = width/4;
+    X86GpVar argsPointer(c);
+    c.mov(argsPointer, imm_ptr(&argBuffer[0]));
+    for (int i = 0; i < (int) args.size(); i++)
+        for (int k = 0; k < numVectors; k++)
+            c.movups(x86::ptr(argsPointer, 4*(width*i+4*k), 0), workspaceVar[args[i]][k]);
+    X86GpVar fn(c, kVarTypeIntPtr);
+    c.mov(fn, imm_ptr((void*) evaluateVectorOperation));
+    X86CallNode* call = c.call(fn, kFuncConvHost, FuncBuilder5<void, Operation*, float*, float*, double*, int>());
+    call->setArg(0, imm_ptr(op));
+    call->setArg(1, imm_ptr(&argBuffer[0]));
+    call->setArg(2, imm_ptr(&resultBuffer[0]));
+    call->setArg(3, imm_ptr(&argValues[0]));
+    call->setArg(4, imm(width));
+    X86GpVar resultPointer(c);
+    c.mov(resultPointer, imm_ptr(&resultBuffer[0]));
+    for (int k = 0; k < numVectors; k++)
+        c.movups(dest[k], x86::ptr(resultPointer, 16*k, 0));
+}
+
+void CompiledVectorExpression::generateInlineCall(X86Compiler& c, vector<X86XmmVar>& dest, vector<vector<X86XmmVar> >& workspaceVar, const vector<int>& args, Operation* op) {
+    // The inline functions work in double precision, so convert each register of four floats to two registers of
+    // two doubles, and convert the results back.
+    
+    JitMath math(c);
+    X86XmmVar allValid;
+    bool needCheck = false;
+    for (int k = 0; k < (int) dest.size(); k++) {
+        X86XmmVar& arg = workspaceVar[args[0]][k];
+        X86XmmVar low = c.newXmmVar(kX86VarTypeXmmPd);
+        X86XmmVar high = c.newXmmVar(kX86VarTypeXmmPd);
+        X86XmmVar temp = c.newXmmVar(kX86VarTypeXmmPs);
+        c.cvtps2pd(low, arg);
+        c.movhlps(temp, arg);
+        c.cvtps2pd(high, temp);
+        X86XmmVar lowValid, highValid;
+        math.generate(*op, low, low, lowValid);
+        needCheck = math.generate(*op, high, high, highValid);
+        c.cvtpd2ps(dest[k], low);
+        c.cvtpd2ps(temp, high);
+        c.movlhps(dest[k], temp);
+        if (needCheck) {
+            if (k == 0)
+                allValid = lowValid;
+            else
+                c.andpd(allValid, lowValid);
+            c.andpd(allValid, highValid);
+        }
+    }
+    if (needCheck) {
+        // If any element is outside the range the inline code handles, evaluate the whole vector with the
+        // library function instead.
+        
+        Label done = c.newLabel();
+        X86GpVar mask(c, kVarTypeInt32);
+        c.movmskpd(mask, allValid);
+        c.cmp(mask, imm(3));
+        c.je(done);
+        generateOperationCall(c, dest, workspaceVar, args, op);
+        c.bind(done);
+    }
+}
+
+void CompiledVectorExpression::generateIntegerPower(X86Compiler& c, vector<X86XmmVar>& dest, vector<X86XmmVar>& arg, X86XmmVar& one, int exponent) {
+    // Compute the power by repeated squaring.
+    
+    for (int k = 0; k < (int) dest.size(); k++) {
+        X86XmmVar base = c.newXmmVar(kX86VarTypeXmmPs);
+        X86XmmVar result = c.newXmmVar(kX86VarTypeXmmPs);
+        c.movaps(base, arg[k]);
+        c.movaps(result, one);
+        for (int remaining = abs(exponent); remaining > 0; remaining >>= 1) {
+            if ((remaining&1) != 0)
+                c.mulps(result, base);
+            if (remaining > 1)
+                c.mulps(base, base);
+        }
+        if (exponent < 0) {
+            c.movaps(dest[k], one);
+            c.divps(dest[k], result);
+        }
+        else
+            c.movaps(dest[k], result);
+    }
+}
+#endif
@@ -0,0 +1,609 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "JitMath.h"
+
+#ifdef LEPTON_USE_JIT
+
+#include "lepton/Exception.h"
+#include <cmath>
+#include <vector>
+
+using namespace Lepton;
+using namespace asmjit;
+using namespace std;
+
+// Every constant is stored twice, so it can be loaded directly into both elements of a register.
+
+static const double one[] = {1.0, 1.0};
+static const double half[] = {0.5, 0.5};
+static const double expMin[] = {-746.0, -746.0};
+static const double expMax[] = {710.0, 710.0};
+static const double invLn2[] = {1.44269504088896338700e+00, 1.44269504088896338700e+00};
+static const double ln2Hi[] = {6.93147180369123816490e-01, 6.93147180369123816490e-01};
+static const double ln2Lo[] = {1.90821492927058770002e-10, 1.90821492927058770002e-10};
+static const double minNormal[] = {2.2250738585072014e-308, 2.2250738585072014e-308};
+static const double maxFinite[] = {1.7976931348623157e+308, 1.7976931348623157e+308};
+static const double sqrt2[] = {1.41421356237309504880, 1.41421356237309504880};
+static const double trigMax[] = {1e5, 1e5};
+static const double twoOverPi[] = {6.36619772367581382433e-01, 6.36619772367581382433e-01};
+static const double pio2_1[] = {1.57079632673412561417e+00, 1.57079632673412561417e+00};
+static const double pio2_2[] = {6.07710050630396597660e-11, 6.07710050630396597660e-11};
+static const double pio2_3[] = {2.02226624871116645580e-21, 2.02226624871116645580e-21};
+static const double quarter[] = {0.25, 0.25};
+static const double two[] = {2.0, 2.0};
+static const double sixteen[] = {16.0, 16.0};
+static const double thirtyTwo[] = {32.0, 32.0};
+static const double erfSmall[] = {0.84375, 0.84375};
+static const double erfMax[] = {28.0, 28.0};
+static const int exponentBias[] = {1023, 1023, 1023, 1023};
+static const int intOne[] = {1, 1, 1, 1};
+static const int intTwo[] = {2, 2, 2, 2};
+static const unsigned int mantissaMask[] = {0xFFFFFFFF, 0x000FFFFF, 0xFFFFFFFF, 0x000FFFFF};
+static const unsigned int absMask[] = {0xFFFFFFFF, 0x7FFFFFFF, 0xFFFFFFFF, 0x7FFFFFFF};
+static const unsigned int signMask[] = {0, 0x80000000, 0, 0x80000000};
+static const unsigned int highBitsMask[] = {0xF8000000, 0xFFFFFFFF, 0xF8000000, 0xFFFFFFFF};
+
+// Taylor series coefficients, highest order first.  Over the reduced ranges used below, the series are truncated
+// where the next term is below 1e-18 relative to the result.
+
+static const double expCoefficients[][2] = { // 1/n!, n = 13 to 0
+    {1.6059043836821613e-10, 1.6059043836821613e-10}, {2.08767569878681e-09, 2.08767569878681e-09},
+    {2.505210838544172e-08, 2.505210838544172e-08}, {2.755731922398589e-07, 2.755731922398589e-07},
+    {2.7557319223985893e-06, 2.7557319223985893e-06}, {2.48015873015873e-05, 2.48015873015873e-05},
+    {0.0001984126984126984, 0.0001984126984126984}, {0.001388888888888889, 0.001388888888888889},
+    {0.008333333333333333, 0.008333333333333333}, {0.041666666666666664, 0.041666666666666664},
+    {0.16666666666666666, 0.16666666666666666}, {0.5, 0.5}, {1.0, 1.0}, {1.0, 1.0}
+};
+static const double logCoefficients[][2] = { // 2/(2n+1), n = 10 to 1
+    {0.09523809523809523, 0.09523809523809523}, {0.10526315789473684, 0.10526315789473684},
+    {0.11764705882352941, 0.11764705882352941}, {0.13333333333333333, 0.13333333333333333},
+    {0.15384615384615385, 0.15384615384615385}, {0.18181818181818182, 0.18181818181818182},
+    {0.2222222222222222, 0.2222222222222222}, {0.2857142857142857, 0.2857142857142857},
+    {0.4, 0.4}, {0.6666666666666666, 0.6666666666666666}
+};
+static const double sinCoefficients[][2] = { // (-1)^n/(2n+1)!, n = 8 to 1
+    {2.8114572543455206e-15, 2.8114572543455206e-15}, {-7.647163731819816e-13, -7.647163731819816e-13},
+    {1.6059043836821613e-10, 1.6059043836821613e-10}, {-2.505210838544172e-08, -2.505210838544172e-08},
+    {2.7557319223985893e-06, 2.7557319223985893e-06}, {-0.0001984126984126984, -0.0001984126984126984},
+    {0.008333333333333333, 0.008333333333333333}, {-0.16666666666666666, -0.16666666666666666}
+};
+static const double cosCoefficients[][2] = { // (-1)^n/(2n)!, n = 9 to 2
+    {-1.5619206968586225e-16, -1.5619206968586225e-16}, {4.779477332387385e-14, 4.779477332387385e-14},
+    {-1.1470745597729725e-11, -1.1470745597729725e-11}, {2.08767569878681e-09, 2.08767569878681e-09},
+    {-2.755731922398589e-07, -2.755731922398589e-07}, {2.48015873015873e-05, 2.48015873015873e-05},
+    {-0.001388888888888889, -0.001388888888888889}, {0.041666666666666664, 0.041666666666666664}
+};
+static const double expCorrectionCoefficients[][2] = { // (-1)^(n+1)/n!, n = 3 to 1
+    {0.16666666666666666, 0.16666666666666666}, {-0.5, -0.5}, {1.0, 1.0}
+};
+
+// The following coefficients were fitted by Chebyshev interpolation to values computed with 60 digit arithmetic.
+// For |x| < 0.84375, erf(x) = x + x*P(x^2).
+
+static const double erfCoefficients[][2] = {
+    {-8.8797027049858482e-10, -8.8797027049858482e-10}, {1.4205594850504056e-08, 1.4205594850504056e-08},
+    {-1.6303095084688869e-07, -1.6303095084688869e-07}, {1.6457914349746103e-06, 1.6457914349746103e-06},
+    {-1.4925463570287675e-05, -1.4925463570287675e-05}, {0.00012055327421282683, 0.00012055327421282683},
+    {-0.00085483269142511197, -0.00085483269142511197}, {0.0052239776240807423, 0.0052239776240807423},
+    {-0.026866170645030999, -0.026866170645030999}, {0.11283791670954745, 0.11283791670954745},
+    {-0.37612638903183748, -0.37612638903183748}, {0.12837916709551259, 0.12837916709551259}
+};
+
+// For larger |x|, erfc(|x|) = exp(-x^2)*Q(u)/|x| with u = 1/|x|.  Q is a separate polynomial on each interval
+// [i/16, (i+1)/16], in terms of t = 32*u-(2*i+1), which ranges from -1 to 1.
+
+static const int erfcTableWidth = 10;
+static const double erfcTable[][erfcTableWidth] = {
+    {-1.3115869665097754e-13, 2.715404429672999e-12, 2.5226127787574539e-11, -8.9393303846904888e-10, -5.7263222976804768e-09,
+     3.8899440860780389e-07, 1.5946420688968047e-06, -0.00027307664051521977, -0.00054935811527305977, 0.56391450291064915},
+    {-1.4661621503394307e-13, -2.789690928987633e-13, 4.5069161263747003e-11, -3.4326283239783954e-10, -1.3428070323308178e-08,
+     2.8759640377555785e-07, 4.3527220745659401e-06, -0.00025482441403637144, -0.001610697134849778, 0.5617422245641448},
+    {-3.9041108111247903e-15, -1.5896103484409634e-12, 2.6303064843472194e-11, 1.8055651751137559e-10, -1.4131243552521842e-08,
+     1.4451342737859213e-07, 6.0854794497415129e-06, -0.00022293323193444753, -0.0025696796048319975, 0.55754050991626092},
+    {4.6290035442257749e-14, -1.0505799617489466e-12, 3.9025390766055127e-12, 3.8108801003432443e-10, -1.0444467353459918e-08,
+     1.965201709950744e-08, 6.7171384195443679e-06, -0.00018402435418027883, -0.0033848480209753029, 0.55155997614544561},
+    {3.1176832249748839e-14, -3.1561227410535475e-13, -6.6105349208023013e-12, 3.4821299656590313e-10, -5.9226372283876728e-09,
+     -6.182677027855425e-08, 6.5180998225559262e-06, -0.00014399301930471348, -0.0040404725217138438, 0.54410792464731528},
+    {1.1115769339348611e-14, 5.23748816993998e-14, -8.190938268884094e-12, 2.3780217061808336e-10, -2.385815482688785e-09,
+     -1.0225137776796382e-07, 5.838181534124289e-06, -0.00010676337556770514, -0.0045406160280662029, 0.53550199494659334},
+    {1.0339967421311263e-15, 1.4778670160091382e-13, -6.3292168676223383e-12, 1.3445464379565553e-10, -1.7902049543698902e-10,
+     -1.140387259156696e-07, 4.958345180130136e-06, -7.4327476641700401e-05, -0.0049010321956120392, 0.52603871666195967},
+    {-2.0692801906975616e-15, 1.3168940983727154e-13, -4.0142901305548586e-12, 6.2386729860838872e-11, 9.6941438967968607e-10,
+     -1.0936677772386365e-07, 4.0571105261832945e-06, -4.7300373055123832e-05, -0.0051424823881254036, 0.51597718661052716},
+    {-2.2713181902357301e-15, 9.0388421403599813e-14, -2.2331541090501358e-12, 1.9437458888457683e-11, 1.4354136579520057e-09,
+     -9.6914719328537919e-08, 3.2289111419761836e-06, -2.5492458077862174e-05, -0.00528641042796769, 0.50553376189063337},
+    {-1.6803337755454136e-15, 5.4459463226057778e-14, -1.0899907401368829e-12, -3.1519625952694176e-12, 1.5171641717435511e-09,
+     -8.1927282556503737e-08, 2.5130193914805163e-06, -8.3267954008325714e-06, -0.0053526169455693929, 0.49488329876939202},
+    {-1.067007780518649e-15, 2.9927313096727779e-14, -4.308988829153279e-13, -1.3341302155992834e-11, 1.4090196107301137e-09,
+     -6.7195383221469351e-08, 1.9172619158554341e-06, 4.9050404524157545e-06, -0.005358269235883303, 0.48416359923636809},
+    {-6.2098586311756904e-16, 1.5003096687853155e-14, -8.3045528869647892e-14, -1.6661760641199342e-11, 1.224161810031174e-09,
+     -5.3996824753464242e-08, 1.433731905398512e-06, 1.4905201750758376e-05, -0.0053176821880863935, 0.473480988082364},
+    {-3.3840411294474926e-16, 6.5774979809522747e-15, 8.2270919598644003e-14, -1.6511021463341173e-11, 1.0228299486678509e-09,
+     -4.2763684832656843e-08, 1.0480351293152706e-06, 2.2305571857006719e-05, -0.0052424897859454514, 0.46291588851896842},
+    {-1.7246420657555849e-16, 2.1168605671556852e-15, 1.4752753268018348e-13, -1.4819899626960479e-11, 8.3394211352748019e-10,
+     -3.3496900253646531e-08, 7.4425323821086102e-07, 2.7645383538193081e-05, -0.0051419808157571667, 0.45252786298248227},
+    {-8.0057555903298575e-17, -7.3019568251605635e-17, 1.6148674553451213e-13, -1.2616364008046127e-11, 6.6913537569085329e-10,
+     -2.6003628702367743e-08, 5.0735008280716065e-07, 3.1370238135331258e-05, -0.0050234762057258164, 0.44235992671763646},
+    {-3.0999625461638023e-17, -1.025036996454509e-15, 1.5143363029675093e-13, -1.0408403876918572e-11, 5.3113083714745548e-10,
+     -2.0024412083799977e-08, 3.2415775604064352e-07, 3.3840862488880698e-05, -0.0048926879877250057, 0.43244211862682636},
+    {-6.3825761537024611e-18, -1.3352613469671127e-15, 1.3191521002744229e-13, -8.4193110266058312e-12, 4.1843947113510704e-10,
+     -1.5296462667634742e-08, 1.8362516534921161e-07, 3.5345315380912102e-05, -0.0047540348671042858, 0.42279439532194185},
+    {4.9503869019114578e-18, -1.3341957086733362e-15, 1.1026716300468352e-13, -6.7241287611318704e-12, 3.2788266961838313e-10,
+     -1.1581803541861289e-08, 7.6715406994837245e-08, 3.6111492022612974e-05, -0.0046109076740335625, 0.41342894397494467},
+    {9.3349229644429736e-18, -1.1985138184273284e-15, 8.9892734036135518e-14, -5.3255801578405297e-12, 2.5586995196890725e-10,
+     -8.6770207500906918e-09, -3.8401862604256386e-09, 3.6318509736126132e-05, -0.0044658867511458318, 0.40435201308504382}
+};
+
+JitMath::JitMath(X86Compiler& c) : c(c) {
+}
+
+bool JitMath::hasInlineImplementation(const Operation& op) {
+    switch (op.getId()) {
+        case Operation::EXP:
+        case Operation::LOG:
+        case Operation::SIN:
+        case Operation::COS:
+        case Operation::TAN:
+        case Operation::ERF:
+        case Operation::ERFC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool JitMath::isIntegerPower(const Operation& op, int& exponent) {
+    if (op.getId() != Operation::POWER_CONSTANT)
+        return false;
+    double value = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+    if (value != floor(value) || fabs(value) > 16)
+        return false;
+    exponent = (int) value;
+    return true;
+}
+
+bool JitMath::generate(const Operation& op, X86XmmVar& dest, X86XmmVar& arg, X86XmmVar& valid) {
+    switch (op.getId()) {
+        case Operation::EXP:
+            generateExp(dest, arg);
+            return false;
+        case Operation::LOG:
+            generateLog(dest, arg, valid);
+            return true;
+        case Operation::SIN:
+        case Operation::COS:
+        case Operation::TAN:
+            generateTrig(op.getId(), dest, arg, valid);
+            return true;
+        case Operation::ERF:
+        case Operation::ERFC:
+            generateErf(op.getId(), dest, arg, valid);
+            return true;
+        default:
+            throw Exception("JitMath: No inline implementation for "+op.getName());
+    }
+}
+
+X86XmmVar JitMath::load(const void* data) {
+    X86GpVar pointer(c, kVarTypeIntPtr);
+    c.mov(pointer, imm_ptr((void*) data));
+    X86XmmVar var = c.newXmmVar(kX86VarTypeXmmPd);
+    c.movupd(var, x86::ptr(pointer, 0, 0));
+    return var;
+}
+
+X86XmmVar JitMath::copy(const X86XmmVar& var) {
+    X86XmmVar result = c.newXmmVar(kX86VarTypeXmmPd);
+    c.movapd(result, var);
+    return result;
+}
+
+X86XmmVar JitMath::loadCoefficient(const double (*coefficients)[2], const X86GpVar* rows, int index) {
+    if (rows == NULL)
+        return load(coefficients[index]);
+    X86XmmVar var = c.newXmmVar(kX86VarTypeXmmPd);
+    c.movsd(var, x86::ptr(rows[0], 8*index, 0));
+    c.movhpd(var, x86::ptr(rows[1], 8*index, 0));
+    return var;
+}
+
+X86XmmVar JitMath::evaluatePolynomial(const X86XmmVar& x, const double (*coefficients)[2], int numCoefficients, const X86GpVar* rows) {
+    // Use Estrin's scheme rather than Horner's rule.  It takes a few more operations, but they are mostly
+    // independent of each other, so the latency is logarithmic rather than linear in the degree.  The coefficients
+    // are listed from highest order to lowest.
+
+    vector<X86XmmVar> terms;
+    for (int i = numCoefficients-1; i >= 0; i -= 2) {
+        X86XmmVar term = loadCoefficient(coefficients, rows, i);
+        if (i > 0) {
+            X86XmmVar temp = loadCoefficient(coefficients, rows, i-1);
+            c.mulpd(temp, x);
+            c.addpd(term, temp);
+        }
+        terms.push_back(term);
+    }
+    X86XmmVar power = copy(x);
+    c.mulpd(power, x);
+    while (terms.size() > 1) {
+        vector<X86XmmVar> combined;
+        for (int i = 0; i < (int) terms.size(); i += 2) {
+            if (i+1 < (int) terms.size()) {
+                c.mulpd(terms[i+1], power);
+                c.addpd(terms[i], terms[i+1]);
+            }
+            combined.push_back(terms[i]);
+        }
+        terms = combined;
+        if (terms.size() > 1)
+            c.mulpd(power, power);
+    }
+    return terms[0];
+}
+
+void JitMath::select(X86XmmVar& dest, const X86XmmVar& mask, const X86XmmVar& value) {
+    X86XmmVar temp = copy(mask);
+    c.andpd(temp, value);
+    X86XmmVar keep = copy(mask);
+    c.andnpd(keep, dest);
+    c.orpd(temp, keep);
+    c.movapd(dest, temp);
+}
+
+void JitMath::generateExp(X86XmmVar& dest, X86XmmVar& arg) {
+    // Clamp the argument to the range where the result neither overflows to infinity nor underflows to zero.
+    // The order of operands is chosen so that NaNs are propagated.
+
+    X86XmmVar clamped = load(expMin);
+    c.maxpd(clamped, arg);
+    X86XmmVar x = load(expMax);
+    c.minpd(x, clamped);
+
+    // Write exp(x) = 2^n * exp(r), with n = round(x/ln(2)) and |r| <= ln(2)/2.  ln(2) is split into two parts so
+    // that n*ln2Hi is exact.
+
+    X86XmmVar n = copy(x);
+    c.mulpd(n, load(invLn2));
+    X86XmmVar intN = c.newXmmVar(kX86VarTypeXmm);
+    c.cvtpd2dq(intN, n);
+    c.cvtdq2pd(n, intN);
+    X86XmmVar r = copy(x);
+    X86XmmVar temp = copy(n);
+    c.mulpd(temp, load(ln2Hi));
+    c.subpd(r, temp);
+    c.movapd(temp, n);
+    c.mulpd(temp, load(ln2Lo));
+    c.subpd(r, temp);
+    X86XmmVar result = evaluatePolynomial(r, expCoefficients, 14);
+
+    // Multiply by 2^n.  This is done as two factors, each of which is a normalized number, so that results near the
+    // ends of the range (including denormals) come out right.
+
+    X86XmmVar n1 = c.newXmmVar(kX86VarTypeXmm);
+    X86XmmVar n2 = c.newXmmVar(kX86VarTypeXmm);
+    c.movaps(n1, intN);
+    c.psrad(n1, imm(1));
+    c.movaps(n2, intN);
+    c.psubd(n2, n1);
+    X86XmmVar bias = load(exponentBias);
+    c.paddd(n1, bias);
+    c.paddd(n2, bias);
+    c.pshufd(n1, n1, imm(0x50));
+    c.psllq(n1, imm(52));
+    c.pshufd(n2, n2, imm(0x50));
+    c.psllq(n2, imm(52));
+    c.mulpd(result, n1);
+    c.mulpd(result, n2);
+    c.movapd(dest, result);
+}
+
+void JitMath::generateLog(X86XmmVar& dest, X86XmmVar& arg, X86XmmVar& valid) {
+    // Only positive, finite, normalized arguments are handled.
+
+    valid = load(minNormal);
+    c.cmppd(valid, arg, imm(2)); // minNormal <= x
+    X86XmmVar temp = copy(arg);
+    c.cmppd(temp, load(maxFinite), imm(2)); // x <= maxFinite
+    c.andpd(valid, temp);
+
+    // Split x into an exponent e and a mantissa m in [1, 2).
+
+    X86XmmVar intE = c.newXmmVar(kX86VarTypeXmm);
+    c.movaps(intE, arg);
+    c.psrlq(intE, imm(52));
+    c.pshufd(intE, intE, imm(0x08));
+    c.psubd(intE, load(exponentBias));
+    X86XmmVar e = c.newXmmVar(kX86VarTypeXmmPd);
+    c.cvtdq2pd(e, intE);
+    X86XmmVar m = copy(arg);
+    c.andpd(m, load(mantissaMask));
+    X86XmmVar oneVar = load(one);
+    c.orpd(m, oneVar);
+
+    // If m > sqrt(2), divide it by 2 and increment e, so that m is in [sqrt(1/2), sqrt(2)].
+
+    X86XmmVar mask = load(sqrt2);
+    c.cmppd(mask, m, imm(1)); // sqrt(2) < m
+    c.movapd(temp, mask);
+    c.andpd(temp, load(half));
+    X86XmmVar scale = copy(oneVar);
+    c.subpd(scale, temp);
+    c.mulpd(m, scale);
+    c.andpd(mask, oneVar);
+    c.addpd(e, mask);
+
+    // log(m) = 2*atanh(f) where f = (m-1)/(m+1).  The series is written as 2f + f*s*P(s) with s = f^2, so the
+    // dominant term has no rounding error beyond that of f.
+
+    X86XmmVar f = copy(m);
+    c.subpd(f, oneVar);
+    c.addpd(m, oneVar);
+    c.divpd(f, m);
+    X86XmmVar s = copy(f);
+    c.mulpd(s, f);
+    X86XmmVar series = evaluatePolynomial(s, logCoefficients, 10);
+    c.mulpd(series, s);
+    c.mulpd(series, f);
+    X86XmmVar logm = copy(f);
+    c.addpd(logm, f);
+    c.addpd(logm, series);
+
+    // log(x) = e*ln2Hi + (log(m) + e*ln2Lo)
+
+    c.movapd(temp, e);
+    c.mulpd(temp, load(ln2Lo));
+    c.addpd(logm, temp);
+    c.mulpd(e, load(ln2Hi));
+    c.addpd(e, logm);
+    c.movapd(dest, e);
+}
+
+void JitMath::generateTrig(Operation::Id function, X86XmmVar& dest, X86XmmVar& arg, X86XmmVar& valid) {
+    // Only |x| <= trigMax is handled.  For larger arguments the range reduction below loses accuracy.
+
+    valid = copy(arg);
+    c.andpd(valid, load(absMask));
+    c.cmppd(valid, load(trigMax), imm(2)); // |x| <= trigMax
+
+    // Reduce the argument to r = x - n*pi/2 with |r| <= pi/4.  pi/2 is split into three parts, the first two of which
+    // have enough trailing zeros that multiplying them by n is exact.
+
+    X86XmmVar n = copy(arg);
+    c.mulpd(n, load(twoOverPi));
+    X86XmmVar intN = c.newXmmVar(kX86VarTypeXmm);
+    c.cvtpd2dq(intN, n);
+    c.cvtdq2pd(n, intN);
+    X86XmmVar r = copy(arg);
+    X86XmmVar temp = copy(n);
+    c.mulpd(temp, load(pio2_1));
+    c.subpd(r, temp);
+    c.movapd(temp, n);
+    c.mulpd(temp, load(pio2_2));
+    c.subpd(r, temp);
+    c.movapd(temp, n);
+    c.mulpd(temp, load(pio2_3));
+    c.subpd(r, temp);
+    X86XmmVar z = copy(r);
+    c.mulpd(z, r);
+
+    // sin(r) = r + r*z*P(z)
+
+    X86XmmVar sinr = evaluatePolynomial(z, sinCoefficients, 8);
+    c.mulpd(sinr, z);
+    c.mulpd(sinr, r);
+    c.addpd(sinr, r);
+
+    // cos(r) = 1 - z/2 + z^2*Q(z).  The rounding error of w = 1-z/2 is computed and added back in.
+
+    X86XmmVar halfz = copy(z);
+    c.mulpd(halfz, load(half));
+    X86XmmVar oneVar = load(one);
+    X86XmmVar w = copy(oneVar);
+    c.subpd(w, halfz);
+    X86XmmVar correction = copy(oneVar);
+    c.subpd(correction, w);
+    c.subpd(correction, halfz);
+    X86XmmVar cosr = evaluatePolynomial(z, cosCoefficients, 8);
+    c.mulpd(cosr, z);
+    c.mulpd(cosr, z);
+    c.addpd(cosr, correction);
+    c.addpd(cosr, w);
+
+    // Select the result based on the quadrant.  cos(x) = sin(x+pi/2), so for cosine we just add one to n.  Each
+    // element of n is duplicated into both halves of a 64 bit lane to build masks covering the whole double.
+
+    X86XmmVar intOneVar = load(intOne);
+    if (function == Operation::COS)
+        c.paddd(intN, intOneVar);
+    c.pshufd(intN, intN, imm(0x50));
+    X86XmmVar swap = c.newXmmVar(kX86VarTypeXmm);
+    c.movaps(swap, intN);
+    c.pand(swap, intOneVar);
+    c.pcmpeqd(swap, intOneVar); // All ones if n is odd
+    X86XmmVar numerator = copy(swap);
+    c.andpd(numerator, cosr);
+    c.movapd(temp, swap);
+    c.andnpd(temp, sinr);
+    c.orpd(numerator, temp);
+    if (function == Operation::TAN) {
+        // tan(x) is sin(r)/cos(r) if n is even, -cos(r)/sin(r) if n is odd.
+
+        X86XmmVar denominator = copy(swap);
+        c.andpd(denominator, sinr);
+        c.movapd(temp, swap);
+        c.andnpd(temp, cosr);
+        c.orpd(denominator, temp);
+        c.divpd(numerator, denominator);
+        c.andpd(swap, load(signMask));
+        c.xorpd(numerator, swap);
+    }
+    else {
+        // Negate the result in quadrants 2 and 3.
+
+        X86XmmVar sign = c.newXmmVar(kX86VarTypeXmm);
+        c.movaps(sign, intN);
+        c.pand(sign, load(intTwo));
+        c.psllq(sign, imm(62));
+        c.xorpd(numerator, sign);
+    }
+    c.movapd(dest, numerator);
+}
+
+void JitMath::generateErf(Operation::Id function, X86XmmVar& dest, X86XmmVar& arg, X86XmmVar& valid) {
+    // Every argument except NaN is handled.  Beyond |x| = 28, erfc(|x|) underflows to zero, so clamping |x| there
+    // does not change the results.
+
+    valid = copy(arg);
+    c.cmppd(valid, arg, imm(7)); // x is not NaN
+    X86XmmVar absx = copy(arg);
+    c.andpd(absx, load(absMask));
+    c.minpd(absx, load(erfMax));
+    X86XmmVar small = copy(absx);
+    c.cmppd(small, load(erfSmall), imm(1)); // |x| < 0.84375
+    X86XmmVar result = c.newXmmVar(kX86VarTypeXmmPd);
+    c.xorpd(result, result);
+    X86GpVar smallMask(c, kVarTypeInt32);
+    c.movmskpd(smallMask, small);
+
+    // Each of the two ranges is skipped if no element falls in it.
+
+    Label skipLarge = c.newLabel();
+    Label skipSmall = c.newLabel();
+    c.cmp(smallMask, imm(3));
+    c.je(skipLarge);
+    {
+        // Look up the polynomial for the interval containing u = 1/|x|.  Elements that belong to the other range
+        // are clamped so they still select a valid interval.
+
+        X86XmmVar clamped = copy(absx);
+        c.maxpd(clamped, load(erfSmall));
+        X86XmmVar u = load(one);
+        c.divpd(u, clamped);
+        X86XmmVar scaled = copy(u);
+        c.mulpd(scaled, load(sixteen));
+        X86XmmVar intIndex = c.newXmmVar(kX86VarTypeXmm);
+        c.cvttpd2dq(intIndex, scaled);
+        X86GpVar rows[2] = {X86GpVar(c, kVarTypeIntPtr), X86GpVar(c, kVarTypeIntPtr)};
+        X86GpVar table(c, kVarTypeIntPtr);
+        c.mov(table, imm_ptr((void*) erfcTable));
+        for (int i = 0; i < 2; i++) {
+            if (i == 1)
+                c.unpckhpd(scaled, scaled);
+            c.cvttsd2si(rows[i], scaled);
+            c.imul(rows[i], rows[i], imm(8*erfcTableWidth));
+            c.add(rows[i], table);
+        }
+        X86XmmVar t = copy(u);
+        c.mulpd(t, load(thirtyTwo));
+        X86XmmVar offset = c.newXmmVar(kX86VarTypeXmmPd);
+        c.cvtdq2pd(offset, intIndex);
+        c.addpd(offset, offset);
+        c.addpd(offset, load(one));
+        c.subpd(t, offset);
+        X86XmmVar q = evaluatePolynomial(t, NULL, erfcTableWidth, rows);
+        c.divpd(q, clamped);
+
+        // Multiply by exp(-x^2).  Rounding x^2 would cause an error of up to x^2/2 ulp, so write it as h^2 + l*(|x|+h),
+        // where h holds the upper 26 bits of |x| and l = |x|-h.  h^2 is exact, and l*(|x|+h) is small enough that
+        // exp(-l*(|x|+h)) = 1-d, where a few terms of its Taylor series are sufficient to compute d.
+
+        X86XmmVar high = copy(clamped);
+        c.andpd(high, load(highBitsMask));
+        X86XmmVar low = copy(clamped);
+        c.subpd(low, high);
+        X86XmmVar sum = copy(clamped);
+        c.addpd(sum, high);
+        c.mulpd(low, sum);
+        X86XmmVar square = copy(high);
+        c.mulpd(square, high);
+        c.xorpd(square, load(signMask));
+        X86XmmVar gaussian = c.newXmmVar(kX86VarTypeXmmPd);
+        generateExp(gaussian, square);
+        X86XmmVar d = evaluatePolynomial(low, expCorrectionCoefficients, 3);
+        c.mulpd(d, low);
+        c.mulpd(q, gaussian);
+        c.mulpd(d, q);
+        c.subpd(q, d);
+
+        // q now holds erfc(|x|).  Use the symmetries erf(-x) = -erf(x) and erfc(-x) = 2-erfc(x).
+
+        X86XmmVar sign = copy(arg);
+        c.andpd(sign, load(signMask));
+        if (function == Operation::ERF) {
+            c.movapd(result, load(one));
+            c.subpd(result, q);
+            c.orpd(result, sign);
+        }
+        else {
+            c.movapd(result, q);
+            X86XmmVar zero = c.newXmmVar(kX86VarTypeXmmPd);
+            c.xorpd(zero, zero);
+            X86XmmVar negative = copy(arg);
+            c.cmppd(negative, zero, imm(1)); // x < 0
+            X86XmmVar reflected = load(two);
+            c.subpd(reflected, q);
+            select(result, negative, reflected);
+        }
+    }
+    c.bind(skipLarge);
+    c.test(smallMask, smallMask);
+    c.jz(skipSmall);
+    {
+        // erf(x) = x + x*P(x^2).  For erfc, the subtraction is arranged to minimize rounding error.
+
+        X86XmmVar z = copy(arg);
+        c.mulpd(z, arg);
+        X86XmmVar xp = evaluatePolynomial(z, erfCoefficients, 12);
+        c.mulpd(xp, arg);
+        X86XmmVar value = copy(arg);
+        c.addpd(value, xp);
+        if (function == Operation::ERFC) {
+            // erfc(x) = 1-(x+x*P) for x < 1/4, and 1/2-(x*P+(x-1/2)) otherwise.  The subtraction x-1/2 is exact.
+
+            X86XmmVar oneMinus = load(one);
+            c.subpd(oneMinus, value);
+            X86XmmVar halfVar = load(half);
+            c.movapd(value, arg);
+            c.subpd(value, halfVar);
+            c.addpd(value, xp);
+            c.subpd(halfVar, value);
+            X86XmmVar lessThanQuarter = copy(arg);
+            c.cmppd(lessThanQuarter, load(quarter), imm(1)); // x < 1/4
+            select(halfVar, lessThanQuarter, oneMinus);
+            c.movapd(value, halfVar);
+        }
+        select(result, small, value);
+    }
+    c.bind(skipSmall);
+    c.movapd(dest, result);
+}
+
+#endif /*LEPTON_USE_JIT*/
@@ -0,0 +1,115 @@
+#ifndef LEPTON_JIT_MATH_H_
+#define LEPTON_JIT_MATH_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#ifdef LEPTON_USE_JIT
+
+#include "lepton/Operation.h"
+#include "asmjit.h"
+
+namespace Lepton {
+
+/**
+ * This class generates inline machine code for transcendental functions, so that JIT compiled expressions do not
+ * need to call into the C math library for them.  A library call forces every live register to be spilled around it,
+ * and computes only one value at a time.  It is used internally by CompiledVectorExpression.  CompiledExpression
+ * still calls the library, since for a single value its table driven implementations have lower latency than the
+ * polynomials used here.
+ *
+ * All functions are computed in double precision on both elements of an SSE register.  Only SSE2 instructions are
+ * used.  Measured over their whole supported range, against glibc or (for erf and erfc) against values computed with
+ * 50 digit arithmetic, the maximum errors are
+ *
+ * exp: 1 ulp, for all arguments (results that overflow or underflow are handled correctly)
+ * log: 2 ulp, for positive normalized arguments
+ * sin, cos: 2 ulp, for |x| <= 1e5
+ * tan: 4 ulp, for |x| <= 1e5
+ * erf: 2 ulp, for all arguments
+ * erfc: 5 ulp, for all arguments whose result is a normalized number
+ *
+ * For arguments outside the supported range, generate() reports the element as invalid and the caller must compute
+ * it in some other way, usually by calling the library function.
+ */
+
+class JitMath {
+public:
+    JitMath(asmjit::X86Compiler& c);
+    /**
+     * Get whether an inline implementation is available for an operation.
+     */
+    static bool hasInlineImplementation(const Operation& op);
+    /**
+     * Get whether an operation raises its argument to a small integer power, which can be computed by
+     * a short sequence of multiplications.  The error grows with the number of multiplications, up to
+     * about |exponent| ulp for the largest allowed exponents.
+     *
+     * @param op         the operation to check
+     * @param exponent   if this returns true, the exponent is stored into this
+     */
+    static bool isIntegerPower(const Operation& op, int& exponent);
+    /**
+     * Generate code to evaluate an operation.  hasInlineImplementation() must return true for it.
+     *
+     * @param op      the operation to evaluate
+     * @param dest    the result is stored into this
+     * @param arg     the argument to the operation
+     * @param valid   if this returns true, this is set to a mask that is all ones for each element that was computed
+     *                correctly, and zero for each element the caller must compute in some other way
+     * @return true if the result might be invalid for some arguments, in which case valid must be checked
+     */
+    bool generate(const Operation& op, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, asmjit::X86XmmVar& valid);
+private:
+    asmjit::X86XmmVar load(const void* data);
+    asmjit::X86XmmVar copy(const asmjit::X86XmmVar& var);
+    asmjit::X86XmmVar loadCoefficient(const double (*coefficients)[2], const asmjit::X86GpVar* rows, int index);
+    /**
+     * Evaluate a polynomial.  The coefficients are listed from highest order to lowest.  If rows is not NULL, it
+     * holds a pointer for each element to the coefficients to use for that element, and coefficients is ignored.
+     */
+    asmjit::X86XmmVar evaluatePolynomial(const asmjit::X86XmmVar& x, const double (*coefficients)[2], int numCoefficients, const asmjit::X86GpVar* rows=NULL);
+    /**
+     * Set each element of dest to the corresponding element of value, if mask is all ones for that element.
+     */
+    void select(asmjit::X86XmmVar& dest, const asmjit::X86XmmVar& mask, const asmjit::X86XmmVar& value);
+    void generateExp(asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg);
+    void generateLog(asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, asmjit::X86XmmVar& valid);
+    void generateTrig(Operation::Id function, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, asmjit::X86XmmVar& valid);
+    void generateErf(Operation::Id function, asmjit::X86XmmVar& dest, asmjit::X86XmmVar& arg, asmjit::X86XmmVar& valid);
+    asmjit::X86Compiler& c;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_USE_JIT*/
+
+#endif /*LEPTON_JIT_MATH_H_*/
@@ -129,6 +129,18 @@ public:
      * any platform-specific data that was stored in it.
      */
     virtual void contextDestroyed(ContextImpl& context) const;
+    /**
+     * This is called when a calculation such as Context::computeEnergies() has many independent configurations of
+     * a System to evaluate.  It decides whether they should be divided between several copies of the Context, each
+     * used by its own thread.  The default implementation returns 1, which means the configurations are evaluated
+     * one after another in the original Context.
+     *
+     * @param context     the Context in which the calculation was requested
+     * @param properties  on entry, the properties the Context was created with.  On exit, the properties each copy
+     *                    of the Context should be created with.
+     * @return the number of copies of the Context to evaluate configurations in
+     */
+    virtual int getNumConcurrentContexts(ContextImpl& context, std::map<std::string, std::string>& properties) const;
     /**
      * Register a KernelFactory which should be used to create Kernels with a particular name.
      * The Platform takes over ownership of the factory, and will delete it when the Platform itself
@@ -67,6 +67,8 @@
 
 namespace OpenMM {
 
+class ThreadPool;
+
 /**
  * This kernel is invoked at the beginning and end of force and energy computations.  It gives the
  * Platform a chance to clear buffers and do other initialization at the beginning, and to do any
@@ -172,6 +174,118 @@ public:
      * @param forces  on exit, this contains the forces
      */
     virtual void getForces(ContextImpl& context, std::vector<Vec3>& forces) = 0;
+    /**
+     * Get the positions of a subset of particles.  The default implementation calls getPositions() and selects
+     * the requested particles.  Platforms that can read individual particles more cheaply should override it.
+     *
+     * @param particles  the indices of the particles to get
+     * @param positions  on exit, element i contains the position of particle particles[i]
+     */
+    virtual void getSubsetPositions(ContextImpl& context, const std::vector<int>& particles, std::vector<Vec3>& positions) {
+        std::vector<Vec3> all;
+        getPositions(context, all);
+        positions.resize(particles.size());
+        for (int i = 0; i < (int) particles.size(); i++)
+            positions[i] = all[particles[i]];
+    }
+    /**
+     * Get the velocities of a subset of particles.  The default implementation calls getVelocities() and selects
+     * the requested particles.  Platforms that can read individual particles more cheaply should override it.
+     *
+     * @param particles   the indices of the particles to get
+     * @param velocities  on exit, element i contains the velocity of particle particles[i]
+     */
+    virtual void getSubsetVelocities(ContextImpl& context, const std::vector<int>& particles, std::vector<Vec3>& velocities) {
+        std::vector<Vec3> all;
+        getVelocities(context, all);
+        velocities.resize(particles.size());
+        for (int i = 0; i < (int) particles.size(); i++)
+            velocities[i] = all[particles[i]];
+    }
+    /**
+     * Copy the positions of some or all particles into an array supplied by the caller.  The default implementation
+     * calls getPositions() or getSubsetPositions() and copies the result.  Platforms that can copy directly from
+     * their own storage should override it.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the position of the i'th requested particle is written to output[i*stride], output[i*stride+1],
+     *                   and output[i*stride+2]
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    virtual void copyPositions(ContextImpl& context, const std::vector<int>& particles, double* output, int stride) {
+        std::vector<Vec3> values;
+        if (particles.size() == 0)
+            getPositions(context, values);
+        else
+            getSubsetPositions(context, particles, values);
+        copyToArray(values, output, stride);
+    }
+    /**
+     * Copy the positions of some or all particles into a single precision array supplied by the caller.  This is
+     * identical to the other version of this method except for the type of the output array.
+     */
+    virtual void copyPositions(ContextImpl& context, const std::vector<int>& particles, float* output, int stride) {
+        std::vector<Vec3> values;
+        if (particles.size() == 0)
+            getPositions(context, values);
+        else
+            getSubsetPositions(context, particles, values);
+        copyToArray(values, output, stride);
+    }
+    /**
+     * Copy the velocities of some or all particles into an array supplied by the caller.  The default implementation
+     * calls getVelocities() or getSubsetVelocities() and copies the result.  Platforms that can copy directly from
+     * their own storage should override it.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the velocity of the i'th requested particle is written to output[i*stride], output[i*stride+1],
+     *                   and output[i*stride+2]
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    virtual void copyVelocities(ContextImpl& context, const std::vector<int>& particles, double* output, int stride) {
+        std::vector<Vec3> values;
+        if (particles.size() == 0)
+            getVelocities(context, values);
+        else
+            getSubsetVelocities(context, particles, values);
+        copyToArray(values, output, stride);
+    }
+    /**
+     * Copy the velocities of some or all particles into a single precision array supplied by the caller.  This is
+     * identical to the other version of this method except for the type of the output array.
+     */
+    virtual void copyVelocities(ContextImpl& context, const std::vector<int>& particles, float* output, int stride) {
+        std::vector<Vec3> values;
+        if (particles.size() == 0)
+            getVelocities(context, values);
+        else
+            getSubsetVelocities(context, particles, values);
+        copyToArray(values, output, stride);
+    }
+    /**
+     * Copy the most recently computed forces on some or all particles into an array supplied by the caller.  The
+     * default implementation calls getForces() and copies the requested elements.  Platforms that can copy directly
+     * from their own storage should override it.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the force on the i'th requested particle is written to output[i*stride], output[i*stride+1],
+     *                   and output[i*stride+2]
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    virtual void copyForces(ContextImpl& context, const std::vector<int>& particles, double* output, int stride) {
+        std::vector<Vec3> values;
+        getForces(context, values);
+        copyToArray(values, particles, output, stride);
+    }
+    /**
+     * Copy the most recently computed forces on some or all particles into a single precision array supplied by the
+     * caller.  This is identical to the other version of this method except for the type of the output array.
+     */
+    virtual void copyForces(ContextImpl& context, const std::vector<int>& particles, float* output, int stride) {
+        std::vector<Vec3> values;
+        getForces(context, values);
+        copyToArray(values, particles, output, stride);
+    }
     /**
      * Get the current periodic box vectors.
      *
@@ -200,6 +314,37 @@ public:
      * @param stream    an input stream the checkpoint data should be read from
      */
     virtual void loadCheckpoint(ContextImpl& context, std::istream& stream) = 0;
+protected:
+    /**
+     * Copy a list of vectors into an array with the specified stride.  V may be any type whose elements are
+     * accessed with operator[].
+     */
+    template <class V, class T>
+    static void copyToArray(const std::vector<V>& values, T* output, int stride) {
+        for (int i = 0; i < (int) values.size(); i++) {
+            T* element = output+(size_t) i*stride;
+            element[0] = (T) values[i][0];
+            element[1] = (T) values[i][1];
+            element[2] = (T) values[i][2];
+        }
+    }
+    /**
+     * Copy selected elements of a list of vectors into an array with the specified stride.  If the list of
+     * indices is empty, all of them are copied.
+     */
+    template <class V, class T>
+    static void copyToArray(const std::vector<V>& values, const std::vector<int>& indices, T* output, int stride) {
+        if (indices.size() == 0) {
+            copyToArray(values, output, stride);
+            return;
+        }
+        for (int i = 0; i < (int) indices.size(); i++) {
+            T* element = output+(size_t) i*stride;
+            element[0] = (T) values[indices[i]][0];
+            element[1] = (T) values[indices[i]][1];
+            element[2] = (T) values[indices[i]][2];
+        }
+    }
 };
 
 /**
@@ -555,6 +700,20 @@ public:
      * @param force      the NonbondedForce this kernel will be used for
      */
     virtual void initialize(const System& system, const NonbondedForce& force) = 0;
+    /**
+     * Initialize the kernel for a Context that is a clone of another one, copying whatever it can from the
+     * corresponding kernel of the original Context rather than computing it again.  The parameters it uses are those
+     * of the original kernel, including any changes made with copyParametersToContext().  Supporting this is optional,
+     * and the default implementation returns false.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the NonbondedForce this kernel will be used for
+     * @param original   the kernel of the original Context to copy from
+     * @return true if the kernel was initialized, or false if initialize() must be called instead
+     */
+    virtual bool initializeFromKernel(const System& system, const NonbondedForce& force, const CalcNonbondedForceKernel& original) {
+        return false;
+    }
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -573,6 +732,36 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const NonbondedForce& force) = 0;
+    /**
+     * Copy changed parameters over to a context, when only a subset of particles and exceptions have changed.
+     * The default implementation copies all of them.
+     *
+     * @param context     the context to copy parameters to
+     * @param force       the NonbondedForce to copy the parameters from
+     * @param particles   the indices of the particles whose parameters have changed
+     * @param exceptions  the indices of the exceptions whose parameters have changed
+     */
+    virtual void copyChangedParametersToContext(ContextImpl& context, const NonbondedForce& force, const std::vector<int>& particles, const std::vector<int>& exceptions) {
+        copyParametersToContext(context, force);
+    }
+    /**
+     * Compute how the energy would change if a subset of particles were moved, considering only the interactions
+     * that involve those particles.  The Context is not modified.  Supporting this is optional, and the default
+     * implementation returns false.  Implementations should return false when the change cannot be computed at a
+     * cost proportional to the number of moved particles, such as for the reciprocal space part of Ewald or PME.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param particles      the indices of the particles to move
+     * @param newPositions   the new positions of those particles
+     * @param includeDirect  true if direct space interactions should be included
+     * @param includeReciprocal  true if reciprocal space interactions should be included
+     * @param energyChange   on exit, if this returns true, the change in energy
+     * @return true if the change was computed, false if it is not supported for this kernel's nonbonded method
+     */
+    virtual bool computeEnergyChange(ContextImpl& context, const std::vector<int>& particles, const std::vector<Vec3>& newPositions,
+            bool includeDirect, bool includeReciprocal, double& energyChange) {
+        return false;
+    }
 };
 
 /**
@@ -597,6 +786,20 @@ public:
      * @param force      the CustomNonbondedForce this kernel will be used for
      */
     virtual void initialize(const System& system, const CustomNonbondedForce& force) = 0;
+    /**
+     * Initialize the kernel for a Context that is a clone of another one, copying whatever it can from the
+     * corresponding kernel of the original Context rather than computing it again.  The parameters it uses are those
+     * of the original kernel, including any changes made with copyParametersToContext().  Supporting this is optional,
+     * and the default implementation returns false.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomNonbondedForce this kernel will be used for
+     * @param original   the kernel of the original Context to copy from
+     * @return true if the kernel was initialized, or false if initialize() must be called instead
+     */
+    virtual bool initializeFromKernel(const System& system, const CustomNonbondedForce& force, const CalcCustomNonbondedForceKernel& original) {
+        return false;
+    }
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -613,6 +816,17 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force) = 0;
+    /**
+     * Copy changed parameters over to a context, when only a subset of particles have changed.  The default
+     * implementation copies all of them.
+     *
+     * @param context     the context to copy parameters to
+     * @param force       the CustomNonbondedForce to copy the parameters from
+     * @param particles   the indices of the particles whose parameters have changed
+     */
+    virtual void copyChangedParametersToContext(ContextImpl& context, const CustomNonbondedForce& force, const std::vector<int>& particles) {
+        copyParametersToContext(context, force);
+    }
 };
 
 /**
@@ -1229,8 +1443,11 @@ public:
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
      * @param includeEnergy       true if potential energy should be computed
+     * @param includeForces       true if forces should be computed.  If this is false, the kernel
+     *                            may skip interpolating forces, and finishComputation() need not
+     *                            call setForce() on the IO object.
      */
-    virtual void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) = 0;
+    virtual void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy, bool includeForces=true) = 0;
     /**
      * Finish computing the force and energy.
      * 
@@ -1259,6 +1476,15 @@ public:
      *                 should be ignored.
      */
     virtual void setForce(float* force) = 0;
+    /**
+     * Get a ThreadPool whose worker threads the kernel should use to perform the calculation.
+     * If this returns NULL (the default), the kernel is free to create its own threads.  A caller
+     * that already has a ThreadPool should return it here, so that the kernel does not create
+     * additional threads that would compete with the caller's ones for CPU cores.
+     */
+    virtual ThreadPool* getThreadPool() {
+        return NULL;
+    }
 };
 
 
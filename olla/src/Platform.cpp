@@ -104,6 +104,10 @@ void Platform::contextCreated(ContextImpl& context, const map<string, string>& p
 void Platform::contextDestroyed(ContextImpl& context) const {
 }
 
+int Platform::getNumConcurrentContexts(ContextImpl& context, map<string, string>& properties) const {
+    return 1;
+}
+
 void Platform::registerKernelFactory(const string& name, KernelFactory* factory) {
     kernelFactories[name] = factory;
 }
@@ -125,6 +125,79 @@ public:
      * and energies.  Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
      */
     State getState(int types, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF) const;
+    /**
+     * Copy the positions of some or all particles (in nm) into an array supplied by the caller.  This avoids
+     * creating a State, and if only a subset of particles is needed, avoids retrieving all the others.  Positions
+     * are not translated into the periodic box.
+     *
+     * @param output     the array to write to.  The position of the i'th requested particle is written to
+     *                   output[i*stride], output[i*stride+1], and output[i*stride+2].
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param stride     the spacing between consecutive particles in the output array.  This must be at least 3.
+     */
+    void copyPositions(double* output, const std::vector<int>& particles=std::vector<int>(), int stride=3) const;
+    /**
+     * Copy the positions of some or all particles (in nm) into a single precision array supplied by the caller.
+     * This is identical to the other version of this method except for the type of the output array.
+     */
+    void copyPositions(float* output, const std::vector<int>& particles=std::vector<int>(), int stride=3) const;
+    /**
+     * Copy the velocities of some or all particles (in nm/ps) into an array supplied by the caller.
+     *
+     * @param output     the array to write to.  The velocity of the i'th requested particle is written to
+     *                   output[i*stride], output[i*stride+1], and output[i*stride+2].
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param stride     the spacing between consecutive particles in the output array.  This must be at least 3.
+     */
+    void copyVelocities(double* output, const std::vector<int>& particles=std::vector<int>(), int stride=3) const;
+    /**
+     * Copy the velocities of some or all particles (in nm/ps) into a single precision array supplied by the caller.
+     * This is identical to the other version of this method except for the type of the output array.
+     */
+    void copyVelocities(float* output, const std::vector<int>& particles=std::vector<int>(), int stride=3) const;
+    /**
+     * Copy the forces on some or all particles (in kJ/mol/nm) into an array supplied by the caller.  The forces
+     * are computed if necessary, exactly as by getState().
+     *
+     * @param output     the array to write to.  The force on the i'th requested particle is written to
+     *                   output[i*stride], output[i*stride+1], and output[i*stride+2].
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param stride     the spacing between consecutive particles in the output array.  This must be at least 3.
+     * @param groups     a set of bit flags for which force groups to include.  Group i will be included
+     *                   if (groups&(1<<i)) != 0.  The default value includes all groups.
+     */
+    void copyForces(double* output, const std::vector<int>& particles=std::vector<int>(), int stride=3, int groups=0xFFFFFFFF) const;
+    /**
+     * Copy the forces on some or all particles (in kJ/mol/nm) into a single precision array supplied by the caller.
+     * This is identical to the other version of this method except for the type of the output array.
+     */
+    void copyForces(float* output, const std::vector<int>& particles=std::vector<int>(), int stride=3, int groups=0xFFFFFFFF) const;
+    /**
+     * Start advancing the simulation by a number of time steps on a background thread, and return immediately.
+     * This lets the caller do other work, such as analyzing or writing out the previous frame, while the
+     * simulation runs.  When the steps are finished, a State is recorded exactly as if getState() had been called,
+     * and it is returned by waitForSteps().  A typical loop calls waitForSteps(), immediately calls stepAsync()
+     * again to start the next chunk, and then processes the State it just received.
+     *
+     * Until waitForSteps() is called, no other method may be called on this Context or its Integrator, and the
+     * System must not be modified.  Methods of this Context that access its state throw an exception if they are
+     * called before then.
+     *
+     * @param steps               the number of time steps to take
+     * @param types               the set of data types to store in the State returned by waitForSteps()
+     * @param enforcePeriodicBox  whether to translate molecules into the periodic box, as in getState()
+     * @param groups              a set of bit flags for which force groups to include when computing forces
+     *                            and energies for the State, as in getState()
+     */
+    void stepAsync(int steps, int types=0, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF);
+    /**
+     * Wait for the time steps started by stepAsync() to finish.  If an exception was thrown while taking the
+     * steps, it is rethrown by this method.
+     *
+     * @return a State recorded immediately after the last step, containing the data types that were passed
+     * to stepAsync()
+     */
+    State waitForSteps();
     /**
      * Copy information from a State object into this Context.  This restores the Context to
      * approximately the same state it was in when the State was created.  If the State does not include
@@ -178,6 +251,73 @@ public:
      * @param value the value of the parameter
      */
     void setParameter(const std::string& name, double value);
+    /**
+     * Compute the potential energy of the System at each of a series of values of one adjustable parameter,
+     * keeping the positions and all other parameters fixed.  This is useful for free energy methods such as
+     * MBAR, which need the energy of every sampled configuration in every thermodynamic state.
+     *
+     * Forces that do not depend on the parameter (that is, forces that do not define it) are evaluated only once.
+     * A force whose energy is a known polynomial in the parameter is evaluated only at enough values to determine
+     * the polynomial, and its energy at the requested values is interpolated from those.  This is the case for
+     * NonbondedForce::LambdaElectrostatics(), on which the energy of a NonbondedForce (including the reciprocal
+     * space part of Ewald or PME) depends quadratically, so it costs three evaluations however many values are
+     * requested.  Any other force that defines the parameter, such as a NonbondedForce for LambdaSterics() or
+     * a custom force, is recomputed in full for each value, so the cost for those grows linearly with the number
+     * of values.  When this returns, the parameter has its original value.
+     *
+     * @param name    the name of the parameter to vary
+     * @param values  the values of the parameter at which to compute the energy
+     * @param groups  a set of bit flags for which force groups to include.  Group i will be included
+     *                if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the potential energy (in kJ/mol) corresponding to each element of values
+     */
+    std::vector<double> computeEnergiesAtParameters(const std::string& name, const std::vector<double>& values, int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of each force group.  This gives the same values as calling getState() once
+     * for each group, but the shared parts of the calculation (such as preparing the positions, and on most
+     * platforms building the neighbor list) are done only once.
+     *
+     * @param groups  a set of bit flags for which force groups to include.  Group i will be included
+     *                if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return a vector of length 32 whose element i is the potential energy (in kJ/mol) of force group i.
+     * Elements for groups that were not included are 0.
+     */
+    std::vector<double> computeEnergiesByGroup(int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of each of a series of configurations of the System.  This is much faster than
+     * calling setPositions() and getState() for each one: forces are not computed, no State objects are created,
+     * and the Integrator is not notified of every change.  When this returns, the Context has its original
+     * positions.
+     *
+     * For small Systems, the configurations may be divided between several clones of this Context (see clone()),
+     * each evaluating its share on its own thread.  Whether this is done depends on the Platform.  It is most useful
+     * when there are many configurations, since creating the clones has a cost.  As with clone(), any Force you have
+     * modified without calling updateParametersInContext() may use its modified parameters in the clones.
+     *
+     * @param configurations  the particle positions (in nm) of each configuration
+     * @param groups          a set of bit flags for which force groups to include.  Group i will be included
+     *                        if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the potential energy (in kJ/mol) of each configuration
+     */
+    std::vector<double> computeEnergies(const std::vector<std::vector<Vec3> >& configurations, int groups=0xFFFFFFFF);
+    /**
+     * Compute how the potential energy would change if a subset of particles were moved to new positions, without
+     * actually moving them.  This is meant for Monte Carlo moves of a few particles, such as a ligand, a side chain,
+     * or a single water molecule.
+     *
+     * Where the platform supports it, only interactions involving the moved particles are evaluated, so the cost
+     * is proportional to the number of moved particles rather than the size of the System.  This is currently
+     * done for NonbondedForce on the Reference and CPU platforms when it does not use Ewald or PME.  With Ewald or
+     * PME the reciprocal space energy depends on every particle, so the whole NonbondedForce is evaluated before
+     * and after the move, as are all other forces.  Either way, the Context is left exactly as it was.
+     *
+     * @param particles     the indices of the particles to move
+     * @param newPositions  the new positions (in nm) of those particles.  This must be the same length as particles.
+     * @param groups        a set of bit flags for which force groups to include.  Group i will be included
+     *                      if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the energy after the move minus the energy before it (in kJ/mol)
+     */
+    double computeEnergyChange(const std::vector<int>& particles, const std::vector<Vec3>& newPositions, int groups=0xFFFFFFFF);
     /**
      * Set the vectors defining the axes of the periodic box (measured in nm).  They will affect
      * any Force that uses periodic boundary conditions.
@@ -257,9 +397,29 @@ public:
      * belong to exactly one molecule.
      */
     const std::vector<std::vector<int> >& getMolecules() const;
+    /**
+     * Create a new Context that is a copy of this one.  It simulates the same System on the same Platform with the
+     * same properties, and its time, positions, velocities, periodic box vectors, and parameters are copied
+     * directly from this Context.  Information that has already been computed for this Context, such as the list
+     * of molecules, the exclusions, compiled expressions, and long range corrections of nonbonded forces, is copied
+     * rather than being computed again when the Platform supports it.  This is much faster than creating a new
+     * Context and loading a checkpoint into it, which makes it useful for spawning many replicas of a simulation.
+     *
+     * Forces whose data the Platform can copy use exactly the same parameters as in this Context, including any
+     * changes made with updateParametersInContext().  Other Forces are initialized from the System, the same way as
+     * in a new Context, so if you have modified one of them you should call updateParametersInContext() on the new
+     * Context.  This Context is never modified.  Internal state that is not publicly visible, such as the states of
+     * random number generators, is not copied.
+     *
+     * @param integrator   the Integrator to use for the new Context.  It must not already be bound to another Context.
+     * @return a newly created Context.  The caller is responsible for deleting it.
+     */
+    Context* clone(Integrator& integrator);
 private:
     friend class Force;
     friend class Platform;
+    friend class ContextImpl;
+    Context(Context& original, Integrator& integrator, const std::map<std::string, std::string>& properties);
     ContextImpl& getImpl();
     ContextImpl* impl;
     std::map<std::string, std::string> properties;
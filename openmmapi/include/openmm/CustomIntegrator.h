@@ -482,6 +482,12 @@ protected:
      * Compute the kinetic energy of the system at the current time.
      */
     double computeKineticEnergy();
+    /**
+     * Get whether computeKineticEnergy() expects forces to have been computed.
+     */
+    bool kineticEnergyRequiresForce() const {
+        return false;
+    }
 private:
     class ComputationInfo;
     std::vector<std::string> globalNames;
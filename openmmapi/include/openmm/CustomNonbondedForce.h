@@ -464,6 +464,16 @@ public:
      * the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the per-particle parameters of some particles in a Context to match those stored in this Force object.
+     * This is like updateParametersInContext(Context&), but only copies the particles you specify, so its cost depends
+     * on how many of them have changed rather than on the size of the System.  If a long range correction is used, it
+     * still must be recomputed from scratch.
+     * 
+     * @param context     the Context to update
+     * @param particles   the indices of the particles whose parameters have changed
+     */
+    void updateParametersInContext(Context& context, const std::vector<int>& particles);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -129,6 +129,14 @@ protected:
      * but the kinetic energy should be computed at the current time, not delayed by half a step.
      */
     virtual double computeKineticEnergy() = 0;
+    /**
+     * Get whether computeKineticEnergy() expects forces to have been computed for the current positions.
+     * A leapfrog integrator, for example, uses the forces to shift the velocities by half a step.  If this
+     * returns false, the Context can compute the energy without also computing forces.
+     */
+    virtual bool kineticEnergyRequiresForce() const {
+        return true;
+    }
 private:
     double stepSize, constraintTol;
 };
@@ -36,6 +36,7 @@
 #include "Force.h"
 #include <map>
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 #include "internal/windowsExport.h"
@@ -76,10 +77,40 @@ namespace OpenMM {
  * the effect of all Lennard-Jones interactions beyond the cutoff in a periodic system.  When running a simulation
  * at constant pressure, this can improve the quality of the result.  Call setUseDispersionCorrection() to set whether
  * this should be used.
+ *
+ * For alchemical free energy calculations, any subset of particles can be marked as alchemical by calling
+ * setParticleAlchemical().  The interactions of alchemical particles are then scaled by two global parameters
+ * whose names are given by LambdaSterics() and LambdaElectrostatics(), both of which default to 1.  Lennard-Jones
+ * interactions between an alchemical and a non-alchemical particle are computed with the soft-core form of
+ * Beutler et al.:
+ *
+ * <tt><pre>E = lambda_sterics*4*epsilon*x*(x-1); x = 1/(alpha*(1-lambda_sterics) + (r/sigma)^6)</pre></tt>
+ *
+ * where alpha is set with setSoftcoreAlpha().  Lennard-Jones interactions between two alchemical particles, and
+ * all exceptions, are not modified.  The charge of every alchemical particle is multiplied by lambda_electrostatics.
+ * This applies everywhere the charge is used, including exceptions and the reciprocal space part of Ewald and
+ * PME, so at lambda_electrostatics=0 the alchemical particles have no electrostatic interactions at all.  If a
+ * dispersion correction is used, the contribution from pairs of one alchemical and one non-alchemical particle is
+ * multiplied by lambda_sterics.
  */
 
 class OPENMM_EXPORT NonbondedForce : public Force {
 public:
+    /**
+     * This is the name of the global parameter which scales the Lennard-Jones interactions between alchemical
+     * and non-alchemical particles.
+     */
+    static const std::string& LambdaSterics() {
+        static const std::string key = "lambda_sterics";
+        return key;
+    }
+    /**
+     * This is the name of the global parameter which scales the charges of alchemical particles.
+     */
+    static const std::string& LambdaElectrostatics() {
+        static const std::string key = "lambda_electrostatics";
+        return key;
+    }
     /**
      * This is an enumeration of the different methods that may be used for handling long range nonbonded forces.
      */
@@ -250,6 +281,35 @@ public:
      * @param epsilon   the epsilon parameter of the Lennard-Jones potential (corresponding to the well depth of the van der Waals interaction), measured in kJ/mol
      */
     void setParticleParameters(int index, double charge, double sigma, double epsilon);
+    /**
+     * Get whether a particle is alchemical.  The interactions of alchemical particles are scaled by the global
+     * parameters LambdaSterics() and LambdaElectrostatics().
+     *
+     * @param index     the index of the particle to check
+     */
+    bool isParticleAlchemical(int index) const;
+    /**
+     * Set whether a particle is alchemical.  The interactions of alchemical particles are scaled by the global
+     * parameters LambdaSterics() and LambdaElectrostatics().
+     *
+     * @param index       the index of the particle to modify
+     * @param alchemical  true if the particle should be alchemical
+     */
+    void setParticleAlchemical(int index, bool alchemical);
+    /**
+     * Get the number of particles that have been marked as alchemical.
+     */
+    int getNumAlchemicalParticles() const;
+    /**
+     * Get the alpha parameter of the soft-core Lennard-Jones interaction between alchemical and non-alchemical
+     * particles.  The default value is 0.5.
+     */
+    double getSoftcoreAlpha() const;
+    /**
+     * Set the alpha parameter of the soft-core Lennard-Jones interaction between alchemical and non-alchemical
+     * particles.  The default value is 0.5.
+     */
+    void setSoftcoreAlpha(double alpha);
     /**
      * Add an interaction to the list of exceptions that should be calculated differently from other interactions.
      * If chargeProd and epsilon are both equal to 0, this will cause the interaction to be completely omitted from
@@ -346,12 +406,26 @@ public:
      * updateParametersInState() to copy them over to the Context.
      * 
      * This method has several limitations.  The only information it updates is the parameters of particles and exceptions.
-     * All other aspects of the Force (the nonbonded method, the cutoff distance, etc.) are unaffected and can only be
-     * changed by reinitializing the Context.  Furthermore, only the chargeProd, sigma, and epsilon values of an exception
+     * All other aspects of the Force (the nonbonded method, the cutoff distance, the set of alchemical particles, etc.) are
+     * unaffected and can only be changed by reinitializing the Context.  Furthermore, only the chargeProd, sigma, and epsilon values of an exception
      * can be changed; the pair of particles involved in the exception cannot change.  Finally, this method cannot be used
      * to add new particles or exceptions, only to change the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the parameters of some particles and exceptions in a Context to match those stored in this Force object.
+     * This is like updateParametersInContext(Context&), but only copies the particles and exceptions you specify, so
+     * its cost depends on how many of them have changed rather than on the size of the System.  This is useful when
+     * only a small part of the System changes, such as the charges of a ligand or of a titratable residue.
+     * 
+     * It has the same limitations as updateParametersInContext(Context&).  In addition, an exception whose chargeProd
+     * and epsilon were both zero when the Context was created must remain so, and vice versa.
+     * 
+     * @param context     the Context to update
+     * @param particles   the indices of the particles whose parameters have changed
+     * @param exceptions  the indices of the exceptions whose parameters have changed
+     */
+    void updateParametersInContext(Context& context, const std::vector<int>& particles, const std::vector<int>& exceptions);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -369,7 +443,7 @@ private:
     class ParticleInfo;
     class ExceptionInfo;
     NonbondedMethod nonbondedMethod;
-    double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha;
+    double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha, softcoreAlpha;
     bool useSwitchingFunction, useDispersionCorrection;
     int recipForceGroup, nx, ny, nz;
     void addExclusionsToSet(const std::vector<std::set<int> >& bonded12, std::set<int>& exclusions, int baseParticle, int fromParticle, int currentLevel) const;
@@ -385,11 +459,13 @@ private:
 class NonbondedForce::ParticleInfo {
 public:
     double charge, sigma, epsilon;
+    bool alchemical;
     ParticleInfo() {
         charge = sigma = epsilon = 0.0;
+        alchemical = false;
     }
     ParticleInfo(double charge, double sigma, double epsilon) :
-        charge(charge), sigma(sigma), epsilon(epsilon) {
+        charge(charge), sigma(sigma), epsilon(epsilon), alchemical(false) {
     }
 };
 
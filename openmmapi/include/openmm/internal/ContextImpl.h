@@ -44,6 +44,7 @@ namespace OpenMM {
 class ForceImpl;
 class Integrator;
 class Context;
+class State;
 class System;
 
 /**
@@ -54,8 +55,12 @@ class OPENMM_EXPORT ContextImpl {
 public:
     /**
      * Create an ContextImpl for a Context;
+     *
+     * @param originalContext  if this is not NULL, the new Context is a clone of it.  Its ForceImpls are initialized with
+     *                         ForceImpl::initializeClone(), and its current state is copied into the new Context.
      */
-    ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const std::map<std::string, std::string>& properties);
+    ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const std::map<std::string, std::string>& properties,
+            ContextImpl* originalContext=NULL);
     ~ContextImpl();
     /**
      * Get the Context for which this is the implementation.
@@ -119,6 +124,56 @@ public:
      * @param forces  on exit, this contains the forces
      */
     void getForces(std::vector<Vec3>& forces);
+    /**
+     * Get the positions of a subset of particles.
+     *
+     * @param particles  the indices of the particles to get
+     * @param positions  on exit, element i contains the position of particle particles[i]
+     */
+    void getSubsetPositions(const std::vector<int>& particles, std::vector<Vec3>& positions);
+    /**
+     * Get the velocities of a subset of particles.
+     *
+     * @param particles   the indices of the particles to get
+     * @param velocities  on exit, element i contains the velocity of particle particles[i]
+     */
+    void getSubsetVelocities(const std::vector<int>& particles, std::vector<Vec3>& velocities);
+    /**
+     * Copy the positions of some or all particles directly from the platform into an array supplied by the caller.
+     * This is used by Context::copyPositions().
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the array to write to
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    void copyPositions(const std::vector<int>& particles, double* output, int stride);
+    void copyPositions(const std::vector<int>& particles, float* output, int stride);
+    /**
+     * Copy the velocities of some or all particles directly from the platform into an array supplied by the caller.
+     * This is used by Context::copyVelocities().
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the array to write to
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    void copyVelocities(const std::vector<int>& particles, double* output, int stride);
+    void copyVelocities(const std::vector<int>& particles, float* output, int stride);
+    /**
+     * Copy the forces on some or all particles into an array supplied by the caller.  This is used by
+     * Context::copyForces().  If the forces for the requested groups are already cached they are copied from the
+     * cache.  Otherwise they are computed if necessary and copied directly from the platform.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param groups     a set of bit flags for which force groups to include
+     * @param output     the array to write to
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    void copyForces(const std::vector<int>& particles, int groups, double* output, int stride);
+    void copyForces(const std::vector<int>& particles, int groups, float* output, int stride);
+    /**
+     * Throw an exception if any element of a list is not a valid particle index.
+     */
+    void checkParticleIndices(const std::vector<int>& particles) const;
     /**
      * Get the set of all adjustable parameters and their values
      */
@@ -191,10 +246,103 @@ public:
      * @return the potential energy of the system, or 0 if includeEnergy is false
      */
     double calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups=0xFFFFFFFF);
+    /**
+     * Get the forces and/or potential energy for the current state of the Context.  This is used by
+     * Context::getState().  Unlike calcForcesAndEnergy(), the results are cached, so if nothing has changed
+     * since the last call for the same set of groups, they are returned without being recomputed.
+     *
+     * @param includeForces  true if forces should be returned
+     * @param includeEnergy  true if the energy should be returned
+     * @param groups         a set of bit flags for which force groups to include
+     * @param forces         on exit, if includeForces is true, this contains the forces
+     * @return the potential energy of the system, or 0 if includeEnergy is false
+     */
+    double calcForcesAndEnergyForState(bool includeForces, bool includeEnergy, int groups, std::vector<Vec3>& forces);
+    /**
+     * Compute the potential energy of the system without computing forces.  This is meant for code such as
+     * Monte Carlo moves that only need the energy.  Because the force buffer is not updated, the Integrator
+     * is told that any forces it has cached are no longer valid.
+     *
+     * @param groups         a set of bit flags for which force groups to include.  Group i will be included
+     *                       if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the potential energy of the system
+     */
+    double calcPotentialEnergy(int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of the system at each of a series of values of one adjustable parameter.
+     * Forces that do not define the parameter are evaluated only once.  Forces whose energy is a polynomial
+     * in it (see ForceImpl::getEnergyPolynomialDegree()) are evaluated at degree+1 values and interpolated, and
+     * all other forces that define it are evaluated at every value.  On exit the parameter has its original value.
+     *
+     * @param name    the name of the parameter to vary
+     * @param values  the values of the parameter at which to compute the energy
+     * @param groups  a set of bit flags for which force groups to include
+     * @return the potential energy corresponding to each element of values
+     */
+    std::vector<double> calcEnergiesAtParameters(const std::string& name, const std::vector<double>& values, int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of each force group in a single pass.  Each ForceImpl is asked for the
+     * energy of one group at a time, all between a single pair of beginComputation() and finishComputation()
+     * calls.  If the platform returns part of the energy from finishComputation() so it cannot be assigned
+     * to a group, each group is instead evaluated separately.
+     *
+     * @param groups  a set of bit flags for which force groups to include
+     * @return a vector of length 32 whose element i is the potential energy of force group i
+     */
+    std::vector<double> calcEnergiesByGroup(int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of each of a series of configurations.  The positions are loaded directly
+     * into the platform and only the energy is computed.  On exit the original positions are restored.  If
+     * Platform::getNumConcurrentContexts() recommends it, the configurations are instead divided between
+     * clones of this Context, which are evaluated in parallel.  The clones are kept for later calls until the
+     * state of this Context changes.
+     *
+     * @param configurations  the particle positions of each configuration
+     * @param groups          a set of bit flags for which force groups to include
+     * @return the potential energy of each configuration
+     */
+    std::vector<double> calcEnergiesOfConfigurations(const std::vector<std::vector<Vec3> >& configurations, int groups=0xFFFFFFFF);
+    /**
+     * Compute how the potential energy would change if a subset of particles were moved.  Each ForceImpl is first
+     * asked to compute its own change with calcEnergyChange().  The ones that cannot are evaluated together before
+     * and after the move.  On exit the Context is unchanged.
+     *
+     * @param particles     the indices of the particles to move
+     * @param newPositions  the new positions of those particles
+     * @param groups        a set of bit flags for which force groups to include
+     * @return the change in potential energy
+     */
+    double calcEnergyChange(const std::vector<int>& particles, const std::vector<Vec3>& newPositions, int groups=0xFFFFFFFF);
     /**
      * Get the set of force group flags that were passed to the most recent call to calcForcesAndEnergy().
      */
     int getLastForceGroups() const;
+    /**
+     * Get a counter that is incremented every time something happens that might change the forces or energy:
+     * setting positions, parameters, or periodic box vectors, taking a time step, and so on.  Results that
+     * were computed when this had the same value are still valid.
+     */
+    int getStateVersion() const;
+    /**
+     * Start taking time steps on a background thread.  This is used by Context::stepAsync().
+     *
+     * @param steps               the number of time steps to take
+     * @param types               the data types to store in the State recorded when the steps finish
+     * @param enforcePeriodicBox  passed to Context::getState() when recording the State
+     * @param groups              passed to Context::getState() when recording the State
+     */
+    void startAsyncSteps(int steps, int types, bool enforcePeriodicBox, int groups);
+    /**
+     * Wait for the steps started by startAsyncSteps() to finish and return the State recorded at the end.
+     * If an exception was thrown on the background thread, it is rethrown here.
+     */
+    State finishAsyncSteps();
+    /**
+     * Record that the state of the Context may have changed in a way that affects the forces or energy.
+     * This increments the state version and discards cached results.  Code that modifies the Context
+     * directly (for example, through a kernel) must call this.
+     */
+    void markStateChanged();
     /**
      * Calculate the kinetic energy of the system (in kJ/mol).
      */
@@ -255,6 +403,30 @@ public:
     static std::vector<std::vector<int> > findMolecules(int numParticles, std::vector<std::vector<int> >& particleBonds);
 private:
     friend class Context;
+    struct AsyncStepData;
+    class ConfigurationEnergyTask;
+    static void* runAsyncSteps(void* data);
+    /**
+     * Throw an exception if steps started by startAsyncSteps() are still running on a different thread.
+     */
+    void checkNoAsyncSteps() const;
+    /**
+     * Compute the forces and/or energy for a subset of the ForceImpls.
+     */
+    double calcForcesAndEnergy(const std::vector<ForceImpl*>& impls, bool includeForces, bool includeEnergy, int groups);
+    /**
+     * Compute the energies of configurations first, first+stride, first+2*stride, etc., leaving the last one loaded.
+     */
+    void calcEnergiesOfConfigurations(const std::vector<std::vector<Vec3> >& configurations, int first, int stride, int groups, std::vector<double>& energies);
+    /**
+     * Make sure the forces for a set of groups are available to copyForces().  If they are cached, this returns a
+     * pointer to the cached values.  Otherwise it makes sure the platform's force buffer contains them, and returns NULL.
+     */
+    const std::vector<Vec3>* prepareForcesForCopy(const std::vector<int>& particles, int groups);
+    /**
+     * Delete the clones created by calcEnergiesOfConfigurations().
+     */
+    void deleteConfigurationClones();
     Context& owner;
     const System& system;
     Integrator& integrator;
@@ -262,7 +434,15 @@ private:
     std::map<std::string, double> parameters;
     mutable std::vector<std::vector<int> > molecules;
     bool hasInitializedForces, hasSetPositions, integratorIsDeleted;
-    int lastForceGroups;
+    int lastForceGroups, stateVersion;
+    bool forceBufferIsCurrent;
+    int forceBufferGroups;
+    std::map<int, std::vector<Vec3> > cachedForcesByGroups;
+    std::map<int, double> cachedEnergyByGroups;
+    AsyncStepData* asyncStepData;
+    std::vector<Context*> configurationClones;
+    std::vector<Integrator*> configurationCloneIntegrators;
+    int configurationClonesVersion;
     Platform* platform;
     Kernel initializeForcesKernel, updateStateDataKernel, applyConstraintsKernel, virtualSitesKernel;
     void* platformData;
@@ -35,6 +35,7 @@
 #include "ForceImpl.h"
 #include "openmm/CustomNonbondedForce.h"
 #include "openmm/Kernel.h"
+#include "openmm/internal/ThreadPool.h"
 #include "lepton/CompiledExpression.h"
 #include <utility>
 #include <map>
@@ -48,9 +49,11 @@ namespace OpenMM {
 
 class OPENMM_EXPORT CustomNonbondedForceImpl : public ForceImpl {
 public:
+    class LongRangeCorrectionData;
     CustomNonbondedForceImpl(const CustomNonbondedForce& owner);
     ~CustomNonbondedForceImpl();
     void initialize(ContextImpl& context);
+    void initializeClone(ContextImpl& context, ContextImpl& originalContext, ForceImpl& original);
     const CustomNonbondedForce& getOwner() const {
         return owner;
     }
@@ -61,18 +64,61 @@ public:
     std::map<std::string, double> getDefaultParameters();
     std::vector<std::string> getKernelNames();
     void updateParametersInContext(ContextImpl& context);
+    void updateParametersInContext(ContextImpl& context, const std::vector<int>& particles);
     /**
      * Compute the coefficient which, when divided by the periodic box volume, gives the
      * long range correction to the energy.
      */
     static double calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context);
+    /**
+     * Identify the particle classes and count the interactions between each pair of them, which is the information
+     * needed by calcLongRangeCorrection() that depends on per-particle parameters.  Call this again whenever those
+     * parameters change.  Integrals computed previously are kept, so only pairs of classes that did not exist before
+     * need to be integrated.
+     */
+    static void prepareLongRangeCorrection(const CustomNonbondedForce& force, LongRangeCorrectionData& data);
+    /**
+     * Compute the coefficient which, when divided by the periodic box volume, gives the long range correction to the
+     * energy, using data created by prepareLongRangeCorrection().  The results are cached, so returning to global
+     * parameter values that have been seen before does not require any integrals to be recomputed.
+     *
+     * @param force     the force for which to compute the correction
+     * @param data      the data created by prepareLongRangeCorrection()
+     * @param context   the Context from which to get global parameters
+     * @param threads   if this is not NULL, the integrals for different pairs of classes are computed in parallel
+     */
+    static double calcLongRangeCorrection(const CustomNonbondedForce& force, LongRangeCorrectionData& data, const Context& context, ThreadPool* threads=NULL);
 private:
+    class IntegrateTask;
     static double integrateInteraction(Lepton::CompiledExpression& expression, const std::vector<double>& params1, const std::vector<double>& params2,
-            const CustomNonbondedForce& force, const Context& context);
+            const CustomNonbondedForce& force, const std::map<std::string, double>& globalParameters);
     const CustomNonbondedForce& owner;
     Kernel kernel;
 };
 
+/**
+ * This class holds the information calcLongRangeCorrection() needs about a force, along with cached results.
+ */
+class CustomNonbondedForceImpl::LongRangeCorrectionData {
+public:
+    LongRangeCorrectionData() : hasExpression(false) {
+    }
+    bool hasExpression;
+    Lepton::CompiledExpression expression;
+    std::vector<std::string> globalParameterNames;
+    std::vector<std::vector<double> > classes;
+    std::vector<std::pair<std::pair<int, int>, long long int> > interactionCounts;
+    int numParticles;
+    /**
+     * Integrals for pairs of classes.  The key is the parameters of the two classes followed by the global parameters.
+     */
+    std::map<std::vector<double>, double> integrals;
+    /**
+     * The coefficient for each set of global parameter values that has been seen since the last call to prepareLongRangeCorrection().
+     */
+    std::map<std::vector<double>, double> coefficients;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_CUSTOMNONBONDEDFORCEIMPL_H_*/
@@ -32,6 +32,7 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
  * -------------------------------------------------------------------------- */
 
+#include "openmm/Vec3.h"
 #include "openmm/internal/windowsExport.h"
 #include <map>
 #include <string>
@@ -93,6 +94,18 @@ public:
      * parameters and their default values will automatically be added to the Context.
      */
     virtual std::map<std::string, double> getDefaultParameters() = 0;
+    /**
+     * Get the degree of the polynomial that gives this force's potential energy as a function of one of the
+     * adjustable parameters it defines, with the positions and all other parameters held fixed.  This lets
+     * ContextImpl::calcEnergiesAtParameters() find the energy at many values of the parameter by interpolating
+     * between degree+1 evaluations.  The default implementation returns -1, meaning the energy is not known to
+     * be a polynomial in the parameter.
+     *
+     * @param parameter   the name of the parameter
+     */
+    virtual int getEnergyPolynomialDegree(const std::string& parameter) {
+        return -1;
+    }
     /**
      * Get the names of all Kernels used by this Force.
      */
@@ -104,6 +117,38 @@ public:
     virtual std::vector<std::pair<int, int> > getBondedParticles() const {
         return std::vector<std::pair<int, int> >(0);
     }
+    /**
+     * This is called instead of initialize() when the Context is being created as a clone of another one.  The
+     * ForceImpl must end up using the same parameters as the corresponding ForceImpl of the original Context.  A
+     * subclass that can copy its data from the original, instead of computing it again from the Force, should override
+     * this.  The default implementation simply calls initialize(), so the parameters are taken from the Force.  This
+     * must not modify the original Context.
+     *
+     * @param context          the context being created
+     * @param originalContext  the context it is a clone of
+     * @param original         the ForceImpl of the original context that corresponds to this one
+     */
+    virtual void initializeClone(ContextImpl& context, ContextImpl& originalContext, ForceImpl& original) {
+        initialize(context);
+    }
+    /**
+     * Compute how this force's contribution to the potential energy would change if a subset of particles were
+     * moved, without modifying the Context.  This is optional.  A ForceImpl that can compute it more cheaply than
+     * by evaluating the full energy before and after the move (for example, by considering only interactions that
+     * involve the moved particles) should override it.  The default implementation returns false.
+     *
+     * @param context       the context in which the system is being simulated
+     * @param particles     the indices of the particles to move
+     * @param newPositions  the new positions of those particles
+     * @param groups        a set of bit flags for which force groups to include.  Group i should be included
+     *                      if (groups&(1<<i)) != 0.
+     * @param energyChange  on exit, if this returns true, the change in energy
+     * @return true if the change was computed, or false if the caller must compute the energy before and after the move
+     */
+    virtual bool calcEnergyChange(ContextImpl& context, const std::vector<int>& particles, const std::vector<Vec3>& newPositions,
+            int groups, double& energyChange) {
+        return false;
+    }
 };
 
 } // namespace OpenMM
@@ -52,6 +52,7 @@ public:
     NonbondedForceImpl(const NonbondedForce& owner);
     ~NonbondedForceImpl();
     void initialize(ContextImpl& context);
+    void initializeClone(ContextImpl& context, ContextImpl& originalContext, ForceImpl& original);
     const NonbondedForce& getOwner() const {
         return owner;
     }
@@ -59,11 +60,17 @@ public:
         // This force field doesn't update the state directly.
     }
     double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups);
-    std::map<std::string, double> getDefaultParameters() {
-        return std::map<std::string, double>(); // This force field doesn't define any parameters.
-    }
+    bool calcEnergyChange(ContextImpl& context, const std::vector<int>& particles, const std::vector<Vec3>& newPositions,
+            int groups, double& energyChange);
+    std::map<std::string, double> getDefaultParameters();
+    /**
+     * Every term that involves charges is a product of two of them, so the energy is a quadratic function of
+     * LambdaElectrostatics().
+     */
+    int getEnergyPolynomialDegree(const std::string& parameter);
     std::vector<std::string> getKernelNames();
     void updateParametersInContext(ContextImpl& context);
+    void updateParametersInContext(ContextImpl& context, const std::vector<int>& particles, const std::vector<int>& exceptions);
     /**
      * This is a utility routine that calculates the values to use for alpha and kmax when using
      * Ewald summation.
@@ -76,9 +83,10 @@ public:
     static void calcPMEParameters(const System& system, const NonbondedForce& force, double& alpha, int& xsize, int& ysize, int& zsize);
     /**
      * Compute the coefficient which, when divided by the periodic box volume, gives the
-     * long range dispersion correction to the energy.
+     * long range dispersion correction to the energy.  The contribution from pairs of one
+     * alchemical and one non-alchemical particle is multiplied by lambdaSterics.
      */
-    static double calcDispersionCorrection(const System& system, const NonbondedForce& force);
+    static double calcDispersionCorrection(const System& system, const NonbondedForce& force, double lambdaSterics = 1.0);
 private:
     class ErrorFunction;
     class EwaldErrorFunction;
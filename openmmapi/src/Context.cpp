@@ -85,14 +85,12 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     bool includeForces = types&State::Forces;
     bool includeEnergy = types&State::Energy;
     if (includeForces || includeEnergy) {
-        double energy = impl->calcForcesAndEnergy(includeForces || includeEnergy, includeEnergy, groups);
+        vector<Vec3> forces;
+        double energy = impl->calcForcesAndEnergyForState(includeForces, includeEnergy, groups, forces);
         if (includeEnergy)
             builder.setEnergy(impl->calcKineticEnergy(), energy);
-        if (includeForces) {
-            vector<Vec3> forces;
-            impl->getForces(forces);
+        if (includeForces)
             builder.setForces(forces);
-        }
     }
     if (types&State::Parameters) {
         map<string, double> params;
@@ -142,6 +140,49 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     return builder.getState();
 }
 
+static void checkStride(int stride) {
+    if (stride < 3)
+        throw OpenMMException("The stride of an output array must be at least 3");
+}
+
+void Context::copyPositions(double* output, const vector<int>& particles, int stride) const {
+    checkStride(stride);
+    impl->copyPositions(particles, output, stride);
+}
+
+void Context::copyPositions(float* output, const vector<int>& particles, int stride) const {
+    checkStride(stride);
+    impl->copyPositions(particles, output, stride);
+}
+
+void Context::copyVelocities(double* output, const vector<int>& particles, int stride) const {
+    checkStride(stride);
+    impl->copyVelocities(particles, output, stride);
+}
+
+void Context::copyVelocities(float* output, const vector<int>& particles, int stride) const {
+    checkStride(stride);
+    impl->copyVelocities(particles, output, stride);
+}
+
+void Context::copyForces(double* output, const vector<int>& particles, int stride, int groups) const {
+    checkStride(stride);
+    impl->copyForces(particles, groups, output, stride);
+}
+
+void Context::copyForces(float* output, const vector<int>& particles, int stride, int groups) const {
+    checkStride(stride);
+    impl->copyForces(particles, groups, output, stride);
+}
+
+void Context::stepAsync(int steps, int types, bool enforcePeriodicBox, int groups) {
+    impl->startAsyncSteps(steps, types, enforcePeriodicBox, groups);
+}
+
+State Context::waitForSteps() {
+    return impl->finishAsyncSteps();
+}
+
 void Context::setState(const State& state) {
     setTime(state.getTime());
     Vec3 a, b, c;
@@ -215,6 +256,22 @@ void Context::setParameter(const string& name, double value) {
     impl->setParameter(name, value);
 }
 
+vector<double> Context::computeEnergiesAtParameters(const string& name, const vector<double>& values, int groups) {
+    return impl->calcEnergiesAtParameters(name, values, groups);
+}
+
+vector<double> Context::computeEnergiesByGroup(int groups) {
+    return impl->calcEnergiesByGroup(groups);
+}
+
+vector<double> Context::computeEnergies(const vector<vector<Vec3> >& configurations, int groups) {
+    return impl->calcEnergiesOfConfigurations(configurations, groups);
+}
+
+double Context::computeEnergyChange(const vector<int>& particles, const vector<Vec3>& newPositions, int groups) {
+    return impl->calcEnergyChange(particles, newPositions, groups);
+}
+
 void Context::setPeriodicBoxVectors(const Vec3& a, const Vec3& b, const Vec3& c) {
     impl->setPeriodicBoxVectors(a, b, c);
 }
@@ -232,6 +289,7 @@ void Context::computeVirtualSites() {
 }
 
 void Context::reinitialize() {
+    impl->checkNoAsyncSteps();
     const System& system = impl->getSystem();
     Integrator& integrator = impl->getIntegrator();
     Platform& platform = impl->getPlatform();
@@ -255,3 +313,11 @@ ContextImpl& Context::getImpl() {
 const vector<vector<int> >& Context::getMolecules() const {
     return impl->getMolecules();
 }
+
+Context* Context::clone(Integrator& integrator) {
+    return new Context(*this, integrator, properties);
+}
+
+Context::Context(Context& original, Integrator& integrator, const map<string, string>& properties) : properties(properties) {
+    impl = new ContextImpl(*this, original.impl->getSystem(), integrator, &original.impl->getPlatform(), properties, original.impl);
+}
@@ -39,24 +39,74 @@
 #include "openmm/State.h"
 #include "openmm/VirtualSite.h"
 #include "openmm/Context.h"
+#include "openmm/VerletIntegrator.h"
+#include "openmm/internal/ThreadPool.h"
 #include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <map>
 #include <utility>
 #include <vector>
+#include <pthread.h>
 #include <string.h>
 
 using namespace OpenMM;
 using namespace std;
 const static char CHECKPOINT_MAGIC_BYTES[] = "OpenMM Binary Checkpoint\n";
 
+struct ContextImpl::AsyncStepData {
+    AsyncStepData(ContextImpl& context, int steps, int types, bool enforcePeriodicBox, int groups) :
+            context(context), steps(steps), types(types), enforcePeriodicBox(enforcePeriodicBox), groups(groups), failed(false) {
+        pthread_mutex_init(&startLock, NULL);
+    }
+    ~AsyncStepData() {
+        pthread_mutex_destroy(&startLock);
+    }
+    ContextImpl& context;
+    int steps, types;
+    bool enforcePeriodicBox;
+    int groups;
+    pthread_t thread;
+    pthread_mutex_t startLock;
+    State state;
+    bool failed;
+    string errorMessage;
+};
+
+class ContextImpl::ConfigurationEnergyTask : public ThreadPool::Task {
+public:
+    ConfigurationEnergyTask(vector<ContextImpl*>& contexts, const vector<vector<Vec3> >& configurations, int groups, vector<double>& energies) :
+            contexts(contexts), configurations(configurations), groups(groups), energies(energies), errorMessages(contexts.size()) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Each thread evaluates every n'th configuration in its own Context.
+
+        try {
+            contexts[threadIndex]->calcEnergiesOfConfigurations(configurations, threadIndex, threads.getNumThreads(), groups, energies);
+        }
+        catch (exception& ex) {
+            errorMessages[threadIndex] = ex.what();
+        }
+        catch (...) {
+            errorMessages[threadIndex] = "Unknown error while computing energies";
+        }
+    }
+    vector<ContextImpl*>& contexts;
+    const vector<vector<Vec3> >& configurations;
+    int groups;
+    vector<double>& energies;
+    vector<string> errorMessages;
+};
 
-ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties) :
+
+ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties,
+            ContextImpl* originalContext) :
         owner(owner), system(system), integrator(integrator), hasInitializedForces(false), hasSetPositions(false), integratorIsDeleted(false),
-        lastForceGroups(-1), platform(platform), platformData(NULL) {
+        lastForceGroups(-1), stateVersion(0), forceBufferIsCurrent(false), forceBufferGroups(0), asyncStepData(NULL), configurationClonesVersion(-1), platform(platform), platformData(NULL) {
     if (system.getNumParticles() == 0)
         throw OpenMMException("Cannot create a Context for a System with no particles");
+    if (originalContext != NULL && originalContext->asyncStepData != NULL)
+        throw OpenMMException("clone: The Context cannot be cloned until its steps have been completed with waitForSteps()");
     
     // Check for errors in virtual sites and massless particles.
     
@@ -109,6 +159,12 @@ ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integ
         kernelNames.insert(kernelNames.begin(), forceKernels.begin(), forceKernels.end());
     }
     hasInitializedForces = true;
+    if (originalContext != NULL) {
+        // The list of molecules depends only on the System, so it can be shared with the original Context.  It
+        // must be available before the ForceImpls are initialized, since some of them use it.
+
+        molecules = originalContext->getMolecules();
+    }
     vector<string> integratorKernels = integrator.getKernelNames();
     kernelNames.insert(kernelNames.begin(), integratorKernels.begin(), integratorKernels.end());
     
@@ -156,13 +212,44 @@ ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integ
     Vec3 periodicBoxVectors[3];
     system.getDefaultPeriodicBoxVectors(periodicBoxVectors[0], periodicBoxVectors[1], periodicBoxVectors[2]);
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPeriodicBoxVectors(*this, periodicBoxVectors[0], periodicBoxVectors[1], periodicBoxVectors[2]);
-    for (size_t i = 0; i < forceImpls.size(); ++i)
-        forceImpls[i]->initialize(*this);
+    if (originalContext == NULL) {
+        for (size_t i = 0; i < forceImpls.size(); ++i)
+            forceImpls[i]->initialize(*this);
+    }
+    else {
+        // Each ForceImpl copies what it can from the original.  The original Context is not modified.
+
+        for (size_t i = 0; i < forceImpls.size(); ++i)
+            forceImpls[i]->initializeClone(*this, *originalContext, *originalContext->forceImpls[i]);
+    }
     integrator.initialize(*this);
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, vector<Vec3>(system.getNumParticles()));
+    if (originalContext != NULL) {
+        // Copy the state directly from the original Context.
+
+        Vec3 a, b, c;
+        originalContext->getPeriodicBoxVectors(a, b, c);
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setPeriodicBoxVectors(*this, a, b, c);
+        setTime(originalContext->getTime());
+        parameters = originalContext->parameters;
+        vector<Vec3> values;
+        if (originalContext->hasSetPositions) {
+            originalContext->getPositions(values);
+            setPositions(values);
+        }
+        originalContext->getVelocities(values);
+        setVelocities(values);
+    }
 }
 
 ContextImpl::~ContextImpl() {
+    if (asyncStepData != NULL) {
+        // Let any time steps that are still running finish before deleting anything they might use.
+
+        pthread_join(asyncStepData->thread, NULL);
+        delete asyncStepData;
+    }
+    deleteConfigurationClones();
     for (int i = 0; i < (int) forceImpls.size(); ++i)
         delete forceImpls[i];
     
@@ -182,58 +269,167 @@ ContextImpl::~ContextImpl() {
 }
 
 double ContextImpl::getTime() const {
+    checkNoAsyncSteps();
     return updateStateDataKernel.getAs<const UpdateStateDataKernel>().getTime(*this);
 }
 
 void ContextImpl::setTime(double t) {
+    checkNoAsyncSteps();
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setTime(*this, t);
 }
 
 void ContextImpl::getPositions(std::vector<Vec3>& positions) {
+    checkNoAsyncSteps();
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getPositions(*this, positions);
 }
 
 void ContextImpl::setPositions(const std::vector<Vec3>& positions) {
+    checkNoAsyncSteps();
     hasSetPositions = true;
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(*this, positions);
+    markStateChanged();
     integrator.stateChanged(State::Positions);
 }
 
 void ContextImpl::getVelocities(std::vector<Vec3>& velocities) {
+    checkNoAsyncSteps();
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getVelocities(*this, velocities);
 }
 
 void ContextImpl::setVelocities(const std::vector<Vec3>& velocities) {
+    checkNoAsyncSteps();
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, velocities);
     integrator.stateChanged(State::Velocities);
 }
 
 void ContextImpl::getForces(std::vector<Vec3>& forces) {
+    checkNoAsyncSteps();
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getForces(*this, forces);
 }
 
+void ContextImpl::getSubsetPositions(const vector<int>& particles, vector<Vec3>& positions) {
+    checkNoAsyncSteps();
+    checkParticleIndices(particles);
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().getSubsetPositions(*this, particles, positions);
+}
+
+void ContextImpl::getSubsetVelocities(const vector<int>& particles, vector<Vec3>& velocities) {
+    checkNoAsyncSteps();
+    checkParticleIndices(particles);
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().getSubsetVelocities(*this, particles, velocities);
+}
+
+void ContextImpl::copyPositions(const vector<int>& particles, double* output, int stride) {
+    checkNoAsyncSteps();
+    checkParticleIndices(particles);
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().copyPositions(*this, particles, output, stride);
+}
+
+void ContextImpl::copyPositions(const vector<int>& particles, float* output, int stride) {
+    checkNoAsyncSteps();
+    checkParticleIndices(particles);
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().copyPositions(*this, particles, output, stride);
+}
+
+void ContextImpl::copyVelocities(const vector<int>& particles, double* output, int stride) {
+    checkNoAsyncSteps();
+    checkParticleIndices(particles);
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().copyVelocities(*this, particles, output, stride);
+}
+
+void ContextImpl::copyVelocities(const vector<int>& particles, float* output, int stride) {
+    checkNoAsyncSteps();
+    checkParticleIndices(particles);
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().copyVelocities(*this, particles, output, stride);
+}
+
+/**
+ * Copy selected elements of a list of vectors into an array, or all of them if the list of indices is empty.
+ */
+template <class T>
+static void copyCachedForces(const vector<Vec3>& forces, const vector<int>& particles, T* output, int stride) {
+    int numCopied = (particles.size() == 0 ? forces.size() : particles.size());
+    for (int i = 0; i < numCopied; i++) {
+        const Vec3& force = forces[particles.size() == 0 ? i : particles[i]];
+        T* element = output+(size_t) i*stride;
+        element[0] = (T) force[0];
+        element[1] = (T) force[1];
+        element[2] = (T) force[2];
+    }
+}
+
+void ContextImpl::copyForces(const vector<int>& particles, int groups, double* output, int stride) {
+    const vector<Vec3>* cached = prepareForcesForCopy(particles, groups);
+    if (cached != NULL)
+        copyCachedForces(*cached, particles, output, stride);
+    else
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().copyForces(*this, particles, output, stride);
+}
+
+void ContextImpl::copyForces(const vector<int>& particles, int groups, float* output, int stride) {
+    const vector<Vec3>* cached = prepareForcesForCopy(particles, groups);
+    if (cached != NULL)
+        copyCachedForces(*cached, particles, output, stride);
+    else
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().copyForces(*this, particles, output, stride);
+}
+
+const vector<Vec3>* ContextImpl::prepareForcesForCopy(const vector<int>& particles, int groups) {
+    checkNoAsyncSteps();
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    checkParticleIndices(particles);
+
+    // If the force buffer already holds the forces for these groups, they can be copied directly from it.  Otherwise
+    // use the cached values if there are any, and compute them only as a last resort.  Newly computed forces are not
+    // added to the cache, since that would require copying them.
+
+    if (forceBufferIsCurrent && forceBufferGroups == groups)
+        return NULL;
+    map<int, vector<Vec3> >::const_iterator cachedForces = cachedForcesByGroups.find(groups);
+    if (cachedForces != cachedForcesByGroups.end())
+        return &cachedForces->second;
+    lastForceGroups = groups;
+    calcForcesAndEnergy(forceImpls, true, false, groups);
+    forceBufferIsCurrent = true;
+    forceBufferGroups = groups;
+    return NULL;
+}
+
+void ContextImpl::checkParticleIndices(const vector<int>& particles) const {
+    int numParticles = system.getNumParticles();
+    for (int i = 0; i < (int) particles.size(); i++)
+        if (particles[i] < 0 || particles[i] >= numParticles)
+            throw OpenMMException("Particle index out of range");
+}
+
 const std::map<std::string, double>& ContextImpl::getParameters() const {
     return parameters;
 }
 
 double ContextImpl::getParameter(std::string name) {
+    checkNoAsyncSteps();
     if (parameters.find(name) == parameters.end())
         throw OpenMMException("Called getParameter() with invalid parameter name: "+name);
     return parameters[name];
 }
 
 void ContextImpl::setParameter(std::string name, double value) {
+    checkNoAsyncSteps();
     if (parameters.find(name) == parameters.end())
         throw OpenMMException("Called setParameter() with invalid parameter name: "+name);
     parameters[name] = value;
+    markStateChanged();
     integrator.stateChanged(State::Parameters);
 }
 
 void ContextImpl::getPeriodicBoxVectors(Vec3& a, Vec3& b, Vec3& c) {
+    checkNoAsyncSteps();
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getPeriodicBoxVectors(*this, a, b, c);
 }
 
 void ContextImpl::setPeriodicBoxVectors(const Vec3& a, const Vec3& b, const Vec3& c) {
+    checkNoAsyncSteps();
     if (a[1] != 0.0 || a[2] != 0.0)
         throw OpenMMException("First periodic box vector must be parallel to x.");
     if (b[2] != 0.0)
@@ -241,30 +437,91 @@ void ContextImpl::setPeriodicBoxVectors(const Vec3& a, const Vec3& b, const Vec3
     if (a[0] <= 0.0 || b[1] <= 0.0 || c[2] <= 0.0 || a[0] < 2*fabs(b[0]) || a[0] < 2*fabs(c[0]) || b[1] < 2*fabs(c[1]))
         throw OpenMMException("Periodic box vectors must be in reduced form.");
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPeriodicBoxVectors(*this, a, b, c);
+    markStateChanged();
 }
 
 void ContextImpl::applyConstraints(double tol) {
+    checkNoAsyncSteps();
     applyConstraintsKernel.getAs<ApplyConstraintsKernel>().apply(*this, tol);
+    markStateChanged();
 }
 
 void ContextImpl::applyVelocityConstraints(double tol) {
+    checkNoAsyncSteps();
     applyConstraintsKernel.getAs<ApplyConstraintsKernel>().applyToVelocities(*this, tol);
 }
 
 void ContextImpl::computeVirtualSites() {
+    checkNoAsyncSteps();
     virtualSitesKernel.getAs<VirtualSitesKernel>().computePositions(*this);
+    markStateChanged();
 }
 
 double ContextImpl::calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups) {
+    checkNoAsyncSteps();
     if (!hasSetPositions)
         throw OpenMMException("Particle positions have not been set");
+
+    // This is how Integrators compute forces, and they usually go on to modify the state.
+
+    markStateChanged();
     lastForceGroups = groups;
+    return calcForcesAndEnergy(forceImpls, includeForces, includeEnergy, groups);
+}
+
+double ContextImpl::calcForcesAndEnergyForState(bool includeForces, bool includeEnergy, int groups, vector<Vec3>& forces) {
+    checkNoAsyncSteps();
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+
+    // See whether the results are already cached.  The kinetic energy of some integrators depends on the
+    // force buffer, so in that case the energy can only be reused if the buffer holds the forces for these groups.
+
+    bool kineticEnergyRequiresForce = integrator.kineticEnergyRequiresForce();
+    map<int, vector<Vec3> >::const_iterator cachedForces = cachedForcesByGroups.find(groups);
+    map<int, double>::const_iterator cachedEnergy = cachedEnergyByGroups.find(groups);
+    bool haveForces = (!includeForces || cachedForces != cachedForcesByGroups.end());
+    bool haveEnergy = (!includeEnergy || (cachedEnergy != cachedEnergyByGroups.end() &&
+            (!kineticEnergyRequiresForce || (forceBufferIsCurrent && forceBufferGroups == groups))));
+    if (haveForces && haveEnergy) {
+        if (includeForces)
+            forces = cachedForces->second;
+        return (includeEnergy ? cachedEnergy->second : 0.0);
+    }
+
+    // Compute them.
+
+    bool computeForces = (includeForces || (includeEnergy && kineticEnergyRequiresForce));
+    if (computeForces)
+        lastForceGroups = groups;
+    double energy = calcForcesAndEnergy(forceImpls, computeForces, includeEnergy, groups);
+    if (computeForces) {
+        forceBufferIsCurrent = true;
+        forceBufferGroups = groups;
+    }
+    else {
+        // The forces were not recomputed for these groups, so the Integrator must not assume
+        // that the force buffer matches getLastForceGroups().
+
+        integrator.stateChanged(State::Forces);
+    }
+    if (includeForces) {
+        getForces(forces);
+        cachedForcesByGroups[groups] = forces;
+    }
+    if (includeEnergy)
+        cachedEnergyByGroups[groups] = energy;
+    return energy;
+}
+
+double ContextImpl::calcForcesAndEnergy(const vector<ForceImpl*>& impls, bool includeForces, bool includeEnergy, int groups) {
     CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
+    forceBufferIsCurrent = false;
     while (true) {
         double energy = 0.0;
         kernel.beginComputation(*this, includeForces, includeEnergy, groups);
-        for (int i = 0; i < (int) forceImpls.size(); ++i)
-            energy += forceImpls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+        for (int i = 0; i < (int) impls.size(); ++i)
+            energy += impls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
         bool valid = true;
         energy += kernel.finishComputation(*this, includeForces, includeEnergy, groups, valid);
         if (valid)
@@ -272,15 +529,347 @@ double ContextImpl::calcForcesAndEnergy(bool includeForces, bool includeEnergy,
     }
 }
 
+double ContextImpl::calcPotentialEnergy(int groups) {
+    double energy = calcForcesAndEnergy(false, true, groups);
+    integrator.stateChanged(State::Forces);
+    return energy;
+}
+
+vector<double> ContextImpl::calcEnergiesAtParameters(const string& name, const vector<double>& values, int groups) {
+    checkNoAsyncSteps();
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    map<string, double>::iterator param = parameters.find(name);
+    if (param == parameters.end())
+        throw OpenMMException("Called computeEnergiesAtParameters() with invalid parameter name: "+name);
+
+    // Divide the forces into ones that do not depend on the parameter, ones whose energy is a polynomial
+    // of low enough degree in it that interpolation is cheaper than evaluating every value, and all others.
+
+    vector<ForceImpl*> dependent, polynomial, independent;
+    int degree = 0;
+    for (int i = 0; i < (int) forceImpls.size(); i++) {
+        map<string, double> forceParams = forceImpls[i]->getDefaultParameters();
+        if (forceParams.find(name) == forceParams.end()) {
+            independent.push_back(forceImpls[i]);
+            continue;
+        }
+        int forceDegree = forceImpls[i]->getEnergyPolynomialDegree(name);
+        if (forceDegree >= 0 && forceDegree+1 < (int) values.size()) {
+            polynomial.push_back(forceImpls[i]);
+            degree = max(degree, forceDegree);
+        }
+        else
+            dependent.push_back(forceImpls[i]);
+    }
+
+    // Compute the energy of the independent forces once, the polynomial ones at degree+1 values spread over
+    // the requested range, and the remaining dependent ones for each value.
+
+    vector<double> energies(values.size());
+    if (values.size() == 0)
+        return energies;
+    double independentEnergy = calcForcesAndEnergy(independent, false, true, groups);
+    double originalValue = param->second;
+    try {
+        if (polynomial.size() > 0) {
+            double minValue = *min_element(values.begin(), values.end());
+            double maxValue = *max_element(values.begin(), values.end());
+            if (minValue == maxValue)
+                degree = 0;
+            vector<double> nodes(degree+1), nodeEnergies(degree+1);
+            for (int i = 0; i <= degree; i++) {
+                nodes[i] = (degree == 0 ? minValue : minValue+(maxValue-minValue)*i/degree);
+                param->second = nodes[i];
+                nodeEnergies[i] = calcForcesAndEnergy(polynomial, false, true, groups);
+            }
+            for (int i = 0; i < (int) values.size(); i++) {
+                double energy = 0.0;
+                for (int j = 0; j <= degree; j++) {
+                    double weight = 1.0;
+                    for (int k = 0; k <= degree; k++)
+                        if (k != j)
+                            weight *= (values[i]-nodes[k])/(nodes[j]-nodes[k]);
+                    energy += weight*nodeEnergies[j];
+                }
+                energies[i] = energy;
+            }
+        }
+        for (int i = 0; i < (int) values.size(); i++) {
+            energies[i] += independentEnergy;
+            if (dependent.size() > 0) {
+                param->second = values[i];
+                energies[i] += calcForcesAndEnergy(dependent, false, true, groups);
+            }
+        }
+    }
+    catch (...) {
+        param->second = originalValue;
+        integrator.stateChanged(State::Forces);
+        throw;
+    }
+    param->second = originalValue;
+
+    // The force buffers no longer hold the forces from any single set of groups.
+
+    integrator.stateChanged(State::Forces);
+    return energies;
+}
+
+vector<double> ContextImpl::calcEnergiesByGroup(int groups) {
+    checkNoAsyncSteps();
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
+    vector<double> energies(32, 0.0);
+    double unassignedEnergy;
+    while (true) {
+        kernel.beginComputation(*this, false, true, groups);
+        for (int group = 0; group < 32; group++) {
+            energies[group] = 0.0;
+            if ((groups&(1<<group)) != 0)
+                for (int i = 0; i < (int) forceImpls.size(); i++)
+                    energies[group] += forceImpls[i]->calcForcesAndEnergy(*this, false, true, 1<<group);
+        }
+        bool valid = true;
+        unassignedEnergy = kernel.finishComputation(*this, false, true, groups, valid);
+        if (valid)
+            break;
+    }
+    if (unassignedEnergy != 0.0) {
+        // The platform accumulates energy in its own buffer, so evaluate each group separately.
+
+        for (int group = 0; group < 32; group++)
+            if ((groups&(1<<group)) != 0)
+                energies[group] = calcForcesAndEnergy(forceImpls, false, true, 1<<group);
+    }
+    integrator.stateChanged(State::Forces);
+    return energies;
+}
+
+vector<double> ContextImpl::calcEnergiesOfConfigurations(const vector<vector<Vec3> >& configurations, int groups) {
+    checkNoAsyncSteps();
+    int numParticles = system.getNumParticles();
+    for (int i = 0; i < (int) configurations.size(); i++)
+        if (configurations[i].size() != numParticles)
+            throw OpenMMException("computeEnergies: Each configuration must contain one position for every particle");
+    vector<double> energies(configurations.size());
+    if (configurations.size() == 0)
+        return energies;
+
+    // If the Platform recommends it, divide the configurations between several clones of this Context and evaluate
+    // them in parallel.  Creating the clones has a cost, so each one should get at least a few configurations, and
+    // they are kept for later calls.  They only need to be created again when the state of this Context changes,
+    // since that might mean its parameters or periodic box have changed.
+
+    map<string, string> cloneProperties = owner.properties;
+    int numClones = min(platform->getNumConcurrentContexts(*this, cloneProperties), (int) configurations.size()/4);
+    if (numClones > 1) {
+        if (configurationClonesVersion != stateVersion)
+            deleteConfigurationClones();
+        try {
+            while ((int) configurationClones.size() < numClones) {
+                configurationCloneIntegrators.push_back(new VerletIntegrator(0.001));
+                configurationClones.push_back(new Context(owner, *configurationCloneIntegrators.back(), cloneProperties));
+            }
+        }
+        catch (...) {
+            deleteConfigurationClones();
+            throw;
+        }
+        configurationClonesVersion = stateVersion;
+        vector<ContextImpl*> cloneImpls(numClones);
+        for (int i = 0; i < numClones; i++)
+            cloneImpls[i] = configurationClones[i]->impl;
+        ThreadPool threads(numClones);
+        ConfigurationEnergyTask task(cloneImpls, configurations, groups, energies);
+        threads.execute(task);
+        threads.waitForThreads();
+        for (int i = 0; i < numClones; i++)
+            if (task.errorMessages[i].size() > 0)
+                throw OpenMMException(task.errorMessages[i]);
+        return energies;
+    }
+
+    // Evaluate them one after another in this Context.
+
+    vector<Vec3> originalPositions;
+    if (hasSetPositions)
+        getPositions(originalPositions);
+    try {
+        calcEnergiesOfConfigurations(configurations, 0, 1, groups, energies);
+    }
+    catch (...) {
+        if (hasSetPositions)
+            setPositions(originalPositions);
+        throw;
+    }
+
+    // Restore the positions.  This also tells the Integrator that its cached forces are invalid.
+
+    if (hasSetPositions)
+        setPositions(originalPositions);
+    else
+        markStateChanged();
+    integrator.stateChanged(State::Forces);
+    return energies;
+}
+
+void ContextImpl::calcEnergiesOfConfigurations(const vector<vector<Vec3> >& configurations, int first, int stride, int groups, vector<double>& energies) {
+    UpdateStateDataKernel& updateKernel = updateStateDataKernel.getAs<UpdateStateDataKernel>();
+    for (int i = first; i < (int) configurations.size(); i += stride) {
+        updateKernel.setPositions(*this, configurations[i]);
+        energies[i] = calcForcesAndEnergy(forceImpls, false, true, groups);
+    }
+}
+
+void ContextImpl::deleteConfigurationClones() {
+    for (int i = 0; i < (int) configurationClones.size(); i++)
+        delete configurationClones[i];
+    for (int i = 0; i < (int) configurationCloneIntegrators.size(); i++)
+        delete configurationCloneIntegrators[i];
+    configurationClones.clear();
+    configurationCloneIntegrators.clear();
+    configurationClonesVersion = -1;
+}
+
+double ContextImpl::calcEnergyChange(const vector<int>& particles, const vector<Vec3>& newPositions, int groups) {
+    checkNoAsyncSteps();
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    if (particles.size() != newPositions.size())
+        throw OpenMMException("computeEnergyChange: The number of positions does not match the number of particles");
+    checkParticleIndices(particles);
+    if (particles.size() == 0)
+        return 0.0;
+
+    // Let each ForceImpl compute its own change if it can.
+
+    double energyChange = 0.0;
+    vector<ForceImpl*> remaining;
+    for (int i = 0; i < (int) forceImpls.size(); i++) {
+        double change;
+        if (forceImpls[i]->calcEnergyChange(*this, particles, newPositions, groups, change))
+            energyChange += change;
+        else
+            remaining.push_back(forceImpls[i]);
+    }
+    if (remaining.size() == 0)
+        return energyChange;
+
+    // Evaluate the others before and after the move, then restore the original positions.  The positions are
+    // loaded directly into the kernel rather than through setPositions(), and computing only the energy leaves
+    // the force buffer untouched, so afterward the Context is exactly as it was before: the state version and
+    // cached results are still valid, and the Integrator does not need to be told about it.
+
+    vector<Vec3> originalPositions;
+    getPositions(originalPositions);
+    vector<Vec3> movedPositions = originalPositions;
+    for (int i = 0; i < (int) particles.size(); i++)
+        movedPositions[particles[i]] = newPositions[i];
+    UpdateStateDataKernel& updateKernel = updateStateDataKernel.getAs<UpdateStateDataKernel>();
+    bool bufferWasCurrent = forceBufferIsCurrent;
+    double oldEnergy = calcForcesAndEnergy(remaining, false, true, groups);
+    double newEnergy;
+    updateKernel.setPositions(*this, movedPositions);
+    try {
+        newEnergy = calcForcesAndEnergy(remaining, false, true, groups);
+    }
+    catch (...) {
+        updateKernel.setPositions(*this, originalPositions);
+        forceBufferIsCurrent = bufferWasCurrent;
+        throw;
+    }
+    updateKernel.setPositions(*this, originalPositions);
+    forceBufferIsCurrent = bufferWasCurrent;
+    return energyChange+newEnergy-oldEnergy;
+}
+
 int ContextImpl::getLastForceGroups() const {
     return lastForceGroups;
 }
 
 double ContextImpl::calcKineticEnergy() {
+    checkNoAsyncSteps();
     return integrator.computeKineticEnergy();
 }
 
+int ContextImpl::getStateVersion() const {
+    return stateVersion;
+}
+
+void ContextImpl::markStateChanged() {
+    checkNoAsyncSteps();
+    stateVersion++;
+    forceBufferIsCurrent = false;
+    cachedForcesByGroups.clear();
+    cachedEnergyByGroups.clear();
+}
+
+void ContextImpl::startAsyncSteps(int steps, int types, bool enforcePeriodicBox, int groups) {
+    if (asyncStepData != NULL)
+        throw OpenMMException("stepAsync: The previous steps have not been completed with waitForSteps()");
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    asyncStepData = new AsyncStepData(*this, steps, types, enforcePeriodicBox, groups);
+
+    // Hold the lock until the thread ID has been stored, so the new thread can safely compare against it.
+
+    pthread_mutex_lock(&asyncStepData->startLock);
+    if (pthread_create(&asyncStepData->thread, NULL, runAsyncSteps, asyncStepData) != 0) {
+        pthread_mutex_unlock(&asyncStepData->startLock);
+        delete asyncStepData;
+        asyncStepData = NULL;
+        throw OpenMMException("stepAsync: Failed to create a thread");
+    }
+    pthread_mutex_unlock(&asyncStepData->startLock);
+}
+
+void ContextImpl::checkNoAsyncSteps() const {
+    // The thread taking the steps is allowed to use the Context.  Everyone else must wait for it.
+
+    if (asyncStepData != NULL && !pthread_equal(pthread_self(), asyncStepData->thread))
+        throw OpenMMException("The Context cannot be used while steps started with stepAsync() are running.  Call waitForSteps() first.");
+}
+
+State ContextImpl::finishAsyncSteps() {
+    if (asyncStepData == NULL)
+        throw OpenMMException("waitForSteps: No steps have been started with stepAsync()");
+    pthread_join(asyncStepData->thread, NULL);
+    AsyncStepData* data = asyncStepData;
+    asyncStepData = NULL;
+    if (data->failed) {
+        string message = data->errorMessage;
+        delete data;
+        throw OpenMMException(message);
+    }
+    State state = data->state;
+    delete data;
+    return state;
+}
+
+void* ContextImpl::runAsyncSteps(void* data) {
+    AsyncStepData& stepData = *reinterpret_cast<AsyncStepData*>(data);
+    ContextImpl& context = stepData.context;
+    pthread_mutex_lock(&stepData.startLock);
+    pthread_mutex_unlock(&stepData.startLock);
+    try {
+        context.integrator.step(stepData.steps);
+        stepData.state = context.owner.getState(stepData.types, stepData.enforcePeriodicBox, stepData.groups);
+    }
+    catch (std::exception& ex) {
+        stepData.failed = true;
+        stepData.errorMessage = ex.what();
+    }
+    catch (...) {
+        stepData.failed = true;
+        stepData.errorMessage = "stepAsync: Unknown error while taking time steps";
+    }
+    return 0;
+}
+
 void ContextImpl::updateContextState() {
+    markStateChanged();
     for (int i = 0; i < (int) forceImpls.size(); ++i)
         forceImpls[i]->updateContextState(*this);
 }
@@ -406,6 +995,7 @@ static string readString(istream& stream) {
 }
 
 void ContextImpl::createCheckpoint(ostream& stream) {
+    checkNoAsyncSteps();
     stream.write(CHECKPOINT_MAGIC_BYTES, sizeof(CHECKPOINT_MAGIC_BYTES)/sizeof(CHECKPOINT_MAGIC_BYTES[0]));
     writeString(stream, getPlatform().getName());
     int numParticles = getSystem().getNumParticles();
@@ -421,6 +1011,7 @@ void ContextImpl::createCheckpoint(ostream& stream) {
 }
 
 void ContextImpl::loadCheckpoint(istream& stream) {
+    checkNoAsyncSteps();
     static const int magiclength = sizeof(CHECKPOINT_MAGIC_BYTES)/sizeof(CHECKPOINT_MAGIC_BYTES[0]);
     char magicbytes[magiclength];
     stream.read(magicbytes, magiclength);
@@ -443,4 +1034,5 @@ void ContextImpl::loadCheckpoint(istream& stream) {
         parameters[name] = value;
     }
     updateStateDataKernel.getAs<UpdateStateDataKernel>().loadCheckpoint(*this, stream);
+    markStateChanged();
 }
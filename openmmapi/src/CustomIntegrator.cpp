@@ -96,6 +96,7 @@ double CustomIntegrator::computeKineticEnergy() {
 void CustomIntegrator::step(int steps) {
     globalsAreCurrent = false;
     for (int i = 0; i < steps; ++i) {
+        context->markStateChanged();
         kernel.getAs<IntegrateCustomStepKernel>().execute(*context, *this, forcesAreValid);
     }
 }
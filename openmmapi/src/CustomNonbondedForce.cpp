@@ -285,3 +285,7 @@ ForceImpl* CustomNonbondedForce::createImpl() const {
 void CustomNonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<CustomNonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
+
+void CustomNonbondedForce::updateParametersInContext(Context& context, const vector<int>& particles) {
+    dynamic_cast<CustomNonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context), particles);
+}
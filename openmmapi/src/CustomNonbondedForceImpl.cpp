@@ -114,6 +114,15 @@ void CustomNonbondedForceImpl::initialize(ContextImpl& context) {
     kernel.getAs<CalcCustomNonbondedForceKernel>().initialize(context.getSystem(), owner);
 }
 
+void CustomNonbondedForceImpl::initializeClone(ContextImpl& context, ContextImpl& originalContext, ForceImpl& original) {
+    // The original was validated when it was created, so only the kernel needs to be set up.
+
+    kernel = context.getPlatform().createKernel(CalcCustomNonbondedForceKernel::Name(), context);
+    const CalcCustomNonbondedForceKernel& originalKernel = dynamic_cast<CustomNonbondedForceImpl&>(original).kernel.getAs<CalcCustomNonbondedForceKernel>();
+    if (!kernel.getAs<CalcCustomNonbondedForceKernel>().initializeFromKernel(context.getSystem(), owner, originalKernel))
+        ForceImpl::initializeClone(context, originalContext, original);
+}
+
 double CustomNonbondedForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
     if ((groups&(1<<owner.getForceGroup())) != 0)
         return kernel.getAs<CalcCustomNonbondedForceKernel>().execute(context, includeForces, includeEnergy);
@@ -137,21 +146,78 @@ void CustomNonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
     kernel.getAs<CalcCustomNonbondedForceKernel>().copyParametersToContext(context, owner);
 }
 
+void CustomNonbondedForceImpl::updateParametersInContext(ContextImpl& context, const vector<int>& particles) {
+    if (owner.getNumParticles() != context.getSystem().getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    for (int i = 0; i < (int) particles.size(); i++)
+        if (particles[i] < 0 || particles[i] >= owner.getNumParticles())
+            throw OpenMMException("updateParametersInContext: Illegal particle index");
+    kernel.getAs<CalcCustomNonbondedForceKernel>().copyChangedParametersToContext(context, owner, particles);
+}
+
+class CustomNonbondedForceImpl::IntegrateTask : public ThreadPool::Task {
+public:
+    IntegrateTask(const CustomNonbondedForce& force, const LongRangeCorrectionData& data, const vector<int>& pairIndex,
+                const map<string, double>& globalParameters, vector<double>& results, int numThreads) : force(force), data(data), pairIndex(pairIndex),
+                globalParameters(globalParameters), results(results), errorMessages(numThreads) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Each thread needs its own copy of the expression, since integrateInteraction() sets its variables.
+
+        Lepton::CompiledExpression expression = data.expression;
+        try {
+            for (int i = threadIndex; i < (int) pairIndex.size(); i += threads.getNumThreads()) {
+                const pair<int, int>& classPair = data.interactionCounts[pairIndex[i]].first;
+                results[i] = integrateInteraction(expression, data.classes[classPair.first], data.classes[classPair.second], force, globalParameters);
+            }
+        }
+        catch (exception& ex) {
+            errorMessages[threadIndex] = ex.what();
+        }
+    }
+    const CustomNonbondedForce& force;
+    const LongRangeCorrectionData& data;
+    const vector<int>& pairIndex;
+    const map<string, double>& globalParameters;
+    vector<double>& results;
+    vector<string> errorMessages;
+};
+
 double CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context) {
+    LongRangeCorrectionData data;
+    prepareLongRangeCorrection(force, data);
+    return calcLongRangeCorrection(force, data, context);
+}
+
+void CustomNonbondedForceImpl::prepareLongRangeCorrection(const CustomNonbondedForce& force, LongRangeCorrectionData& data) {
+    data.coefficients.clear();
     if (force.getNonbondedMethod() == CustomNonbondedForce::NoCutoff || force.getNonbondedMethod() == CustomNonbondedForce::CutoffNonPeriodic)
-        return 0.0;
+        return;
     
-    // Parse the energy expression.
+    // Parse the energy expression.  This only needs to be done once, since it cannot be changed by updateParametersInContext().
     
-    map<string, Lepton::CustomFunction*> functions;
-    for (int i = 0; i < force.getNumFunctions(); i++)
-        functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
-    Lepton::CompiledExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).createCompiledExpression();
+    if (!data.hasExpression) {
+        map<string, Lepton::CustomFunction*> functions;
+        for (int i = 0; i < force.getNumFunctions(); i++)
+            functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
+        data.expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).createCompiledExpression();
+        for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
+            delete iter->second;
+        const set<string>& variables = data.expression.getVariables();
+        if (variables.find("r") == variables.end())
+            throw OpenMMException("CustomNonbondedForce: Cannot use long range correction with a force that does not depend on r.");
+        data.globalParameterNames.clear();
+        for (int i = 0; i < force.getNumGlobalParameters(); i++)
+            if (variables.find(force.getGlobalParameterName(i)) != variables.end())
+                data.globalParameterNames.push_back(force.getGlobalParameterName(i));
+        data.hasExpression = true;
+    }
     
     // Identify all particle classes (defined by parameters), and record the class of each particle.
     
     int numParticles = force.getNumParticles();
-    vector<vector<double> > classes;
+    vector<vector<double> >& classes = data.classes;
+    classes.clear();
     map<vector<double>, int> classIndex;
     vector<int> atomClass(numParticles);
     for (int i = 0; i < numParticles; i++) {
@@ -164,6 +230,7 @@ double CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedFo
         atomClass[i] = classIndex[parameters];
     }
     int numClasses = classes.size();
+    data.numParticles = numParticles;
     
     // Count the total number of particle pairs for each pair of classes.
     
@@ -181,13 +248,6 @@ double CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedFo
         }
     }
     else {
-        // Initialize the counts to 0.
-        
-        for (int i = 0; i < numClasses; i++) {
-            for (int j = i; j < numClasses; j++)
-                interactionCount[make_pair(i, j)] = 0;
-        }
-        
         // Loop over interaction groups and count the interactions in each one.
         
         for (int group = 0; group < force.getNumInteractionGroups(); group++) {
@@ -203,21 +263,90 @@ double CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedFo
                 }
         }
     }
+    
+    // Only pairs of classes that actually interact need to be integrated.
+    
+    data.interactionCounts.clear();
+    for (map<pair<int, int>, long long int>::const_iterator iter = interactionCount.begin(); iter != interactionCount.end(); ++iter)
+        if (iter->second != 0)
+            data.interactionCounts.push_back(*iter);
+}
+
+double CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForce& force, LongRangeCorrectionData& data, const Context& context, ThreadPool* threads) {
+    if (force.getNonbondedMethod() == CustomNonbondedForce::NoCutoff || force.getNonbondedMethod() == CustomNonbondedForce::CutoffNonPeriodic)
+        return 0.0;
+    
+    // If we have already computed the coefficient for the current global parameters, just return it.
+    
+    vector<double> globalValues;
+    map<string, double> globalParameters;
+    for (int i = 0; i < (int) data.globalParameterNames.size(); i++) {
+        double value = context.getParameter(data.globalParameterNames[i]);
+        globalValues.push_back(value);
+        globalParameters[data.globalParameterNames[i]] = value;
+    }
+    map<vector<double>, double>::const_iterator cached = data.coefficients.find(globalValues);
+    if (cached != data.coefficients.end())
+        return cached->second;
+    
+    // Find which integrals have not already been computed.
+    
+    int numPairs = data.interactionCounts.size();
+    vector<vector<double> > keys(numPairs);
+    vector<int> pairsToCompute;
+    for (int i = 0; i < numPairs; i++) {
+        const vector<double>& params1 = data.classes[data.interactionCounts[i].first.first];
+        const vector<double>& params2 = data.classes[data.interactionCounts[i].first.second];
+        keys[i].insert(keys[i].end(), params1.begin(), params1.end());
+        keys[i].insert(keys[i].end(), params2.begin(), params2.end());
+        keys[i].insert(keys[i].end(), globalValues.begin(), globalValues.end());
+        if (data.integrals.find(keys[i]) == data.integrals.end())
+            pairsToCompute.push_back(i);
+    }
+    
+    // Compute them, in parallel if possible.
+    
+    vector<double> results(pairsToCompute.size());
+    if (threads != NULL && pairsToCompute.size() > 1) {
+        IntegrateTask task(force, data, pairsToCompute, globalParameters, results, threads->getNumThreads());
+        threads->execute(task);
+        threads->waitForThreads();
+        for (int i = 0; i < (int) task.errorMessages.size(); i++)
+            if (task.errorMessages[i].size() > 0)
+                throw OpenMMException(task.errorMessages[i]);
+    }
+    else {
+        for (int i = 0; i < (int) pairsToCompute.size(); i++) {
+            const pair<int, int>& classPair = data.interactionCounts[pairsToCompute[i]].first;
+            results[i] = integrateInteraction(data.expression, data.classes[classPair.first], data.classes[classPair.second], force, globalParameters);
+        }
+    }
+    
+    // Limit the memory used by the cache.  Discarding everything is simplest, and it is rarely needed in practice.
+    
+    const int maxCachedValues = 1000000;
+    if (data.integrals.size()+results.size() > maxCachedValues)
+        data.integrals.clear();
+    if (data.coefficients.size() >= maxCachedValues/100)
+        data.coefficients.clear();
+    for (int i = 0; i < (int) pairsToCompute.size(); i++)
+        data.integrals[keys[pairsToCompute[i]]] = results[i];
 
-    // Loop over all pairs of classes to compute the coefficient.
+    // Sum over all pairs of classes to compute the coefficient.
 
     double sum = 0;
-    for (int i = 0; i < numClasses; i++)
-        for (int j = i; j < numClasses; j++)
-            sum += interactionCount[make_pair(i, j)]*integrateInteraction(expression, classes[i], classes[j], force, context);
-    double nPart = (double) numParticles;
+    for (int i = 0; i < numPairs; i++)
+        sum += data.interactionCounts[i].second*data.integrals[keys[i]];
+    double nPart = (double) data.numParticles;
     double numInteractions = (nPart*(nPart+1))/2;
     sum /= numInteractions;
-    return 2*M_PI*nPart*nPart*sum;
+    double coefficient = 2*M_PI*nPart*nPart*sum;
+    data.coefficients[globalValues] = coefficient;
+    return coefficient;
 }
 
 double CustomNonbondedForceImpl::integrateInteraction(Lepton::CompiledExpression& expression, const vector<double>& params1, const vector<double>& params2,
-        const CustomNonbondedForce& force, const Context& context) {
+        const CustomNonbondedForce& force, const map<string, double>& globalParameters) {
     const set<string>& variables = expression.getVariables();
     for (int i = 0; i < force.getNumPerParticleParameters(); i++) {
         stringstream name1, name2;
@@ -228,23 +357,14 @@ double CustomNonbondedForceImpl::integrateInteraction(Lepton::CompiledExpression
         if (variables.find(name2.str()) != variables.end())
             expression.getVariableReference(name2.str()) = params2[i];
     }
-    for (int i = 0; i < force.getNumGlobalParameters(); i++) {
-        const string& name = force.getGlobalParameterName(i);
-        if (variables.find(name) != variables.end())
-            expression.getVariableReference(name) = context.getParameter(name);
-    }
+    for (map<string, double>::const_iterator iter = globalParameters.begin(); iter != globalParameters.end(); ++iter)
+        expression.getVariableReference(iter->first) = iter->second;
     
     // To integrate from r_cutoff to infinity, make the change of variables x=r_cutoff/r and integrate from 0 to 1.
     // This introduces another r^2 into the integral, which along with the r^2 in the formula for the correction
     // means we multiply the function by r^4.  Use the midpoint method.
 
-    double* rPointer;
-    try {
-        rPointer = &expression.getVariableReference("r");
-    }
-    catch (exception& ex) {
-        throw OpenMMException("CustomNonbondedForce: Cannot use long range correction with a force that does not depend on r.");
-    }
+    double* rPointer = &expression.getVariableReference("r");
     double cutoff = force.getCutoffDistance();
     double sum = 0;
     int numPoints = 1;
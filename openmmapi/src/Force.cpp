@@ -62,5 +62,9 @@ ForceImpl& Force::getImplInContext(Context& context) {
 }
 
 ContextImpl& Force::getContextImpl(Context& context) {
-    return context.getImpl();
+    // This is used by methods such as updateParametersInContext() that may modify the Context.
+
+    ContextImpl& impl = context.getImpl();
+    impl.markStateChanged();
+    return impl;
 }
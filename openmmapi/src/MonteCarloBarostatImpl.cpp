@@ -72,7 +72,7 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context) {
 
     // Compute the current potential energy.
 
-    double initialEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double initialEnergy = context.calcPotentialEnergy();
 
     // Modify the periodic box size.
 
@@ -87,7 +87,7 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context) {
 
     // Compute the energy of the modified system.
     
-    double finalEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double finalEnergy = context.calcPotentialEnergy();
     double pressure = context.getParameter(MonteCarloBarostat::Pressure())*(AVOGADRO*1e-25);
     double kT = BOLTZ*owner.getTemperature();
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - context.getMolecules().size()*kT*std::log(newVolume/volume);
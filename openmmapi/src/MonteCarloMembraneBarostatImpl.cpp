@@ -74,7 +74,7 @@ void MonteCarloMembraneBarostatImpl::updateContextState(ContextImpl& context) {
     
     // Compute the current potential energy.
     
-    double initialEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double initialEnergy = context.calcPotentialEnergy();
     double pressure = context.getParameter(MonteCarloMembraneBarostat::Pressure())*(AVOGADRO*1e-25);
     double tension = context.getParameter(MonteCarloMembraneBarostat::SurfaceTension())*(AVOGADRO*1e-25);
     
@@ -119,7 +119,7 @@ void MonteCarloMembraneBarostatImpl::updateContextState(ContextImpl& context) {
     
     // Compute the energy of the modified system.
     
-    double finalEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double finalEnergy = context.calcPotentialEnergy();
     double kT = BOLTZ*owner.getTemperature();
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - tension*deltaArea - context.getMolecules().size()*kT*std::log(newVolume/volume);
     if (w > 0 && genrand_real2(random) > std::exp(-w/kT)) {
@@ -48,7 +48,7 @@ using std::stringstream;
 using std::vector;
 
 NonbondedForce::NonbondedForce() : nonbondedMethod(NoCutoff), cutoffDistance(1.0), switchingDistance(-1.0), rfDielectric(78.3),
-        ewaldErrorTol(5e-4), alpha(0.0), useSwitchingFunction(false), useDispersionCorrection(true), recipForceGroup(-1), nx(0), ny(0), nz(0) {
+        ewaldErrorTol(5e-4), alpha(0.0), softcoreAlpha(0.5), useSwitchingFunction(false), useDispersionCorrection(true), recipForceGroup(-1), nx(0), ny(0), nz(0) {
 }
 
 NonbondedForce::NonbondedMethod NonbondedForce::getNonbondedMethod() const {
@@ -132,6 +132,32 @@ void NonbondedForce::setParticleParameters(int index, double charge, double sigm
     particles[index].epsilon = epsilon;
 }
 
+bool NonbondedForce::isParticleAlchemical(int index) const {
+    ASSERT_VALID_INDEX(index, particles);
+    return particles[index].alchemical;
+}
+
+void NonbondedForce::setParticleAlchemical(int index, bool alchemical) {
+    ASSERT_VALID_INDEX(index, particles);
+    particles[index].alchemical = alchemical;
+}
+
+int NonbondedForce::getNumAlchemicalParticles() const {
+    int count = 0;
+    for (int i = 0; i < (int) particles.size(); i++)
+        if (particles[i].alchemical)
+            count++;
+    return count;
+}
+
+double NonbondedForce::getSoftcoreAlpha() const {
+    return softcoreAlpha;
+}
+
+void NonbondedForce::setSoftcoreAlpha(double alpha) {
+    softcoreAlpha = alpha;
+}
+
 int NonbondedForce::addException(int particle1, int particle2, double chargeProd, double sigma, double epsilon, bool replace) {
     map<pair<int, int>, int>::iterator iter = exceptionMap.find(pair<int, int>(particle1, particle2));
     int newIndex;
@@ -240,3 +266,7 @@ void NonbondedForce::setReciprocalSpaceForceGroup(int group) {
 void NonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
+
+void NonbondedForce::updateParametersInContext(Context& context, const vector<int>& particles, const vector<int>& exceptions) {
+    dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context), particles, exceptions);
+}
@@ -101,9 +101,20 @@ void NonbondedForceImpl::initialize(ContextImpl& context) {
         if (owner.getNonbondedMethod() == NonbondedForce::Ewald && (boxVectors[1][0] != 0.0 || boxVectors[2][0] != 0.0 || boxVectors[2][1] != 0))
             throw OpenMMException("NonbondedForce: Ewald is not supported with non-rectangular boxes.  Use PME instead.");
     }
+    if (owner.getSoftcoreAlpha() < 0)
+        throw OpenMMException("NonbondedForce: The soft-core alpha parameter cannot be negative.");
     kernel.getAs<CalcNonbondedForceKernel>().initialize(context.getSystem(), owner);
 }
 
+void NonbondedForceImpl::initializeClone(ContextImpl& context, ContextImpl& originalContext, ForceImpl& original) {
+    // The original was validated when it was created, so only the kernel needs to be set up.
+
+    kernel = context.getPlatform().createKernel(CalcNonbondedForceKernel::Name(), context);
+    const CalcNonbondedForceKernel& originalKernel = dynamic_cast<NonbondedForceImpl&>(original).kernel.getAs<CalcNonbondedForceKernel>();
+    if (!kernel.getAs<CalcNonbondedForceKernel>().initializeFromKernel(context.getSystem(), owner, originalKernel))
+        ForceImpl::initializeClone(context, originalContext, original);
+}
+
 double NonbondedForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
     bool includeDirect = ((groups&(1<<owner.getForceGroup())) != 0);
     bool includeReciprocal = includeDirect;
@@ -112,6 +123,34 @@ double NonbondedForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includ
     return kernel.getAs<CalcNonbondedForceKernel>().execute(context, includeForces, includeEnergy, includeDirect, includeReciprocal);
 }
 
+bool NonbondedForceImpl::calcEnergyChange(ContextImpl& context, const vector<int>& particles, const vector<Vec3>& newPositions,
+        int groups, double& energyChange) {
+    bool includeDirect = ((groups&(1<<owner.getForceGroup())) != 0);
+    bool includeReciprocal = includeDirect;
+    if (owner.getReciprocalSpaceForceGroup() >= 0)
+        includeReciprocal = ((groups&(1<<owner.getReciprocalSpaceForceGroup())) != 0);
+    if (!includeDirect && !includeReciprocal) {
+        energyChange = 0.0;
+        return true;
+    }
+    return kernel.getAs<CalcNonbondedForceKernel>().computeEnergyChange(context, particles, newPositions, includeDirect, includeReciprocal, energyChange);
+}
+
+map<string, double> NonbondedForceImpl::getDefaultParameters() {
+    map<string, double> parameters;
+    if (owner.getNumAlchemicalParticles() > 0) {
+        parameters[NonbondedForce::LambdaSterics()] = 1.0;
+        parameters[NonbondedForce::LambdaElectrostatics()] = 1.0;
+    }
+    return parameters;
+}
+
+int NonbondedForceImpl::getEnergyPolynomialDegree(const string& parameter) {
+    if (parameter == NonbondedForce::LambdaElectrostatics())
+        return 2;
+    return -1;
+}
+
 std::vector<std::string> NonbondedForceImpl::getKernelNames() {
     std::vector<std::string> names;
     names.push_back(CalcNonbondedForceKernel::Name());
@@ -217,19 +256,19 @@ double NonbondedForceImpl::evalIntegral(double r, double rs, double rc, double s
     );
 }
 
-double NonbondedForceImpl::calcDispersionCorrection(const System& system, const NonbondedForce& force) {
+double NonbondedForceImpl::calcDispersionCorrection(const System& system, const NonbondedForce& force, double lambdaSterics) {
     if (force.getNonbondedMethod() == NonbondedForce::NoCutoff || force.getNonbondedMethod() == NonbondedForce::CutoffNonPeriodic)
         return 0.0;
     
-    // Identify all particle classes (defined by sigma and epsilon), and count the number of
-    // particles in each class.
+    // Identify all particle classes (defined by sigma, epsilon, and whether the particle is alchemical), and count
+    // the number of particles in each class.
 
-    map<pair<double, double>, int> classCounts;
+    map<pair<pair<double, double>, bool>, int> classCounts;
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge, sigma, epsilon;
         force.getParticleParameters(i, charge, sigma, epsilon);
-        pair<double, double> key = make_pair(sigma, epsilon);
-        map<pair<double, double>, int>::iterator entry = classCounts.find(key);
+        pair<pair<double, double>, bool> key = make_pair(make_pair(sigma, epsilon), force.isParticleAlchemical(i));
+        map<pair<pair<double, double>, bool>, int>::iterator entry = classCounts.find(key);
         if (entry == classCounts.end())
             classCounts[key] = 1;
         else
@@ -242,9 +281,9 @@ double NonbondedForceImpl::calcDispersionCorrection(const System& system, const
     bool useSwitch = force.getUseSwitchingFunction();
     double cutoff = force.getCutoffDistance();
     double switchDist = force.getSwitchingDistance();
-    for (map<pair<double, double>, int>::const_iterator entry = classCounts.begin(); entry != classCounts.end(); ++entry) {
-        double sigma = entry->first.first;
-        double epsilon = entry->first.second;
+    for (map<pair<pair<double, double>, bool>, int>::const_iterator entry = classCounts.begin(); entry != classCounts.end(); ++entry) {
+        double sigma = entry->first.first.first;
+        double epsilon = entry->first.first.second;
         double count = (double) entry->second;
         count *= (count + 1) / 2;
         double sigma2 = sigma*sigma;
@@ -254,10 +293,12 @@ double NonbondedForceImpl::calcDispersionCorrection(const System& system, const
         if (useSwitch)
             sum3 += count*epsilon*(evalIntegral(cutoff, switchDist, cutoff, sigma)-evalIntegral(switchDist, switchDist, cutoff, sigma));
     }
-    for (map<pair<double, double>, int>::const_iterator class1 = classCounts.begin(); class1 != classCounts.end(); ++class1)
-        for (map<pair<double, double>, int>::const_iterator class2 = classCounts.begin(); class2 != class1; ++class2) {
-            double sigma = 0.5*(class1->first.first+class2->first.first);
-            double epsilon = sqrt(class1->first.second*class2->first.second);
+    for (map<pair<pair<double, double>, bool>, int>::const_iterator class1 = classCounts.begin(); class1 != classCounts.end(); ++class1)
+        for (map<pair<pair<double, double>, bool>, int>::const_iterator class2 = classCounts.begin(); class2 != class1; ++class2) {
+            double sigma = 0.5*(class1->first.first.first+class2->first.first.first);
+            double epsilon = sqrt(class1->first.first.second*class2->first.first.second);
+            if (class1->first.second != class2->first.second)
+                epsilon *= lambdaSterics;
             double count = (double) class1->second;
             count *= (double) class2->second;
             double sigma2 = sigma*sigma;
@@ -278,3 +319,15 @@ double NonbondedForceImpl::calcDispersionCorrection(const System& system, const
 void NonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
     kernel.getAs<CalcNonbondedForceKernel>().copyParametersToContext(context, owner);
 }
+
+void NonbondedForceImpl::updateParametersInContext(ContextImpl& context, const vector<int>& particles, const vector<int>& exceptions) {
+    if (owner.getNumParticles() != context.getSystem().getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    for (int i = 0; i < (int) particles.size(); i++)
+        if (particles[i] < 0 || particles[i] >= owner.getNumParticles())
+            throw OpenMMException("updateParametersInContext: Illegal particle index");
+    for (int i = 0; i < (int) exceptions.size(); i++)
+        if (exceptions[i] < 0 || exceptions[i] >= owner.getNumExceptions())
+            throw OpenMMException("updateParametersInContext: Illegal exception index");
+    kernel.getAs<CalcNonbondedForceKernel>().copyChangedParametersToContext(context, owner, particles, exceptions);
+}
@@ -33,14 +33,17 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include "windowsExportCpu.h"
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace OpenMM {
 
 /**
- * This class simplifies the management of a set of related CompiledExpressions that share variables.
+ * This class simplifies the management of a set of related CompiledExpressions and CompiledVectorExpressions
+ * that share variables.
  */
 class OPENMM_EXPORT_CPU CompiledExpressionSet {
 public:
@@ -49,21 +52,36 @@ public:
      * Add a CompiledExpression to the set.
      */
     void registerExpression(Lepton::CompiledExpression& expression);
+    /**
+     * Add a CompiledVectorExpression to the set.
+     */
+    void registerExpression(Lepton::CompiledVectorExpression& expression);
     /**
      * Get the index of a particular variable.
      */
     int getVariableIndex(const std::string& name);
     /**
-     * Set the value of a variable on every CompiledExpression.
+     * Set the value of a variable on every CompiledExpression, and on every element of every
+     * CompiledVectorExpression.
      * 
      * @param index    the index of the variable, as returned by getVariableIndex()
      * @param value    the value to set it to
      */
     void setVariable(int index, double value);
+    /**
+     * Set a different value of a variable for each element of every CompiledVectorExpression.
+     * CompiledExpressions are not affected.
+     *
+     * @param index    the index of the variable, as returned by getVariableIndex()
+     * @param values   the values to set it to.  This must contain one value for each element of the vectors.
+     */
+    void setVectorVariable(int index, const float* values);
 private:
     std::vector<Lepton::CompiledExpression*> expressions;
+    std::vector<Lepton::CompiledVectorExpression*> vectorExpressions;
     std::vector<std::string> variables;
     std::vector<std::vector<double*> > variableReferences;
+    std::vector<std::vector<std::pair<float*, int> > > vectorVariableReferences;
 };
 
 } // namespace OpenMM
@@ -50,8 +50,17 @@ public:
     CpuBondForce();
     /**
      * Analyze the set of bonds and decide which to compute with each thread.
+     *
+     * If frozen is not empty, frozen[i] should be true for every atom that never moves (that is, has zero mass).
+     * Bonds made up entirely of frozen atoms are then computed once and cached, and only recomputed when one of
+     * their atoms is moved or clearFrozenBonds() is called.
      */
-    void initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads);
+    void initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads,
+            const std::vector<char>& frozen=std::vector<char>());
+    /**
+     * Discard the cached contribution of bonds between frozen atoms.  Call this when their parameters change.
+     */
+    void clearFrozenBonds();
     /**
      * Compute the forces from all bonds.
      */
@@ -70,6 +79,10 @@ private:
     ThreadPool* threads;
     std::vector<std::vector<int> > threadBonds;
     std::vector<int> extraBonds;
+    std::vector<int> frozenBonds, frozenAtoms;
+    std::vector<OpenMM::RealVec> frozenPositions, frozenForces;
+    RealOpenMM frozenEnergy;
+    bool frozenBondsValid;
 };
 
 } // namespace OpenMM
@@ -57,6 +57,7 @@ private:
     std::vector<double> threadEnergy;
     // Workspace vectors
     std::vector<std::vector<float> > values, dEdV;
+    std::vector<std::vector<char> > blockExclusionMasks;
     // The following variables are used to make information accessible to the individual threads.
     int numberOfAtoms;
     float* posq;
@@ -91,13 +92,12 @@ private:
      * @param index            the index of the value to compute
      * @param atom1            the index of the first atom in the pair
      * @param atom2            the index of the second atom in the pair
+     * @param r                the distance between the atoms
      * @param data             workspace for the current thread
-     * @param posq             atom coordinates
      * @param atomParameters   atomParameters[atomIndex][paramterIndex]
      */
 
-    void calculateOnePairValue(int index, int atom1, int atom2, ThreadData& data, float* posq, RealOpenMM** atomParameters,
-                               std::vector<float>& valueArray, const fvec4& boxSize, const fvec4& invBoxSize);
+    void calculateOnePairValue(int index, int atom1, int atom2, float r, ThreadData& data, RealOpenMM** atomParameters, std::vector<float>& valueArray);
 
     /**
      * Calculate an energy term of type SingleParticle
@@ -135,15 +135,16 @@ private:
      * @param index            the index of the term to compute
      * @param atom1            the index of the first atom in the pair
      * @param atom2            the index of the second atom in the pair
+     * @param deltaR           the displacement from the second atom to the first one
+     * @param r                the distance between the atoms
      * @param data             workspace for the current thread
-     * @param posq             atom coordinates
      * @param atomParameters   atomParameters[atomIndex][paramterIndex]
      * @param forces           forces on atoms are added to this
      * @param totalEnergy      the energy contribution is added to this
      */
 
-    void calculateOnePairEnergyTerm(int index, int atom1, int atom2, ThreadData& data, float* posq, RealOpenMM** atomParameters,
-                               float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+    void calculateOnePairEnergyTerm(int index, int atom1, int atom2, const fvec4& deltaR, float r, ThreadData& data, RealOpenMM** atomParameters,
+                               float* forces, double& totalEnergy);
 
     /**
      * Apply the chain rule to compute forces on atoms
@@ -163,6 +164,8 @@ private:
      * 
      * @param atom1            the index of the first atom in the pair
      * @param atom2            the index of the second atom in the pair
+     * @param deltaR           the displacement from the second atom to the first one
+     * @param r                the distance between the atoms
      * @param data             workspace for the current thread
      * @param posq             atom coordinates
      * @param atomParameters   atomParameters[atomIndex][paramterIndex]
@@ -170,8 +173,8 @@ private:
      * @param isExcluded       specifies whether this is an excluded pair
      */
 
-    void calculateOnePairChainRule(int atom1, int atom2, ThreadData& data, float* posq, RealOpenMM** atomParameters,
-                               float* forces, bool isExcluded, const fvec4& boxSize, const fvec4& invBoxSize);
+    void calculateOnePairChainRule(int atom1, int atom2, fvec4 deltaR, float r, ThreadData& data, float* posq, RealOpenMM** atomParameters,
+                               float* forces, bool isExcluded);
 
     /**
      * Compute the displacement and squared distance between two points, optionally using
@@ -179,21 +182,48 @@ private:
      */
     void getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const;
 
+    /**
+     * Get the positions of the four atoms in a neighbor list block.
+     */
+    void getBlockPositions(int blockIndex, fvec4& x, fvec4& y, fvec4& z) const;
+
+    /**
+     * Compute the displacements from the atoms in a block to one of its neighbors, and the
+     * corresponding distances.  The return value is a bitmask in which bit k is set if the
+     * neighbor interacts with atom k of the block: the neighbor list does not exclude the
+     * pair, and it is inside the cutoff.
+     */
+    int getInteractingAtoms(int blockIndex, int neighborIndex, const fvec4& blockAtomX, const fvec4& blockAtomY, const fvec4& blockAtomZ,
+                            fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r, const fvec4& boxSize, const fvec4& invBoxSize) const;
+
+    /**
+     * Record which pairs in a neighbor list block are excluded by the force.  These masks are
+     * found once per evaluation, then used by all the stages that loop over pairs.
+     */
+    void findBlockExclusions(int blockIndex);
+
 public:
 
     /**
      * Construct a new CpuCustomGBForce.
+     *
+     * Each element of valueDerivExpressions computes all the derivatives of one computed value with a single
+     * evaluation.  For the first value its only output is the derivative with respect to r.  For each later value,
+     * the outputs are the derivatives with respect to every previous value, followed by the derivatives with
+     * respect to x, y, and z.
+     *
+     * Each element of energyExpressions computes an energy term as its first output, followed by its derivatives.
+     * For a single particle term, these are the derivatives with respect to every computed value, then x, y, and z.
+     * For a particle pair term, they are the derivative with respect to r, then the derivatives with respect to
+     * each computed value of the first and second particles.
      */
 
      CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
                         const std::vector<Lepton::CompiledExpression>& valueExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
+                        const std::vector<Lepton::CompiledExpression>& valueDerivExpressions,
                         const std::vector<std::string>& valueNames,
                         const std::vector<CustomGBForce::ComputationType>& valueTypes,
                         const std::vector<Lepton::CompiledExpression>& energyExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyGradientExpressions,
                         const std::vector<CustomGBForce::ComputationType>& energyTypes,
                         const std::vector<std::string>& parameterNames, ThreadPool& threads);
 
@@ -237,21 +267,15 @@ class CpuCustomGBForce::ThreadData {
 public:
     ThreadData(int numAtoms, int numThreads, int threadIndex,
                const std::vector<Lepton::CompiledExpression>& valueExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
+               const std::vector<Lepton::CompiledExpression>& valueDerivExpressions,
                const std::vector<std::string>& valueNames,
                const std::vector<Lepton::CompiledExpression>& energyExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyGradientExpressions,
                const std::vector<std::string>& parameterNames);
     CompiledExpressionSet expressionSet;
     std::vector<Lepton::CompiledExpression> valueExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueDerivExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueGradientExpressions;
+    std::vector<Lepton::CompiledExpression> valueDerivExpressions;
     std::vector<int> valueIndex;
     std::vector<Lepton::CompiledExpression> energyExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyDerivExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyGradientExpressions;
     std::vector<int> paramIndex;
     std::vector<int> particleParamIndex;
     std::vector<int> particleValueIndex;
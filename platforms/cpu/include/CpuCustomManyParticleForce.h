@@ -162,44 +162,41 @@ public:
 class CpuCustomManyParticleForce::ParticleTermInfo {
 public:
     std::string name;
-    int atom, component, variableIndex;
-    Lepton::CompiledExpression forceExpression;
-    ParticleTermInfo(const std::string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    int atom, component, variableIndex, outputIndex;
+    ParticleTermInfo(const std::string& name, int atom, int component, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::DistanceTermInfo {
 public:
     std::string name;
-    int p1, p2, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int p1, p2, variableIndex, outputIndex;
     int delta;
     float deltaSign;
-    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::AngleTermInfo {
 public:
     std::string name;
-    int p1, p2, p3, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int p1, p2, p3, variableIndex, outputIndex;
     int delta1, delta2;
     float delta1Sign, delta2Sign;
-    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::DihedralTermInfo {
 public:
     std::string name;
-    int p1, p2, p3, p4, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int p1, p2, p3, p4, variableIndex, outputIndex;
     int delta1, delta2, delta3;
-    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, int outputIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::ThreadData {
 public:
     CompiledExpressionSet expressionSet;
     Lepton::CompiledExpression energyExpression;
+    Lepton::CompiledExpression forceExpression;
     std::vector<std::vector<int> > particleParamIndices;
     std::vector<int> permutedParticles;
     std::vector<std::pair<int, int> > deltaPairs;
@@ -26,10 +26,12 @@
 #define OPENMM_CPU_CUSTOM_NONBONDED_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CompiledExpressionSet.h"
 #include "CpuNeighborList.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include <map>
 #include <set>
 #include <utility>
@@ -44,9 +46,31 @@ class CpuCustomNonbondedForce {
 
          Constructor
 
+         @param energyForceExpression  an expression whose first output is the energy and whose second output is dE/dr
+         @param forceExpression        an expression that computes only dE/dr
+         @param parameterNames         the names of the per-particle parameters
+         @param exclusions             the exclusions for each particle
+         @param threads                the thread pool to use
+
+         --------------------------------------------------------------------------------------- */
+
+       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyForceExpression, const Lepton::CompiledExpression& forceExpression,
+                                   const std::vector<std::string>& parameterNames, const std::vector<std::set<int> >& exclusions, ThreadPool& threads);
+
+      /**---------------------------------------------------------------------------------------
+
+         Constructor.  Interactions are collected into batches, and the expressions are
+         evaluated for a whole batch of pairs at once with one element per pair.
+
+         @param energyForceExpression  an expression whose first output is the energy and whose second output is dE/dr
+         @param forceExpression        an expression that computes only dE/dr
+         @param parameterNames         the names of the per-particle parameters
+         @param exclusions             the exclusions for each particle
+         @param threads                the thread pool to use
+
          --------------------------------------------------------------------------------------- */
 
-       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
+       CpuCustomNonbondedForce(const Lepton::CompiledVectorExpression& energyForceExpression, const Lepton::CompiledVectorExpression& forceExpression,
                                    const std::vector<std::string>& parameterNames, const std::vector<std::set<int> >& exclusions, ThreadPool& threads);
 
       /**---------------------------------------------------------------------------------------
@@ -70,10 +94,11 @@ class CpuCustomNonbondedForce {
 
       /**---------------------------------------------------------------------------------------
 
-         Restrict the force to a list of interaction groups.
+         Restrict the force to a list of interaction groups.  When a cutoff is used, the
+         interactions are found from the neighbor list and filtered by group membership.
+         Otherwise, an explicit list of all interacting pairs is built.
 
-         @param distance            the cutoff distance
-         @param neighbors           the neighbor list to use
+         @param groups              the sets of particles forming each interaction group
 
          --------------------------------------------------------------------------------------- */
 
@@ -101,6 +126,24 @@ class CpuCustomNonbondedForce {
 
       void setPeriodic(RealVec* periodicBoxVectors);
 
+      /**---------------------------------------------------------------------------------------
+
+         Look up the parts of the interaction that depend only on per-particle and global
+         parameters from a table, rather than evaluating them for every pair.  The table holds
+         one set of values for every pair of parameter classes, and is recomputed whenever the
+         global parameters change.  When this is used, the energy and force expressions passed
+         to the constructor must be written in terms of the table values.
+
+         @param tableNames          the name of the variable for each table value
+         @param tableExpressions    the expression for computing each table value
+         @param particleClass       the parameter class of each particle
+         @param classParameters     the per-particle parameters for each class
+
+         --------------------------------------------------------------------------------------- */
+
+      void setUseParameterTable(const std::vector<std::string>& tableNames, const std::vector<Lepton::CompiledExpression>& tableExpressions,
+                                const std::vector<int>& particleClass, const std::vector<std::vector<double> >& classParameters);
+
       /**---------------------------------------------------------------------------------------
 
          Calculate custom pair ixn
@@ -137,8 +180,17 @@ private:
     const std::vector<std::set<int> > exclusions;
     std::vector<ThreadData*> threadData;
     std::vector<std::string> paramNames;
+    std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
     std::vector<std::pair<int, int> > groupInteractions;
+    int numGroupMaskWords;
+    std::vector<unsigned int> groupMask1, groupMask2;
     std::vector<double> threadEnergy;
+    bool useTable, tableIsValid;
+    std::vector<Lepton::CompiledExpression> tableExpressions;
+    std::vector<int> particleClass;
+    std::vector<std::vector<double> > classParameters;
+    std::vector<double> parameterTable;
+    std::map<std::string, double> tableGlobalParameters;
     // The following variables are used to make information accessible to the individual threads.
     int numberOfAtoms;
     float* posq;
@@ -154,6 +206,49 @@ private:
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex);
 
+    /**
+     * Compute the table of values that depend only on the parameters.
+     */
+    void computeParameterTable();
+
+    /**
+     * Build the explicit list of interacting pairs used for interaction groups without a cutoff.
+     */
+    void createGroupInteractions();
+
+    /**
+     * Get the number of interaction groups that include the interaction between two atoms.
+     */
+    int getNumGroupsContaining(int atom1, int atom2) const;
+
+    /**
+     * Set the table values for a pair of atoms.
+     */
+    void setTableValues(int atom1, int atom2, ThreadData& data) const;
+
+    /**
+     * Calculate the interaction between two atoms, or add it to the current batch if vector expressions are used.
+     * 
+     * @param atom1            the index of the first atom
+     * @param atom2            the index of the second atom
+     * @param count            the number of times to include the interaction
+     * @param data             workspace for the current thread
+     * @param forces           force array (forces added)
+     * @param totalEnergy      total energy
+     * @param boxSize          the size of the periodic box
+     * @param invBoxSize       the inverse size of the periodic box
+     */
+    void calculatePair(int atom1, int atom2, int count, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+    /**
+     * Calculate all interactions in the current batch and empty it.
+     * 
+     * @param data             workspace for the current thread
+     * @param forces           force array (forces added)
+     * @param totalEnergy      total energy
+     */
+    void calculateBatchIxn(ThreadData& data, float* forces, double& totalEnergy);
+
     /**
      * Calculate the interaction between two atoms.
      * 
@@ -176,13 +271,23 @@ private:
 
 class CpuCustomNonbondedForce::ThreadData {
 public:
-    ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const std::vector<std::string>& parameterNames);
-    Lepton::CompiledExpression energyExpression;
+    ThreadData(const Lepton::CompiledExpression& energyForceExpression, const Lepton::CompiledExpression& forceExpression, const std::vector<std::string>& parameterNames);
+    ThreadData(const Lepton::CompiledVectorExpression& energyForceExpression, const Lepton::CompiledVectorExpression& forceExpression, const std::vector<std::string>& parameterNames);
+    void findVariables(const std::vector<std::string>& parameterNames);
+    Lepton::CompiledExpression energyForceExpression;
     Lepton::CompiledExpression forceExpression;
-    std::vector<double*> energyParticleParams;
-    std::vector<double*> forceParticleParams;
-    double* energyR;
-    double* forceR;
+    Lepton::CompiledVectorExpression vectorEnergyForceExpression;
+    Lepton::CompiledVectorExpression vectorForceExpression;
+    CompiledExpressionSet expressionSet;
+    std::vector<int> particleParamIndex;
+    std::vector<int> tableParamIndex;
+    int rIndex;
+    // The following variables hold the batch of interactions waiting to be computed with the vector expressions.
+    bool useVector;
+    int batchWidth, batchSize;
+    int batchAtom1[8], batchAtom2[8], batchCount[8];
+    float batchDelta[8][4];
+    float batchR[8], batchValues[8];
 };
 
 } // namespace OpenMM
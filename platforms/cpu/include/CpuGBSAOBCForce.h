@@ -26,6 +26,7 @@
 #define OPENMM_CPU_GBSAOBC_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuNeighborList.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include <set>
@@ -43,8 +44,10 @@ public:
      * Set the force to use a cutoff.
      * 
      * @param distance    the cutoff distance
+     * @param neighbors   the neighbor list to use.  It must have a block size of 4, and must not
+     *                    exclude any pairs of atoms, since GBSA interactions are never excluded.
      */
-    void setUseCutoff(float distance);
+    void setUseCutoff(float distance, const CpuNeighborList& neighbors);
 
     /**
      * 
@@ -87,10 +90,12 @@ public:
      *
      * @param posq             atom coordinates and charges
      * @param forces           force array (forces added)
+     * @param includeForces    whether to compute forces.  If this is false, the passes that only
+     *                         contribute to forces are skipped, and totalEnergy must not be NULL.
      * @param totalEnergy      total energy
      * @param threads          the thread pool to use
      */
-    void computeForce(const AlignedArray<float>& posq, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+    void computeForce(const AlignedArray<float>& posq, std::vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads);
 
     /**
      * This routine contains the code executed by each thread.
@@ -100,10 +105,13 @@ public:
 private:
     bool cutoff;
     bool periodic;
+    const CpuNeighborList* neighborList;
     float periodicBoxSize[3];
     float cutoffDistance, soluteDielectric, solventDielectric, surfaceAreaFactor;
     std::vector<std::pair<float, float> > particleParams;        
     AlignedArray<float> bornRadii;
+    AlignedArray<float> bornForces;
+    std::vector<AlignedArray<float> > threadBornSums;
     std::vector<AlignedArray<float> > threadBornForces;
     AlignedArray<float> obcChain;
     std::vector<double> threadEnergy;
@@ -112,7 +120,7 @@ private:
     // The following variables are used to make information accessible to the individual threads.
     float const* posq;
     std::vector<AlignedArray<float> >* threadForce;
-    bool includeEnergy;
+    bool includeForces, includeEnergy;
     void* atomicCounter;
   
     static const int NUM_TABLE_POINTS;
@@ -124,6 +132,35 @@ private:
      * periodic boundary conditions.
      */
     void getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const;
+
+    /**
+     * Get the number of blocks of four atoms that the interactions are divided into.
+     */
+    int getNumBlocks() const;
+
+    /**
+     * Get the atoms in a block.  On exit, atoms contains the index of each atom (padded with
+     * valid indices if the block is not full), and atomIndex contains the index of each atom
+     * (padded with indices >= the number of particles).  The return value is the number of
+     * neighbors to loop over.
+     */
+    int getBlockAtoms(int blockIndex, int* atoms, ivec4& atomIndex) const;
+
+    /**
+     * Get one neighbor of a block.  Each pair of atoms is visited only once, so the neighbor
+     * interacts only with the atoms of the block that are flagged in include.
+     */
+    int getBlockNeighbor(int blockIndex, int neighborIndex, const ivec4& atomIndex, ivec4& include) const;
+
+    /**
+     * Compute the contribution of atoms J to the Born radius sums of atoms I.
+     */
+    fvec4 computeBornRadiusTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const ivec4& include);
+
+    /**
+     * Compute the factor that multiplies the Born force of atoms I to give the force between atoms I and J.
+     */
+    fvec4 computeBornForceTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const ivec4& include);
     
     /**
      * Evaluate log(x) using a lookup table for speed.
@@ -42,6 +42,7 @@
 #include "CpuNonbondedForce.h"
 #include "CpuPlatform.h"
 #include "openmm/kernels.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/System.h"
 
 namespace OpenMM {
@@ -186,6 +187,15 @@ public:
      * @param force      the NonbondedForce this kernel will be used for
      */
     void initialize(const System& system, const NonbondedForce& force);
+    /**
+     * Initialize the kernel for a Context that is a clone of another one, copying the data from the original kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the NonbondedForce this kernel will be used for
+     * @param original   the kernel of the original Context to copy from
+     * @return true, since this kernel always supports being initialized this way
+     */
+    bool initializeFromKernel(const System& system, const NonbondedForce& force, const CalcNonbondedForceKernel& original);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -204,20 +214,83 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a subset of particles and exceptions have changed.
+     *
+     * @param context     the context to copy parameters to
+     * @param force       the NonbondedForce to copy the parameters from
+     * @param particles   the indices of the particles whose parameters have changed
+     * @param exceptions  the indices of the exceptions whose parameters have changed
+     */
+    void copyChangedParametersToContext(ContextImpl& context, const NonbondedForce& force, const std::vector<int>& particles, const std::vector<int>& exceptions);
+    /**
+     * Compute how the energy would change if a subset of particles were moved, considering only the interactions
+     * that involve those particles.  This is not supported for Ewald or PME, since the reciprocal space energy
+     * depends on every particle.  The coordinates of all particles are converted to single precision once for
+     * each state of the Context, after which each call only costs time proportional to the number of moved particles.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param particles      the indices of the particles to move
+     * @param newPositions   the new positions of those particles
+     * @param includeDirect  true if direct space interactions should be included
+     * @param includeReciprocal  true if reciprocal space interactions should be included
+     * @param energyChange   on exit, if this returns true, the change in energy
+     * @return true if the change was computed
+     */
+    bool computeEnergyChange(ContextImpl& context, const std::vector<int>& particles, const std::vector<Vec3>& newPositions,
+            bool includeDirect, bool includeReciprocal, double& energyChange);
 private:
     class PmeIO;
+    /**
+     * Record the charges of all particles and exceptions, with the charge of every alchemical
+     * particle multiplied by lambdaElectrostatics.
+     */
+    void setAlchemicalCharges(double lambdaElectrostatics);
+    /**
+     * Sort the 1-4 interactions into ones between two frozen particles and all others, and record the list of frozen particles.
+     */
+    void findFrozenInteractions();
+    /**
+     * Compute the direct space interactions between pairs of frozen particles, unless the cached values
+     * are still valid.
+     */
+    void computeFrozenInteractions(ContextImpl& context);
+    /**
+     * Record the single precision coordinates and charges used by computeEnergyChange(), along with the two
+     * particles that have moved furthest since the neighbor list was built.
+     */
+    void updateEnergyChangeData(ContextImpl& context);
     CpuPlatform::PlatformData& data;
     int numParticles, num14;
     int **bonded14IndexArray;
     double **bonded14ParamArray;
-    double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldSelfEnergy, dispersionCoefficient;
+    std::vector<int*> active14IndexArray, frozen14IndexArray;
+    std::vector<double*> active14ParamArray, frozen14ParamArray;
+    std::vector<int> frozenParticles;
+    std::vector<RealVec> frozenPositions, frozenForces;
+    std::vector<AlignedArray<float> > frozenThreadForce;
+    RealVec frozenBoxVectors[3];
+    double frozenEnergy, frozenLambdaSterics;
+    bool frozenInteractionsValid;
+    double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldSelfEnergy, dispersionCoefficient, decoupledDispersionCoefficient;
+    double softcoreAlpha, lambdaElectrostatics;
     int kmax[3], gridSize[3];
-    bool useSwitchingFunction, useOptimizedPme, hasInitializedPme;
+    bool useSwitchingFunction, useOptimizedPme, hasInitializedPme, hasAlchemicalParticles;
     std::vector<std::set<int> > exclusions;
     std::vector<std::pair<float, float> > particleParams;
+    std::vector<float> alchemical;
+    std::vector<double> particleCharges, exceptionChargeProds;
+    std::vector<int> exception14Index;
     std::vector<RealVec> lastPositions;
+    std::vector<float> changePosq;
+    std::vector<std::vector<int> > particle14s;
+    std::vector<char> isMovedParticle;
+    double changeDisplacement2[2];
+    int changeDisplacementIndex[2], changeStateVersion;
+    bool changeDataValid;
     NonbondedMethod nonbondedMethod;
     CpuNeighborList* neighborList;
+    CpuNeighborList* frozenNeighborList;
     CpuNonbondedForce* nonbonded;
     Kernel optimizedPme;
 };
@@ -236,6 +309,15 @@ public:
      * @param force      the CustomNonbondedForce this kernel will be used for
      */
     void initialize(const System& system, const CustomNonbondedForce& force);
+    /**
+     * Initialize the kernel for a Context that is a clone of another one, copying the data from the original kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomNonbondedForce this kernel will be used for
+     * @param original   the kernel of the original Context to copy from
+     * @return true, since this kernel always supports being initialized this way
+     */
+    bool initializeFromKernel(const System& system, const CustomNonbondedForce& force, const CalcCustomNonbondedForceKernel& original);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -252,17 +334,35 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a subset of particles have changed.
+     *
+     * @param context     the context to copy parameters to
+     * @param force       the CustomNonbondedForce to copy the parameters from
+     * @param particles   the indices of the particles whose parameters have changed
+     */
+    void copyChangedParametersToContext(ContextImpl& context, const CustomNonbondedForce& force, const std::vector<int>& particles);
 private:
+    /**
+     * Create the object that computes the interaction, or update it to reflect the current particle parameters.
+     */
+    void createInteraction();
     CpuPlatform::PlatformData& data;
     int numParticles;
     double **particleParamArray;
     double nonbondedCutoff, switchingDistance, periodicBoxSize[3], longRangeCoefficient;
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
     CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData longRangeCorrectionData;
     std::map<std::string, double> globalParamValues;
     std::vector<std::set<int> > exclusions;
     std::vector<std::string> parameterNames, globalParameterNames;
     std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
+    Lepton::CompiledExpression energyForceExpression, forceExpression, tableEnergyForceExpression, tableForceExpression;
+    Lepton::CompiledVectorExpression energyForceVectorExpression, forceVectorExpression, tableEnergyForceVectorExpression, tableForceVectorExpression;
+    std::vector<Lepton::CompiledExpression> tableExpressions;
+    std::vector<std::string> tableNames;
+    bool usingParameterTable, useVectorExpressions;
     NonbondedMethod nonbondedMethod;
     CpuNeighborList* neighborList;
     CpuCustomNonbondedForce* nonbonded;
@@ -274,7 +374,7 @@ private:
 class CpuCalcGBSAOBCForceKernel : public CalcGBSAOBCForceKernel {
 public:
     CpuCalcGBSAOBCForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcGBSAOBCForceKernel(name, platform),
-            data(data) {
+            data(data), neighborList(NULL) {
     }
     ~CpuCalcGBSAOBCForceKernel();
     /**
@@ -304,6 +404,8 @@ private:
     CpuPlatform::PlatformData& data;
     std::vector<std::pair<float, float> > particleParams;
     CpuGBSAOBCForce obc;
+    CpuNeighborList* neighborList;
+    float cutoffDistance;
 };
 
 /**
@@ -47,12 +47,23 @@ public:
     class ThreadTask;
     class Voxels;
     CpuNeighborList(int blockSize);
+    /**
+     * Build the neighbor list.  If frozen is not empty, frozen[i] should be 1 for every atom that never moves.
+     * Pairs of two frozen atoms are then marked as excluded, or if onlyFrozenPairs is true, all other pairs are.
+     */
     void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
-            const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
+            const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads,
+            const std::vector<char>& frozen=std::vector<char>(), bool onlyFrozenPairs=false);
     int getNumBlocks() const;
     const std::vector<int>& getSortedAtoms() const;
     const std::vector<int>& getBlockNeighbors(int blockIndex) const;
     const std::vector<char>& getBlockExclusions(int blockIndex) const;
+    /**
+     * Get every atom the neighbor list pairs with a particular atom, not including excluded pairs.  The first call
+     * after the list is built creates an index of where each atom appears in it, so later calls only need to look
+     * at the entries involving that atom.
+     */
+    void getAtomNeighbors(int atom, std::vector<int>& neighbors) const;
     /**
      * This routine contains the code executed by each thread.
      */
@@ -63,11 +74,16 @@ private:
     std::vector<int> sortedAtoms;
     std::vector<std::vector<int> > blockNeighbors;
     std::vector<std::vector<char> > blockExclusions;
+    mutable std::vector<int> atomSortedIndex;
+    mutable std::vector<std::vector<std::pair<int, int> > > atomNeighborEntries;
+    mutable bool hasAtomIndex;
     // The following variables are used to make information accessible to the individual threads.
     float minx, maxx, miny, maxy, minz, maxz;
     std::vector<std::pair<int, int> > atomBins;
     Voxels* voxels;
     const std::vector<std::set<int> >* exclusions;
+    const std::vector<char>* frozen;
+    bool onlyFrozenPairs;
     const float* atomLocations;
     RealVec periodicBoxVectors[3];
     int numAtoms;
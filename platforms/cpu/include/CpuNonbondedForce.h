@@ -114,6 +114,35 @@ class CpuNonbondedForce {
       
       void setUsePME(float alpha, int meshSize[3]);
 
+      /**---------------------------------------------------------------------------------------
+      
+         Set the force to use a soft-core Lennard-Jones interaction between alchemical and
+         non-alchemical atoms.
+      
+         @param alchemical  alchemical[i] is 1 if atom i is alchemical and 0 otherwise
+         @param alpha       the soft-core alpha parameter
+         @param lambda      the current value of lambda_sterics
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setUseSoftcore(const std::vector<float>& alchemical, float alpha, float lambda);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Select which pairs of frozen atoms to compute.  Interactions between two frozen atoms
+         never change, so they can be computed once and cached.  This only affects the pairs
+         that are not taken from a neighbor list; the neighbor list should be built with the
+         same selection.
+      
+         @param frozen           frozen[i] is 1 if atom i is frozen and 0 otherwise.  If this
+                                 is empty, all pairs are computed.
+         @param onlyFrozenPairs  if true, compute only pairs of two frozen atoms.  If false,
+                                 compute all other pairs.
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setFrozenAtoms(const std::vector<char>& frozen, bool onlyFrozenPairs);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate Ewald ixn
@@ -144,13 +173,37 @@ class CpuNonbondedForce {
          @param exclusions       atom exclusion indices
                                  exclusions[atomIndex] contains the list of exclusions for that atom
          @param forces           force array (forces added)
+         @param includeForces    whether to compute forces.  If this is false, totalEnergy must not be NULL.
          @param totalEnergy      total energy
          @param threads          the thread pool to use
       
          --------------------------------------------------------------------------------------- */
           
       void calculateDirectIxn(int numberOfAtoms, float* posq, const std::vector<RealVec>& atomCoordinates, const std::vector<std::pair<float, float> >& atomParameters,
-            const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+            const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the energy of every direct space interaction that involves at least one atom
+         from a subset.  This is used to find how the energy changes when those atoms move.
+         Ewald summation and PME are not supported.  If useNeighborList is true, only pairs in the
+         neighbor list set with setUseCutoff() are considered, so it must include every pair that
+         is within the cutoff.  In that case the cost is proportional to the size of the subset
+         rather than the number of atoms.
+      
+         @param numberOfAtoms    number of atoms
+         @param posq             atom coordinates and charges
+         @param atomParameters   atom parameters (sigma/2, 2*sqrt(epsilon))
+         @param exclusions       atom exclusion indices
+                                 exclusions[atomIndex] contains the list of exclusions for that atom
+         @param subset           the indices of the atoms whose interactions should be included
+         @param useNeighborList  whether to find interacting pairs from the neighbor list
+         @param totalEnergy      total energy
+      
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateSubsetIxn(int numberOfAtoms, float* posq, const std::vector<std::pair<float, float> >& atomParameters,
+            const std::vector<std::set<int> >& exclusions, const std::vector<int>& subset, bool useNeighborList, double* totalEnergy);
 
     /**
      * This routine contains the code executed by each thread.
@@ -164,19 +217,25 @@ protected:
         bool triclinic;
         bool ewald;
         bool pme;
+        bool softcore;
         bool tableIsValid;
         const CpuNeighborList* neighborList;
+        const std::vector<char>* frozen;
+        bool onlyFrozenPairs;
         float recipBoxSize[3];
         RealVec periodicBoxVectors[3];
         AlignedArray<fvec4> periodicBoxVec4;
         float cutoffDistance, switchingDistance;
         float krf, crf;
         float alphaEwald;
+        float softcoreLambda, softcoreShift;
+        const float* alchemical;
         int numRx, numRy, numRz;
         int meshDim[3];
         std::vector<float> ewaldScaleTable;
         float ewaldDX, ewaldDXInv;
         std::vector<double> threadEnergy;
+        std::vector<char> inSubset;
         // The following variables are used to make information accessible to the individual threads.
         int numberOfAtoms;
         float* posq;
@@ -184,7 +243,7 @@ protected:
         std::pair<float, float> const* atomParameters;        
         std::set<int> const* exclusions;
         std::vector<AlignedArray<float> >* threadForce;
-        bool includeEnergy;
+        bool includeForces, includeEnergy;
         void* atomicCounter;
 
         static const float TWO_OVER_SQRT_PI;
@@ -202,6 +261,13 @@ protected:
          --------------------------------------------------------------------------------------- */
           
       void calculateOneIxn(int atom1, int atom2, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+      /**
+       * Get whether the interaction between two atoms should be skipped based on which of them are frozen.
+       */
+      bool isPairSkipped(int atom1, int atom2) const {
+          return (frozen != NULL && ((*frozen)[atom1] && (*frozen)[atom2]) != onlyFrozenPairs);
+      }
             
       /**---------------------------------------------------------------------------------------
       
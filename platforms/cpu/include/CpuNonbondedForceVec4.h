@@ -54,9 +54,9 @@ protected:
       void calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
       /**
-       * Templatized implementation of calculateBlockIxn.
+       * Templatized implementation of calculateBlockIxn.  If FORCES is false, only the energy is computed.
        */
-      template <bool TRICLINIC>
+      template <bool TRICLINIC, bool FORCES>
       void calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
             
       /**---------------------------------------------------------------------------------------
@@ -72,9 +72,9 @@ protected:
       void calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
       /**
-       * Templatized implementation of calculateBlockEwaldIxn.
+       * Templatized implementation of calculateBlockEwaldIxn.  If FORCES is false, only the energy is computed.
        */
-      template <bool TRICLINIC>
+      template <bool TRICLINIC, bool FORCES>
       void calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
       /**
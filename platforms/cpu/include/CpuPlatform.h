@@ -60,6 +60,7 @@ public:
     static bool isProcessorSupported();
     void contextCreated(ContextImpl& context, const std::map<std::string, std::string>& properties) const;
     void contextDestroyed(ContextImpl& context) const;
+    int getNumConcurrentContexts(ContextImpl& context, std::map<std::string, std::string>& properties) const;
     /**
      * This is the name of the parameter for selecting the number of threads to use.
      */
@@ -84,6 +85,7 @@ public:
     std::vector<AlignedArray<float> > threadForce;
     ThreadPool threads;
     bool isPeriodic;
+    std::vector<char> isFrozen; // Empty if no particles are frozen, otherwise true for each particle with zero mass that is not a virtual site
     CpuRandom random;
     std::map<std::string, std::string> propertyValues;
 };
@@ -40,6 +40,12 @@ namespace OpenMM {
 
 /**
  * This class provides a multithreaded random number generator.
+ *
+ * Two ways of generating numbers are supported.  getGaussianRandom() and getUniformRandom()
+ * draw from a separate stream for each thread, so the values depend on how work is divided
+ * between threads.  getGaussianRandoms() instead uses a counter based generator (Philox4x32-10)
+ * keyed by the seed, the current step, and an index (usually a particle index).  The values it
+ * returns are identical no matter how many threads are used or which thread requests them.
  */
 class OPENMM_EXPORT_CPU CpuRandom {
 public:
@@ -48,9 +54,25 @@ public:
     void initialize(int seed, int numThreads);
     float getGaussianRandom(int threadIndex);
     float getUniformRandom(int threadIndex);
+    /**
+     * Advance to the next step.  This changes the values returned by getGaussianRandoms().  It
+     * should be called from a single thread, before any thread generates values for the step.
+     */
+    void advanceStep();
+    /**
+     * Generate four Gaussian distributed random numbers with mean 0 and variance 1.  They depend
+     * only on the random number seed, the current step, and the index.  This may be called from
+     * any number of threads simultaneously.
+     *
+     * @param index    an index identifying the values to generate, typically a particle index
+     * @param values   on exit, this contains the four random numbers
+     */
+    void getGaussianRandoms(int index, float* values) const;
 private:
     bool hasInitialized;
     int randomSeed;
+    unsigned int key[2];
+    unsigned long long step;
     std::vector<OpenMM_SFMT::SFMT*> threadRandom;
     std::vector<float> nextGaussian;
     std::vector<int> nextGaussianIsValid;
@@ -37,6 +37,13 @@ void CompiledExpressionSet::registerExpression(Lepton::CompiledExpression& expre
             variableReferences[i].push_back(&expression.getVariableReference(variables[i]));
 }
 
+void CompiledExpressionSet::registerExpression(Lepton::CompiledVectorExpression& expression) {
+    vectorExpressions.push_back(&expression);
+    for (int i = 0; i < (int) variables.size(); i++)
+        if (expression.getVariables().find(variables[i]) != expression.getVariables().end())
+            vectorVariableReferences[i].push_back(make_pair(expression.getVariablePointer(variables[i]), expression.getWidth()));
+}
+
 int CompiledExpressionSet::getVariableIndex(const std::string& name) {
     for (int i = 0; i < (int) variables.size(); i++)
         if (variables[i] == name)
@@ -44,13 +51,32 @@ int CompiledExpressionSet::getVariableIndex(const std::string& name) {
     int index = variables.size();
     variables.push_back(name);
     variableReferences.push_back(vector<double*>());
+    vectorVariableReferences.push_back(vector<pair<float*, int> >());
     for (int i = 0; i < (int) expressions.size(); i++)
         if (expressions[i]->getVariables().find(name) != expressions[i]->getVariables().end())
             variableReferences[index].push_back(&expressions[i]->getVariableReference(name));
+    for (int i = 0; i < (int) vectorExpressions.size(); i++)
+        if (vectorExpressions[i]->getVariables().find(name) != vectorExpressions[i]->getVariables().end())
+            vectorVariableReferences[index].push_back(make_pair(vectorExpressions[i]->getVariablePointer(name), vectorExpressions[i]->getWidth()));
     return index;
 }
 
 void CompiledExpressionSet::setVariable(int index, double value) {
     for (int i = 0; i < (int) variableReferences[index].size(); i++)
         *variableReferences[index][i] = value;
+    for (int i = 0; i < (int) vectorVariableReferences[index].size(); i++) {
+        float* pointer = vectorVariableReferences[index][i].first;
+        int width = vectorVariableReferences[index][i].second;
+        for (int j = 0; j < width; j++)
+            pointer[j] = (float) value;
+    }
+}
+
+void CompiledExpressionSet::setVectorVariable(int index, const float* values) {
+    for (int i = 0; i < (int) vectorVariableReferences[index].size(); i++) {
+        float* pointer = vectorVariableReferences[index][i].first;
+        int width = vectorVariableReferences[index][i].second;
+        for (int j = 0; j < width; j++)
+            pointer[j] = values[j];
+    }
 }
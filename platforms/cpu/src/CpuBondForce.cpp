@@ -54,16 +54,40 @@ public:
     ReferenceBondIxn& referenceBondIxn;
 };
 
-CpuBondForce::CpuBondForce() {
+CpuBondForce::CpuBondForce() : frozenBondsValid(false) {
 }
 
-void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads) {
+void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, int** bondAtoms, ThreadPool& threads, const vector<char>& frozen) {
     this->numBonds = numBonds;
     this->numAtomsPerBond = numAtomsPerBond;
     this->bondAtoms = bondAtoms;
     this->threads = &threads;
     int numThreads = threads.getNumThreads();
-    int targetBondsPerThread = numBonds/numThreads;
+
+    // Bonds between frozen atoms are set aside so they can be cached.
+
+    vector<int> bondThread(numBonds, -1);
+    frozenBonds.clear();
+    frozenAtoms.clear();
+    if (frozen.size() > 0) {
+        vector<char> isFrozenAtom(numAtoms, 0);
+        for (int bond = 0; bond < numBonds; bond++) {
+            bool allFrozen = true;
+            for (int i = 0; i < numAtomsPerBond; i++)
+                allFrozen &= (frozen[bondAtoms[bond][i]] != 0);
+            if (allFrozen) {
+                frozenBonds.push_back(bond);
+                bondThread[bond] = numThreads;
+                for (int i = 0; i < numAtomsPerBond; i++)
+                    if (!isFrozenAtom[bondAtoms[bond][i]]) {
+                        isFrozenAtom[bondAtoms[bond][i]] = 1;
+                        frozenAtoms.push_back(bondAtoms[bond][i]);
+                    }
+            }
+        }
+    }
+    frozenBondsValid = false;
+    int targetBondsPerThread = (numBonds-frozenBonds.size())/numThreads;
     
     // Record the bonds that include each atom.
     
@@ -76,7 +100,6 @@ void CpuBondForce::initialize(int numAtoms, int numBonds, int numAtomsPerBond, i
     // Divide bonds into groups.
     
     vector<int> atomThread(numAtoms, -1);
-    vector<int> bondThread(numBonds, -1);
     threadBonds.resize(numThreads);
     int numProcessed = 0;
     int thread = 0;
@@ -183,6 +206,10 @@ void CpuBondForce::assignBond(int bond, int thread, vector<int>& atomThread, vec
     }
 }
 
+void CpuBondForce::clearFrozenBonds() {
+    frozenBondsValid = false;
+}
+
 void CpuBondForce::calculateForce(vector<RealVec>& atomCoordinates, RealOpenMM** parameters, vector<RealVec>& forces, 
         RealOpenMM* totalEnergy, ReferenceBondIxn& referenceBondIxn) {
     // Have the worker threads compute their forces.
@@ -204,6 +231,31 @@ void CpuBondForce::calculateForce(vector<RealVec>& atomCoordinates, RealOpenMM**
     if (totalEnergy != NULL)
         for (int i = 0; i < threads->getNumThreads(); i++)
             *totalEnergy += threadEnergy[i];
+
+    // Add the bonds between frozen atoms, recomputing them only if one of those atoms has been moved.
+
+    if (frozenBonds.size() == 0)
+        return;
+    int numFrozenAtoms = frozenAtoms.size();
+    for (int i = 0; i < numFrozenAtoms && frozenBondsValid; i++)
+        if ((Vec3) atomCoordinates[frozenAtoms[i]] != (Vec3) frozenPositions[i])
+            frozenBondsValid = false;
+    if (!frozenBondsValid) {
+        frozenForces.assign(atomCoordinates.size(), RealVec());
+        frozenEnergy = 0;
+        for (int i = 0; i < (int) frozenBonds.size(); i++) {
+            int bond = frozenBonds[i];
+            referenceBondIxn.calculateBondIxn(bondAtoms[bond], atomCoordinates, parameters[bond], frozenForces, &frozenEnergy);
+        }
+        frozenPositions.resize(numFrozenAtoms);
+        for (int i = 0; i < numFrozenAtoms; i++)
+            frozenPositions[i] = atomCoordinates[frozenAtoms[i]];
+        frozenBondsValid = true;
+    }
+    for (int i = 0; i < numFrozenAtoms; i++)
+        forces[frozenAtoms[i]] += frozenForces[frozenAtoms[i]];
+    if (totalEnergy != NULL)
+        *totalEnergy += frozenEnergy;
 }
 
 void CpuBondForce::threadComputeForce(ThreadPool& threads, int threadIndex, vector<RealVec>& atomCoordinates, RealOpenMM** parameters, vector<RealVec>& forces, 
@@ -45,33 +45,19 @@ public:
 
 CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threadIndex,
                       const vector<Lepton::CompiledExpression>& valueExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
+                      const vector<Lepton::CompiledExpression>& valueDerivExpressions,
                       const vector<string>& valueNames,
                       const vector<Lepton::CompiledExpression>& energyExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyGradientExpressions,
                       const vector<string>& parameterNames) :
-            valueExpressions(valueExpressions), valueDerivExpressions(valueDerivExpressions), valueGradientExpressions(valueGradientExpressions),
-            energyExpressions(energyExpressions), energyDerivExpressions(energyDerivExpressions), energyGradientExpressions(energyGradientExpressions) {
+            valueExpressions(valueExpressions), valueDerivExpressions(valueDerivExpressions), energyExpressions(energyExpressions) {
     firstAtom = (threadIndex*(long long) numAtoms)/numThreads;
     lastAtom = ((threadIndex+1)*(long long) numAtoms)/numThreads;
     for (int i = 0; i < (int) valueExpressions.size(); i++)
         expressionSet.registerExpression(this->valueExpressions[i]);
     for (int i = 0; i < (int) valueDerivExpressions.size(); i++)
-        for (int j = 0; j < (int) valueDerivExpressions[i].size(); j++)
-            expressionSet.registerExpression(this->valueDerivExpressions[i][j]);
-    for (int i = 0; i < (int) valueGradientExpressions.size(); i++)
-        for (int j = 0; j < (int) valueGradientExpressions[i].size(); j++)
-            expressionSet.registerExpression(this->valueGradientExpressions[i][j]);
+        expressionSet.registerExpression(this->valueDerivExpressions[i]);
     for (int i = 0; i < (int) energyExpressions.size(); i++)
         expressionSet.registerExpression(this->energyExpressions[i]);
-    for (int i = 0; i < (int) energyDerivExpressions.size(); i++)
-        for (int j = 0; j < (int) energyDerivExpressions[i].size(); j++)
-            expressionSet.registerExpression(this->energyDerivExpressions[i][j]);
-    for (int i = 0; i < (int) energyGradientExpressions.size(); i++)
-        for (int j = 0; j < (int) energyGradientExpressions[i].size(); j++)
-            expressionSet.registerExpression(this->energyGradientExpressions[i][j]);
     xindex = expressionSet.getVariableIndex("x");
     yindex = expressionSet.getVariableIndex("y");
     zindex = expressionSet.getVariableIndex("z");
@@ -105,20 +91,17 @@ CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threa
 
 CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
                      const vector<Lepton::CompiledExpression>& valueExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
+                     const vector<Lepton::CompiledExpression>& valueDerivExpressions,
                      const vector<string>& valueNames,
                      const vector<CustomGBForce::ComputationType>& valueTypes,
                      const vector<Lepton::CompiledExpression>& energyExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyGradientExpressions,
                      const vector<CustomGBForce::ComputationType>& energyTypes,
                      const vector<string>& parameterNames, ThreadPool& threads) :
             exclusions(exclusions), cutoff(false), periodic(false), valueNames(valueNames), valueTypes(valueTypes),
             energyTypes(energyTypes), paramNames(parameterNames), threads(threads) {
     for (int i = 0; i < threads.getNumThreads(); i++)
-        threadData.push_back(new ThreadData(numAtoms, threads.getNumThreads(), i, valueExpressions, valueDerivExpressions, valueGradientExpressions, valueNames,
-                      energyExpressions, energyDerivExpressions, energyGradientExpressions, parameterNames));
+        threadData.push_back(new ThreadData(numAtoms, threads.getNumThreads(), i, valueExpressions, valueDerivExpressions, valueNames,
+                      energyExpressions, parameterNames));
     values.resize(valueNames.size());
     dEdV.resize(valueNames.size());
     for (int i = 0; i < (int) values.size(); i++) {
@@ -164,6 +147,8 @@ void CpuCustomGBForce::calculateIxn(int numberOfAtoms, float* posq, RealOpenMM**
     this->includeForce = includeForce;
     this->includeEnergy = includeEnergy;
     threadEnergy.resize(threads.getNumThreads());
+    if (cutoff)
+        blockExclusionMasks.resize(neighborList->getNumBlocks());
     gmx_atomic_t counter;
     this->atomicCounter = &counter;
 
@@ -284,11 +269,10 @@ void CpuCustomGBForce::threadComputeForce(ThreadPool& threads, int threadIndex)
 
 void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, int numAtoms, float* posq, RealOpenMM** atomParameters,
         bool useExclusions, const fvec4& boxSize, const fvec4& invBoxSize) {
-    for (int i = 0; i < numAtoms; i++)
-        values[index][i] = 0.0f;
     vector<float>& valueArray = (index == 0 ? data.value0 : values[index]);
     if (cutoff) {
-        // Loop over all pairs in the neighbor list.
+        // Loop over all pairs in the neighbor list.  This is the first pass over the list, so it
+        // also records which pairs are excluded by the force.
 
         while (true) {
             int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
@@ -296,16 +280,23 @@ void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, i
                 break;
             const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+            findBlockExclusions(blockIndex);
+            const vector<char>& forceExclusions = blockExclusionMasks[blockIndex];
+            fvec4 blockAtomX, blockAtomY, blockAtomZ;
+            getBlockPositions(blockIndex, blockAtomX, blockAtomY, blockAtomZ);
             for (int i = 0; i < (int) neighbors.size(); i++) {
+                fvec4 dx, dy, dz, r;
+                int interacting = getInteractingAtoms(blockIndex, i, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r, boxSize, invBoxSize);
+                if (useExclusions)
+                    interacting &= ~forceExclusions[i];
+                if (interacting == 0)
+                    continue;
                 int first = neighbors[i];
                 for (int k = 0; k < 4; k++) {
-                    if ((blockExclusions[i] & (1<<k)) == 0) {
+                    if ((interacting & (1<<k)) != 0) {
                         int second = blockAtom[k];
-                        if (useExclusions && exclusions[first].find(second) != exclusions[first].end())
-                            continue;
-                        calculateOnePairValue(index, first, second, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
-                        calculateOnePairValue(index, second, first, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
+                        calculateOnePairValue(index, first, second, r[k], data, atomParameters, valueArray);
+                        calculateOnePairValue(index, second, first, r[k], data, atomParameters, valueArray);
                     }
                 }
             }
@@ -318,26 +309,22 @@ void CpuCustomGBForce::calculateParticlePairValue(int index, ThreadData& data, i
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numAtoms)
                 break;
+            fvec4 posI(posq+4*i);
             for (int j = i+1; j < numAtoms; j++) {
                 if (useExclusions && exclusions[i].find(j) != exclusions[i].end())
                     continue;
-                calculateOnePairValue(index, i, j, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
-                calculateOnePairValue(index, j, i, data, posq, atomParameters, valueArray, boxSize, invBoxSize);
+                fvec4 deltaR;
+                float r2;
+                getDeltaR(posI, fvec4(posq+4*j), deltaR, r2, periodic, boxSize, invBoxSize);
+                float r = sqrtf(r2);
+                calculateOnePairValue(index, i, j, r, data, atomParameters, valueArray);
+                calculateOnePairValue(index, j, i, r, data, atomParameters, valueArray);
            }
         }
     }
 }
 
-void CpuCustomGBForce::calculateOnePairValue(int index, int atom1, int atom2, ThreadData& data, float* posq, RealOpenMM** atomParameters,
-        vector<float>& valueArray, const fvec4& boxSize, const fvec4& invBoxSize) {
-    fvec4 deltaR;
-    fvec4 pos1(posq+4*atom1);
-    fvec4 pos2(posq+4*atom2);
-    float r2;
-    getDeltaR(pos2, pos1, deltaR, r2, periodic, boxSize, invBoxSize);
-    if (cutoff && r2 >= cutoffDistance2)
-        return;
-    float r = sqrtf(r2);
+void CpuCustomGBForce::calculateOnePairValue(int index, int atom1, int atom2, float r, ThreadData& data, RealOpenMM** atomParameters, vector<float>& valueArray) {
     for (int i = 0; i < (int) paramNames.size(); i++) {
         data.expressionSet.setVariable(data.particleParamIndex[i*2], atomParameters[atom1][i]);
         data.expressionSet.setVariable(data.particleParamIndex[i*2+1], atomParameters[atom2][i]);
@@ -360,13 +347,16 @@ void CpuCustomGBForce::calculateSingleParticleEnergyTerm(int index, ThreadData&
             data.expressionSet.setVariable(data.paramIndex[j], atomParameters[i][j]);
         for (int j = 0; j < (int) valueNames.size(); j++)
             data.expressionSet.setVariable(data.valueIndex[j], values[j][i]);
+        const Lepton::CompiledExpression& expression = data.energyExpressions[index];
+        float energy = (float) expression.evaluate();
         if (includeEnergy)
-            totalEnergy += (float) data.energyExpressions[index].evaluate();
-        for (int j = 0; j < (int) valueNames.size(); j++)
-            data.dEdV[j][i] += (float) data.energyDerivExpressions[index][j].evaluate();
-        forces[4*i+0] -= (float) data.energyGradientExpressions[index][0].evaluate();
-        forces[4*i+1] -= (float) data.energyGradientExpressions[index][1].evaluate();
-        forces[4*i+2] -= (float) data.energyGradientExpressions[index][2].evaluate();
+            totalEnergy += energy;
+        int numValues = valueNames.size();
+        for (int j = 0; j < numValues; j++)
+            data.dEdV[j][i] += (float) expression.getOutputValue(j+1);
+        forces[4*i+0] -= (float) expression.getOutputValue(numValues+1);
+        forces[4*i+1] -= (float) expression.getOutputValue(numValues+2);
+        forces[4*i+2] -= (float) expression.getOutputValue(numValues+3);
     }
 }
 
@@ -381,16 +371,20 @@ void CpuCustomGBForce::calculateParticlePairEnergyTerm(int index, ThreadData& da
                 break;
             const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<char>& forceExclusions = blockExclusionMasks[blockIndex];
+            fvec4 blockAtomX, blockAtomY, blockAtomZ;
+            getBlockPositions(blockIndex, blockAtomX, blockAtomY, blockAtomZ);
             for (int i = 0; i < (int) neighbors.size(); i++) {
+                fvec4 dx, dy, dz, r;
+                int interacting = getInteractingAtoms(blockIndex, i, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r, boxSize, invBoxSize);
+                if (useExclusions)
+                    interacting &= ~forceExclusions[i];
+                if (interacting == 0)
+                    continue;
                 int first = neighbors[i];
                 for (int k = 0; k < 4; k++) {
-                    if ((blockExclusions[i] & (1<<k)) == 0) {
-                        int second = blockAtom[k];
-                        if (useExclusions && exclusions[first].find(second) != exclusions[first].end())
-                            continue;
-                        calculateOnePairEnergyTerm(index, first, second, data, posq, atomParameters, forces, totalEnergy, boxSize, invBoxSize);
-                    }
+                    if ((interacting & (1<<k)) != 0)
+                        calculateOnePairEnergyTerm(index, first, blockAtom[k], fvec4(dx[k], dy[k], dz[k], 0.0f), r[k], data, atomParameters, forces, totalEnergy);
                 }
             }
         }
@@ -402,28 +396,21 @@ void CpuCustomGBForce::calculateParticlePairEnergyTerm(int index, ThreadData& da
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numAtoms)
                 break;
+            fvec4 posI(posq+4*i);
             for (int j = i+1; j < numAtoms; j++) {
                 if (useExclusions && exclusions[i].find(j) != exclusions[i].end())
                     continue;
-                calculateOnePairEnergyTerm(index, i, j, data, posq, atomParameters, forces, totalEnergy, boxSize, invBoxSize);
+                fvec4 deltaR;
+                float r2;
+                getDeltaR(fvec4(posq+4*j), posI, deltaR, r2, periodic, boxSize, invBoxSize);
+                calculateOnePairEnergyTerm(index, i, j, deltaR, sqrtf(r2), data, atomParameters, forces, totalEnergy);
            }
         }
     }
 }
 
-void CpuCustomGBForce::calculateOnePairEnergyTerm(int index, int atom1, int atom2, ThreadData& data, float* posq, RealOpenMM** atomParameters,
-        float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    // Compute the displacement.
-
-    fvec4 deltaR;
-    fvec4 pos1(posq+4*atom1);
-    fvec4 pos2(posq+4*atom2);
-    float r2;
-    getDeltaR(pos2, pos1, deltaR, r2, periodic, boxSize, invBoxSize);
-    if (cutoff && r2 >= cutoffDistance2)
-        return;
-    float r = sqrtf(r2);
-
+void CpuCustomGBForce::calculateOnePairEnergyTerm(int index, int atom1, int atom2, const fvec4& deltaR, float r, ThreadData& data, RealOpenMM** atomParameters,
+        float* forces, double& totalEnergy) {
     // Record variables for evaluating expressions.
 
     for (int i = 0; i < (int) paramNames.size(); i++) {
@@ -438,16 +425,18 @@ void CpuCustomGBForce::calculateOnePairEnergyTerm(int index, int atom1, int atom
 
     // Evaluate the energy and its derivatives.
 
+    const Lepton::CompiledExpression& expression = data.energyExpressions[index];
+    float energy = (float) expression.evaluate();
     if (includeEnergy)
-        totalEnergy += (float) data.energyExpressions[index].evaluate();
-    float dEdR = (float) data.energyDerivExpressions[index][0].evaluate();
+        totalEnergy += energy;
+    float dEdR = (float) expression.getOutputValue(1);
     dEdR *= 1/r;
     fvec4 result = deltaR*dEdR;
     (fvec4(forces+4*atom1)-result).store(forces+4*atom1);
     (fvec4(forces+4*atom2)+result).store(forces+4*atom2);
     for (int i = 0; i < (int) valueNames.size(); i++) {
-        data.dEdV[i][atom1] += (float) data.energyDerivExpressions[index][2*i+1].evaluate();
-        data.dEdV[i][atom2] += (float) data.energyDerivExpressions[index][2*i+2].evaluate();
+        data.dEdV[i][atom1] += (float) expression.getOutputValue(2*i+2);
+        data.dEdV[i][atom2] += (float) expression.getOutputValue(2*i+3);
     }
 }
 
@@ -462,15 +451,22 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
                 break;
             const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
-            const vector<char>& blockExclusions = neighborList->getBlockExclusions(blockIndex);
+            const vector<char>& forceExclusions = blockExclusionMasks[blockIndex];
+            fvec4 blockAtomX, blockAtomY, blockAtomZ;
+            getBlockPositions(blockIndex, blockAtomX, blockAtomY, blockAtomZ);
             for (int i = 0; i < (int) neighbors.size(); i++) {
+                fvec4 dx, dy, dz, r;
+                int interacting = getInteractingAtoms(blockIndex, i, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r, boxSize, invBoxSize);
+                if (interacting == 0)
+                    continue;
                 int first = neighbors[i];
                 for (int k = 0; k < 4; k++) {
-                    if ((blockExclusions[i] & (1<<k)) == 0) {
+                    if ((interacting & (1<<k)) != 0) {
                         int second = blockAtom[k];
-                        bool isExcluded = (exclusions[first].find(second) != exclusions[first].end());
-                        calculateOnePairChainRule(first, second, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
-                        calculateOnePairChainRule(second, first, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
+                        bool isExcluded = ((forceExclusions[i] & (1<<k)) != 0);
+                        fvec4 deltaR(dx[k], dy[k], dz[k], 0.0f);
+                        calculateOnePairChainRule(first, second, deltaR, r[k], data, posq, atomParameters, forces, isExcluded);
+                        calculateOnePairChainRule(second, first, -deltaR, r[k], data, posq, atomParameters, forces, isExcluded);
                     }
                 }
             }
@@ -483,10 +479,15 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= numAtoms)
                 break;
+            fvec4 posI(posq+4*i);
             for (int j = i+1; j < numAtoms; j++) {
                 bool isExcluded = (exclusions[i].find(j) != exclusions[i].end());
-                calculateOnePairChainRule(i, j, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
-                calculateOnePairChainRule(j, i, data, posq, atomParameters, forces, isExcluded, boxSize, invBoxSize);
+                fvec4 deltaR;
+                float r2;
+                getDeltaR(fvec4(posq+4*j), posI, deltaR, r2, periodic, boxSize, invBoxSize);
+                float r = sqrtf(r2);
+                calculateOnePairChainRule(i, j, deltaR, r, data, posq, atomParameters, forces, isExcluded);
+                calculateOnePairChainRule(j, i, -deltaR, r, data, posq, atomParameters, forces, isExcluded);
            }
         }
     }
@@ -501,18 +502,20 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
             data.expressionSet.setVariable(data.paramIndex[j], atomParameters[i][j]);
         for (int j = 1; j < (int) valueNames.size(); j++) {
             data.expressionSet.setVariable(data.valueIndex[j-1], values[j-1][i]);
+            const Lepton::CompiledExpression& expression = data.valueDerivExpressions[j];
+            expression.evaluate();
             data.dVdX[j] = 0.0;
             data.dVdY[j] = 0.0;
             data.dVdZ[j] = 0.0;
             for (int k = 1; k < j; k++) {
-                float dVdV = (float) data.valueDerivExpressions[j][k].evaluate();
+                float dVdV = (float) expression.getOutputValue(k);
                 data.dVdX[j] += dVdV*data.dVdX[k];
                 data.dVdY[j] += dVdV*data.dVdY[k];
                 data.dVdZ[j] += dVdV*data.dVdZ[k];
             }
-            data.dVdX[j] += (float) data.valueGradientExpressions[j][0].evaluate();
-            data.dVdY[j] += (float) data.valueGradientExpressions[j][1].evaluate();
-            data.dVdZ[j] += (float) data.valueGradientExpressions[j][2].evaluate();
+            data.dVdX[j] += (float) expression.getOutputValue(j);
+            data.dVdY[j] += (float) expression.getOutputValue(j+1);
+            data.dVdZ[j] += (float) expression.getOutputValue(j+2);
             forces[4*i+0] -= dEdV[j][i]*data.dVdX[j];
             forces[4*i+1] -= dEdV[j][i]*data.dVdY[j];
             forces[4*i+2] -= dEdV[j][i]*data.dVdZ[j];
@@ -520,19 +523,8 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
     }
 }
 
-void CpuCustomGBForce::calculateOnePairChainRule(int atom1, int atom2, ThreadData& data, float* posq, RealOpenMM** atomParameters,
-        float* forces, bool isExcluded, const fvec4& boxSize, const fvec4& invBoxSize) {
-    // Compute the displacement.
-
-    fvec4 deltaR;
-    fvec4 pos1(posq+4*atom1);
-    fvec4 pos2(posq+4*atom2);
-    float r2;
-    getDeltaR(pos2, pos1, deltaR, r2, periodic, boxSize, invBoxSize);
-    if (cutoff && r2 >= cutoffDistance2)
-        return;
-    float r = sqrtf(r2);
-
+void CpuCustomGBForce::calculateOnePairChainRule(int atom1, int atom2, fvec4 deltaR, float r, ThreadData& data, float* posq, RealOpenMM** atomParameters,
+        float* forces, bool isExcluded) {
     // Record variables for evaluating expressions.
 
     for (int i = 0; i < (int) paramNames.size(); i++) {
@@ -554,17 +546,19 @@ void CpuCustomGBForce::calculateOnePairChainRule(int atom1, int atom2, ThreadDat
     deltaR *= rinv;
     fvec4 f1(0.0f), f2(0.0f);
     if (!isExcluded || valueTypes[0] != CustomGBForce::ParticlePair) {
-        data.dVdR1[0] = (float) data.valueDerivExpressions[0][0].evaluate();
+        data.dVdR1[0] = (float) data.valueDerivExpressions[0].evaluate();
         data.dVdR2[0] = -data.dVdR1[0];
         f1 -= deltaR*(dEdV[0][atom1]*data.dVdR1[0]);
         f2 -= deltaR*(dEdV[0][atom1]*data.dVdR2[0]);
     }
     for (int i = 1; i < (int) valueNames.size(); i++) {
         data.expressionSet.setVariable(data.valueIndex[i], values[i][atom1]);
+        const Lepton::CompiledExpression& expression = data.valueDerivExpressions[i];
+        expression.evaluate();
         data.dVdR1[i] = 0.0;
         data.dVdR2[i] = 0.0;
         for (int j = 0; j < i; j++) {
-            float dVdV = (float) data.valueDerivExpressions[i][j].evaluate();
+            float dVdV = (float) expression.getOutputValue(j);
             data.dVdR1[i] += dVdV*data.dVdR1[j];
             data.dVdR2[i] += dVdV*data.dVdR2[j];
         }
@@ -583,3 +577,49 @@ void CpuCustomGBForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& de
     }
     r2 = dot3(deltaR, deltaR);
 }
+
+void CpuCustomGBForce::getBlockPositions(int blockIndex, fvec4& x, fvec4& y, fvec4& z) const {
+    const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+    x = fvec4(posq[4*blockAtom[0]], posq[4*blockAtom[1]], posq[4*blockAtom[2]], posq[4*blockAtom[3]]);
+    y = fvec4(posq[4*blockAtom[0]+1], posq[4*blockAtom[1]+1], posq[4*blockAtom[2]+1], posq[4*blockAtom[3]+1]);
+    z = fvec4(posq[4*blockAtom[0]+2], posq[4*blockAtom[1]+2], posq[4*blockAtom[2]+2], posq[4*blockAtom[3]+2]);
+}
+
+int CpuCustomGBForce::getInteractingAtoms(int blockIndex, int neighborIndex, const fvec4& blockAtomX, const fvec4& blockAtomY, const fvec4& blockAtomZ,
+        fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r, const fvec4& boxSize, const fvec4& invBoxSize) const {
+    // Compute the displacements from all four atoms of the block to the neighbor at once.
+
+    int neighbor = neighborList->getBlockNeighbors(blockIndex)[neighborIndex];
+    fvec4 posJ(posq+4*neighbor);
+    dx = posJ[0]-blockAtomX;
+    dy = posJ[1]-blockAtomY;
+    dz = posJ[2]-blockAtomZ;
+    if (periodic) {
+        dx -= round(dx*invBoxSize[0])*boxSize[0];
+        dy -= round(dy*invBoxSize[1])*boxSize[1];
+        dz -= round(dz*invBoxSize[2])*boxSize[2];
+    }
+    fvec4 r2 = dx*dx + dy*dy + dz*dz;
+    r = sqrt(r2);
+    int interacting = ~neighborList->getBlockExclusions(blockIndex)[neighborIndex] & 0xF;
+    for (int k = 0; k < 4; k++)
+        if (r2[k] >= cutoffDistance2)
+            interacting &= ~(1<<k);
+    return interacting;
+}
+
+void CpuCustomGBForce::findBlockExclusions(int blockIndex) {
+    const int* blockAtom = &neighborList->getSortedAtoms()[4*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    vector<char>& masks = blockExclusionMasks[blockIndex];
+    masks.resize(neighbors.size());
+    for (int i = 0; i < (int) neighbors.size(); i++) {
+        const set<int>& atomExclusions = exclusions[neighbors[i]];
+        char mask = 0;
+        if (!atomExclusions.empty())
+            for (int k = 0; k < 4; k++)
+                if (atomExclusions.find(blockAtom[k]) != atomExclusions.end())
+                    mask |= 1<<k;
+        masks[i] = mask;
+    }
+}
@@ -316,6 +316,13 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
     }
     
     if (includeForces) {
+        // A single evaluation computes the energy and its derivatives with respect to every variable.
+
+        const Lepton::CompiledExpression& forceExpression = data.forceExpression;
+        double energy = forceExpression.evaluate();
+        if (includeEnergy)
+            data.energy += energy;
+
         // Apply forces based on individual particle coordinates.
 
         AlignedArray<fvec4>& f = data.f;
@@ -325,7 +332,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
             const ParticleTermInfo& term = data.particleTerms[i];
             float temp[4];
             f[term.atom].store(temp);
-            temp[term.component] -= term.forceExpression.evaluate();
+            temp[term.component] -= forceExpression.getOutputValue(term.outputIndex);
             f[term.atom] = fvec4(temp);
         }
 
@@ -333,7 +340,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
 
         for (int i = 0; i < (int) data.distanceTerms.size(); i++) {
             const DistanceTermInfo& term = data.distanceTerms[i];
-            float dEdR = (float) (term.forceExpression.evaluate()*term.deltaSign/(normDelta[term.delta]));
+            float dEdR = (float) (forceExpression.getOutputValue(term.outputIndex)*term.deltaSign/(normDelta[term.delta]));
             fvec4 force = -dEdR*delta[term.delta];
             f[term.p1] -= force;
             f[term.p2] += force;
@@ -343,7 +350,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
 
         for (int i = 0; i < (int) data.angleTerms.size(); i++) {
             const AngleTermInfo& term = data.angleTerms[i];
-            float dEdTheta = (float) term.forceExpression.evaluate();
+            float dEdTheta = (float) forceExpression.getOutputValue(term.outputIndex);
             fvec4 thetaCross = cross(delta[term.delta1], delta[term.delta2]);
             float lengthThetaCross = sqrtf(dot3(thetaCross, thetaCross));
             if (lengthThetaCross < 1.0e-6f)
@@ -364,7 +371,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
 
         for (int i = 0; i < (int) data.dihedralTerms.size(); i++) {
             const DihedralTermInfo& term = data.dihedralTerms[i];
-            float dEdTheta = (float) term.forceExpression.evaluate();
+            float dEdTheta = (float) forceExpression.getOutputValue(term.outputIndex);
             float normCross1 = dot3(cross1[i], cross1[i]);
             float normBC = normDelta[term.delta2];
             float forceFactors[4];
@@ -391,10 +398,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, RealO
             (fvec4(forces+4*index)+f[i]).store(forces+4*index);
         }
     }
-
-    // Add the energy
-
-    if (includeEnergy)
+    else if (includeEnergy)
         data.energy += data.energyExpression.evaluate();
 }
 
@@ -440,26 +444,26 @@ float CpuCustomManyParticleForce::getDihedralAngleBetweenThreeVectors(const fvec
     return angle;
 }
 
-CpuCustomManyParticleForce::ParticleTermInfo::ParticleTermInfo(const string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), atom(atom), component(component), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::ParticleTermInfo::ParticleTermInfo(const string& name, int atom, int component, int outputIndex, ThreadData& data) :
+        name(name), atom(atom), component(component), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
 }
 
-CpuCustomManyParticleForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, int outputIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     data.requestDeltaPair(p1, p2, delta, deltaSign, true);
 }
 
-CpuCustomManyParticleForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, int outputIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     data.requestDeltaPair(p1, p2,delta1, delta1Sign, true);
     data.requestDeltaPair(p3, p2, delta2, delta2Sign, true);
 }
 
-CpuCustomManyParticleForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, int outputIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), outputIndex(outputIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     float sign;
     data.requestDeltaPair(p2, p1, delta1, sign, false);
@@ -477,36 +481,43 @@ CpuCustomManyParticleForce::ThreadData::ThreadData(const CustomManyParticleForce
     energyExpression = energyExpr.createCompiledExpression();
     expressionSet.registerExpression(energyExpression);
 
-    // Differentiate the energy to get expressions for the force.
+    // Differentiate the energy to get expressions for the force.  The energy and all its derivatives are
+    // compiled into a single expression, with the energy as the first output.
+
+    vector<Lepton::ParsedExpression> outputs;
+    outputs.push_back(energyExpr);
 
     for (int i = 0; i < numParticlesPerSet; i++) {
         stringstream xname, yname, zname;
         xname << 'x' << (i+1);
         yname << 'y' << (i+1);
         zname << 'z' << (i+1);
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(xname.str(), i, 0, energyExpr.differentiate(xname.str()).optimize().createCompiledExpression(), *this));
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(yname.str(), i, 1, energyExpr.differentiate(yname.str()).optimize().createCompiledExpression(), *this));
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(zname.str(), i, 2, energyExpr.differentiate(zname.str()).optimize().createCompiledExpression(), *this));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(xname.str(), i, 0, outputs.size(), *this));
+        outputs.push_back(energyExpr.differentiate(xname.str()));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(yname.str(), i, 1, outputs.size(), *this));
+        outputs.push_back(energyExpr.differentiate(yname.str()));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(zname.str(), i, 2, outputs.size(), *this));
+        outputs.push_back(energyExpr.differentiate(zname.str()));
         for (int j = 0; j < numPerParticleParameters; j++) {
             stringstream paramname;
             paramname << force.getPerParticleParameterName(j) << (i+1);
             particleParamIndices[i].push_back(expressionSet.getVariableIndex(paramname.str()));
         }
     }
-    for (map<string, vector<int> >::const_iterator iter = dihedrals.begin(); iter != dihedrals.end(); ++iter)
-        dihedralTerms.push_back(CpuCustomManyParticleForce::DihedralTermInfo(iter->first, iter->second, energyExpr.differentiate(iter->first).optimize().createCompiledExpression(), *this));
-    for (map<string, vector<int> >::const_iterator iter = distances.begin(); iter != distances.end(); ++iter)
-        distanceTerms.push_back(CpuCustomManyParticleForce::DistanceTermInfo(iter->first, iter->second, energyExpr.differentiate(iter->first).optimize().createCompiledExpression(), *this));
-    for (map<string, vector<int> >::const_iterator iter = angles.begin(); iter != angles.end(); ++iter)
-        angleTerms.push_back(CpuCustomManyParticleForce::AngleTermInfo(iter->first, iter->second, energyExpr.differentiate(iter->first).optimize().createCompiledExpression(), *this));
-    for (int i = 0; i < particleTerms.size(); i++)
-        expressionSet.registerExpression(particleTerms[i].forceExpression);
-    for (int i = 0; i < distanceTerms.size(); i++)
-        expressionSet.registerExpression(distanceTerms[i].forceExpression);
-    for (int i = 0; i < angleTerms.size(); i++)
-        expressionSet.registerExpression(angleTerms[i].forceExpression);
-    for (int i = 0; i < dihedralTerms.size(); i++)
-        expressionSet.registerExpression(dihedralTerms[i].forceExpression);
+    for (map<string, vector<int> >::const_iterator iter = dihedrals.begin(); iter != dihedrals.end(); ++iter) {
+        dihedralTerms.push_back(CpuCustomManyParticleForce::DihedralTermInfo(iter->first, iter->second, outputs.size(), *this));
+        outputs.push_back(energyExpr.differentiate(iter->first));
+    }
+    for (map<string, vector<int> >::const_iterator iter = distances.begin(); iter != distances.end(); ++iter) {
+        distanceTerms.push_back(CpuCustomManyParticleForce::DistanceTermInfo(iter->first, iter->second, outputs.size(), *this));
+        outputs.push_back(energyExpr.differentiate(iter->first));
+    }
+    for (map<string, vector<int> >::const_iterator iter = angles.begin(); iter != angles.end(); ++iter) {
+        angleTerms.push_back(CpuCustomManyParticleForce::AngleTermInfo(iter->first, iter->second, outputs.size(), *this));
+        outputs.push_back(energyExpr.differentiate(iter->first));
+    }
+    forceExpression = Lepton::CompiledExpression(outputs);
+    expressionSet.registerExpression(forceExpression);
     int numDeltas = deltaPairs.size();
     delta.resize(numDeltas);
     normDelta.resize(numDeltas);
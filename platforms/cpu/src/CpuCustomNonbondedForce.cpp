@@ -43,25 +43,45 @@ public:
     CpuCustomNonbondedForce& owner;
 };
 
-CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames) :
-            energyExpression(energyExpression), forceExpression(forceExpression) {
-    energyR = ReferenceForce::getVariablePointer(this->energyExpression, "r");
-    forceR = ReferenceForce::getVariablePointer(this->forceExpression, "r");
+CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyForceExpression, const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames) :
+            energyForceExpression(energyForceExpression), forceExpression(forceExpression), useVector(false), batchWidth(1), batchSize(0) {
+    expressionSet.registerExpression(this->energyForceExpression);
+    expressionSet.registerExpression(this->forceExpression);
+    findVariables(parameterNames);
+}
+
+CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledVectorExpression& energyForceExpression, const Lepton::CompiledVectorExpression& forceExpression, const vector<string>& parameterNames) :
+            vectorEnergyForceExpression(energyForceExpression), vectorForceExpression(forceExpression), useVector(true), batchWidth(energyForceExpression.getWidth()), batchSize(0) {
+    expressionSet.registerExpression(vectorEnergyForceExpression);
+    expressionSet.registerExpression(vectorForceExpression);
+    findVariables(parameterNames);
+}
+
+void CpuCustomNonbondedForce::ThreadData::findVariables(const vector<string>& parameterNames) {
+    rIndex = expressionSet.getVariableIndex("r");
     for (int i = 0; i < (int) parameterNames.size(); i++) {
         for (int j = 1; j < 3; j++) {
             stringstream name;
             name << parameterNames[i] << j;
-            energyParticleParams.push_back(ReferenceForce::getVariablePointer(this->energyExpression, name.str()));
-            forceParticleParams.push_back(ReferenceForce::getVariablePointer(this->forceExpression, name.str()));
+            particleParamIndex.push_back(expressionSet.getVariableIndex(name.str()));
         }
     }
 }
 
-CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression,
+CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyForceExpression,
             const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,ThreadPool& threads) :
-            cutoff(false), useSwitch(false), periodic(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
+            cutoff(false), useSwitch(false), periodic(false), paramNames(parameterNames), exclusions(exclusions), threads(threads),
+            numGroupMaskWords(0), useTable(false), tableIsValid(false) {
     for (int i = 0; i < threads.getNumThreads(); i++)
-        threadData.push_back(new ThreadData(energyExpression, forceExpression, parameterNames));
+        threadData.push_back(new ThreadData(energyForceExpression, forceExpression, parameterNames));
+}
+
+CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledVectorExpression& energyForceExpression,
+            const Lepton::CompiledVectorExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,ThreadPool& threads) :
+            cutoff(false), useSwitch(false), periodic(false), paramNames(parameterNames), exclusions(exclusions), threads(threads),
+            numGroupMaskWords(0), useTable(false), tableIsValid(false) {
+    for (int i = 0; i < threads.getNumThreads(); i++)
+        threadData.push_back(new ThreadData(energyForceExpression, forceExpression, parameterNames));
 }
 
 CpuCustomNonbondedForce::~CpuCustomNonbondedForce() {
@@ -76,9 +96,29 @@ void CpuCustomNonbondedForce::setUseCutoff(RealOpenMM distance, const CpuNeighbo
   }
 
 void CpuCustomNonbondedForce::setInteractionGroups(const vector<pair<set<int>, set<int> > >& groups) {
+    interactionGroups = groups;
+    groupInteractions.clear();
+
+    // Record which groups each atom belongs to as a pair of bitmasks, one for each side of the groups.
+
+    int numAtoms = exclusions.size();
+    numGroupMaskWords = (groups.size()+31)/32;
+    groupMask1.assign(numAtoms*numGroupMaskWords, 0);
+    groupMask2.assign(numAtoms*numGroupMaskWords, 0);
     for (int group = 0; group < (int) groups.size(); group++) {
-        const set<int>& set1 = groups[group].first;
-        const set<int>& set2 = groups[group].second;
+        int word = group/32;
+        unsigned int bit = 1u<<(group%32);
+        for (set<int>::const_iterator atom = groups[group].first.begin(); atom != groups[group].first.end(); ++atom)
+            groupMask1[*atom*numGroupMaskWords+word] |= bit;
+        for (set<int>::const_iterator atom = groups[group].second.begin(); atom != groups[group].second.end(); ++atom)
+            groupMask2[*atom*numGroupMaskWords+word] |= bit;
+    }
+}
+
+void CpuCustomNonbondedForce::createGroupInteractions() {
+    for (int group = 0; group < (int) interactionGroups.size(); group++) {
+        const set<int>& set1 = interactionGroups[group].first;
+        const set<int>& set2 = interactionGroups[group].second;
         for (set<int>::const_iterator atom1 = set1.begin(); atom1 != set1.end(); ++atom1) {
             for (set<int>::const_iterator atom2 = set2.begin(); atom2 != set2.end(); ++atom2) {
                 if (*atom1 == *atom2 || exclusions[*atom1].find(*atom2) != exclusions[*atom1].end())
@@ -91,6 +131,21 @@ void CpuCustomNonbondedForce::setInteractionGroups(const vector<pair<set<int>, s
     }
 }
 
+int CpuCustomNonbondedForce::getNumGroupsContaining(int atom1, int atom2) const {
+    // A group contains the interaction if either atom is in its first set and the other is in its second set.
+    // Each group that does so contributes a separate copy of the interaction.
+
+    const unsigned int* first1 = &groupMask1[atom1*numGroupMaskWords];
+    const unsigned int* second1 = &groupMask2[atom1*numGroupMaskWords];
+    const unsigned int* first2 = &groupMask1[atom2*numGroupMaskWords];
+    const unsigned int* second2 = &groupMask2[atom2*numGroupMaskWords];
+    int count = 0;
+    for (int i = 0; i < numGroupMaskWords; i++)
+        for (unsigned int bits = (first1[i]&second2[i]) | (second1[i]&first2[i]); bits != 0; bits &= bits-1)
+            count++;
+    return count;
+}
+
 void CpuCustomNonbondedForce::setUseSwitchingFunction(RealOpenMM distance) {
     useSwitch = true;
     switchingDistance = distance;
@@ -117,6 +172,53 @@ void CpuCustomNonbondedForce::setPeriodic(RealVec* periodicBoxVectors) {
                  periodicBoxVectors[2][0] != 0.0 || periodicBoxVectors[2][1] != 0.0);
 }
 
+void CpuCustomNonbondedForce::setUseParameterTable(const vector<string>& tableNames, const vector<Lepton::CompiledExpression>& tableExpressions,
+            const vector<int>& particleClass, const vector<vector<double> >& classParameters) {
+    useTable = true;
+    tableIsValid = false;
+    this->tableExpressions = tableExpressions;
+    this->particleClass = particleClass;
+    this->classParameters = classParameters;
+    for (int i = 0; i < (int) threadData.size(); i++) {
+        ThreadData& data = *threadData[i];
+        data.tableParamIndex.clear();
+        for (int j = 0; j < (int) tableNames.size(); j++)
+            data.tableParamIndex.push_back(data.expressionSet.getVariableIndex(tableNames[j]));
+    }
+}
+
+void CpuCustomNonbondedForce::computeParameterTable() {
+    int numClasses = classParameters.size();
+    int numValues = tableExpressions.size();
+    parameterTable.resize(numClasses*numClasses*numValues);
+    for (int i = 0; i < numValues; i++) {
+        Lepton::CompiledExpression& expression = tableExpressions[i];
+        for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter)
+            ReferenceForce::setVariable(ReferenceForce::getVariablePointer(expression, iter->first), iter->second);
+        vector<double*> params1, params2;
+        for (int j = 0; j < (int) paramNames.size(); j++) {
+            params1.push_back(ReferenceForce::getVariablePointer(expression, paramNames[j]+"1"));
+            params2.push_back(ReferenceForce::getVariablePointer(expression, paramNames[j]+"2"));
+        }
+        for (int class1 = 0; class1 < numClasses; class1++)
+            for (int class2 = 0; class2 < numClasses; class2++) {
+                for (int j = 0; j < (int) paramNames.size(); j++) {
+                    ReferenceForce::setVariable(params1[j], classParameters[class1][j]);
+                    ReferenceForce::setVariable(params2[j], classParameters[class2][j]);
+                }
+                parameterTable[(class1*numClasses+class2)*numValues+i] = expression.evaluate();
+            }
+    }
+    tableGlobalParameters = *globalParameters;
+    tableIsValid = true;
+}
+
+void CpuCustomNonbondedForce::setTableValues(int atom1, int atom2, ThreadData& data) const {
+    int numValues = tableExpressions.size();
+    const double* values = &parameterTable[(particleClass[atom1]*classParameters.size()+particleClass[atom2])*numValues];
+    for (int i = 0; i < numValues; i++)
+        data.expressionSet.setVariable(data.tableParamIndex[i], values[i]);
+}
 
 void CpuCustomNonbondedForce::calculatePairIxn(int numberOfAtoms, float* posq, vector<RealVec>& atomCoordinates, RealOpenMM** atomParameters,
                                              RealOpenMM* fixedParameters, const map<string, double>& globalParameters,
@@ -131,6 +233,10 @@ void CpuCustomNonbondedForce::calculatePairIxn(int numberOfAtoms, float* posq, v
     this->threadForce = &threadForce;
     this->includeForce = includeForce;
     this->includeEnergy = includeEnergy;
+    if (useTable && (!tableIsValid || tableGlobalParameters != globalParameters))
+        computeParameterTable();
+    if (interactionGroups.size() > 0 && !cutoff && groupInteractions.size() == 0)
+        createGroupInteractions();
     threadEnergy.resize(threads.getNumThreads());
     gmx_atomic_t counter;
     gmx_atomic_set(&counter, 0);
@@ -159,32 +265,23 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
     double& energy = threadEnergy[threadIndex];
     float* forces = &(*threadForce)[threadIndex][0];
     ThreadData& data = *threadData[threadIndex];
-    for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter) {
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(data.energyExpression, iter->first), iter->second);
-        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(data.forceExpression, iter->first), iter->second);
-    }
+    for (map<string, double>::const_iterator iter = globalParameters->begin(); iter != globalParameters->end(); ++iter)
+        data.expressionSet.setVariable(data.expressionSet.getVariableIndex(iter->first), iter->second);
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
-    if (groupInteractions.size() > 0) {
+    if (interactionGroups.size() > 0 && !cutoff) {
         // The user has specified interaction groups, so compute only the requested interactions.
         
         while (true) {
             int i = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
             if (i >= groupInteractions.size())
                 break;
-            int atom1 = groupInteractions[i].first;
-            int atom2 = groupInteractions[i].second;
-            for (int j = 0; j < (int) paramNames.size(); j++) {
-                ReferenceForce::setVariable(data.energyParticleParams[j*2], atomParameters[atom1][j]);
-                ReferenceForce::setVariable(data.energyParticleParams[j*2+1], atomParameters[atom2][j]);
-                ReferenceForce::setVariable(data.forceParticleParams[j*2], atomParameters[atom1][j]);
-                ReferenceForce::setVariable(data.forceParticleParams[j*2+1], atomParameters[atom2][j]);
-            }
-            calculateOneIxn(atom1, atom2, data, forces, energy, boxSize, invBoxSize);
+            calculatePair(groupInteractions[i].first, groupInteractions[i].second, 1, data, forces, energy, boxSize, invBoxSize);
         }
     }
     else if (cutoff) {
-        // We are using a cutoff, so get the interactions from the neighbor list.
+        // We are using a cutoff, so get the interactions from the neighbor list.  If there are interaction
+        // groups, skip any pair that is not in one of them.
 
         while (true) {
             int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
@@ -195,18 +292,16 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
-                for (int j = 0; j < (int) paramNames.size(); j++) {
-                    ReferenceForce::setVariable(data.energyParticleParams[j*2], atomParameters[first][j]);
-                    ReferenceForce::setVariable(data.forceParticleParams[j*2], atomParameters[first][j]);
-                }
                 for (int k = 0; k < 4; k++) {
                     if ((exclusions[i] & (1<<k)) == 0) {
                         int second = blockAtom[k];
-                        for (int j = 0; j < (int) paramNames.size(); j++) {
-                            ReferenceForce::setVariable(data.energyParticleParams[j*2+1], atomParameters[second][j]);
-                            ReferenceForce::setVariable(data.forceParticleParams[j*2+1], atomParameters[second][j]);
+                        int count = 1;
+                        if (interactionGroups.size() > 0) {
+                            count = getNumGroupsContaining(first, second);
+                            if (count == 0)
+                                continue;
                         }
-                        calculateOneIxn(first, second, data, forces, energy, boxSize, invBoxSize);
+                        calculatePair(first, second, count, data, forces, energy, boxSize, invBoxSize);
                     }
                 }
             }
@@ -220,17 +315,118 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             if (ii >= numberOfAtoms)
                 break;
             for (int jj = ii+1; jj < numberOfAtoms; jj++) {
-                if (exclusions[jj].find(ii) == exclusions[jj].end()) {
-                    for (int j = 0; j < (int) paramNames.size(); j++) {
-                        ReferenceForce::setVariable(data.energyParticleParams[j*2], atomParameters[ii][j]);
-                        ReferenceForce::setVariable(data.energyParticleParams[j*2+1], atomParameters[jj][j]);
-                        ReferenceForce::setVariable(data.forceParticleParams[j*2], atomParameters[ii][j]);
-                        ReferenceForce::setVariable(data.forceParticleParams[j*2+1], atomParameters[jj][j]);
-                    }
-                    calculateOneIxn(ii, jj, data, forces, energy, boxSize, invBoxSize);
-                }
+                if (exclusions[jj].find(ii) == exclusions[jj].end())
+                    calculatePair(ii, jj, 1, data, forces, energy, boxSize, invBoxSize);
+            }
+        }
+    }
+
+    // Compute any interactions left over in a partial batch.
+
+    calculateBatchIxn(data, forces, energy);
+}
+
+void CpuCustomNonbondedForce::calculatePair(int atom1, int atom2, int count, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    if (!data.useVector) {
+        if (useTable)
+            setTableValues(atom1, atom2, data);
+        else {
+            for (int j = 0; j < (int) paramNames.size(); j++) {
+                data.expressionSet.setVariable(data.particleParamIndex[j*2], atomParameters[atom1][j]);
+                data.expressionSet.setVariable(data.particleParamIndex[j*2+1], atomParameters[atom2][j]);
+            }
+        }
+        for (int copy = 0; copy < count; copy++)
+            calculateOneIxn(atom1, atom2, data, forces, totalEnergy, boxSize, invBoxSize);
+        return;
+    }
+
+    // Add the interaction to the batch if it is inside the cutoff, and compute the batch once it is full.
+
+    fvec4 deltaR;
+    float r2;
+    getDeltaR(fvec4(posq+4*atom1), fvec4(posq+4*atom2), deltaR, r2, boxSize, invBoxSize);
+    if (cutoff && r2 >= cutoffDistance*cutoffDistance)
+        return;
+    int index = data.batchSize++;
+    data.batchAtom1[index] = atom1;
+    data.batchAtom2[index] = atom2;
+    data.batchCount[index] = count;
+    data.batchR[index] = sqrtf(r2);
+    deltaR.store(data.batchDelta[index]);
+    if (data.batchSize == data.batchWidth)
+        calculateBatchIxn(data, forces, totalEnergy);
+}
+
+void CpuCustomNonbondedForce::calculateBatchIxn(ThreadData& data, float* forces, double& totalEnergy) {
+    int size = data.batchSize;
+    if (size == 0)
+        return;
+    data.batchSize = 0;
+
+    // The unused elements of a partial batch repeat the first interaction, so they hold valid arguments.
+
+    int width = data.batchWidth;
+    for (int i = size; i < width; i++) {
+        data.batchAtom1[i] = data.batchAtom1[0];
+        data.batchAtom2[i] = data.batchAtom2[0];
+        data.batchR[i] = data.batchR[0];
+    }
+
+    // Set the variables for every element.
+
+    data.expressionSet.setVectorVariable(data.rIndex, data.batchR);
+    if (useTable) {
+        int numValues = tableExpressions.size();
+        int numClasses = classParameters.size();
+        for (int j = 0; j < numValues; j++) {
+            for (int i = 0; i < width; i++)
+                data.batchValues[i] = (float) parameterTable[(particleClass[data.batchAtom1[i]]*numClasses+particleClass[data.batchAtom2[i]])*numValues+j];
+            data.expressionSet.setVectorVariable(data.tableParamIndex[j], data.batchValues);
+        }
+    }
+    else {
+        for (int j = 0; j < (int) paramNames.size(); j++) {
+            for (int i = 0; i < width; i++)
+                data.batchValues[i] = (float) atomParameters[data.batchAtom1[i]][j];
+            data.expressionSet.setVectorVariable(data.particleParamIndex[j*2], data.batchValues);
+            for (int i = 0; i < width; i++)
+                data.batchValues[i] = (float) atomParameters[data.batchAtom2[i]][j];
+            data.expressionSet.setVectorVariable(data.particleParamIndex[j*2+1], data.batchValues);
+        }
+    }
+
+    // Evaluate the expressions for all elements at once, then accumulate the forces and energy for each interaction.
+
+    const float* energyValues = NULL;
+    const float* forceValues;
+    bool computeEnergy = (includeEnergy || useSwitch);
+    if (computeEnergy) {
+        energyValues = data.vectorEnergyForceExpression.evaluate();
+        forceValues = data.vectorEnergyForceExpression.getOutputValues(1);
+    }
+    else
+        forceValues = data.vectorForceExpression.evaluate();
+    for (int i = 0; i < size; i++) {
+        RealOpenMM r = data.batchR[i];
+        double dEdR = forceValues[i]/r;
+        double energy = (computeEnergy ? energyValues[i] : 0.0);
+        if (useSwitch) {
+            if (r > switchingDistance) {
+                RealOpenMM t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
+                RealOpenMM switchValue = 1+t*t*t*(-10+t*(15-t*6));
+                RealOpenMM switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
+                dEdR = switchValue*dEdR + energy*switchDeriv/r;
+                energy *= switchValue;
             }
         }
+        dEdR *= data.batchCount[i];
+        fvec4 result = fvec4(data.batchDelta[i])*dEdR;
+        int atom1 = data.batchAtom1[i];
+        int atom2 = data.batchAtom2[i];
+        (fvec4(forces+4*atom1)+result).store(forces+4*atom1);
+        (fvec4(forces+4*atom2)-result).store(forces+4*atom2);
+        totalEnergy += energy*data.batchCount[i];
     }
 }
 
@@ -249,10 +445,18 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
 
     // accumulate forces
 
-    ReferenceForce::setVariable(data.energyR, r);
-    ReferenceForce::setVariable(data.forceR, r);
-    double dEdR = (includeForce ? data.forceExpression.evaluate()/r : 0.0);
-    double energy = (includeEnergy ? data.energyExpression.evaluate() : 0.0);
+    data.expressionSet.setVariable(data.rIndex, r);
+    double dEdR, energy;
+    if (includeEnergy || useSwitch) {
+        // A single evaluation computes both the energy and its derivative, sharing any common subexpressions.
+
+        energy = data.energyForceExpression.evaluate();
+        dEdR = data.energyForceExpression.getOutputValue(1)/r;
+    }
+    else {
+        energy = 0.0;
+        dEdR = data.forceExpression.evaluate()/r;
+    }
     if (useSwitch) {
         if (r > switchingDistance) {
             RealOpenMM t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
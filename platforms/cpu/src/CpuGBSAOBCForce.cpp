@@ -47,7 +47,7 @@ public:
     CpuGBSAOBCForce& owner;
 };
 
-CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
+CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false), neighborList(NULL) {
     logDX = (TABLE_MAX-TABLE_MIN)/NUM_TABLE_POINTS;
     logDXInv = 1.0f/logDX;
     logTable.resize(NUM_TABLE_POINTS+4);
@@ -57,9 +57,10 @@ CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
     }
 }
 
-void CpuGBSAOBCForce::setUseCutoff(float distance) {
+void CpuGBSAOBCForce::setUseCutoff(float distance, const CpuNeighborList& neighbors) {
     cutoff = true;
     cutoffDistance = distance;
+    neighborList = &neighbors;
 }
 
 void CpuGBSAOBCForce::setPeriodic(float* periodicBoxSize) {
@@ -88,20 +89,25 @@ const std::vector<std::pair<float, float> >& CpuGBSAOBCForce::getParticleParamet
 void CpuGBSAOBCForce::setParticleParameters(const std::vector<std::pair<float, float> >& params) {
     particleParams = params;
     bornRadii.resize(params.size()+3);
+    bornForces.resize(params.size()+3);
     obcChain.resize(params.size()+3);
 }
 
-void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads) {
     // Record the parameters for the threads.
     
     this->posq = &posq[0];
     this->threadForce = &threadForce;
+    this->includeForces = includeForces;
     includeEnergy = (totalEnergy != NULL);
     int numThreads = threads.getNumThreads();
     threadEnergy.resize(numThreads);
+    threadBornSums.resize(numThreads);
     threadBornForces.resize(numThreads);
-    for (int i = 0; i < numThreads; i++)
+    for (int i = 0; i < numThreads; i++) {
+        threadBornSums[i].resize(particleParams.size()+3);
         threadBornForces[i].resize(particleParams.size()+3);
+    }
     gmx_atomic_t counter;
     this->atomicCounter = &counter;
     
@@ -110,16 +116,21 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
     ComputeTask task(*this);
     gmx_atomic_set(&counter, 0);
     threads.execute(task);
-    threads.waitForThreads(); // Compute Born radii
+    threads.waitForThreads(); // Compute Born radius sums
     gmx_atomic_set(&counter, 0);
     threads.resumeThreads();
-    threads.waitForThreads(); // Compute surface area term
+    threads.waitForThreads(); // Compute Born radii and surface area term
     gmx_atomic_set(&counter, 0);
     threads.resumeThreads();
     threads.waitForThreads(); // First loop
-    gmx_atomic_set(&counter, 0);
-    threads.resumeThreads();
-    threads.waitForThreads(); // Second loop
+    if (includeForces) {
+        gmx_atomic_set(&counter, 0);
+        threads.resumeThreads();
+        threads.waitForThreads(); // Sum Born forces
+        gmx_atomic_set(&counter, 0);
+        threads.resumeThreads();
+        threads.waitForThreads(); // Second loop
+    }
     
     // Combine the energies from all the threads.
     
@@ -134,155 +145,153 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
 void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     int numParticles = particleParams.size();
     int numThreads = threads.getNumThreads();
+    int numBlocks = getNumBlocks();
     const float dielectricOffset = 0.009;
     const float alphaObc = 1.0f;
     const float betaObc = 0.8f;
     const float gammaObc = 4.85f;
+    const float cutoff2 = cutoffDistance*cutoffDistance;
     fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
     fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
-    int start = (threadIndex*numParticles)/numThreads;
-    int end = ((threadIndex+1)*numParticles)/numThreads;
+    fvec4 one(1.0f);
 
-    // Calculate Born radii
+    // Calculate the sums for the Born radii.  Each pair is visited once, and contributes to the
+    // sums for both atoms.
 
+    AlignedArray<float>& bornSums = threadBornSums[threadIndex];
+    for (int i = 0; i < numParticles; i++)
+        bornSums[i] = 0.0f;
     while (true) {
-        int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
-        if (blockStart >= numParticles)
+        int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (blockIndex >= numBlocks)
             break;
-        int numInBlock = min(4, numParticles-blockStart);
-        ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
-        float atomRadius[4], atomx[4], atomy[4], atomz[4];
-        int blockMask[4] = {0, 0, 0, 0};
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            atomRadius[i] = particleParams[atomIndex].first;
-            atomx[i] = posq[4*atomIndex];
-            atomy[i] = posq[4*atomIndex+1];
-            atomz[i] = posq[4*atomIndex+2];
-            blockMask[i] = 0xFFFFFFFF;
+        int atoms[4];
+        ivec4 blockAtomIndex;
+        int numNeighbors = getBlockAtoms(blockIndex, atoms, blockAtomIndex);
+        float atomRadius[4], atomScaledRadius[4], atomx[4], atomy[4], atomz[4];
+        for (int i = 0; i < 4; i++) {
+            atomRadius[i] = particleParams[atoms[i]].first;
+            atomScaledRadius[i] = particleParams[atoms[i]].second;
+            atomx[i] = posq[4*atoms[i]];
+            atomy[i] = posq[4*atoms[i]+1];
+            atomz[i] = posq[4*atoms[i]+2];
         }
         fvec4 offsetRadiusI(atomRadius);
-        fvec4 radiusIInverse = 1.0f/offsetRadiusI;
+        fvec4 scaledRadiusI(atomScaledRadius);
         fvec4 x(atomx);
         fvec4 y(atomy);
         fvec4 z(atomz);
-        ivec4 mask(blockMask);
-        float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-        for (int atomJ = 0; atomJ < numParticles; atomJ++) {
+        fvec4 blockSum(0.0f);
+        for (int neighbor = 0; neighbor < numNeighbors; neighbor++) {
+            ivec4 include;
+            int atomJ = getBlockNeighbor(blockIndex, neighbor, blockAtomIndex, include);
             fvec4 posJ(posq+4*atomJ);
             fvec4 dx, dy, dz, r2;
             getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
-            ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
             if (cutoff)
-                include = include & (r2 < cutoffDistance*cutoffDistance);
+                include = include & (r2 < cutoff2);
             if (!any(include))
                 continue;
             fvec4 r = sqrt(r2);
-            float scaledRadiusJ = particleParams[atomJ].second;
-            float scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
-            fvec4 rScaledRadiusJ = r + scaledRadiusJ;
-            include = include & (offsetRadiusI < rScaledRadiusJ);
-            fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
-            fvec4 u_ij = 1.0f/rScaledRadiusJ;
-            fvec4 l_ij2 = l_ij*l_ij;
-            fvec4 u_ij2 = u_ij*u_ij;
-            fvec4 rInverse = 1.0f/r;
-            fvec4 r2Inverse = rInverse*rInverse;
-            fvec4 logRatio = fastLog(u_ij/l_ij);
-            fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
-            for (int j = 0; j < 4; j++) {
-                if (include[j]) {
-                    sum[j] += term[j];
-                    if (offsetRadiusI[j] < scaledRadiusJ-r[j])
-                        sum[j] += 2.0f*(radiusIInverse[j]-l_ij[j]);
-                }
-            }
-        }
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            sum[i] *= 0.5f*atomRadius[i];
-            float sum2 = sum[i]*sum[i];
-            float sum3 = sum[i]*sum2;
-            float tanhSum = tanh(alphaObc*sum[i] - betaObc*sum2 + gammaObc*sum3);
-            float radiusI = atomRadius[i] + dielectricOffset;
-            bornRadii[atomIndex] = 1.0f/(1.0f/atomRadius[i] - tanhSum/radiusI);
-            obcChain[atomIndex] = atomRadius[i]*(alphaObc - 2.0f*betaObc*sum[i] + 3.0f*gammaObc*sum2);
-            obcChain[atomIndex] = (1.0f - tanhSum*tanhSum)*obcChain[atomIndex]/radiusI;
+            blockSum += computeBornRadiusTerm(offsetRadiusI, particleParams[atomJ].second, r, include);
+            bornSums[atomJ] += dot4(computeBornRadiusTerm(particleParams[atomJ].first, scaledRadiusI, r, include), one);
         }
+        for (int i = 0; i < 4; i++)
+            bornSums[atoms[i]] += blockSum[i];
     }
     threads.syncThreads();
 
-    // Calculate ACE surface area term.
+    // Calculate the Born radii and the ACE surface area term.
 
     const float probeRadius = 0.14f;
     double energy = 0.0;
-    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    float preFactor;
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
+    else
+        preFactor = 0.0f;
+    AlignedArray<float>& threadBornForce = threadBornForces[threadIndex];
     for (int i = 0; i < numParticles; i++)
-        bornForces[i] = 0.0f;
+        threadBornForce[i] = 0.0f;
     while (true) {
         int atomI = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
         if (atomI >= numParticles)
             break;
+        float offsetRadius = particleParams[atomI].first;
+        float sum = 0.0f;
+        for (int i = 0; i < numThreads; i++)
+            sum += threadBornSums[i][atomI];
+        sum *= 0.5f*offsetRadius;
+        float sum2 = sum*sum;
+        float sum3 = sum*sum2;
+        float tanhSum = tanh(alphaObc*sum - betaObc*sum2 + gammaObc*sum3);
+        float radiusI = offsetRadius + dielectricOffset;
+        bornRadii[atomI] = 1.0f/(1.0f/offsetRadius - tanhSum/radiusI);
+        obcChain[atomI] = offsetRadius*(alphaObc - 2.0f*betaObc*sum + 3.0f*gammaObc*sum2);
+        obcChain[atomI] = (1.0f - tanhSum*tanhSum)*obcChain[atomI]/radiusI;
         if (bornRadii[atomI] > 0) {
-            float radiusI = particleParams[atomI].first + dielectricOffset;
             float r = radiusI + probeRadius;
             float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
             float saTerm = surfaceAreaFactor*r*r*ratio6;
             energy += saTerm;
-            bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
+            threadBornForce[atomI] = -6.0f*saTerm/bornRadii[atomI]; 
         }
-        else
-            bornForces[atomI] = 0.0f;
+        
+        // Add the self interaction of this atom in the Born energy.
+        
+        float partialCharge = posq[4*atomI+3];
+        float gpol = preFactor*partialCharge*partialCharge/bornRadii[atomI];
+        energy += 0.5f*gpol;
+        threadBornForce[atomI] -= 0.5f*gpol/bornRadii[atomI];
     }
     threads.syncThreads();
  
     // First loop of Born energy computation.
 
     float* forces = &(*threadForce)[threadIndex][0];
-    float preFactor;
-    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
-        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
-    else
-        preFactor = 0.0f;
     while (true) {
-        int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
-        if (blockStart >= numParticles)
+        int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (blockIndex >= numBlocks)
             break;
-        int numInBlock = min(4, numParticles-blockStart);
-        ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
-        float atomCharge[4], atomx[4], atomy[4], atomz[4];
-        int blockMask[4] = {0, 0, 0, 0};
+        int atoms[4];
+        ivec4 blockAtomIndex;
+        int numNeighbors = getBlockAtoms(blockIndex, atoms, blockAtomIndex);
+        float atomCharge[4], atomRadii[4], atomx[4], atomy[4], atomz[4];
         fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            atomx[i] = posq[4*atomIndex];
-            atomy[i] = posq[4*atomIndex+1];
-            atomz[i] = posq[4*atomIndex+2];
-            atomCharge[i] = preFactor*posq[4*atomIndex+3];
-            blockMask[i] = 0xFFFFFFFF;
+        for (int i = 0; i < 4; i++) {
+            atomx[i] = posq[4*atoms[i]];
+            atomy[i] = posq[4*atoms[i]+1];
+            atomz[i] = posq[4*atoms[i]+2];
+            atomCharge[i] = preFactor*posq[4*atoms[i]+3];
+            atomRadii[i] = bornRadii[atoms[i]];
         }
-        fvec4 radii(&bornRadii[blockStart]);
+        fvec4 radii(atomRadii);
         fvec4 x(atomx);
         fvec4 y(atomy);
         fvec4 z(atomz);
         fvec4 partialChargeI(atomCharge);
-        ivec4 mask(blockMask);
-        for (int atomJ = blockStart; atomJ < numParticles; atomJ++) {
+        for (int neighbor = 0; neighbor < numNeighbors; neighbor++) {
+            ivec4 include;
+            int atomJ = getBlockNeighbor(blockIndex, neighbor, blockAtomIndex, include);
             fvec4 posJ(posq+4*atomJ);
             fvec4 dx, dy, dz, r2;
             getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
-            ivec4 include = mask & (blockAtomIndex <= ivec4(atomJ));
             if (cutoff)
-                include = include & (r2 < cutoffDistance*cutoffDistance);
+                include = include & (r2 < cutoff2);
             if (!any(include))
                 continue;
-            fvec4 r = sqrt(r2);
             fvec4 alpha2_ij = radii*bornRadii[atomJ];
             fvec4 D_ij = r2/(4.0f*alpha2_ij);
             fvec4 expTerm(expf(-D_ij[0]), expf(-D_ij[1]), expf(-D_ij[2]), expf(-D_ij[3]));
             fvec4 denominator2 = r2 + alpha2_ij*expTerm;
             fvec4 denominator = sqrt(denominator2);
             fvec4 Gpol = (partialChargeI*posJ[3])/denominator; 
+            fvec4 termEnergy = Gpol;
+            if (cutoff)
+                termEnergy -= partialChargeI*posJ[3]/cutoffDistance;
+            energy += dot4(blend(0.0f, termEnergy, include), one);
+            if (!includeForces)
+                continue;
             fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;  
             fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
             dGpol_dr = blend(0.0f, dGpol_dr, include);
@@ -295,29 +304,32 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
             blockAtomForceZ -= fz;
             blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
             float* atomForce = forces+4*atomJ;
-            fvec4 one(1.0f);
             atomForce[0] += dot4(fx, one);
             atomForce[1] += dot4(fy, one);
             atomForce[2] += dot4(fz, one);
-            ivec4 atomJMask = include & (blockAtomIndex != ivec4(atomJ));
-            fvec4 termEnergy = blend(0.0f, Gpol, include);
-            if (cutoff)
-                termEnergy -= blend(0.0f, partialChargeI*posJ[3]/cutoffDistance, atomJMask);
-            termEnergy *= blend(0.5f, 1.0f, atomJMask);
-            energy += dot4(termEnergy, one);
-            bornForces[atomJ] += dot4(blend(0.0f, dGpol_dalpha2_ij, atomJMask), radii);
+            threadBornForce[atomJ] += dot4(dGpol_dalpha2_ij, radii);
         }
+        if (!includeForces)
+            continue;
         fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
         transpose(f[0], f[1], f[2], f[3]);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
-            bornForces[atomIndex] += blockAtomBornForce[i];
+        for (int i = 0; i < 4; i++) {
+            if (blockAtomIndex[i] < numParticles) {
+                int atomIndex = atoms[i];
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+                threadBornForce[atomIndex] += blockAtomBornForce[i];
+            }
         }
     }
+    if (!includeForces) {
+        // The remaining passes only compute forces.
+
+        threadEnergy[threadIndex] = energy;
+        return;
+    }
     threads.syncThreads();
 
-    // Second loop of Born energy computation.
+    // Sum the Born forces from all the threads.
 
     while (true) {
         int blockStart = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 4);
@@ -328,53 +340,48 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
             bornForce += fvec4(&threadBornForces[i][blockStart]);
         fvec4 radii(&bornRadii[blockStart]);
         bornForce *= radii*radii*fvec4(&obcChain[blockStart]);
-        int numInBlock = min(4, numParticles-blockStart);
-        ivec4 blockAtomIndex(blockStart, blockStart+1, blockStart+2, blockStart+3);
-        float atomRadius[4], atomx[4], atomy[4], atomz[4];
-        int blockMask[4] = {0, 0, 0, 0};
-        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            atomRadius[i] = particleParams[atomIndex].first;
-            atomx[i] = posq[4*atomIndex];
-            atomy[i] = posq[4*atomIndex+1];
-            atomz[i] = posq[4*atomIndex+2];
-            blockMask[i] = 0xFFFFFFFF;
-        }
-        for (int i = numInBlock; i < 4; i++) {
-            atomx[i] = 0.0f;
-            atomy[i] = 0.0f;
-            atomz[i] = 0.0f;
+        bornForce.store(&bornForces[blockStart]);
+    }
+    threads.syncThreads();
+
+    // Second loop of Born energy computation.
+
+    while (true) {
+        int blockIndex = gmx_atomic_fetch_add(reinterpret_cast<gmx_atomic_t*>(atomicCounter), 1);
+        if (blockIndex >= numBlocks)
+            break;
+        int atoms[4];
+        ivec4 blockAtomIndex;
+        int numNeighbors = getBlockAtoms(blockIndex, atoms, blockAtomIndex);
+        float atomRadius[4], atomScaledRadius[4], atomBornForce[4], atomx[4], atomy[4], atomz[4];
+        for (int i = 0; i < 4; i++) {
+            atomRadius[i] = particleParams[atoms[i]].first;
+            atomScaledRadius[i] = particleParams[atoms[i]].second;
+            atomBornForce[i] = bornForces[atoms[i]];
+            atomx[i] = posq[4*atoms[i]];
+            atomy[i] = posq[4*atoms[i]+1];
+            atomz[i] = posq[4*atoms[i]+2];
         }
         fvec4 offsetRadiusI(atomRadius);
+        fvec4 scaledRadiusI(atomScaledRadius);
+        fvec4 bornForceI(atomBornForce);
         fvec4 x(atomx);
         fvec4 y(atomy);
         fvec4 z(atomz);
-        ivec4 mask(blockMask);
-        for (int atomJ = 0; atomJ < numParticles; atomJ++) {
+        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+        for (int neighbor = 0; neighbor < numNeighbors; neighbor++) {
+            ivec4 include;
+            int atomJ = getBlockNeighbor(blockIndex, neighbor, blockAtomIndex, include);
             fvec4 posJ(posq+4*atomJ);
             fvec4 dx, dy, dz, r2;
             getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
-            ivec4 include = mask & (blockAtomIndex != ivec4(atomJ));
             if (cutoff)
-                include = include & (r2 < cutoffDistance*cutoffDistance);
+                include = include & (r2 < cutoff2);
             if (!any(include))
                 continue;
             fvec4 r = sqrt(r2);
-            float scaledRadiusJ = particleParams[atomJ].second;
-            float scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
-            fvec4 rScaledRadiusJ = r + scaledRadiusJ;
-            include = include & (offsetRadiusI < rScaledRadiusJ);
-            fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
-            fvec4 u_ij = 1.0f/rScaledRadiusJ;
-            fvec4 l_ij2 = l_ij*l_ij;
-            fvec4 u_ij2 = u_ij*u_ij;
-            fvec4 rInverse = 1.0f/r;
-            fvec4 r2Inverse = rInverse*rInverse;
-            fvec4 logRatio = fastLog(u_ij/l_ij);
-            fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ2*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
-            fvec4 de = bornForce*t3*rInverse;
-            de = blend(0.0f, de, include);
+            fvec4 de = bornForceI*computeBornForceTerm(offsetRadiusI, particleParams[atomJ].second, r, include);
+            de += bornForces[atomJ]*computeBornForceTerm(particleParams[atomJ].first, scaledRadiusI, r, include);
             fvec4 fx = dx*de;
             fvec4 fy = dy*de;
             fvec4 fz = dz*de;
@@ -382,21 +389,87 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
             blockAtomForceY += fy;
             blockAtomForceZ += fz;
             float* atomForce = forces+4*atomJ;
-            fvec4 one(1.0f);
             atomForce[0] -= dot4(fx, one);
             atomForce[1] -= dot4(fy, one);
             atomForce[2] -= dot4(fz, one);
         }
         fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
         transpose(f[0], f[1], f[2], f[3]);
-        for (int i = 0; i < numInBlock; i++) {
-            int atomIndex = blockStart+i;
-            (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+        for (int i = 0; i < 4; i++) {
+            if (blockAtomIndex[i] < numParticles) {
+                int atomIndex = atoms[i];
+                (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+            }
         }
     }
     threadEnergy[threadIndex] = energy;
 }
 
+int CpuGBSAOBCForce::getNumBlocks() const {
+    if (cutoff)
+        return neighborList->getNumBlocks();
+    return (particleParams.size()+3)/4;
+}
+
+int CpuGBSAOBCForce::getBlockAtoms(int blockIndex, int* atoms, ivec4& atomIndex) const {
+    int numParticles = particleParams.size();
+    int blockStart = 4*blockIndex;
+    if (cutoff) {
+        // Atoms past the end of the last block are padding, which the neighbor list has already
+        // marked as excluded from all interactions.
+
+        const int* blockAtom = &neighborList->getSortedAtoms()[blockStart];
+        for (int i = 0; i < 4; i++)
+            atoms[i] = blockAtom[i];
+        atomIndex = ivec4(blockStart, blockStart+1, blockStart+2, blockStart+3);
+        return neighborList->getBlockNeighbors(blockIndex).size();
+    }
+    
+    // Without a cutoff, each block interacts with itself and all later atoms.
+    
+    for (int i = 0; i < 4; i++)
+        atoms[i] = (blockStart+i < numParticles ? blockStart+i : blockStart);
+    atomIndex = ivec4(blockStart, blockStart+1, blockStart+2, blockStart+3);
+    return numParticles-blockStart;
+}
+
+int CpuGBSAOBCForce::getBlockNeighbor(int blockIndex, int neighborIndex, const ivec4& atomIndex, ivec4& include) const {
+    if (cutoff) {
+        int exclusions = neighborList->getBlockExclusions(blockIndex)[neighborIndex];
+        include = ((ivec4(exclusions) & ivec4(1, 2, 4, 8)) == ivec4(0));
+        return neighborList->getBlockNeighbors(blockIndex)[neighborIndex];
+    }
+    int atom = 4*blockIndex+neighborIndex;
+    include = (atomIndex < ivec4(atom));
+    return atom;
+}
+
+fvec4 CpuGBSAOBCForce::computeBornRadiusTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const ivec4& include) {
+    fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 rInverse = 1.0f/r;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(1.0f/offsetRadiusI-l_ij), offsetRadiusI < scaledRadiusJ-r);
+    return blend(0.0f, term, include & (offsetRadiusI < rScaledRadiusJ));
+}
+
+fvec4 CpuGBSAOBCForce::computeBornForceTerm(const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, const fvec4& r, const ivec4& include) {
+    fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 rInverse = 1.0f/r;
+    fvec4 r2Inverse = rInverse*rInverse;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ*scaledRadiusJ*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3*rInverse, include & (offsetRadiusI < rScaledRadiusJ));
+}
+
 void CpuGBSAOBCForce::getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
     dx = x-posI[0];
     dy = y-posI[1];
@@ -47,8 +47,10 @@
 #include "RealVec.h"
 #include "lepton/CompiledExpression.h"
 #include "lepton/CustomFunction.h"
+#include "lepton/Operation.h"
 #include "lepton/Parser.h"
 #include "lepton/ParsedExpression.h"
+#include <sstream>
 
 using namespace OpenMM;
 using namespace std;
@@ -271,7 +273,7 @@ void CpuCalcPeriodicTorsionForceKernel::initialize(const System& system, const P
         torsionParamArray[i][1] = (RealOpenMM) phase;
         torsionParamArray[i][2] = (RealOpenMM) periodicity;
     }
-    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
+    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads, data.isFrozen);
 }
 
 double CpuCalcPeriodicTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -299,6 +301,7 @@ void CpuCalcPeriodicTorsionForceKernel::copyParametersToContext(ContextImpl& con
         torsionParamArray[i][1] = (RealOpenMM) phase;
         torsionParamArray[i][2] = (RealOpenMM) periodicity;
     }
+    bondForce.clearFrozenBonds();
 }
 
 CpuCalcRBTorsionForceKernel::~CpuCalcRBTorsionForceKernel() {
@@ -335,7 +338,7 @@ void CpuCalcRBTorsionForceKernel::initialize(const System& system, const RBTorsi
         torsionParamArray[i][4] = (RealOpenMM) c4;
         torsionParamArray[i][5] = (RealOpenMM) c5;
     }
-    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
+    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads, data.isFrozen);
 }
 
 double CpuCalcRBTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -366,11 +369,12 @@ void CpuCalcRBTorsionForceKernel::copyParametersToContext(ContextImpl& context,
         torsionParamArray[i][4] = (RealOpenMM) c4;
         torsionParamArray[i][5] = (RealOpenMM) c5;
     }
+    bondForce.clearFrozenBonds();
 }
 
 class CpuCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
 public:
-    PmeIO(float* posq, float* force, int numParticles) : posq(posq), force(force), numParticles(numParticles) {
+    PmeIO(float* posq, float* force, int numParticles, ThreadPool& threads) : posq(posq), force(force), numParticles(numParticles), threads(threads) {
     }
     float* getPosq() {
         return posq;
@@ -382,10 +386,14 @@ public:
             force[4*i+2] += f[4*i+2];
         }
     }
+    ThreadPool* getThreadPool() {
+        return &threads;
+    }
 private:
     float* posq;
     float* force;
     int numParticles;
+    ThreadPool& threads;
 };
 
 bool isVec8Supported();
@@ -393,13 +401,16 @@ CpuNonbondedForce* createCpuNonbondedForceVec4();
 CpuNonbondedForce* createCpuNonbondedForceVec8();
 
 CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcNonbondedForceKernel(name, platform),
-        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), hasInitializedPme(false), neighborList(NULL), nonbonded(NULL) {
+        data(data), bonded14IndexArray(NULL), bonded14ParamArray(NULL), frozenInteractionsValid(false), changeDataValid(false), hasInitializedPme(false),
+        neighborList(NULL), frozenNeighborList(NULL), nonbonded(NULL) {
     if (isVec8Supported()) {
         neighborList = new CpuNeighborList(8);
+        frozenNeighborList = new CpuNeighborList(8);
         nonbonded = createCpuNonbondedForceVec8();
     }
     else {
         neighborList = new CpuNeighborList(4);
+        frozenNeighborList = new CpuNeighborList(4);
         nonbonded = createCpuNonbondedForceVec4();
     }
 }
@@ -417,6 +428,8 @@ CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
         delete nonbonded;
     if (neighborList != NULL)
         delete neighborList;
+    if (frozenNeighborList != NULL)
+        delete frozenNeighborList;
 }
 
 void CpuCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
@@ -439,6 +452,9 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
     // Record the particle parameters.
 
     num14 = nb14s.size();
+    exception14Index.resize(force.getNumExceptions(), -1);
+    for (int i = 0; i < num14; i++)
+        exception14Index[nb14s[i]] = i;
     bonded14IndexArray = new int*[num14];
     for (int i = 0; i < num14; i++)
         bonded14IndexArray[i] = new int[2];
@@ -446,17 +462,21 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
     for (int i = 0; i < num14; i++)
         bonded14ParamArray[i] = new double[3];
     particleParams.resize(numParticles);
-    double sumSquaredCharges = 0.0;
+    particleCharges.resize(numParticles);
+    alchemical.resize(numParticles);
     for (int i = 0; i < numParticles; ++i) {
         double charge, radius, depth;
         force.getParticleParameters(i, charge, radius, depth);
-        data.posq[4*i+3] = (float) charge;
+        particleCharges[i] = charge;
         particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
-        sumSquaredCharges += charge*charge;
+        alchemical[i] = (force.isParticleAlchemical(i) ? 1.0f : 0.0f);
     }
+    hasAlchemicalParticles = (force.getNumAlchemicalParticles() > 0);
+    softcoreAlpha = force.getSoftcoreAlpha();
     
     // Recorded exception parameters.
     
+    exceptionChargeProds.resize(num14);
     for (int i = 0; i < num14; ++i) {
         int particle1, particle2;
         double charge, radius, depth;
@@ -465,8 +485,10 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
         bonded14IndexArray[i][1] = particle2;
         bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
         bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
-        bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
+        exceptionChargeProds[i] = charge;
     }
+
+    findFrozenInteractions();
     
     // Record other parameters.
     
@@ -488,17 +510,83 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
         NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2]);
         ewaldAlpha = alpha;
     }
-    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
-        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
-    else
-        ewaldSelfEnergy = 0.0;
+    setAlchemicalCharges(1.0);
     rfDielectric = force.getReactionFieldDielectric();
-    if (force.getUseDispersionCorrection())
+    if (force.getUseDispersionCorrection()) {
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
+        decoupledDispersionCoefficient = (hasAlchemicalParticles ? NonbondedForceImpl::calcDispersionCorrection(system, force, 0.0) : dispersionCoefficient);
+    }
     else
-        dispersionCoefficient = 0.0;
+        dispersionCoefficient = decoupledDispersionCoefficient = 0.0;
+    lastPositions.resize(numParticles, Vec3(1e10, 1e10, 1e10));
+    data.isPeriodic = (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME);
+}
+
+bool CpuCalcNonbondedForceKernel::initializeFromKernel(const System& system, const NonbondedForce& force, const CalcNonbondedForceKernel& originalKernel) {
+    const CpuCalcNonbondedForceKernel& original = dynamic_cast<const CpuCalcNonbondedForceKernel&>(originalKernel);
+
+    // Copy the exclusions and parameters.
+
+    numParticles = original.numParticles;
+    num14 = original.num14;
+    exclusions = original.exclusions;
+    exception14Index = original.exception14Index;
+    bonded14IndexArray = new int*[num14];
+    bonded14ParamArray = new double*[num14];
+    for (int i = 0; i < num14; i++) {
+        bonded14IndexArray[i] = new int[2];
+        bonded14ParamArray[i] = new double[3];
+        for (int j = 0; j < 2; j++)
+            bonded14IndexArray[i][j] = original.bonded14IndexArray[i][j];
+        for (int j = 0; j < 3; j++)
+            bonded14ParamArray[i][j] = original.bonded14ParamArray[i][j];
+    }
+    particleParams = original.particleParams;
+    particleCharges = original.particleCharges;
+    exceptionChargeProds = original.exceptionChargeProds;
+    alchemical = original.alchemical;
+    hasAlchemicalParticles = original.hasAlchemicalParticles;
+    softcoreAlpha = original.softcoreAlpha;
+    findFrozenInteractions();
+
+    // Copy the other parameters, including the ones that are expensive to compute.
+
+    nonbondedMethod = original.nonbondedMethod;
+    nonbondedCutoff = original.nonbondedCutoff;
+    useSwitchingFunction = original.useSwitchingFunction;
+    if (useSwitchingFunction)
+        switchingDistance = original.switchingDistance;
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        ewaldAlpha = original.ewaldAlpha;
+    for (int i = 0; i < 3; i++) {
+        kmax[i] = original.kmax[i];
+        gridSize[i] = original.gridSize[i];
+    }
+    setAlchemicalCharges(1.0);
+    rfDielectric = original.rfDielectric;
+    dispersionCoefficient = original.dispersionCoefficient;
+    decoupledDispersionCoefficient = original.decoupledDispersionCoefficient;
     lastPositions.resize(numParticles, Vec3(1e10, 1e10, 1e10));
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME);
+    return true;
+}
+
+void CpuCalcNonbondedForceKernel::findFrozenInteractions() {
+    // Interactions between particles with zero mass never change, so they are computed separately and cached.
+
+    for (int i = 0; i < num14; i++) {
+        if (data.isFrozen.size() > 0 && data.isFrozen[bonded14IndexArray[i][0]] && data.isFrozen[bonded14IndexArray[i][1]]) {
+            frozen14IndexArray.push_back(bonded14IndexArray[i]);
+            frozen14ParamArray.push_back(bonded14ParamArray[i]);
+        }
+        else {
+            active14IndexArray.push_back(bonded14IndexArray[i]);
+            active14ParamArray.push_back(bonded14ParamArray[i]);
+        }
+    }
+    for (int i = 0; i < (int) data.isFrozen.size(); i++)
+        if (data.isFrozen[i])
+            frozenParticles.push_back(i);
 }
 
 double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
@@ -521,7 +609,7 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     vector<RealVec>& posData = extractPositions(context);
     vector<RealVec>& forceData = extractForces(context);
     RealVec* boxVectors = extractBoxVectors(context);
-    double energy = (includeReciprocal ? ewaldSelfEnergy : 0.0);
+    double energy = 0.0;
     bool ewald  = (nonbondedMethod == Ewald);
     bool pme  = (nonbondedMethod == PME);
     if (nonbondedMethod != NoCutoff) {
@@ -566,8 +654,9 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
                 }
         }
         if (needRecompute) {
-            neighborList->computeNeighborList(numParticles, posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff+padding, data.threads);
+            neighborList->computeNeighborList(numParticles, posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff+padding, data.threads, data.isFrozen);
             lastPositions = posData;
+            changeDataValid = false;
         }
         nonbonded->setUseCutoff(nonbondedCutoff, *neighborList, rfDielectric);
     }
@@ -584,14 +673,32 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         nonbonded->setUsePME(ewaldAlpha, gridSize);
     if (useSwitchingFunction)
         nonbonded->setUseSwitchingFunction(switchingDistance);
+    double lambdaSterics = 1.0;
+    if (hasAlchemicalParticles) {
+        lambdaSterics = context.getParameter(NonbondedForce::LambdaSterics());
+        double lambda = context.getParameter(NonbondedForce::LambdaElectrostatics());
+        if (lambda != lambdaElectrostatics)
+            setAlchemicalCharges(lambda);
+        nonbonded->setUseSoftcore(alchemical, (float) softcoreAlpha, (float) lambdaSterics);
+    }
+    if (includeReciprocal)
+        energy += ewaldSelfEnergy;
+    if (includeDirect && frozenParticles.size() > 0) {
+        computeFrozenInteractions(context);
+        if (includeForces)
+            for (int i = 0; i < (int) frozenParticles.size(); i++)
+                forceData[frozenParticles[i]] += frozenForces[frozenParticles[i]];
+        energy += frozenEnergy;
+    }
+    nonbonded->setFrozenAtoms(data.isFrozen, false);
     double nonbondedEnergy = 0;
     if (includeDirect)
-        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
+        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, exclusions, data.threadForce, includeForces, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
     if (includeReciprocal) {
         if (useOptimizedPme) {
-            PmeIO io(&posq[0], &data.threadForce[0][0], numParticles);
+            PmeIO io(&posq[0], &data.threadForce[0][0], numParticles, data.threads);
             Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
-            optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
+            optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy, includeForces);
             nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
         }
         else
@@ -601,13 +708,244 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     if (includeDirect) {
         ReferenceBondForce refBondForce;
         ReferenceLJCoulomb14 nonbonded14;
-        refBondForce.calculateForce(num14, bonded14IndexArray, posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14);
-        if (data.isPeriodic)
-            energy += dispersionCoefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
+        int numActive14 = active14IndexArray.size();
+        if (numActive14 > 0)
+            refBondForce.calculateForce(numActive14, &active14IndexArray[0], posData, &active14ParamArray[0], forceData, includeEnergy ? &energy : NULL, nonbonded14);
+        if (data.isPeriodic) {
+            double coefficient = decoupledDispersionCoefficient+lambdaSterics*(dispersionCoefficient-decoupledDispersionCoefficient);
+            energy += coefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
+        }
     }
     return energy;
 }
 
+bool CpuCalcNonbondedForceKernel::computeEnergyChange(ContextImpl& context, const vector<int>& particles, const vector<Vec3>& newPositions,
+        bool includeDirect, bool includeReciprocal, double& energyChange) {
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        return false;
+    energyChange = 0.0;
+    if (!includeDirect)
+        return true;
+    if (hasAlchemicalParticles) {
+        double lambda = context.getParameter(NonbondedForce::LambdaElectrostatics());
+        if (lambda != lambdaElectrostatics)
+            setAlchemicalCharges(lambda);
+        nonbonded->setUseSoftcore(alchemical, (float) softcoreAlpha, (float) context.getParameter(NonbondedForce::LambdaSterics()));
+    }
+    if (!changeDataValid || changeStateVersion != context.getStateVersion())
+        updateEnergyChangeData(context);
+    if (nonbondedMethod != NoCutoff)
+        nonbonded->setUseCutoff(nonbondedCutoff, *neighborList, rfDielectric);
+    if (data.isPeriodic)
+        nonbonded->setPeriodic(extractBoxVectors(context));
+    if (useSwitchingFunction)
+        nonbonded->setUseSwitchingFunction(switchingDistance);
+    vector<RealVec>& posData = extractPositions(context);
+    int numMoved = particles.size();
+    for (int i = 0; i < numMoved; i++)
+        isMovedParticle[particles[i]] = 1;
+
+    // The neighbor list can be used if it contains every pair that is within the cutoff both before and after the
+    // move.  That is true as long as no two particles have together moved further than the padding since it was
+    // built.  Only the moved particles need to be checked individually.  Every other particle has moved no further
+    // than the furthest one that was not moved.  Pairs of frozen particles are left out of the list, so it cannot
+    // be used if a frozen particle moves.
+
+    bool useNeighborList = (nonbondedMethod != NoCutoff);
+    if (useNeighborList) {
+        double largest = (isMovedParticle[changeDisplacementIndex[0]] ? changeDisplacement2[1] : changeDisplacement2[0]);
+        double secondLargest = 0;
+        for (int i = 0; i < numMoved; i++) {
+            int particle = particles[i];
+            RealVec oldDelta = posData[particle]-lastPositions[particle];
+            RealVec newDelta = RealVec(newPositions[i][0], newPositions[i][1], newPositions[i][2])-lastPositions[particle];
+            double displacement2 = max(oldDelta.dot(oldDelta), newDelta.dot(newDelta));
+            if (displacement2 > largest) {
+                secondLargest = largest;
+                largest = displacement2;
+            }
+            else if (displacement2 > secondLargest)
+                secondLargest = displacement2;
+            if (data.isFrozen.size() > 0 && data.isFrozen[particle])
+                useNeighborList = false;
+        }
+        double padding = 0.15*nonbondedCutoff;
+        if (sqrt(largest)+sqrt(secondLargest) > padding)
+            useNeighborList = false;
+    }
+
+    // Compute the interactions involving the moved particles before the move, update their coordinates in the
+    // private buffer, compute them again, and finally restore the buffer.
+
+    double oldEnergy = 0, newEnergy = 0;
+    nonbonded->calculateSubsetIxn(numParticles, &changePosq[0], particleParams, exclusions, particles, useNeighborList, &oldEnergy);
+    for (int i = 0; i < numMoved; i++)
+        for (int j = 0; j < 3; j++)
+            changePosq[4*particles[i]+j] = (float) newPositions[i][j];
+    nonbonded->calculateSubsetIxn(numParticles, &changePosq[0], particleParams, exclusions, particles, useNeighborList, &newEnergy);
+    for (int i = 0; i < numMoved; i++)
+        for (int j = 0; j < 3; j++)
+            changePosq[4*particles[i]+j] = (float) posData[particles[i]][j];
+
+    // Compute the 1-4 interactions involving them.  Each one is evaluated on a private copy of the two
+    // positions, and an interaction between two moved particles is only counted once.
+
+    ReferenceLJCoulomb14 nonbonded14;
+    int pairIndices[2] = {0, 1};
+    vector<RealVec> oldPairPos(2), newPairPos(2), pairForces(2);
+    for (int i = 0; i < numMoved; i++) {
+        int particle = particles[i];
+        for (int j = 0; j < (int) particle14s[particle].size(); j++) {
+            int index = particle14s[particle][j];
+            int particle1 = bonded14IndexArray[index][0];
+            int particle2 = bonded14IndexArray[index][1];
+            int other = (particle1 == particle ? particle2 : particle1);
+            if (isMovedParticle[other] && other < particle)
+                continue;
+            for (int k = 0; k < 2; k++) {
+                int atom = bonded14IndexArray[index][k];
+                oldPairPos[k] = posData[atom];
+                newPairPos[k] = posData[atom];
+            }
+            for (int k = 0; k < numMoved; k++) {
+                if (particles[k] == particle1)
+                    newPairPos[0] = RealVec(newPositions[k][0], newPositions[k][1], newPositions[k][2]);
+                if (particles[k] == particle2)
+                    newPairPos[1] = RealVec(newPositions[k][0], newPositions[k][1], newPositions[k][2]);
+            }
+            nonbonded14.calculateBondIxn(pairIndices, oldPairPos, bonded14ParamArray[index], pairForces, &oldEnergy);
+            nonbonded14.calculateBondIxn(pairIndices, newPairPos, bonded14ParamArray[index], pairForces, &newEnergy);
+        }
+    }
+    for (int i = 0; i < numMoved; i++)
+        isMovedParticle[particles[i]] = 0;
+    energyChange = newEnergy-oldEnergy;
+    return true;
+}
+
+void CpuCalcNonbondedForceKernel::updateEnergyChangeData(ContextImpl& context) {
+    // This is done once for each state of the Context, so repeated trial moves from the same state are cheap.
+
+    vector<RealVec>& posData = extractPositions(context);
+    if (particle14s.size() == 0) {
+        particle14s.resize(numParticles);
+        for (int i = 0; i < num14; i++) {
+            particle14s[bonded14IndexArray[i][0]].push_back(i);
+            particle14s[bonded14IndexArray[i][1]].push_back(i);
+        }
+        isMovedParticle.resize(numParticles, 0);
+    }
+    changePosq.resize(4*numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        for (int j = 0; j < 3; j++)
+            changePosq[4*i+j] = (float) posData[i][j];
+        changePosq[4*i+3] = (float) (alchemical[i] != 0.0f ? lambdaElectrostatics*particleCharges[i] : particleCharges[i]);
+    }
+    changeDisplacement2[0] = changeDisplacement2[1] = 0.0;
+    changeDisplacementIndex[0] = changeDisplacementIndex[1] = 0;
+    if (nonbondedMethod != NoCutoff) {
+        for (int i = 0; i < numParticles; i++) {
+            RealVec delta = posData[i]-lastPositions[i];
+            double displacement2 = delta.dot(delta);
+            if (displacement2 > changeDisplacement2[0]) {
+                changeDisplacement2[1] = changeDisplacement2[0];
+                changeDisplacementIndex[1] = changeDisplacementIndex[0];
+                changeDisplacement2[0] = displacement2;
+                changeDisplacementIndex[0] = i;
+            }
+            else if (displacement2 > changeDisplacement2[1]) {
+                changeDisplacement2[1] = displacement2;
+                changeDisplacementIndex[1] = i;
+            }
+        }
+    }
+    changeStateVersion = context.getStateVersion();
+    changeDataValid = true;
+}
+
+void CpuCalcNonbondedForceKernel::computeFrozenInteractions(ContextImpl& context) {
+    vector<RealVec>& posData = extractPositions(context);
+    RealVec* boxVectors = extractBoxVectors(context);
+    double lambdaSterics = (hasAlchemicalParticles ? context.getParameter(NonbondedForce::LambdaSterics()) : 1.0);
+    int numFrozen = frozenParticles.size();
+    if (frozenInteractionsValid) {
+        // The cached values remain valid as long as no frozen particle has been moved (for example by setPositions()
+        // or a barostat) and nothing else they depend on has changed.
+
+        if (lambdaSterics != frozenLambdaSterics)
+            frozenInteractionsValid = false;
+        for (int i = 0; i < 3 && frozenInteractionsValid; i++)
+            if ((Vec3) boxVectors[i] != (Vec3) frozenBoxVectors[i])
+                frozenInteractionsValid = false;
+        for (int i = 0; i < numFrozen && frozenInteractionsValid; i++)
+            if ((Vec3) posData[frozenParticles[i]] != (Vec3) frozenPositions[i])
+                frozenInteractionsValid = false;
+        if (frozenInteractionsValid)
+            return;
+    }
+    int numThreads = data.threads.getNumThreads();
+    frozenThreadForce.resize(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        frozenThreadForce[i].resize(4*numParticles);
+        for (int j = 0; j < 4*numParticles; j++)
+            frozenThreadForce[i][j] = 0.0f;
+    }
+    if (nonbondedMethod != NoCutoff) {
+        frozenNeighborList->computeNeighborList(numParticles, data.posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads, data.isFrozen, true);
+        nonbonded->setUseCutoff(nonbondedCutoff, *frozenNeighborList, rfDielectric);
+    }
+    nonbonded->setFrozenAtoms(data.isFrozen, true);
+    frozenEnergy = 0;
+    nonbonded->calculateDirectIxn(numParticles, &data.posq[0], posData, particleParams, exclusions, frozenThreadForce, true, &frozenEnergy, data.threads);
+    if (nonbondedMethod != NoCutoff)
+        nonbonded->setUseCutoff(nonbondedCutoff, *neighborList, rfDielectric);
+    frozenForces.assign(numParticles, RealVec());
+    for (int i = 0; i < numFrozen; i++) {
+        int particle = frozenParticles[i];
+        for (int j = 0; j < numThreads; j++)
+            frozenForces[particle] += RealVec(frozenThreadForce[j][4*particle], frozenThreadForce[j][4*particle+1], frozenThreadForce[j][4*particle+2]);
+    }
+    if (frozen14IndexArray.size() > 0) {
+        ReferenceBondForce refBondForce;
+        ReferenceLJCoulomb14 nonbonded14;
+        refBondForce.calculateForce(frozen14IndexArray.size(), &frozen14IndexArray[0], posData, &frozen14ParamArray[0], frozenForces, &frozenEnergy, nonbonded14);
+    }
+
+    // Record what the cached values depend on.
+
+    frozenPositions.resize(numFrozen);
+    for (int i = 0; i < numFrozen; i++)
+        frozenPositions[i] = posData[frozenParticles[i]];
+    for (int i = 0; i < 3; i++)
+        frozenBoxVectors[i] = boxVectors[i];
+    frozenLambdaSterics = lambdaSterics;
+    frozenInteractionsValid = true;
+}
+
+void CpuCalcNonbondedForceKernel::setAlchemicalCharges(double lambda) {
+    frozenInteractionsValid = false;
+    changeDataValid = false;
+    lambdaElectrostatics = lambda;
+    double sumSquaredCharges = 0.0;
+    for (int i = 0; i < numParticles; i++) {
+        double charge = (alchemical[i] != 0.0f ? lambda*particleCharges[i] : particleCharges[i]);
+        data.posq[4*i+3] = (float) charge;
+        sumSquaredCharges += charge*charge;
+    }
+    for (int i = 0; i < num14; i++) {
+        double chargeProd = exceptionChargeProds[i];
+        if (alchemical[bonded14IndexArray[i][0]] != 0.0f)
+            chargeProd *= lambda;
+        if (alchemical[bonded14IndexArray[i][1]] != 0.0f)
+            chargeProd *= lambda;
+        bonded14ParamArray[i][2] = chargeProd;
+    }
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
+    else
+        ewaldSelfEnergy = 0.0;
+}
+
 void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context, const NonbondedForce& force) {
     if (force.getNumParticles() != numParticles)
         throw OpenMMException("updateParametersInContext: The number of particles has changed");
@@ -621,21 +959,18 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
     }
     if (nb14s.size() != num14)
         throw OpenMMException("updateParametersInContext: The number of non-excluded exceptions has changed");
+    for (int i = 0; i < numParticles; ++i)
+        if (force.isParticleAlchemical(i) != (alchemical[i] != 0.0f))
+            throw OpenMMException("updateParametersInContext: The set of alchemical particles has changed");
 
     // Record the values.
 
-    double sumSquaredCharges = 0.0;
     for (int i = 0; i < numParticles; ++i) {
         double charge, radius, depth;
         force.getParticleParameters(i, charge, radius, depth);
-        data.posq[4*i+3] = (float) charge;
+        particleCharges[i] = charge;
         particleParams[i] = make_pair((float) (0.5*radius), (float) (2.0*sqrt(depth)));
-        sumSquaredCharges += charge*charge;
     }
-    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
-        ewaldSelfEnergy = -ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(M_PI);
-    else
-        ewaldSelfEnergy = 0.0;
     for (int i = 0; i < num14; ++i) {
         int particle1, particle2;
         double charge, radius, depth;
@@ -644,18 +979,125 @@ void CpuCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
         bonded14IndexArray[i][1] = particle2;
         bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
         bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
-        bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
+        exceptionChargeProds[i] = charge;
     }
+    exception14Index.assign(force.getNumExceptions(), -1);
+    for (int i = 0; i < num14; i++)
+        exception14Index[nb14s[i]] = i;
+    setAlchemicalCharges(lambdaElectrostatics);
     
     // Recompute the coefficient for the dispersion correction.
 
     NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
-    if (force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME))
+    if (force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME)) {
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+        decoupledDispersionCoefficient = (hasAlchemicalParticles ? NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force, 0.0) : dispersionCoefficient);
+    }
+}
+
+void CpuCalcNonbondedForceKernel::copyChangedParametersToContext(ContextImpl& context, const NonbondedForce& force, const vector<int>& particles, const vector<int>& exceptions) {
+    if (force.getNumParticles() != numParticles)
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    if (force.getNumExceptions() != (int) exception14Index.size())
+        throw OpenMMException("updateParametersInContext: The number of exceptions has changed");
+    frozenInteractionsValid = false;
+
+    // Record the values, applying the current value of lambda to alchemical particles.  The Ewald self energy
+    // is updated to reflect just the particles that changed.
+
+    bool ljChanged = false;
+    double selfEnergyScale = (nonbondedMethod == Ewald || nonbondedMethod == PME ? -ONE_4PI_EPS0*ewaldAlpha/sqrt(M_PI) : 0.0);
+    for (int i = 0; i < (int) particles.size(); i++) {
+        int index = particles[i];
+        if (force.isParticleAlchemical(index) != (alchemical[index] != 0.0f))
+            throw OpenMMException("updateParametersInContext: The set of alchemical particles has changed");
+        double charge, radius, depth;
+        force.getParticleParameters(index, charge, radius, depth);
+        pair<float, float> params((float) (0.5*radius), (float) (2.0*sqrt(depth)));
+        if (params != particleParams[index])
+            ljChanged = true;
+        particleParams[index] = params;
+        double scale = (alchemical[index] != 0.0f ? lambdaElectrostatics : 1.0);
+        double oldCharge = scale*particleCharges[index];
+        double newCharge = scale*charge;
+        ewaldSelfEnergy += selfEnergyScale*(newCharge*newCharge-oldCharge*oldCharge);
+        particleCharges[index] = charge;
+        data.posq[4*index+3] = (float) newCharge;
+    }
+    for (int i = 0; i < (int) exceptions.size(); i++) {
+        int particle1, particle2;
+        double charge, radius, depth;
+        force.getExceptionParameters(exceptions[i], particle1, particle2, charge, radius, depth);
+        int index = exception14Index[exceptions[i]];
+        if ((charge != 0.0 || depth != 0.0) != (index != -1))
+            throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        if (index == -1)
+            continue;
+        bonded14IndexArray[index][0] = particle1;
+        bonded14IndexArray[index][1] = particle2;
+        bonded14ParamArray[index][0] = static_cast<RealOpenMM>(radius);
+        bonded14ParamArray[index][1] = static_cast<RealOpenMM>(4.0*depth);
+        exceptionChargeProds[index] = charge;
+        if (alchemical[particle1] != 0.0f)
+            charge *= lambdaElectrostatics;
+        if (alchemical[particle2] != 0.0f)
+            charge *= lambdaElectrostatics;
+        bonded14ParamArray[index][2] = charge;
+    }
+
+    // The dispersion correction only needs to be recomputed if Lennard-Jones parameters changed.
+
+    NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
+    if (ljChanged && force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME)) {
+        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+        decoupledDispersionCoefficient = (hasAlchemicalParticles ? NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force, 0.0) : dispersionCoefficient);
+    }
+}
+
+/**
+ * Find which variables a subexpression depends on.
+ */
+static void findNodeDependencies(const Lepton::ExpressionTreeNode& node, const set<string>& particleVariables, bool& usesR, bool& usesParticleVariables) {
+    const Lepton::Operation& op = node.getOperation();
+    if (op.getId() == Lepton::Operation::VARIABLE) {
+        if (op.getName() == "r")
+            usesR = true;
+        else if (particleVariables.find(op.getName()) != particleVariables.end())
+            usesParticleVariables = true;
+    }
+    for (int i = 0; i < (int) node.getChildren().size(); i++)
+        findNodeDependencies(node.getChildren()[i], particleVariables, usesR, usesParticleVariables);
+}
+
+/**
+ * Replace every largest subexpression that depends on per-particle parameters but not on r with a
+ * variable.  The replaced subexpressions are added to tableExpressions, and the corresponding variables
+ * to tableNames.
+ */
+static Lepton::ExpressionTreeNode extractParameterTableExpressions(const Lepton::ExpressionTreeNode& node, const set<string>& particleVariables,
+        vector<Lepton::ExpressionTreeNode>& tableExpressions, vector<string>& tableNames) {
+    bool usesR = false, usesParticleVariables = false;
+    findNodeDependencies(node, particleVariables, usesR, usesParticleVariables);
+    if (!usesParticleVariables)
+        return node;
+    if (!usesR) {
+        for (int i = 0; i < (int) tableExpressions.size(); i++)
+            if (tableExpressions[i] == node)
+                return Lepton::ExpressionTreeNode(new Lepton::Operation::Variable(tableNames[i]));
+        stringstream name;
+        name << "$table" << tableNames.size();
+        tableExpressions.push_back(node);
+        tableNames.push_back(name.str());
+        return Lepton::ExpressionTreeNode(new Lepton::Operation::Variable(name.str()));
+    }
+    vector<Lepton::ExpressionTreeNode> children;
+    for (int i = 0; i < (int) node.getChildren().size(); i++)
+        children.push_back(extractParameterTableExpressions(node.getChildren()[i], particleVariables, tableExpressions, tableNames));
+    return Lepton::ExpressionTreeNode(node.getOperation().clone(), children);
 }
 
 CpuCalcCustomNonbondedForceKernel::CpuCalcCustomNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) :
-            CalcCustomNonbondedForceKernel(name, platform), data(data), forceCopy(NULL), neighborList(NULL), nonbonded(NULL) {
+            CalcCustomNonbondedForceKernel(name, platform), data(data), forceCopy(NULL), usingParameterTable(false), useVectorExpressions(false), neighborList(NULL), nonbonded(NULL) {
 }
 
 CpuCalcCustomNonbondedForceKernel::~CpuCalcCustomNonbondedForceKernel() {
@@ -713,13 +1155,54 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     for (int i = 0; i < force.getNumFunctions(); i++)
         functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
 
-    // Parse the various expressions used to calculate the force.
+    // Parse the various expressions used to calculate the force.  They are evaluated for eight pairs at a time
+    // with CompiledVectorExpressions, unless there are tabulated functions.  The scalar JIT computes splines
+    // inline, while the vector one calls the function separately for every element.
 
+    const int vectorWidth = 8;
+    useVectorExpressions = (force.getNumFunctions() == 0);
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
-    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
-    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    Lepton::ParsedExpression forceParsed = expression.differentiate("r").optimize();
+    vector<Lepton::ParsedExpression> energyAndForce;
+    energyAndForce.push_back(expression);
+    energyAndForce.push_back(forceParsed);
+    if (useVectorExpressions) {
+        energyForceVectorExpression = Lepton::CompiledVectorExpression(energyAndForce, vectorWidth);
+        forceVectorExpression = forceParsed.createCompiledVectorExpression(vectorWidth);
+    }
+    else {
+        energyForceExpression = Lepton::CompiledExpression(energyAndForce);
+        forceExpression = forceParsed.createCompiledExpression();
+    }
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerParticleParameterName(i));
+
+    // Create alternate versions of the expressions in which everything that depends only on the
+    // parameters is looked up from a table.
+
+    set<string> particleVariables;
+    for (int i = 0; i < numParameters; i++) {
+        particleVariables.insert(parameterNames[i]+"1");
+        particleVariables.insert(parameterNames[i]+"2");
+    }
+    vector<Lepton::ExpressionTreeNode> tableNodes;
+    Lepton::ParsedExpression tableExpression(extractParameterTableExpressions(expression.getRootNode(), particleVariables, tableNodes, tableNames));
+    if (tableNodes.size() > 0) {
+        Lepton::ParsedExpression tableForceParsed = tableExpression.differentiate("r").optimize();
+        vector<Lepton::ParsedExpression> tableEnergyAndForce;
+        tableEnergyAndForce.push_back(tableExpression);
+        tableEnergyAndForce.push_back(tableForceParsed);
+        if (useVectorExpressions) {
+            tableEnergyForceVectorExpression = Lepton::CompiledVectorExpression(tableEnergyAndForce, vectorWidth);
+            tableForceVectorExpression = tableForceParsed.createCompiledVectorExpression(vectorWidth);
+        }
+        else {
+            tableEnergyForceExpression = Lepton::CompiledExpression(tableEnergyAndForce);
+            tableForceExpression = tableForceParsed.createCompiledExpression();
+        }
+        for (int i = 0; i < (int) tableNodes.size(); i++)
+            tableExpressions.push_back(Lepton::ParsedExpression(tableNodes[i]).createCompiledExpression());
+    }
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         globalParameterNames.push_back(force.getGlobalParameterName(i));
         globalParamValues[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
@@ -734,6 +1217,7 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
         forceCopy = new CustomNonbondedForce(force);
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -749,7 +1233,108 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
         interactionGroups.push_back(make_pair(set1, set2));
     }
     data.isPeriodic = (nonbondedMethod == CutoffPeriodic);
-    nonbonded = new CpuCustomNonbondedForce(energyExpression, forceExpression, parameterNames, exclusions, data.threads);
+    createInteraction();
+}
+
+bool CpuCalcCustomNonbondedForceKernel::initializeFromKernel(const System& system, const CustomNonbondedForce& force, const CalcCustomNonbondedForceKernel& originalKernel) {
+    const CpuCalcCustomNonbondedForceKernel& original = dynamic_cast<const CpuCalcCustomNonbondedForceKernel&>(originalKernel);
+
+    // Copy the exclusions and parameters.
+
+    numParticles = original.numParticles;
+    exclusions = original.exclusions;
+    int numParameters = original.parameterNames.size();
+    particleParamArray = new double*[numParticles];
+    for (int i = 0; i < numParticles; i++) {
+        particleParamArray[i] = new double[numParameters];
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[i][j] = original.particleParamArray[i][j];
+    }
+    nonbondedMethod = original.nonbondedMethod;
+    nonbondedCutoff = original.nonbondedCutoff;
+    useSwitchingFunction = original.useSwitchingFunction;
+    if (useSwitchingFunction)
+        switchingDistance = original.switchingDistance;
+    if (nonbondedMethod != NoCutoff)
+        neighborList = new CpuNeighborList(4);
+
+    // Copying a CompiledExpression shares its compiled code, so the expressions do not need to be parsed again.
+
+    energyForceExpression = original.energyForceExpression;
+    forceExpression = original.forceExpression;
+    tableEnergyForceExpression = original.tableEnergyForceExpression;
+    tableForceExpression = original.tableForceExpression;
+    useVectorExpressions = original.useVectorExpressions;
+    energyForceVectorExpression = original.energyForceVectorExpression;
+    forceVectorExpression = original.forceVectorExpression;
+    tableEnergyForceVectorExpression = original.tableEnergyForceVectorExpression;
+    tableForceVectorExpression = original.tableForceVectorExpression;
+    tableExpressions = original.tableExpressions;
+    tableNames = original.tableNames;
+    parameterNames = original.parameterNames;
+    globalParameterNames = original.globalParameterNames;
+    globalParamValues = original.globalParamValues;
+    interactionGroups = original.interactionGroups;
+
+    // Copy the long range correction, along with the integrals that have been cached for it.
+
+    if (original.forceCopy != NULL)
+        forceCopy = new CustomNonbondedForce(*original.forceCopy);
+    longRangeCorrectionData = original.longRangeCorrectionData;
+    hasInitializedLongRangeCorrection = original.hasInitializedLongRangeCorrection;
+    if (hasInitializedLongRangeCorrection)
+        longRangeCoefficient = original.longRangeCoefficient;
+    data.isPeriodic = (nonbondedMethod == CutoffPeriodic);
+    createInteraction();
+    return true;
+}
+
+void CpuCalcCustomNonbondedForceKernel::createInteraction() {
+    // Identify the classes of particles (defined by their parameters).  If there are few enough of
+    // them, the parameter dependent parts of the energy are precomputed for every pair of classes.
+
+    const int maxParameterClasses = 128;
+    vector<vector<double> > classParameters;
+    vector<int> particleClass;
+    bool useTable = (tableExpressions.size() > 0);
+    if (useTable) {
+        map<vector<double>, int> classIndex;
+        particleClass.resize(numParticles);
+        for (int i = 0; i < numParticles && useTable; i++) {
+            vector<double> parameters(particleParamArray[i], particleParamArray[i]+parameterNames.size());
+            map<vector<double>, int>::const_iterator iter = classIndex.find(parameters);
+            if (iter == classIndex.end()) {
+                particleClass[i] = classParameters.size();
+                classIndex[parameters] = classParameters.size();
+                classParameters.push_back(parameters);
+                useTable = (classParameters.size() <= maxParameterClasses);
+            }
+            else
+                particleClass[i] = iter->second;
+        }
+    }
+    
+    // If the choice of whether to use the table is unchanged, we only need to update the classes.
+    
+    if (nonbonded != NULL && useTable == usingParameterTable) {
+        if (useTable)
+            nonbonded->setUseParameterTable(tableNames, tableExpressions, particleClass, classParameters);
+        return;
+    }
+    if (nonbonded != NULL)
+        delete nonbonded;
+    if (useTable) {
+        if (useVectorExpressions)
+            nonbonded = new CpuCustomNonbondedForce(tableEnergyForceVectorExpression, tableForceVectorExpression, parameterNames, exclusions, data.threads);
+        else
+            nonbonded = new CpuCustomNonbondedForce(tableEnergyForceExpression, tableForceExpression, parameterNames, exclusions, data.threads);
+        nonbonded->setUseParameterTable(tableNames, tableExpressions, particleClass, classParameters);
+    }
+    else if (useVectorExpressions)
+        nonbonded = new CpuCustomNonbondedForce(energyForceVectorExpression, forceVectorExpression, parameterNames, exclusions, data.threads);
+    else
+        nonbonded = new CpuCustomNonbondedForce(energyForceExpression, forceExpression, parameterNames, exclusions, data.threads);
+    usingParameterTable = useTable;
     if (interactionGroups.size() > 0)
         nonbonded->setInteractionGroups(interactionGroups);
 }
@@ -784,7 +1369,7 @@ double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool inc
     // Add in the long range correction.
     
     if (!hasInitializedLongRangeCorrection || (globalParamsChanged && forceCopy != NULL)) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner());
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner(), &data.threads);
         hasInitializedLongRangeCorrection = true;
     }
     energy += longRangeCoefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
@@ -805,17 +1390,50 @@ void CpuCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl& con
         for (int j = 0; j < numParameters; j++)
             particleParamArray[i][j] = parameters[j];
     }
+    createInteraction();
     
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner());
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner(), &data.threads);
+        hasInitializedLongRangeCorrection = true;
+        *forceCopy = force;
+    }
+}
+
+void CpuCalcCustomNonbondedForceKernel::copyChangedParametersToContext(ContextImpl& context, const CustomNonbondedForce& force, const vector<int>& particles) {
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerParticleParameters();
+    vector<double> parameters;
+    for (int i = 0; i < (int) particles.size(); ++i) {
+        force.getParticleParameters(particles[i], parameters);
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[particles[i]][j] = parameters[j];
+    }
+
+    // The classes of particles only need to be updated if parameter tables are used.
+
+    if (tableExpressions.size() > 0)
+        createInteraction();
+    
+    // If necessary, recompute the long range correction.
+    
+    if (forceCopy != NULL && particles.size() > 0) {
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner(), &data.threads);
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
 }
 
 CpuCalcGBSAOBCForceKernel::~CpuCalcGBSAOBCForceKernel() {
+    if (neighborList != NULL)
+        delete neighborList;
 }
 
 void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCForce& force) {
@@ -832,8 +1450,11 @@ void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCFo
     obc.setSolventDielectric((float) force.getSolventDielectric());
     obc.setSoluteDielectric((float) force.getSoluteDielectric());
     obc.setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
-    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff)
-        obc.setUseCutoff((float) force.getCutoffDistance());
+    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff) {
+        neighborList = new CpuNeighborList(4);
+        cutoffDistance = (float) force.getCutoffDistance();
+        obc.setUseCutoff(cutoffDistance, *neighborList);
+    }
     data.isPeriodic = (force.getNonbondedMethod() == GBSAOBCForce::CutoffPeriodic);
 }
 
@@ -843,8 +1464,14 @@ double CpuCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool includeForc
         float floatBoxSize[3] = {(float) boxSize[0], (float) boxSize[1], (float) boxSize[2]};
         obc.setPeriodic(floatBoxSize);
     }
+    if (neighborList != NULL) {
+        // GBSA interactions are never excluded, so the list is built without exclusions.
+
+        vector<set<int> > noExclusions(particleParams.size());
+        neighborList->computeNeighborList(particleParams.size(), data.posq, noExclusions, extractBoxVectors(context), data.isPeriodic, cutoffDistance, data.threads);
+    }
     double energy = 0.0;
-    obc.computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.threads);
+    obc.computeForce(data.posq, data.threadForce, includeForces, includeEnergy ? &energy : NULL, data.threads);
     return energy;
 }
 
@@ -933,9 +1560,11 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
 
     // Parse the expressions for computed values.
 
-    vector<vector<Lepton::CompiledExpression> > valueDerivExpressions(force.getNumComputedValues());
-    vector<vector<Lepton::CompiledExpression> > valueGradientExpressions(force.getNumComputedValues());
+    // All the derivatives of each value are compiled into a single expression, so they can share
+    // subexpressions and be computed with one evaluation.
+
     vector<Lepton::CompiledExpression> valueExpressions;
+    vector<Lepton::CompiledExpression> valueDerivExpressions;
     vector<Lepton::CompiledExpression> energyExpressions;
     for (int i = 0; i < force.getNumComputedValues(); i++) {
         string name, expression;
@@ -945,50 +1574,52 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
         valueExpressions.push_back(ex.createCompiledExpression());
         valueTypes.push_back(type);
         valueNames.push_back(name);
+        vector<Lepton::ParsedExpression> derivs;
         if (i == 0)
-            valueDerivExpressions[i].push_back(ex.differentiate("r").createCompiledExpression());
+            derivs.push_back(ex.differentiate("r"));
         else {
-            valueGradientExpressions[i].push_back(ex.differentiate("x").createCompiledExpression());
-            valueGradientExpressions[i].push_back(ex.differentiate("y").createCompiledExpression());
-            valueGradientExpressions[i].push_back(ex.differentiate("z").createCompiledExpression());
             for (int j = 0; j < i; j++)
-                valueDerivExpressions[i].push_back(ex.differentiate(valueNames[j]).createCompiledExpression());
+                derivs.push_back(ex.differentiate(valueNames[j]));
+            derivs.push_back(ex.differentiate("x"));
+            derivs.push_back(ex.differentiate("y"));
+            derivs.push_back(ex.differentiate("z"));
         }
+        valueDerivExpressions.push_back(Lepton::CompiledExpression(derivs));
     }
 
-    // Parse the expressions for energy terms.
+    // Parse the expressions for energy terms.  Each one is compiled together with its derivatives.
 
-    vector<vector<Lepton::CompiledExpression> > energyDerivExpressions(force.getNumEnergyTerms());
-    vector<vector<Lepton::CompiledExpression> > energyGradientExpressions(force.getNumEnergyTerms());
     for (int i = 0; i < force.getNumEnergyTerms(); i++) {
         string expression;
         CustomGBForce::ComputationType type;
         force.getEnergyTermParameters(i, expression, type);
         Lepton::ParsedExpression ex = Lepton::Parser::parse(expression, functions).optimize();
-        energyExpressions.push_back(ex.createCompiledExpression());
         energyTypes.push_back(type);
-        if (type != CustomGBForce::SingleParticle)
-            energyDerivExpressions[i].push_back(ex.differentiate("r").createCompiledExpression());
-        for (int j = 0; j < force.getNumComputedValues(); j++) {
-            if (type == CustomGBForce::SingleParticle) {
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]).createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("x").createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("y").createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("z").createCompiledExpression());
-            }
-            else {
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]+"1").createCompiledExpression());
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]+"2").createCompiledExpression());
+        vector<Lepton::ParsedExpression> outputs;
+        outputs.push_back(ex);
+        if (type == CustomGBForce::SingleParticle) {
+            for (int j = 0; j < force.getNumComputedValues(); j++)
+                outputs.push_back(ex.differentiate(valueNames[j]));
+            outputs.push_back(ex.differentiate("x"));
+            outputs.push_back(ex.differentiate("y"));
+            outputs.push_back(ex.differentiate("z"));
+        }
+        else {
+            outputs.push_back(ex.differentiate("r"));
+            for (int j = 0; j < force.getNumComputedValues(); j++) {
+                outputs.push_back(ex.differentiate(valueNames[j]+"1"));
+                outputs.push_back(ex.differentiate(valueNames[j]+"2"));
             }
         }
+        energyExpressions.push_back(Lepton::CompiledExpression(outputs));
     }
 
     // Delete the custom functions.
 
     for (map<string, Lepton::CustomFunction*>::iterator iter = functions.begin(); iter != functions.end(); iter++)
         delete iter->second;
-    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions, valueNames, valueTypes, energyExpressions,
-        energyDerivExpressions, energyGradientExpressions, energyTypes, particleParameterNames, data.threads);
+    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueNames, valueTypes, energyExpressions,
+        energyTypes, particleParameterNames, data.threads);
     data.isPeriodic = (force.getNonbondedMethod() == CustomGBForce::CutoffPeriodic);
 }
 
@@ -1000,7 +1631,7 @@ double CpuCalcCustomGBForceKernel::execute(ContextImpl& context, bool includeFor
         ixn->setPeriodic(extractBoxSize(context));
     if (nonbondedMethod != NoCutoff) {
         vector<set<int> > noExclusions(numParticles);
-        neighborList->computeNeighborList(numParticles, data.posq, exclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
+        neighborList->computeNeighborList(numParticles, data.posq, noExclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
         ixn->setUseCutoff(nonbondedCutoff, *neighborList);
     }
     map<string, double> globalParameters;
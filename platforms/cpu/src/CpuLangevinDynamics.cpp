@@ -69,6 +69,7 @@ void CpuLangevinDynamics::updatePart1(int numberOfAtoms, vector<RealVec>& atomCo
     
     // Signal the threads to start running and wait for them to finish.
     
+    random.advanceStep();
     Update1Task task(*this);
     threads.execute(task);
     threads.waitForThreads();
@@ -104,7 +105,9 @@ void CpuLangevinDynamics::threadUpdate1(int threadIndex) {
     for (int i = start; i < end; i++) {
         if (inverseMasses[i] != 0.0) {
             RealOpenMM sqrtInvMass = SQRT(inverseMasses[i]);
-            RealVec noise(random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex), random.getGaussianRandom(threadIndex));
+            float values[4];
+            random.getGaussianRandoms(i, values);
+            RealVec noise(values[0], values[1], values[2]);
             velocities[i]  = velocities[i]*vscale + forces[i]*(fscale*inverseMasses[i]) + noise*(noisescale*sqrtInvMass);
         }
    }
@@ -370,12 +370,14 @@ public:
     CpuNeighborList& owner;
 };
 
-CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize) {
+CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize), hasAtomIndex(false) {
 }
 
 void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
-            const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads) {
+            const RealVec* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads,
+            const vector<char>& frozen, bool onlyFrozenPairs) {
     int numBlocks = (numAtoms+blockSize-1)/blockSize;
+    hasAtomIndex = false;
     blockNeighbors.resize(numBlocks);
     blockExclusions.resize(numBlocks);
     sortedAtoms.resize(numAtoms);
@@ -383,6 +385,8 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
     // Record the parameters for the threads.
     
     this->exclusions = &exclusions;
+    this->frozen = (frozen.size() == 0 ? NULL : &frozen);
+    this->onlyFrozenPairs = onlyFrozenPairs;
     this->atomLocations = &atomLocations[0];
     this->periodicBoxVectors[0] = periodicBoxVectors[0];
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
@@ -468,6 +472,38 @@ const std::vector<char>& CpuNeighborList::getBlockExclusions(int blockIndex) con
     
 }
 
+void CpuNeighborList::getAtomNeighbors(int atom, vector<int>& neighbors) const {
+    if (!hasAtomIndex) {
+        // Record where each atom appears in the list, both as a member of a block and as a neighbor of one.
+
+        atomSortedIndex.resize(numAtoms);
+        for (int i = 0; i < numAtoms; i++)
+            atomSortedIndex[sortedAtoms[i]] = i;
+        atomNeighborEntries.clear();
+        atomNeighborEntries.resize(numAtoms);
+        for (int i = 0; i < (int) blockNeighbors.size(); i++)
+            for (int j = 0; j < (int) blockNeighbors[i].size(); j++)
+                atomNeighborEntries[blockNeighbors[i][j]].push_back(make_pair(i, j));
+        hasAtomIndex = true;
+    }
+    neighbors.clear();
+    int blockIndex = atomSortedIndex[atom]/blockSize;
+    char mask = 1<<(atomSortedIndex[atom]%blockSize);
+    const vector<int>& blockNeighborList = blockNeighbors[blockIndex];
+    const vector<char>& blockExclusionList = blockExclusions[blockIndex];
+    for (int i = 0; i < (int) blockNeighborList.size(); i++)
+        if ((blockExclusionList[i] & mask) == 0 && blockNeighborList[i] != atom)
+            neighbors.push_back(blockNeighborList[i]);
+    const vector<pair<int, int> >& entries = atomNeighborEntries[atom];
+    for (int i = 0; i < (int) entries.size(); i++) {
+        int firstIndex = entries[i].first*blockSize;
+        char exclusions = blockExclusions[entries[i].first][entries[i].second];
+        for (int j = 0; j < blockSize && firstIndex+j < numAtoms; j++)
+            if ((exclusions & (1<<j)) == 0 && sortedAtoms[firstIndex+j] != atom)
+                neighbors.push_back(sortedAtoms[firstIndex+j]);
+    }
+}
+
 void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadIndex) {
     // Compute the positions of atoms along the Hilbert curve.
 
@@ -521,6 +557,29 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
                     blockExclusions[i][k] |= mask;
             }
         }
+        if (frozen == NULL)
+            continue;
+
+        // Exclude the pairs that were not selected based on which atoms are frozen, and remove any neighbors
+        // that no longer interact with any atom in the block.
+
+        vector<int>& neighbors = blockNeighbors[i];
+        vector<char>& exc = blockExclusions[i];
+        int atomMask = (1<<atomsInBlock)-1;
+        int numKept = 0;
+        for (int k = 0; k < (int) neighbors.size(); k++) {
+            bool neighborFrozen = (*frozen)[neighbors[k]];
+            for (int j = 0; j < atomsInBlock; j++)
+                if ((neighborFrozen && (*frozen)[blockAtoms[j]]) != onlyFrozenPairs)
+                    exc[k] |= 1<<j;
+            if ((exc[k] & atomMask) != atomMask) {
+                neighbors[numKept] = neighbors[k];
+                exc[numKept] = exc[k];
+                numKept++;
+            }
+        }
+        neighbors.resize(numKept);
+        exc.resize(numKept);
     }
 }
 
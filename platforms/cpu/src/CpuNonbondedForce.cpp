@@ -57,7 +57,8 @@ public:
 
    --------------------------------------------------------------------------------------- */
 
-CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), tableIsValid(false), cutoffDistance(0.0f), alphaEwald(0.0f) {
+CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), softcore(false), tableIsValid(false), cutoffDistance(0.0f), alphaEwald(0.0f),
+        frozen(NULL), onlyFrozenPairs(false) {
 }
 
 CpuNonbondedForce::~CpuNonbondedForce() {
@@ -170,6 +171,23 @@ void CpuNonbondedForce::setUseSwitchingFunction(float distance) {
       tabulateEwaldScaleFactor();
   }
 
+  /**---------------------------------------------------------------------------------------
+
+     Set the force to use a soft-core Lennard-Jones interaction between alchemical and
+     non-alchemical atoms.
+
+     @param alchemical  alchemical[i] is 1 if atom i is alchemical and 0 otherwise
+     @param alpha       the soft-core alpha parameter
+     @param lambda      the current value of lambda_sterics
+
+     --------------------------------------------------------------------------------------- */
+
+  void CpuNonbondedForce::setUseSoftcore(const vector<float>& alchemical, float alpha, float lambda) {
+      this->alchemical = &alchemical[0];
+      softcoreLambda = lambda;
+      softcoreShift = alpha*(1.0f-lambda);
+      softcore = true;
+  }
   
 void CpuNonbondedForce::tabulateEwaldScaleFactor() {
     if (tableIsValid)
@@ -185,6 +203,11 @@ void CpuNonbondedForce::tabulateEwaldScaleFactor() {
     }
 }
   
+void CpuNonbondedForce::setFrozenAtoms(const vector<char>& frozen, bool onlyFrozenPairs) {
+    this->frozen = (frozen.size() == 0 ? NULL : &frozen);
+    this->onlyFrozenPairs = onlyFrozenPairs;
+}
+
 void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, const vector<RealVec>& atomCoordinates,
                                              const vector<pair<float, float> >& atomParameters, const vector<set<int> >& exclusions,
                                              vector<RealVec>& forces, double* totalEnergy) const {
@@ -298,7 +321,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
 
 void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const vector<RealVec>& atomCoordinates, const vector<pair<float, float> >& atomParameters,
-                const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+                const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, bool includeForces, double* totalEnergy, ThreadPool& threads) {
     // Record the parameters for the threads.
     
     this->numberOfAtoms = numberOfAtoms;
@@ -307,6 +330,7 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
     this->atomParameters = &atomParameters[0];
     this->exclusions = &exclusions[0];
     this->threadForce = &threadForce;
+    this->includeForces = includeForces;
     includeEnergy = (totalEnergy != NULL);
     threadEnergy.resize(threads.getNumThreads());
     gmx_atomic_t counter;
@@ -330,6 +354,61 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
     }
 }
 
+void CpuNonbondedForce::calculateSubsetIxn(int numberOfAtoms, float* posq, const vector<pair<float, float> >& atomParameters,
+            const vector<set<int> >& exclusions, const vector<int>& subset, bool useNeighborList, double* totalEnergy) {
+    this->numberOfAtoms = numberOfAtoms;
+    this->posq = posq;
+    this->atomParameters = &atomParameters[0];
+    this->exclusions = &exclusions[0];
+    includeForces = false;
+    includeEnergy = true;
+
+    // The flags are kept between calls, and only the entries for the subset are set and then cleared again.
+
+    if ((int) inSubset.size() < numberOfAtoms)
+        inSubset.resize(numberOfAtoms, 0);
+    for (int i = 0; i < (int) subset.size(); i++)
+        inSubset[subset[i]] = 1;
+    fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
+    fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
+    if (useNeighborList) {
+        // Only look at the entries of the neighbor list that involve each atom.  Excluded pairs were
+        // already removed from it.
+
+        vector<int> neighbors;
+        for (int i = 0; i < (int) subset.size(); i++) {
+            int atom1 = subset[i];
+            neighborList->getAtomNeighbors(atom1, neighbors);
+            for (int j = 0; j < (int) neighbors.size(); j++) {
+                // Interactions within the subset are only counted once.
+
+                int atom2 = neighbors[j];
+                if (!inSubset[atom2] || atom2 > atom1)
+                    calculateOneIxn(atom1, atom2, NULL, totalEnergy, boxSize, invBoxSize);
+            }
+        }
+    }
+    else {
+        vector<char> isExcluded(numberOfAtoms, 0);
+        for (int i = 0; i < (int) subset.size(); i++) {
+            int atom1 = subset[i];
+            for (set<int>::const_iterator iter = exclusions[atom1].begin(); iter != exclusions[atom1].end(); ++iter)
+                isExcluded[*iter] = 1;
+            for (int atom2 = 0; atom2 < numberOfAtoms; atom2++) {
+                // Interactions within the subset are only counted once.
+
+                if (atom2 == atom1 || (inSubset[atom2] && atom2 < atom1) || isExcluded[atom2])
+                    continue;
+                calculateOneIxn(atom1, atom2, NULL, totalEnergy, boxSize, invBoxSize);
+            }
+            for (set<int>::const_iterator iter = exclusions[atom1].begin(); iter != exclusions[atom1].end(); ++iter)
+                isExcluded[*iter] = 0;
+        }
+    }
+    for (int i = 0; i < (int) subset.size(); i++)
+        inSubset[subset[i]] = 0;
+}
+
 void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex) {
     // Compute this thread's subset of interactions.
 
@@ -354,7 +433,7 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
         for (int i = threadIndex; i < numberOfAtoms; i += numThreads) {
             fvec4 posI((float) atomCoordinates[i][0], (float) atomCoordinates[i][1], (float) atomCoordinates[i][2], 0.0f);
             for (set<int>::const_iterator iter = exclusions[i].begin(); iter != exclusions[i].end(); ++iter) {
-                if (*iter > i) {
+                if (*iter > i && !isPairSkipped(i, *iter)) {
                     int j = *iter;
                     fvec4 deltaR;
                     fvec4 posJ((float) atomCoordinates[j][0], (float) atomCoordinates[j][1], (float) atomCoordinates[j][2], 0.0f);
@@ -366,11 +445,13 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
                     float alphaR = alphaEwald*r;
                     float erfcAlphaR = erfcApprox(alphaR);
                     if (1-erfcAlphaR > 1e-6f) {
-                        float dEdR = (float) (chargeProd * inverseR * inverseR * inverseR);
-                        dEdR = (float) (dEdR * (1.0f-erfcAlphaR-TWO_OVER_SQRT_PI*alphaR*exp(-alphaR*alphaR)));
-                        fvec4 result = deltaR*dEdR;
-                        (fvec4(forces+4*i)-result).store(forces+4*i);
-                        (fvec4(forces+4*j)+result).store(forces+4*j);
+                        if (includeForces) {
+                            float dEdR = (float) (chargeProd * inverseR * inverseR * inverseR);
+                            dEdR = (float) (dEdR * (1.0f-erfcAlphaR-TWO_OVER_SQRT_PI*alphaR*exp(-alphaR*alphaR)));
+                            fvec4 result = deltaR*dEdR;
+                            (fvec4(forces+4*i)-result).store(forces+4*i);
+                            (fvec4(forces+4*j)+result).store(forces+4*j);
+                        }
                         if (includeEnergy)
                             threadEnergy[threadIndex] -= chargeProd*inverseR*(1.0f-erfcAlphaR);
                     }
@@ -396,7 +477,7 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
             if (i >= numberOfAtoms)
                 break;
             for (int j = i+1; j < numberOfAtoms; j++)
-                if (exclusions[j].find(i) == exclusions[j].end())
+                if (exclusions[j].find(i) == exclusions[j].end() && !isPairSkipped(i, j))
                     calculateOneIxn(i, j, forces, energyPtr, boxSize, invBoxSize);
         }
     }
@@ -426,14 +507,25 @@ void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* t
     float sig6      = sig2*sig2*sig2;
 
     float eps       = atomParameters[ii].second*atomParameters[jj].second;
-    float dEdR      = switchValue*eps*(12.0f*sig6 - 6.0f)*sig6;
+    float energy, dEdR;
+    if (softcore && alchemical[ii] != alchemical[jj]) {
+        // Use the soft-core form: E = lambda*eps*x*(x-1), where x = 1/(alpha*(1-lambda) + (r/sigma)^6).
+
+        float x = 1.0f/(softcoreShift+1.0f/sig6);
+        energy = softcoreLambda*eps*x*(x-1.0f);
+        dEdR = 6.0f*softcoreLambda*eps*x*(2.0f*x-1.0f)*(1.0f-softcoreShift*x);
+    }
+    else {
+        energy = eps*(sig6-1.0f)*sig6;
+        dEdR = eps*(12.0f*sig6 - 6.0f)*sig6;
+    }
+    dEdR *= switchValue;
     float chargeProd = ONE_4PI_EPS0*posq[4*ii+3]*posq[4*jj+3];
     if (cutoff)
         dEdR += (float) (chargeProd*(inverseR-2.0f*krf*r2));
     else
         dEdR += (float) (chargeProd*inverseR);
     dEdR *= inverseR*inverseR;
-    float energy = eps*(sig6-1.0f)*sig6;
     if (useSwitch) {
         dEdR -= energy*switchDeriv*inverseR;
         energy *= switchValue;
@@ -451,9 +543,11 @@ void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* t
 
     // accumulate forces
 
-    fvec4 result = deltaR*dEdR;
-    (fvec4(forces+4*ii)+result).store(forces+4*ii);
-    (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    if (includeForces) {
+        fvec4 result = deltaR*dEdR;
+        (fvec4(forces+4*ii)+result).store(forces+4*ii);
+        (fvec4(forces+4*jj)-result).store(forces+4*jj);
+    }
   }
 
 void CpuNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
@@ -45,13 +45,21 @@ CpuNonbondedForceVec4::CpuNonbondedForceVec4() {
 }
 
 void CpuNonbondedForceVec4::calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockIxnImpl<true, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<true, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockIxnImpl<false, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<false, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
+template <bool TRICLINIC, bool FORCES>
 void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
     // Load the positions and parameters of the atoms in the block.
     
@@ -66,6 +74,10 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
     fvec4 blockAtomCharge = fvec4(ONE_4PI_EPS0)*fvec4(blockAtomPosq[0][3], blockAtomPosq[1][3], blockAtomPosq[2][3], blockAtomPosq[3][3]);
     fvec4 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first);
     fvec4 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second);
+    fvec4 blockAtomAlchemical(0.0f);
+    if (softcore)
+        blockAtomAlchemical = fvec4(alchemical[blockAtom[0]], alchemical[blockAtom[1]], alchemical[blockAtom[2]], alchemical[blockAtom[3]]);
+    bool blockIsAlchemical = (softcore && any(blockAtomAlchemical != 0.0f));
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -107,6 +119,17 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
             fvec4 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (softcore && (blockIsAlchemical || alchemical[atom] != 0.0f)) {
+                // Use the soft-core form for pairs of one alchemical and one non-alchemical atom.
+
+                fvec4 eps = blockAtomEpsilon*atomEpsilon;
+                fvec4 x = 1.0f/(softcoreShift+1.0f/sig6);
+                fvec4 softcoreEnergy = softcoreLambda*eps*x*(x-1.0f);
+                fvec4 softcoreDEdR = 6.0f*softcoreLambda*eps*x*(2.0f*x-1.0f)*(1.0f-softcoreShift*x);
+                ivec4 useSoftcore = (blockAtomAlchemical != alchemical[atom]);
+                energy = blend(energy, softcoreEnergy, useSoftcore);
+                dEdR = blend(dEdR, softcoreDEdR, useSoftcore);
+            }
             if (useSwitch) {
                 fvec4 t = blend(0.0f, (r-switchingDistance)*invSwitchingInterval, r>switchingDistance);
                 fvec4 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
@@ -120,16 +143,18 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
             dEdR = 0.0f;
         }
         fvec4 chargeProd = blockAtomCharge*posq[4*atom+3];
-        if (cutoff)
-            dEdR += chargeProd*(inverseR-2.0f*krf*r2);
-        else
-            dEdR += chargeProd*inverseR;
-        dEdR *= inverseR*inverseR;
+        if (FORCES) {
+            if (cutoff)
+                dEdR += chargeProd*(inverseR-2.0f*krf*r2);
+            else
+                dEdR += chargeProd*inverseR;
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
         fvec4 one(1.0f);
-        if (totalEnergy) {
+        if (!FORCES || totalEnergy) {
             if (cutoff)
                 energy += chargeProd*(inverseR+krf*r2-crf);
             else
@@ -140,35 +165,47 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
 
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec4 fx = dx*dEdR;
-        fvec4 fy = dy*dEdR;
-        fvec4 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot4(fx, one);
-        atomForce[1] -= dot4(fy, one);
-        atomForce[2] -= dot4(fz, one);
+        if (FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec4 fx = dx*dEdR;
+            fvec4 fy = dy*dEdR;
+            fvec4 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot4(fx, one);
+            atomForce[1] -= dot4(fy, one);
+            atomForce[2] -= dot4(fz, one);
+        }
     }
     
     // Record the forces on the block atoms.
 
-    fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
-    transpose(f[0], f[1], f[2], f[3]);
-    for (int j = 0; j < 4; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (FORCES) {
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int j = 0; j < 4; j++)
+            (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    }
   }
 
 void CpuNonbondedForceVec4::calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockEwaldIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockEwaldIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<true, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<true, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<false, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<false, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
+template <bool TRICLINIC, bool FORCES>
 void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
     // Load the positions and parameters of the atoms in the block.
     
@@ -183,6 +220,10 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     fvec4 blockAtomCharge = fvec4(ONE_4PI_EPS0)*fvec4(blockAtomPosq[0][3], blockAtomPosq[1][3], blockAtomPosq[2][3], blockAtomPosq[3][3]);
     fvec4 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first);
     fvec4 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second);
+    fvec4 blockAtomAlchemical(0.0f);
+    if (softcore)
+        blockAtomAlchemical = fvec4(alchemical[blockAtom[0]], alchemical[blockAtom[1]], alchemical[blockAtom[2]], alchemical[blockAtom[3]]);
+    bool blockIsAlchemical = (softcore && any(blockAtomAlchemical != 0.0f));
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -224,6 +265,17 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             fvec4 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (softcore && (blockIsAlchemical || alchemical[atom] != 0.0f)) {
+                // Use the soft-core form for pairs of one alchemical and one non-alchemical atom.
+
+                fvec4 eps = blockAtomEpsilon*atomEpsilon;
+                fvec4 x = 1.0f/(softcoreShift+1.0f/sig6);
+                fvec4 softcoreEnergy = softcoreLambda*eps*x*(x-1.0f);
+                fvec4 softcoreDEdR = 6.0f*softcoreLambda*eps*x*(2.0f*x-1.0f)*(1.0f-softcoreShift*x);
+                ivec4 useSoftcore = (blockAtomAlchemical != alchemical[atom]);
+                energy = blend(energy, softcoreEnergy, useSoftcore);
+                dEdR = blend(dEdR, softcoreDEdR, useSoftcore);
+            }
             if (useSwitch) {
                 fvec4 t = blend(0.0f, (r-switchingDistance)*invSwitchingInterval, r>switchingDistance);
                 fvec4 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
@@ -237,13 +289,15 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             dEdR = 0.0f;
         }
         fvec4 chargeProd = blockAtomCharge*posq[4*atom+3];
-        dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
-        dEdR *= inverseR*inverseR;        
+        if (FORCES) {
+            dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
         fvec4 one(1.0f);
-        if (totalEnergy) {
+        if (!FORCES || totalEnergy) {
             energy += chargeProd*inverseR*erfcApprox(alphaEwald*r);
             energy = blend(0.0f, energy, include);
             *totalEnergy += dot4(energy, one);
@@ -251,25 +305,29 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
 
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec4 fx = dx*dEdR;
-        fvec4 fy = dy*dEdR;
-        fvec4 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot4(fx, one);
-        atomForce[1] -= dot4(fy, one);
-        atomForce[2] -= dot4(fz, one);
+        if (FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec4 fx = dx*dEdR;
+            fvec4 fy = dy*dEdR;
+            fvec4 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot4(fx, one);
+            atomForce[1] -= dot4(fy, one);
+            atomForce[2] -= dot4(fz, one);
+        }
     }
     
     // Record the forces on the block atoms.
     
-    fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
-    transpose(f[0], f[1], f[2], f[3]);
-    for (int j = 0; j < 4; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (FORCES) {
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int j = 0; j < 4; j++)
+            (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    }
 }
 
 template <bool TRICLINIC>
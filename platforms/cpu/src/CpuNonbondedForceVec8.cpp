@@ -77,13 +77,21 @@ CpuNonbondedForceVec8::CpuNonbondedForceVec8() {
 }
 
 void CpuNonbondedForceVec8::calculateBlockIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockIxnImpl<true, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<true, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockIxnImpl<false, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockIxnImpl<false, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
+template <bool TRICLINIC, bool FORCES>
 void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
     // Load the positions and parameters of the atoms in the block.
     
@@ -97,6 +105,10 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
     blockAtomCharge *= ONE_4PI_EPS0;
     fvec8 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first, atomParameters[blockAtom[4]].first, atomParameters[blockAtom[5]].first, atomParameters[blockAtom[6]].first, atomParameters[blockAtom[7]].first);
     fvec8 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second, atomParameters[blockAtom[4]].second, atomParameters[blockAtom[5]].second, atomParameters[blockAtom[6]].second, atomParameters[blockAtom[7]].second);
+    fvec8 blockAtomAlchemical(0.0f);
+    if (softcore)
+        blockAtomAlchemical = fvec8(alchemical[blockAtom[0]], alchemical[blockAtom[1]], alchemical[blockAtom[2]], alchemical[blockAtom[3]], alchemical[blockAtom[4]], alchemical[blockAtom[5]], alchemical[blockAtom[6]], alchemical[blockAtom[7]]);
+    bool blockIsAlchemical = (softcore && any(blockAtomAlchemical != 0.0f));
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -138,6 +150,17 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
             fvec8 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (softcore && (blockIsAlchemical || alchemical[atom] != 0.0f)) {
+                // Use the soft-core form for pairs of one alchemical and one non-alchemical atom.
+
+                fvec8 eps = blockAtomEpsilon*atomEpsilon;
+                fvec8 x = 1.0f/(softcoreShift+1.0f/sig6);
+                fvec8 softcoreEnergy = softcoreLambda*eps*x*(x-1.0f);
+                fvec8 softcoreDEdR = 6.0f*softcoreLambda*eps*x*(2.0f*x-1.0f)*(1.0f-softcoreShift*x);
+                ivec8 useSoftcore = (blockAtomAlchemical != alchemical[atom]);
+                energy = blend(energy, softcoreEnergy, useSoftcore);
+                dEdR = blend(dEdR, softcoreDEdR, useSoftcore);
+            }
             if (useSwitch) {
                 fvec8 t = (r>switchingDistance) & ((r-switchingDistance)*invSwitchingInterval);
                 fvec8 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
@@ -151,16 +174,18 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
             dEdR = 0.0f;
         }
         fvec8 chargeProd = blockAtomCharge*posq[4*atom+3];
-        if (cutoff)
-            dEdR += chargeProd*(inverseR-2.0f*krf*r2);
-        else
-            dEdR += chargeProd*inverseR;
-        dEdR *= inverseR*inverseR;
+        if (FORCES) {
+            if (cutoff)
+                dEdR += chargeProd*(inverseR-2.0f*krf*r2);
+            else
+                dEdR += chargeProd*inverseR;
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
         fvec8 one(1.0f);
-        if (totalEnergy) {
+        if (!FORCES || totalEnergy) {
             if (cutoff)
                 energy += chargeProd*(inverseR+krf*r2-crf);
             else
@@ -171,35 +196,47 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
 
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec8 fx = dx*dEdR;
-        fvec8 fy = dy*dEdR;
-        fvec8 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot8(fx, one);
-        atomForce[1] -= dot8(fy, one);
-        atomForce[2] -= dot8(fz, one);
+        if (FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec8 fx = dx*dEdR;
+            fvec8 fy = dy*dEdR;
+            fvec8 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot8(fx, one);
+            atomForce[1] -= dot8(fy, one);
+            atomForce[2] -= dot8(fz, one);
+        }
     }
     
     // Record the forces on the block atoms.
 
-    fvec4 f[8];
-    transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
-    for (int j = 0; j < 8; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (FORCES) {
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        for (int j = 0; j < 8; j++)
+            (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    }
   }
 
 void CpuNonbondedForceVec8::calculateBlockEwaldIxn(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
-    if (triclinic)
-        calculateBlockEwaldIxnImpl<true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
-    else
-        calculateBlockEwaldIxnImpl<false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    if (triclinic) {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<true, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<true, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
+    else {
+        if (includeForces)
+            calculateBlockEwaldIxnImpl<false, true>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+        else
+            calculateBlockEwaldIxnImpl<false, false>(blockIndex, forces, totalEnergy, boxSize, invBoxSize);
+    }
 }
 
-template <bool TRICLINIC>
+template <bool TRICLINIC, bool FORCES>
 void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
     // Load the positions and parameters of the atoms in the block.
     
@@ -213,6 +250,10 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     blockAtomCharge *= ONE_4PI_EPS0;
     fvec8 blockAtomSigma(atomParameters[blockAtom[0]].first, atomParameters[blockAtom[1]].first, atomParameters[blockAtom[2]].first, atomParameters[blockAtom[3]].first, atomParameters[blockAtom[4]].first, atomParameters[blockAtom[5]].first, atomParameters[blockAtom[6]].first, atomParameters[blockAtom[7]].first);
     fvec8 blockAtomEpsilon(atomParameters[blockAtom[0]].second, atomParameters[blockAtom[1]].second, atomParameters[blockAtom[2]].second, atomParameters[blockAtom[3]].second, atomParameters[blockAtom[4]].second, atomParameters[blockAtom[5]].second, atomParameters[blockAtom[6]].second, atomParameters[blockAtom[7]].second);
+    fvec8 blockAtomAlchemical(0.0f);
+    if (softcore)
+        blockAtomAlchemical = fvec8(alchemical[blockAtom[0]], alchemical[blockAtom[1]], alchemical[blockAtom[2]], alchemical[blockAtom[3]], alchemical[blockAtom[4]], alchemical[blockAtom[5]], alchemical[blockAtom[6]], alchemical[blockAtom[7]]);
+    bool blockIsAlchemical = (softcore && any(blockAtomAlchemical != 0.0f));
     bool needPeriodic = (periodic && (any(blockAtomX < cutoffDistance) || any(blockAtomY < cutoffDistance) || any(blockAtomZ < cutoffDistance) ||
             any(blockAtomX > boxSize[0]-cutoffDistance) || any(blockAtomY > boxSize[1]-cutoffDistance) || any(blockAtomZ > boxSize[2]-cutoffDistance)));
     const float invSwitchingInterval = 1/(cutoffDistance-switchingDistance);
@@ -254,6 +295,17 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             fvec8 epsSig6 = blockAtomEpsilon*atomEpsilon*sig6;
             dEdR = epsSig6*(12.0f*sig6 - 6.0f);
             energy = epsSig6*(sig6-1.0f);
+            if (softcore && (blockIsAlchemical || alchemical[atom] != 0.0f)) {
+                // Use the soft-core form for pairs of one alchemical and one non-alchemical atom.
+
+                fvec8 eps = blockAtomEpsilon*atomEpsilon;
+                fvec8 x = 1.0f/(softcoreShift+1.0f/sig6);
+                fvec8 softcoreEnergy = softcoreLambda*eps*x*(x-1.0f);
+                fvec8 softcoreDEdR = 6.0f*softcoreLambda*eps*x*(2.0f*x-1.0f)*(1.0f-softcoreShift*x);
+                ivec8 useSoftcore = (blockAtomAlchemical != alchemical[atom]);
+                energy = blend(energy, softcoreEnergy, useSoftcore);
+                dEdR = blend(dEdR, softcoreDEdR, useSoftcore);
+            }
             if (useSwitch) {
                 fvec8 t = (r>switchingDistance) & ((r-switchingDistance)*invSwitchingInterval);
                 fvec8 switchValue = 1+t*t*t*(-10.0f+t*(15.0f-t*6.0f));
@@ -267,13 +319,15 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
             dEdR = 0.0f;
         }
         fvec8 chargeProd = blockAtomCharge*posq[4*atom+3];
-        dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
-        dEdR *= inverseR*inverseR;        
+        if (FORCES) {
+            dEdR += chargeProd*inverseR*ewaldScaleFunction(r);
+            dEdR *= inverseR*inverseR;
+        }
 
         // Accumulate energies.
 
         fvec8 one(1.0f);
-        if (totalEnergy) {
+        if (!FORCES || totalEnergy) {
             energy += chargeProd*inverseR*erfcApprox(alphaEwald*r);
             energy = blend(0.0f, energy, include);
             *totalEnergy += dot8(energy, one);
@@ -281,25 +335,29 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
 
         // Accumulate forces.
 
-        dEdR = blend(0.0f, dEdR, include);
-        fvec8 fx = dx*dEdR;
-        fvec8 fy = dy*dEdR;
-        fvec8 fz = dz*dEdR;
-        blockAtomForceX += fx;
-        blockAtomForceY += fy;
-        blockAtomForceZ += fz;
-        float* atomForce = forces+4*atom;
-        atomForce[0] -= dot8(fx, one);
-        atomForce[1] -= dot8(fy, one);
-        atomForce[2] -= dot8(fz, one);
+        if (FORCES) {
+            dEdR = blend(0.0f, dEdR, include);
+            fvec8 fx = dx*dEdR;
+            fvec8 fy = dy*dEdR;
+            fvec8 fz = dz*dEdR;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atom;
+            atomForce[0] -= dot8(fx, one);
+            atomForce[1] -= dot8(fy, one);
+            atomForce[2] -= dot8(fz, one);
+        }
     }
     
     // Record the forces on the block atoms.
     
-    fvec4 f[8];
-    transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
-    for (int j = 0; j < 8; j++)
-        (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    if (FORCES) {
+        fvec4 f[8];
+        transpose(blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f, f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
+        for (int j = 0; j < 8; j++)
+            (fvec4(forces+4*blockAtom[j])+f[j]).store(forces+4*blockAtom[j]);
+    }
 }
 
 template <bool TRICLINIC>
@@ -106,8 +106,14 @@ void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>
             getPropertyDefaultValue(CpuThreads()) : properties.find(CpuThreads())->second);
     int numThreads;
     stringstream(threadsPropValue) >> numThreads;
-    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads);
+    const System& system = context.getSystem();
+    PlatformData* data = new PlatformData(system.getNumParticles(), numThreads);
     contextData[&context] = data;
+    for (int i = 0; i < system.getNumParticles(); i++)
+        if (system.getParticleMass(i) == 0.0 && !system.isVirtualSite(i)) {
+            data->isFrozen.resize(system.getNumParticles(), 0);
+            data->isFrozen[i] = 1;
+        }
     ReferenceConstraints& constraints = *(ReferenceConstraints*) reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData())->constraints;
     if (constraints.settle != NULL) {
         CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads);
@@ -122,6 +128,18 @@ void CpuPlatform::contextDestroyed(ContextImpl& context) const {
     contextData.erase(&context);
 }
 
+int CpuPlatform::getNumConcurrentContexts(ContextImpl& context, map<string, string>& properties) const {
+    // For a small System, dividing the work for a single configuration between threads has too much overhead.  It is
+    // faster to give each thread its own single threaded Context and its own configurations.  A large System makes
+    // good use of the threads within each configuration.
+
+    const int maxParticles = 2000;
+    if (context.getSystem().getNumParticles() > maxParticles)
+        return 1;
+    properties[CpuThreads()] = "1";
+    return getPlatformData(context).threads.getNumThreads();
+}
+
 CpuPlatform::PlatformData& CpuPlatform::getPlatformData(ContextImpl& context) {
     return *contextData[&context];
 }
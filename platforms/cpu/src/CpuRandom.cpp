@@ -30,7 +30,8 @@
 using namespace std;
 using namespace OpenMM;
 
-CpuRandom::CpuRandom() : hasInitialized(false) {
+CpuRandom::CpuRandom() : hasInitialized(false), step(0) {
+    key[0] = key[1] = 0;
 }
 
 CpuRandom::~CpuRandom() {
@@ -57,6 +58,12 @@ void CpuRandom::initialize(int seed, int numThreads) {
     unsigned int r = (unsigned int) seed;
     if (r == 0)
         r = (unsigned int) osrngseed();
+    
+    // The key for the counter based generator must not depend on the number of threads.
+    
+    key[0] = r;
+    key[1] = (1664525*r + 1013904223) & 0xFFFFFFFF;
+    step = 0;
     for (int i = 0; i < numThreads; i++) {
         r = (1664525*r + 1013904223) & 0xFFFFFFFF;
         threadRandom[i] = new OpenMM_SFMT::SFMT();
@@ -87,3 +94,47 @@ float CpuRandom::getGaussianRandom(int threadIndex) {
 float CpuRandom::getUniformRandom(int threadIndex) {
     return genrand_real2(*threadRandom[threadIndex]);
 }
+
+void CpuRandom::advanceStep() {
+    step++;
+}
+
+/**
+ * Apply the Philox4x32-10 bijection to a counter.  See Salmon et al., "Parallel Random Numbers:
+ * As Easy as 1, 2, 3", Proceedings of SC11 (2011).
+ */
+static void philox4x32(unsigned int* counter, const unsigned int* key) {
+    const unsigned int multiplier0 = 0xD2511F53;
+    const unsigned int multiplier1 = 0xCD9E8D57;
+    unsigned int k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        unsigned long long product0 = (unsigned long long) multiplier0*counter[0];
+        unsigned long long product1 = (unsigned long long) multiplier1*counter[2];
+        unsigned int hi0 = (unsigned int) (product0>>32), lo0 = (unsigned int) product0;
+        unsigned int hi1 = (unsigned int) (product1>>32), lo1 = (unsigned int) product1;
+        counter[0] = hi1^counter[1]^k0;
+        counter[1] = lo1;
+        counter[2] = hi0^counter[3]^k1;
+        counter[3] = lo0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+
+void CpuRandom::getGaussianRandoms(int index, float* values) const {
+    unsigned int counter[4] = {(unsigned int) step, (unsigned int) (step>>32), (unsigned int) index, 0};
+    philox4x32(counter, key);
+    
+    // Convert to uniform values in (0, 1], then use the Box-Muller transformation to produce
+    // two pairs of Gaussian random numbers.
+    
+    const float scale = 1.0f/16777216.0f;
+    const float twoPi = 6.283185307179586f;
+    for (int i = 0; i < 4; i += 2) {
+        float u1 = ((counter[i]>>8)+1)*scale;
+        float u2 = ((counter[i+1]>>8)+1)*scale;
+        float r = sqrtf(-2.0f*logf(u1));
+        values[i] = r*cosf(twoPi*u2);
+        values[i+1] = r*sinf(twoPi*u2);
+    }
+}
@@ -0,0 +1,106 @@
+#include "CpuPlatform.h"
+#include "openmm/Context.h"
+#include "openmm/CustomIntegrator.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/LangevinIntegrator.h"
+#include "openmm/MonteCarloBarostat.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * This program measures how much faster it is to compute only the potential energy than to compute forces and energy
+ * together on the CPU platform, and what that means for a simulation that attempts a MonteCarloBarostat move every
+ * step (each attempt requires two energy evaluations).  It is not run as part of the test suite.
+ *
+ * The system is a periodic box of diatomic molecules.  Times are reported in milliseconds.  The evaluations are timed
+ * with a CustomIntegrator, since a leapfrog integrator needs forces to compute the kinetic energy.
+ */
+
+static double getTime() {
+    struct timeval tod;
+    gettimeofday(&tod, 0);
+    return tod.tv_sec+1e-6*tod.tv_usec;
+}
+
+static void createSystem(System& system, vector<Vec3>& positions, NonbondedForce::NonbondedMethod method, int numMolecules) {
+    const double boxSize = pow(numMolecules/16.0, 1.0/3.0);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(0.9);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    const int gridSize = (int) ceil(pow((double) numMolecules, 1.0/3.0));
+    const double spacing = boxSize/gridSize;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(16.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.4, 0.315, 0.64);
+        nonbonded->addParticle(0.4, 0.1, 0.0);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        bonds->addBond(2*i, 2*i+1, 0.1, 1e5);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        pos += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*(0.1*spacing);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    system.addForce(nonbonded);
+    system.addForce(bonds);
+}
+
+static double timeEvaluation(Context& context, int types, int iterations) {
+    context.getState(types);
+    double start = getTime();
+    for (int i = 0; i < iterations; i++)
+        context.getState(types);
+    return 1000*(getTime()-start)/iterations;
+}
+
+static double timeSteps(NonbondedForce::NonbondedMethod method, int numMolecules, bool barostat, int steps) {
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions, method, numMolecules);
+    LangevinIntegrator integrator(300.0, 1.0, 0.0005);
+    if (barostat)
+        system.addForce(new MonteCarloBarostat(1.0, 300.0, 1));
+    CpuPlatform platform;
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    integrator.step(1);
+    double start = getTime();
+    integrator.step(steps);
+    return 1000*(getTime()-start)/steps;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = (argc > 1 ? atoi(argv[1]) : 50);
+    int numMolecules = (argc > 2 ? atoi(argv[2]) : 4000);
+    const char* names[] = {"CutoffPeriodic", "PME"};
+    NonbondedForce::NonbondedMethod methods[] = {NonbondedForce::CutoffPeriodic, NonbondedForce::PME};
+    printf("%-16s %16s %16s %16s %16s\n", "Method", "Forces+Energy", "Energy", "Step", "Step+Barostat");
+    for (int i = 0; i < 2; i++) {
+        System system;
+        vector<Vec3> positions;
+        createSystem(system, positions, methods[i], numMolecules);
+        CustomIntegrator integrator(0.0005);
+        CpuPlatform platform;
+        Context context(system, integrator, platform);
+        context.setPositions(positions);
+        double both = timeEvaluation(context, State::Forces | State::Energy, iterations);
+        double energy = timeEvaluation(context, State::Energy, iterations);
+        double step = timeSteps(methods[i], numMolecules, false, iterations);
+        double barostatStep = timeSteps(methods[i], numMolecules, true, iterations);
+        printf("%-16s %16.3f %16.3f %16.3f %16.3f\n", names[i], both, energy, step, barostatStep);
+    }
+    return 0;
+}
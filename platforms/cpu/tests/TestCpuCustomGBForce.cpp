@@ -392,7 +392,7 @@ void testPositionDependence() {
     }
 }
 
-void testExclusions() {
+void testExclusions(CustomGBForce::NonbondedMethod method) {
     CpuPlatform platform;
     for (int i = 3; i < 4; i++) {
         System system;
@@ -406,6 +406,8 @@ void testExclusions() {
         force->addParticle(vector<double>());
         force->addParticle(vector<double>());
         force->addExclusion(0, 1);
+        force->setNonbondedMethod(method);
+        force->setCutoffDistance(2.0);
         system.addForce(force);
         Context context(system, integrator, platform);
         vector<Vec3> positions(2);
@@ -472,7 +474,8 @@ int main() {
         testTabulatedFunction();
         testMultipleChainRules();
         testPositionDependence();
-        testExclusions();
+        testExclusions(CustomGBForce::NoCutoff);
+        testExclusions(CustomGBForce::CutoffNonPeriodic);
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -38,6 +38,7 @@
   #define _USE_MATH_DEFINES // Needed to get M_PI
 #endif
 #include "CpuPlatform.h"
+#include "ReferencePlatform.h"
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
 #include "openmm/CustomNonbondedForce.h"
@@ -727,6 +728,116 @@ void testLongRangeCorrection() {
     ASSERT_EQUAL_TOL(standardEnergy1-standardEnergy2, customEnergy1-customEnergy2, 1e-4);
 }
 
+void testLongRangeCorrectionParameters() {
+    // Create a system with several classes of particles and an energy that depends on a global parameter.
+    
+    const int numParticles = 60;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("scale*4*eps*((sigma/r)^12-(sigma/r)^6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    nonbonded->addPerParticleParameter("sigma");
+    nonbonded->addPerParticleParameter("eps");
+    nonbonded->addGlobalParameter("scale", 1.0);
+    nonbonded->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseLongRangeCorrection(true);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> params(2);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.2+0.01*(i%7);
+        params[1] = 0.5+0.1*(i%5);
+        nonbonded->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    
+    // Changing the global parameter back and forth should give consistent energies.
+    
+    double energy1 = context.getState(State::Energy).getPotentialEnergy();
+    context.setParameter("scale", 2.0);
+    double energy2 = context.getState(State::Energy).getPotentialEnergy();
+    context.setParameter("scale", 1.0);
+    ASSERT_EQUAL_TOL(energy1, context.getState(State::Energy).getPotentialEnergy(), 1e-6);
+    ASSERT_EQUAL_TOL(2*energy1, energy2, 1e-5);
+    context.setParameter("scale", 2.0);
+    ASSERT_EQUAL_TOL(energy2, context.getState(State::Energy).getPotentialEnergy(), 1e-6);
+    
+    // Modify some per-particle parameters, and compare the result to a newly created Context.
+    
+    params[0] = 0.35;
+    params[1] = 1.5;
+    nonbonded->setParticleParameters(3, params);
+    nonbonded->setParticleParameters(10, params);
+    nonbonded->updateParametersInContext(context);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    context2.setParameter("scale", 2.0);
+    ASSERT_EQUAL_TOL(context2.getState(State::Energy).getPotentialEnergy(), context.getState(State::Energy).getPotentialEnergy(), 1e-6);
+}
+
+void testClone() {
+    const int numParticles = 60;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("scale*4*eps*((sigma/r)^12-(sigma/r)^6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    nonbonded->addPerParticleParameter("sigma");
+    nonbonded->addPerParticleParameter("eps");
+    nonbonded->addGlobalParameter("scale", 1.0);
+    nonbonded->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseLongRangeCorrection(true);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> params(2);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.2+0.01*(i%7);
+        params[1] = 0.5+0.1*(i%5);
+        nonbonded->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    for (int i = 0; i < numParticles; i += 2)
+        nonbonded->addExclusion(i, i+1);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    context1.setParameter("scale", 2.0);
+    params[0] = 0.35;
+    params[1] = 1.5;
+    nonbonded->setParticleParameters(3, params);
+    nonbonded->updateParametersInContext(context1);
+    State state1 = context1.getState(State::Energy | State::Forces);
+
+    // Modify the Force again without updating the Context.  The clone should still match the original.
+
+    params[0] = 0.1;
+    nonbonded->setParticleParameters(3, params);
+    VerletIntegrator integrator2(0.01);
+    Context* context2 = context1.clone(integrator2);
+    State state2 = context2->getState(State::Energy | State::Forces);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-6);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-6);
+
+    // Changing the global parameter should update the long range correction in the clone.
+
+    context1.setParameter("scale", 1.0);
+    context2->setParameter("scale", 1.0);
+    ASSERT_EQUAL_TOL(context1.getState(State::Energy).getPotentialEnergy(), context2->getState(State::Energy).getPotentialEnergy(), 1e-6);
+    delete context2;
+}
+
 void testInteractionGroups() {
     const int numParticles = 6;
     System system;
@@ -843,6 +954,59 @@ void testLargeInteractionGroup() {
         ASSERT_EQUAL_VEC(state1.getForces()[i], state3.getForces()[i], 1e-4);
 }
 
+void testManyInteractionGroupsWithCutoff() {
+    const int numParticles = 200;
+    const int numGroups = 40;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("a1*a2*(r-0.2)^2");
+    nonbonded->addPerParticleParameter("a");
+    nonbonded->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(0.9);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> params(1);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.5+genrand_real2(sfmt);
+        nonbonded->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    for (int i = 0; i < numParticles; i += 10)
+        nonbonded->addExclusion(i, i+1);
+    
+    // Create groups whose sets overlap, so some pairs appear in several groups and some atoms in both sets of a group.
+    
+    for (int i = 0; i < numGroups; i++) {
+        set<int> set1, set2;
+        for (int j = 0; j < numParticles; j++) {
+            if (genrand_real2(sfmt) < 0.2)
+                set1.insert(j);
+            if (genrand_real2(sfmt) < 0.3)
+                set2.insert(j);
+        }
+        nonbonded->addInteractionGroup(set1, set2);
+    }
+    system.addForce(nonbonded);
+    
+    // Compare the results to the reference platform.
+    
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    ReferencePlatform reference;
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, reference);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-4);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-4);
+}
+
 void testInteractionGroupLongRangeCorrection() {
     const int numParticles = 10;
     const double boxSize = 10.0;
@@ -900,6 +1064,83 @@ void testInteractionGroupLongRangeCorrection() {
     ASSERT_EQUAL_TOL(expected, energy2-energy1, 1e-4);
 }
 
+void compareToReference(Context& context, Context& refContext) {
+    State state = context.getState(State::Forces | State::Energy);
+    State refState = refContext.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+    for (int i = 0; i < context.getSystem().getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(refState.getForces()[i], state.getForces()[i], 1e-4);
+}
+
+void testParameterClasses() {
+    // When there are few distinct sets of parameters, the parameter dependent parts of the energy
+    // are precomputed.  Make sure that gives the correct result, including when global parameters
+    // change and when updating parameters changes the number of classes.
+
+    const int numParticles = 200;
+    const double boxSize = 4.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* force = new CustomNonbondedForce("lambda*4*eps*(x^2-x); x=1/(0.5*(1-lambda)+(r/sigma)^6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    force->addPerParticleParameter("sigma");
+    force->addPerParticleParameter("eps");
+    force->addGlobalParameter("lambda", 0.5);
+    force->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    force->setCutoffDistance(1.5);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<double> params(2);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.2+0.05*(i%3);
+        params[1] = 0.5+0.1*(i%2);
+        force->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    system.addForce(force);
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context context(system, integrator1, platform);
+    Context refContext(system, integrator2, reference);
+    context.setPositions(positions);
+    refContext.setPositions(positions);
+    compareToReference(context, refContext);
+    context.setParameter("lambda", 0.8);
+    refContext.setParameter("lambda", 0.8);
+    compareToReference(context, refContext);
+    for (int i = 0; i < numParticles; i++) {
+        params[0] = 0.2+0.001*i;
+        params[1] = 0.5+0.1*(i%2);
+        force->setParticleParameters(i, params);
+    }
+    force->updateParametersInContext(context);
+    force->updateParametersInContext(refContext);
+    compareToReference(context, refContext);
+    for (int i = 0; i < numParticles; i++) {
+        params[0] = 0.2+0.05*(i%2);
+        params[1] = 0.5+0.1*(i%3);
+        force->setParticleParameters(i, params);
+    }
+    force->updateParametersInContext(context);
+    force->updateParametersInContext(refContext);
+    compareToReference(context, refContext);
+
+    // Update only a few particles.
+
+    vector<int> particles;
+    for (int i = 0; i < 5; i++) {
+        particles.push_back(3*i);
+        params[0] = 0.35;
+        params[1] = 0.4;
+        force->setParticleParameters(3*i, params);
+    }
+    force->updateParametersInContext(context, particles);
+    force->updateParametersInContext(refContext);
+    compareToReference(context, refContext);
+}
+
 int main() {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -921,9 +1162,13 @@ int main() {
         testCoulombLennardJones();
         testSwitchingFunction();
         testLongRangeCorrection();
+        testLongRangeCorrectionParameters();
+        testClone();
         testInteractionGroups();
         testLargeInteractionGroup();
+        testManyInteractionGroupsWithCutoff();
         testInteractionGroupLongRangeCorrection();
+        testParameterClasses();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
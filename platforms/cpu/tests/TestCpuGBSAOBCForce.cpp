@@ -36,6 +36,7 @@
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
 #include "CpuPlatform.h"
+#include "openmm/CustomIntegrator.h"
 #include "openmm/GBSAOBCForce.h"
 #include "openmm/System.h"
 #include "openmm/LangevinIntegrator.h"
@@ -226,6 +227,14 @@ void testForce(int numParticles, NonbondedForce::NonbondedMethod method, GBSAOBC
     ASSERT_EQUAL_TOL(0.0, diff, 0.001*norm);
     ASSERT_EQUAL_TOL(state.getPotentialEnergy(), refState.getPotentialEnergy(), 1e-3);
 
+    // Computing only the energy should give the same result.  This needs an integrator whose kinetic
+    // energy does not depend on the forces.
+
+    CustomIntegrator integrator3(0.01);
+    Context context3(system, integrator3, platform);
+    context3.setPositions(positions);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), context3.getState(State::Energy).getPotentialEnergy(), 1e-5);
+
     // Take a small step in the direction of the energy gradient and see whether the potential energy changes by the expected amount.
     // (This doesn't work with cutoffs, since the energy changes discontinuously at the cutoff distance.)
 
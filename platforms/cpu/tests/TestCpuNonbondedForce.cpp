@@ -37,9 +37,12 @@
 #include "openmm/Context.h"
 #include "CpuPlatform.h"
 #include "ReferencePlatform.h"
+#include "openmm/CustomIntegrator.h"
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
+#include "openmm/VirtualSite.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/VerletIntegrator.h"
 #include "openmm/internal/ContextImpl.h"
@@ -684,6 +687,686 @@ void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testSoftcore() {
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.01);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->addParticle(0.5, 1.2, 1);
+    nonbonded->addParticle(-0.7, 1.4, 2);
+    nonbonded->setParticleAlchemical(0, true);
+    nonbonded->setSoftcoreAlpha(0.4);
+    system.addForce(nonbonded);
+    Context context(system, integrator, platform);
+    const double lambdaSterics = 0.3, lambdaElectrostatics = 0.6;
+    context.setParameter(NonbondedForce::LambdaSterics(), lambdaSterics);
+    context.setParameter(NonbondedForce::LambdaElectrostatics(), lambdaElectrostatics);
+    vector<Vec3> positions(2);
+    positions[0] = Vec3(0, 0, 0);
+    double eps = 4.0*SQRT_TWO;
+    for (double r = 0.2; r < 3.0; r += 0.4) {
+        positions[1] = Vec3(r, 0, 0);
+        context.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        double x = 1.0/(0.4*(1-lambdaSterics)+std::pow(r/1.3, 6.0));
+        double expectedEnergy = lambdaSterics*eps*x*(x-1) + ONE_4PI_EPS0*lambdaElectrostatics*0.5*(-0.7)/r;
+        ASSERT_EQUAL_TOL(expectedEnergy, state.getPotentialEnergy(), TOL);
+        double delta = 1e-3;
+        positions[1] = Vec3(r-delta, 0, 0);
+        context.setPositions(positions);
+        double e1 = context.getState(State::Energy).getPotentialEnergy();
+        positions[1] = Vec3(r+delta, 0, 0);
+        context.setPositions(positions);
+        double e2 = context.getState(State::Energy).getPotentialEnergy();
+        ASSERT_EQUAL_TOL((e2-e1)/(2*delta), state.getForces()[0][0], 1e-3);
+    }
+}
+
+void testAlchemical(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 300;
+    const int numParticles = numMolecules*2;
+    const double cutoff = 1.5;
+    const double boxSize = 10.0;
+    const double tol = 2e-3;
+    ReferencePlatform reference;
+    System system;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        nonbonded->addParticle(-1.0, 0.2, 0.1);
+        nonbonded->addParticle(1.0, 0.1, 0.2);
+        if (i < 10)
+            positions[2*i] = Vec3(2.0*(i%5), 5.0*(i/5), 1.0); // Keep the alchemical molecules out of each other's cutoff.
+        else
+            positions[2*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions[2*i+1] = Vec3(positions[2*i][0]+0.1, positions[2*i][1], positions[2*i][2]);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 0.15, 0.0);
+    }
+    for (int i = 0; i < 3; i++) {
+        nonbonded->addException(2*i, 2*i+2, -0.5, 0.15, 0.05);
+        nonbonded->addException(2*i+1, 2*i+3, 0.5, 0.15, 0.05);
+    }
+    for (int i = 0; i < 20; i++)
+        nonbonded->setParticleAlchemical(i, true);
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(cutoff);
+    system.addForce(nonbonded);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+
+    // See if Reference and CPU give the same forces and energies at intermediate values of lambda.
+
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context cpuContext(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    double lambdas[][2] = {{1.0, 1.0}, {0.6, 0.8}, {0.2, 0.0}, {0.0, 0.0}};
+    for (int i = 0; i < 4; i++) {
+        cpuContext.setParameter(NonbondedForce::LambdaSterics(), lambdas[i][0]);
+        cpuContext.setParameter(NonbondedForce::LambdaElectrostatics(), lambdas[i][1]);
+        referenceContext.setParameter(NonbondedForce::LambdaSterics(), lambdas[i][0]);
+        referenceContext.setParameter(NonbondedForce::LambdaElectrostatics(), lambdas[i][1]);
+        State cpuState = cpuContext.getState(State::Forces | State::Energy);
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(cpuState.getForces()[j], referenceState.getForces()[j], tol);
+        ASSERT_EQUAL_TOL(cpuState.getPotentialEnergy(), referenceState.getPotentialEnergy(), tol);
+    }
+
+    // With both lambdas equal to 1 it should match an ordinary NonbondedForce, and with both equal to 0 it
+    // should match a system in which the alchemical particles have no charge or Lennard-Jones interactions with
+    // the rest of the system.
+
+    System system2;
+    for (int i = 0; i < numParticles; i++)
+        system2.addParticle(1.0);
+    system2.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded2 = new NonbondedForce(*nonbonded);
+    system2.addForce(nonbonded2);
+    for (int i = 0; i < 20; i++)
+        nonbonded2->setParticleAlchemical(i, false);
+    VerletIntegrator integrator3(0.01);
+    Context context2(system2, integrator3, platform);
+    context2.setPositions(positions);
+    cpuContext.setParameter(NonbondedForce::LambdaSterics(), 1.0);
+    cpuContext.setParameter(NonbondedForce::LambdaElectrostatics(), 1.0);
+    State state1 = cpuContext.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    for (int j = 0; j < numParticles; j++)
+        ASSERT_EQUAL_VEC(state2.getForces()[j], state1.getForces()[j], tol);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), tol);
+    nonbonded->setUseDispersionCorrection(false);
+    nonbonded2->setUseDispersionCorrection(false);
+    for (int i = 0; i < 20; i++)
+        nonbonded2->setParticleParameters(i, 0.0, 0.1, 0.0);
+    for (int i = 0; i < 6; i++) {
+        int p1, p2;
+        double chargeProd, sigma, epsilon;
+        nonbonded2->getExceptionParameters(numMolecules+i, p1, p2, chargeProd, sigma, epsilon);
+        nonbonded2->setExceptionParameters(numMolecules+i, p1, p2, 0.0, sigma, epsilon);
+    }
+    VerletIntegrator integrator4(0.01);
+    VerletIntegrator integrator5(0.01);
+    Context context3(system, integrator4, platform);
+    Context context4(system2, integrator5, platform);
+    context3.setPositions(positions);
+    context4.setPositions(positions);
+    context3.setParameter(NonbondedForce::LambdaSterics(), 0.0);
+    context3.setParameter(NonbondedForce::LambdaElectrostatics(), 0.0);
+    state1 = context3.getState(State::Forces | State::Energy);
+    state2 = context4.getState(State::Forces | State::Energy);
+    for (int j = 0; j < numParticles; j++)
+        ASSERT_EQUAL_VEC(state2.getForces()[j], state1.getForces()[j], tol);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), tol);
+}
+
+void testChangingLambda(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions;
+    const int gridSize = 5;
+    const double spacing = boxSize/gridSize;
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    for (int i = 0; i < 10; i++)
+        nonbonded->setParticleAlchemical(i, true);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    referenceContext.setPositions(positions);
+    context.getState(State::Energy);
+
+    // The first evaluation after changing LambdaElectrostatics should already use the new charges, including in
+    // the Ewald self energy.
+
+    double lambdas[] = {0.5, 0.0, 1.0};
+    for (int i = 0; i < 3; i++) {
+        context.setParameter(NonbondedForce::LambdaElectrostatics(), lambdas[i]);
+        referenceContext.setParameter(NonbondedForce::LambdaElectrostatics(), lambdas[i]);
+        double energy = context.getState(State::Energy).getPotentialEnergy();
+        double expectedEnergy = referenceContext.getState(State::Energy).getPotentialEnergy();
+        ASSERT_EQUAL_TOL(expectedEnergy, energy, 1e-4);
+    }
+
+    // Energies at many values of LambdaElectrostatics are interpolated from a few evaluations.  They should
+    // match evaluating each value separately.
+
+    vector<double> values;
+    for (int i = 0; i <= 10; i++)
+        values.push_back(0.1*i);
+    context.setParameter(NonbondedForce::LambdaSterics(), 0.7);
+    referenceContext.setParameter(NonbondedForce::LambdaSterics(), 0.7);
+    vector<double> energies = context.computeEnergiesAtParameters(NonbondedForce::LambdaElectrostatics(), values);
+    ASSERT_EQUAL(1.0, context.getParameter(NonbondedForce::LambdaElectrostatics()));
+    for (int i = 0; i < (int) values.size(); i++) {
+        referenceContext.setParameter(NonbondedForce::LambdaElectrostatics(), values[i]);
+        double expectedEnergy = referenceContext.getState(State::Energy).getPotentialEnergy();
+        ASSERT_EQUAL_TOL(expectedEnergy, energies[i], 1e-4);
+    }
+}
+
+void testEnergyOnly(NonbondedForce::NonbondedMethod method, bool triclinic) {
+    const int numMolecules = 300;
+    const double boxSize = 4.0;
+    System system;
+    if (triclinic)
+        system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0.3*boxSize, boxSize, 0), Vec3(-0.2*boxSize, 0.1*boxSize, boxSize));
+    else
+        system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    system.addForce(nonbonded);
+    CustomIntegrator integrator(0.001);
+    integrator.addComputePerDof("v", "v+0.5*dt*f/m");
+    integrator.addComputePerDof("x", "x+dt*v");
+    integrator.addComputePerDof("v", "v+0.5*dt*f/m");
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+
+    // Computing only the energy should give the same result as computing forces and energy together.
+
+    double energy = context.getState(State::Energy).getPotentialEnergy();
+    State state = context.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), energy, 1e-5);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), context.getState(State::Energy).getPotentialEnergy(), 1e-5);
+
+    // The integrator reuses forces between steps.  Computing only the energy in between should not
+    // affect the trajectory.
+
+    CustomIntegrator integrator2(0.001);
+    integrator2.addComputePerDof("v", "v+0.5*dt*f/m");
+    integrator2.addComputePerDof("x", "x+dt*v");
+    integrator2.addComputePerDof("v", "v+0.5*dt*f/m");
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    for (int i = 0; i < 3; i++) {
+        integrator.step(1);
+        context.getState(State::Energy, false, 2);
+        context.getState(State::Energy);
+        integrator2.step(1);
+    }
+    State state1 = context.getState(State::Positions);
+    State state2 = context2.getState(State::Positions);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state2.getPositions()[i], state1.getPositions()[i], 1e-5);
+}
+
+void testEnergyChange(NonbondedForce::NonbondedMethod method, bool triclinic) {
+    const int numMolecules = 300;
+    const double boxSize = 4.0;
+    ReferencePlatform reference;
+    System system;
+    if (triclinic)
+        system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0.3*boxSize, boxSize, 0), Vec3(-0.2*boxSize, 0.1*boxSize, boxSize));
+    else
+        system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions;
+    const int gridSize = 7;
+    const double spacing = boxSize/gridSize;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        pos += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*(0.1*spacing);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    nonbonded->addException(1, 2, 0.2, 0.3, 0.1);
+    nonbonded->setParticleAlchemical(0, true);
+    nonbonded->setParticleAlchemical(1, true);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    context.setParameter(NonbondedForce::LambdaSterics(), 0.7);
+    context.setParameter(NonbondedForce::LambdaElectrostatics(), 0.4);
+    referenceContext.setParameter(NonbondedForce::LambdaSterics(), 0.7);
+    referenceContext.setParameter(NonbondedForce::LambdaElectrostatics(), 0.4);
+    context.setPositions(positions);
+
+    // Move a few molecules, and compare the energy change to the difference of full evaluations.  The first time
+    // the neighbor list has not been built yet.  The second time it has, and the moves are small enough that it
+    // can be used.  The third time tries different moves from the same state, and the fourth time starts from
+    // new positions, so the cached coordinates must be updated.
+
+    referenceContext.setPositions(positions);
+    double energy1 = referenceContext.getState(State::Energy).getPotentialEnergy();
+    for (int trial = 0; trial < 4; trial++) {
+        if (trial == 1)
+            context.getState(State::Energy);
+        if (trial == 3) {
+            for (int i = 0; i < (int) positions.size(); i++)
+                positions[i] += Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*0.01;
+            context.setPositions(positions);
+            referenceContext.setPositions(positions);
+            energy1 = referenceContext.getState(State::Energy).getPotentialEnergy();
+        }
+        double scale = (trial == 0 ? 0.4 : 0.1);
+        vector<int> particles;
+        vector<Vec3> newPositions;
+        vector<Vec3> movedPositions = positions;
+        for (int i = 0; i < 6; i++) {
+            int particle = (trial == 0 ? i : 7*i+trial);
+            Vec3 delta = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*scale;
+            particles.push_back(particle);
+            newPositions.push_back(positions[particle]+delta);
+            movedPositions[particle] = positions[particle]+delta;
+        }
+        double change = context.computeEnergyChange(particles, newPositions);
+        referenceContext.setPositions(movedPositions);
+        double energy2 = referenceContext.getState(State::Energy).getPotentialEnergy();
+        ASSERT_EQUAL_TOL(energy2-energy1, change, 1e-3);
+        State state = context.getState(State::Positions);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(positions[i], state.getPositions()[i], 0.0);
+    }
+}
+
+void testFrozenParticles(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 300;
+    const double boxSize = 4.0;
+    const double tol = 2e-3;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions;
+    const int gridSize = 7;
+    const double spacing = boxSize/gridSize;
+    for (int i = 0; i < numMolecules; i++) {
+        // Place the molecules on a grid, and freeze every one outside a slab in the middle of the box.
+
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        double mass = (pos[0] > 1.5 && pos[0] < 2.5 ? 1.0 : 0.0);
+        system.addParticle(mass);
+        system.addParticle(mass);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    for (int i = 0; i < 20; i++)
+        nonbonded->addException(2*i, 2*i+2, 0.2, 0.3, 0.1);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+
+    // Interactions between frozen particles are cached.  Compare to the Reference platform after taking
+    // some steps, and after moving a frozen particle.
+
+    for (int iteration = 0; iteration < 3; iteration++) {
+        if (iteration == 1)
+            integrator1.step(5);
+        if (iteration == 2) {
+            State state = context.getState(State::Positions);
+            positions = state.getPositions();
+            for (int i = 0; i < system.getNumParticles(); i++)
+                if (system.getParticleMass(i) == 0.0) {
+                    positions[i] += Vec3(0.05, 0, 0);
+                    break;
+                }
+            context.setPositions(positions);
+        }
+        State cpuState = context.getState(State::Positions | State::Forces | State::Energy);
+        referenceContext.setPositions(cpuState.getPositions());
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), tol);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], tol);
+    }
+}
+
+void testFrozenWithVirtualSites() {
+    const int gridSize = 4;
+    const double spacing = 0.4;
+    const double boxSize = gridSize*spacing;
+    const double tol = 2e-3;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(0.7);
+    system.addForce(nonbonded);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    vector<Vec3> positions;
+    for (int i = 0; i < gridSize*gridSize*gridSize; i++) {
+        // Build a four site water model.  The massless charge site is a virtual site, so it is not frozen.
+
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        int first = system.getNumParticles();
+        system.addParticle(16.0);
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        system.addParticle(0.0);
+        system.setVirtualSite(first+3, new ThreeParticleAverageSite(first, first+1, first+2, 0.8, 0.1, 0.1));
+        nonbonded->addParticle(0.0, 0.315, 0.65);
+        nonbonded->addParticle(0.52, 1.0, 0.0);
+        nonbonded->addParticle(0.52, 1.0, 0.0);
+        nonbonded->addParticle(-1.04, 1.0, 0.0);
+        for (int j = 0; j < 4; j++)
+            for (int k = j+1; k < 4; k++)
+                nonbonded->addException(first+j, first+k, 0.0, 1.0, 0.0);
+        bonds->addBond(first, first+1, 0.09572, 4e5);
+        bonds->addBond(first, first+2, 0.09572, 4e5);
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.09572, 0, 0));
+        positions.push_back(pos+Vec3(-0.024, 0.0927, 0));
+        positions.push_back(Vec3());
+    }
+    VerletIntegrator integrator1(0.0005);
+    VerletIntegrator integrator2(0.0005);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    context.computeVirtualSites();
+    ContextImpl* contextImpl = *reinterpret_cast<ContextImpl**>(&context);
+    ASSERT(CpuPlatform::getPlatformData(*contextImpl).isFrozen.size() == 0);
+    for (int iteration = 0; iteration < 2; iteration++) {
+        if (iteration == 1)
+            integrator1.step(5);
+        State cpuState = context.getState(State::Positions | State::Forces | State::Energy);
+        referenceContext.setPositions(cpuState.getPositions());
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), tol);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], tol);
+    }
+
+    // A massless particle that is not a virtual site is still frozen.
+
+    system.addParticle(0.0);
+    nonbonded->addParticle(0.0, 0.3, 0.5);
+    positions.push_back(Vec3(0.1, 0.1, 0.1));
+    VerletIntegrator integrator3(0.0005);
+    Context context2(system, integrator3, platform);
+    contextImpl = *reinterpret_cast<ContextImpl**>(&context2);
+    const vector<char>& isFrozen = CpuPlatform::getPlatformData(*contextImpl).isFrozen;
+    ASSERT_EQUAL(system.getNumParticles(), isFrozen.size());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL(i == system.getNumParticles()-1, isFrozen[i] != 0);
+}
+
+void testUpdateSomeParameters(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseDispersionCorrection(true);
+    vector<Vec3> positions;
+    const int gridSize = 5;
+    const double spacing = boxSize/gridSize;
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    for (int i = 0; i < 10; i++)
+        nonbonded->addException(2*i, 2*i+2, 0.1, 0.3, 0.2);
+    nonbonded->setParticleAlchemical(0, true);
+    nonbonded->setParticleAlchemical(1, true);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context1.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+    context2.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+    context2.getState(State::Energy);
+
+    // Change a few particles and exceptions, and copy them over to one Context in full and to the other
+    // just the ones that changed.
+
+    vector<int> particles, exceptions;
+    particles.push_back(0);
+    particles.push_back(7);
+    nonbonded->setParticleParameters(0, 0.3, 0.3, 0.4);
+    nonbonded->setParticleParameters(7, -0.2, 0.25, 0.5);
+    exceptions.push_back(numMolecules+1);
+    nonbonded->setExceptionParameters(numMolecules+1, 2, 4, -0.2, 0.35, 0.1);
+    nonbonded->updateParametersInContext(context1);
+    nonbonded->updateParametersInContext(context2, particles, exceptions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+
+    // An exception cannot be changed between excluded and non-excluded.
+
+    nonbonded->setExceptionParameters(0, 0, 1, 0.1, 1.0, 0.0);
+    exceptions[0] = 0;
+    bool threwException = false;
+    try {
+        nonbonded->updateParametersInContext(context2, particles, exceptions);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testClone(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseDispersionCorrection(true);
+    vector<Vec3> positions;
+    const int gridSize = 5;
+    const double spacing = boxSize/gridSize;
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(i < 5 ? 0.0 : 1.0);
+        system.addParticle(i < 5 ? 0.0 : 1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    for (int i = 0; i < 10; i++)
+        nonbonded->addException(2*i, 2*i+2, 0.1, 0.3, 0.2);
+    for (int i = 20; i < 30; i++)
+        nonbonded->setParticleAlchemical(i, true);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    context1.setParameter(NonbondedForce::LambdaSterics(), 0.6);
+    context1.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+    nonbonded->setParticleParameters(40, 0.3, 0.3, 0.4);
+    nonbonded->setExceptionParameters(numMolecules+5, 10, 12, -0.2, 0.35, 0.1);
+    nonbonded->updateParametersInContext(context1);
+    integrator1.step(5);
+    State state1 = context1.getState(State::Positions | State::Forces | State::Energy);
+
+    // Modify the Force again without updating the Context, then clone it.  The clone should match the original.
+
+    nonbonded->setParticleParameters(40, -0.3, 0.3, 0.4);
+    VerletIntegrator integrator2(0.001);
+    Context* context2 = context1.clone(integrator2);
+    State state2 = context2->getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+
+    // It should also agree with the Reference platform, including after the lambdas change.
+
+    nonbonded->setParticleParameters(40, 0.3, 0.3, 0.4);
+    VerletIntegrator integrator3(0.001);
+    Context referenceContext(system, integrator3, reference);
+    referenceContext.setPositions(state1.getPositions());
+    context2->setParameter(NonbondedForce::LambdaElectrostatics(), 0.2);
+    referenceContext.setParameter(NonbondedForce::LambdaSterics(), 0.6);
+    referenceContext.setParameter(NonbondedForce::LambdaElectrostatics(), 0.2);
+    state2 = context2->getState(State::Forces | State::Energy);
+    State state3 = referenceContext.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state3.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-4);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state3.getForces()[i], state2.getForces()[i], 1e-4);
+    delete context2;
+}
+
+void testEnergiesOfConfigurations() {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    vector<Vec3> positions;
+    const int gridSize = 5;
+    const double spacing = boxSize/gridSize;
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        bonds->addBond(2*i, 2*i+1, 0.1, 1000.0);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    system.addForce(nonbonded);
+    system.addForce(bonds);
+
+    // Use several threads, so the configurations are divided between clones of the Context.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "4";
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform, properties);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    nonbonded->setParticleParameters(3, 0.2, 0.3, 0.5);
+    nonbonded->updateParametersInContext(context);
+    nonbonded->updateParametersInContext(referenceContext);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<vector<Vec3> > configurations(30, positions);
+    for (int i = 0; i < (int) configurations.size(); i++)
+        for (int j = 0; j < (int) positions.size(); j++)
+            configurations[i][j] += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.02;
+    for (int groups = 1; groups < 4; groups++) {
+        vector<double> energies = context.computeEnergies(configurations, groups);
+        ASSERT_EQUAL(configurations.size(), energies.size());
+        for (int i = 0; i < (int) configurations.size(); i++) {
+            referenceContext.setPositions(configurations[i]);
+            ASSERT_EQUAL_TOL(referenceContext.getState(State::Energy, false, groups).getPotentialEnergy(), energies[i], 1e-5);
+        }
+    }
+
+    // The clones are reused between calls.  Make sure they see later changes to the parameters.
+
+    nonbonded->setParticleParameters(5, 0.7, 0.3, 0.5);
+    nonbonded->updateParametersInContext(context);
+    nonbonded->updateParametersInContext(referenceContext);
+    vector<double> energies = context.computeEnergies(configurations);
+    for (int i = 0; i < (int) configurations.size(); i++) {
+        referenceContext.setPositions(configurations[i]);
+        ASSERT_EQUAL_TOL(referenceContext.getState(State::Energy).getPotentialEnergy(), energies[i], 1e-5);
+    }
+
+    // The positions of the Context should be unchanged.
+
+    State state = context.getState(State::Positions);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(positions[i], state.getPositions()[i], 0.0);
+}
+
 int main(int argc, char* argv[]) {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -702,6 +1385,35 @@ int main(int argc, char* argv[]) {
         testChangingParameters();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
+        testSoftcore();
+        testAlchemical(NonbondedForce::CutoffPeriodic);
+        testAlchemical(NonbondedForce::PME);
+        testChangingLambda(NonbondedForce::Ewald);
+        testChangingLambda(NonbondedForce::PME);
+        testEnergyOnly(NonbondedForce::NoCutoff, false);
+        testEnergyOnly(NonbondedForce::CutoffPeriodic, false);
+        testEnergyOnly(NonbondedForce::CutoffPeriodic, true);
+        testEnergyOnly(NonbondedForce::Ewald, false);
+        testEnergyOnly(NonbondedForce::PME, false);
+        testEnergyOnly(NonbondedForce::PME, true);
+        testEnergyChange(NonbondedForce::NoCutoff, false);
+        testEnergyChange(NonbondedForce::CutoffNonPeriodic, false);
+        testEnergyChange(NonbondedForce::CutoffPeriodic, false);
+        testEnergyChange(NonbondedForce::CutoffPeriodic, true);
+        testEnergyChange(NonbondedForce::PME, false);
+        testFrozenParticles(NonbondedForce::NoCutoff);
+        testFrozenParticles(NonbondedForce::CutoffNonPeriodic);
+        testFrozenParticles(NonbondedForce::CutoffPeriodic);
+        testFrozenParticles(NonbondedForce::Ewald);
+        testFrozenParticles(NonbondedForce::PME);
+        testFrozenWithVirtualSites();
+        testUpdateSomeParameters(NonbondedForce::NoCutoff);
+        testUpdateSomeParameters(NonbondedForce::CutoffPeriodic);
+        testUpdateSomeParameters(NonbondedForce::Ewald);
+        testUpdateSomeParameters(NonbondedForce::PME);
+        testClone(NonbondedForce::CutoffPeriodic);
+        testClone(NonbondedForce::PME);
+        testEnergiesOfConfigurations();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -119,10 +119,50 @@ void testParallelComputation() {
         ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
 }
 
+void testFrozenParticles() {
+    System system;
+    const int numParticles = 200;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(i < 150 ? 0.0 : 1.0);
+    PeriodicTorsionForce* force = new PeriodicTorsionForce();
+    for (int i = 3; i < numParticles; i++)
+        force->addTorsion(i-3, i-2, i-1, i, 2, 1.1, i);
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        positions[i] = Vec3(i, i%2, i%3);
+    VerletIntegrator integrator1(0.01);
+    ReferencePlatform reference;
+    Context context1(system, integrator1, reference);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+
+    // Torsions between frozen particles are cached.  Make sure the results stay correct when the frozen
+    // particles are moved, and when parameters are changed.
+
+    for (int iteration = 0; iteration < 3; iteration++) {
+        if (iteration == 1)
+            positions[10] += Vec3(0.1, 0.2, 0.3);
+        if (iteration == 2) {
+            force->setTorsionParameters(10, 10, 11, 12, 13, 3, 0.5, 2.0);
+            force->updateParametersInContext(context1);
+            force->updateParametersInContext(context2);
+        }
+        context1.setPositions(positions);
+        context2.setPositions(positions);
+        State state1 = context1.getState(State::Forces | State::Energy);
+        State state2 = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+    }
+}
+
 int main(int argc, char* argv[]) {
     try {
         testPeriodicTorsions();
         testParallelComputation();
+        testFrozenParticles();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
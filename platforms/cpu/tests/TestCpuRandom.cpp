@@ -0,0 +1,126 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2014 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of random number generation.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "CpuRandom.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testGaussian() {
+    const int numSteps = 100;
+    const int numValues = 10000;
+    CpuRandom random;
+    random.initialize(5, 1);
+    double mean = 0.0;
+    double var = 0.0;
+    double skew = 0.0;
+    double kurtosis = 0.0;
+    for (int step = 0; step < numSteps; step++) {
+        random.advanceStep();
+        for (int i = 0; i < numValues; i++) {
+            float values[4];
+            random.getGaussianRandoms(i, values);
+            for (int j = 0; j < 4; j++) {
+                double value = values[j];
+                mean += value;
+                var += value*value;
+                skew += value*value*value;
+                kurtosis += value*value*value*value;
+            }
+        }
+    }
+    int total = 4*numSteps*numValues;
+    mean /= total;
+    var /= total;
+    skew /= total;
+    kurtosis /= total;
+    double c2 = var-mean*mean;
+    double c3 = skew-3*var*mean+2*mean*mean*mean;
+    double c4 = kurtosis-4*skew*mean-3*var*var+12*var*mean*mean-6*mean*mean*mean*mean;
+    ASSERT_EQUAL_TOL(0.0, mean, 0.01);
+    ASSERT_EQUAL_TOL(1.0, c2, 0.01);
+    ASSERT_EQUAL_TOL(0.0, c3, 0.01);
+    ASSERT_EQUAL_TOL(0.0, c4, 0.01);
+}
+
+void testReproducibility() {
+    // Values should depend only on the seed, step, and index, not on the number of threads.
+    
+    const int numValues = 1000;
+    CpuRandom random1, random2, random3;
+    random1.initialize(10, 1);
+    random2.initialize(10, 7);
+    random3.initialize(11, 1);
+    for (int step = 0; step < 3; step++) {
+        random1.advanceStep();
+        random2.advanceStep();
+        random3.advanceStep();
+        for (int i = numValues-1; i >= 0; i--) {
+            float values1[4], values2[4], values3[4];
+            random1.getGaussianRandoms(i, values1);
+            random2.getGaussianRandoms(i, values2);
+            random3.getGaussianRandoms(i, values3);
+            for (int j = 0; j < 4; j++) {
+                ASSERT_EQUAL(values1[j], values2[j]);
+                ASSERT(values1[j] != values3[j]);
+            }
+        }
+    }
+    
+    // Different steps should produce different values.
+    
+    float values1[4], values2[4];
+    random1.getGaussianRandoms(0, values1);
+    random1.advanceStep();
+    random1.getGaussianRandoms(0, values2);
+    for (int j = 0; j < 4; j++)
+        ASSERT(values1[j] != values2[j]);
+}
+
+int main() {
+    try {
+        testGaussian();
+        testReproducibility();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -1488,6 +1488,8 @@ static int findFFTDimension(int minimum) {
 
 void CudaCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
     cu.setAsCurrent();
+    if (force.getNumAlchemicalParticles() > 0)
+        throw OpenMMException("NonbondedForce: Alchemical particles are not supported on this platform");
 
     // Identify which exceptions are 1-4 interactions.
 
@@ -2142,6 +2144,7 @@ void CudaCalcCustomNonbondedForceKernel::initialize(const System& system, const
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection() && cu.getContextIndex() == 0) {
         forceCopy = new CustomNonbondedForce(force);
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -2400,13 +2403,13 @@ double CudaCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool in
         if (changed) {
             globals->upload(globalParamValues);
             if (forceCopy != NULL) {
-                longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner());
+                longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner());
                 hasInitializedLongRangeCorrection = true;
             }
         }
     }
     if (!hasInitializedLongRangeCorrection) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner());
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner());
         hasInitializedLongRangeCorrection = true;
     }
     if (interactionGroupData != NULL) {
@@ -2454,7 +2457,8 @@ void CudaCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl& co
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner());
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner());
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
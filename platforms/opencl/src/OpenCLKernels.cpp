@@ -1461,6 +1461,8 @@ OpenCLCalcNonbondedForceKernel::~OpenCLCalcNonbondedForceKernel() {
 }
 
 void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
+    if (force.getNumAlchemicalParticles() > 0)
+        throw OpenMMException("NonbondedForce: Alchemical particles are not supported on this platform");
 
     // Identify which exceptions are 1-4 interactions.
 
@@ -2176,6 +2178,7 @@ void OpenCLCalcCustomNonbondedForceKernel::initialize(const System& system, cons
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection() && cl.getContextIndex() == 0) {
         forceCopy = new CustomNonbondedForce(force);
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -2442,13 +2445,13 @@ double OpenCLCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool
         if (changed) {
             globals->upload(globalParamValues);
             if (forceCopy != NULL) {
-                longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner());
+                longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner());
                 hasInitializedLongRangeCorrection = true;
             }
         }
     }
     if (!hasInitializedLongRangeCorrection) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner());
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner());
         hasInitializedLongRangeCorrection = true;
     }
     if (interactionGroupData != NULL) {
@@ -2494,7 +2497,8 @@ void OpenCLCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl&
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner());
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner());
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
@@ -34,6 +34,7 @@
 
 #include "ReferencePlatform.h"
 #include "openmm/kernels.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "SimTKOpenMMRealType.h"
 #include "ReferenceNeighborList.h"
 #include "lepton/CompiledExpression.h"
@@ -47,6 +48,7 @@ class ReferenceAndersenThermostat;
 class ReferenceCustomCompoundBondIxn;
 class ReferenceCustomHbondIxn;
 class ReferenceCustomManyParticleIxn;
+class ReferenceLJCoulombIxn;
 class ReferenceBrownianDynamics;
 class ReferenceStochasticDynamics;
 class ReferenceConstraintAlgorithm;
@@ -156,6 +158,47 @@ public:
      * @param forces  on exit, this contains the forces
      */
     void getForces(ContextImpl& context, std::vector<Vec3>& forces);
+    /**
+     * Get the positions of a subset of particles.
+     *
+     * @param particles  the indices of the particles to get
+     * @param positions  on exit, element i contains the position of particle particles[i]
+     */
+    void getSubsetPositions(ContextImpl& context, const std::vector<int>& particles, std::vector<Vec3>& positions);
+    /**
+     * Get the velocities of a subset of particles.
+     *
+     * @param particles   the indices of the particles to get
+     * @param velocities  on exit, element i contains the velocity of particle particles[i]
+     */
+    void getSubsetVelocities(ContextImpl& context, const std::vector<int>& particles, std::vector<Vec3>& velocities);
+    /**
+     * Copy the positions of some or all particles into an array supplied by the caller.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the array to write to
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    void copyPositions(ContextImpl& context, const std::vector<int>& particles, double* output, int stride);
+    void copyPositions(ContextImpl& context, const std::vector<int>& particles, float* output, int stride);
+    /**
+     * Copy the velocities of some or all particles into an array supplied by the caller.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the array to write to
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    void copyVelocities(ContextImpl& context, const std::vector<int>& particles, double* output, int stride);
+    void copyVelocities(ContextImpl& context, const std::vector<int>& particles, float* output, int stride);
+    /**
+     * Copy the most recently computed forces on some or all particles into an array supplied by the caller.
+     *
+     * @param particles  the indices of the particles to copy.  If this is empty, all particles are copied.
+     * @param output     the array to write to
+     * @param stride     the spacing between consecutive particles in the output array
+     */
+    void copyForces(ContextImpl& context, const std::vector<int>& particles, double* output, int stride);
+    void copyForces(ContextImpl& context, const std::vector<int>& particles, float* output, int stride);
     /**
      * Get the current periodic box vectors.
      *
@@ -553,6 +596,15 @@ public:
      * @param force      the NonbondedForce this kernel will be used for
      */
     void initialize(const System& system, const NonbondedForce& force);
+    /**
+     * Initialize the kernel for a Context that is a clone of another one, copying the data from the original kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the NonbondedForce this kernel will be used for
+     * @param original   the kernel of the original Context to copy from
+     * @return true, since this kernel always supports being initialized this way
+     */
+    bool initializeFromKernel(const System& system, const NonbondedForce& force, const CalcNonbondedForceKernel& original);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -570,14 +622,45 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a subset of particles and exceptions have changed.
+     *
+     * @param context     the context to copy parameters to
+     * @param force       the NonbondedForce to copy the parameters from
+     * @param particles   the indices of the particles whose parameters have changed
+     * @param exceptions  the indices of the exceptions whose parameters have changed
+     */
+    void copyChangedParametersToContext(ContextImpl& context, const NonbondedForce& force, const std::vector<int>& particles, const std::vector<int>& exceptions);
+    /**
+     * Compute how the energy would change if a subset of particles were moved, considering only the interactions
+     * that involve those particles.  This is not supported for Ewald or PME.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param particles      the indices of the particles to move
+     * @param newPositions   the new positions of those particles
+     * @param includeDirect  true if direct space interactions should be included
+     * @param includeReciprocal  true if reciprocal space interactions should be included
+     * @param energyChange   on exit, if this returns true, the change in energy
+     * @return true if the change was computed
+     */
+    bool computeEnergyChange(ContextImpl& context, const std::vector<int>& particles, const std::vector<Vec3>& newPositions,
+            bool includeDirect, bool includeReciprocal, double& energyChange);
 private:
+    /**
+     * Scale the charges of alchemical particles by the current value of lambda_electrostatics, and
+     * configure soft-core Lennard-Jones.  Returns the current value of lambda_sterics.
+     */
+    RealOpenMM setupAlchemicalParameters(ContextImpl& context, ReferenceLJCoulombIxn& clj);
     int numParticles, num14;
     int **bonded14IndexArray;
     RealOpenMM **particleParamArray, **bonded14ParamArray;
-    RealOpenMM nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, dispersionCoefficient;
+    RealOpenMM nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, dispersionCoefficient, decoupledDispersionCoefficient, softcoreAlpha;
     int kmax[3], gridSize[3];
-    bool useSwitchingFunction;
+    bool useSwitchingFunction, hasAlchemicalParticles;
     std::vector<std::set<int> > exclusions;
+    std::vector<bool> alchemical;
+    std::vector<RealOpenMM> particleCharges, exceptionChargeProds;
+    std::vector<int> exception14Index;
     NonbondedMethod nonbondedMethod;
     NeighborList* neighborList;
 };
@@ -597,6 +680,15 @@ public:
      * @param force      the CustomNonbondedForce this kernel will be used for
      */
     void initialize(const System& system, const CustomNonbondedForce& force);
+    /**
+     * Initialize the kernel for a Context that is a clone of another one, copying the data from the original kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomNonbondedForce this kernel will be used for
+     * @param original   the kernel of the original Context to copy from
+     * @return true, since this kernel always supports being initialized this way
+     */
+    bool initializeFromKernel(const System& system, const CustomNonbondedForce& force, const CalcCustomNonbondedForceKernel& original);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -613,12 +705,21 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a subset of particles have changed.
+     *
+     * @param context     the context to copy parameters to
+     * @param force       the CustomNonbondedForce to copy the parameters from
+     * @param particles   the indices of the particles whose parameters have changed
+     */
+    void copyChangedParametersToContext(ContextImpl& context, const CustomNonbondedForce& force, const std::vector<int>& particles);
 private:
     int numParticles;
     RealOpenMM **particleParamArray;
     RealOpenMM nonbondedCutoff, switchingDistance, periodicBoxSize[3], longRangeCoefficient;
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
     CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData longRangeCorrectionData;
     std::map<std::string, double> globalParamValues;
     std::vector<std::set<int> > exclusions;
     Lepton::CompiledExpression energyExpression, forceExpression;
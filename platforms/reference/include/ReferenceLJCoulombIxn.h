@@ -39,13 +39,16 @@ class ReferenceLJCoulombIxn {
       bool periodic;
       bool ewald;
       bool pme;
+      bool softcore;
       const OpenMM::NeighborList* neighborList;
+      const std::vector<bool>* alchemical;
       OpenMM::RealVec periodicBoxVectors[3];
       RealOpenMM cutoffDistance, switchingDistance;
       RealOpenMM krf, crf;
       RealOpenMM alphaEwald;
       int numRx, numRy, numRz;
       int meshDim[3];
+      RealOpenMM softcoreAlpha, softcoreLambda;
 
       // parameter indices
 
@@ -71,6 +74,22 @@ class ReferenceLJCoulombIxn {
                            RealOpenMM** atomParameters, std::vector<OpenMM::RealVec>& forces,
                            RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const;
 
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the Lennard-Jones interaction between two atoms, using the soft-core form
+         if exactly one of them is alchemical
+      
+         @param atom1            the index of the first atom
+         @param atom2            the index of the second atom
+         @param sig6             (sigma/r)^6
+         @param eps              4*epsilon
+         @param energy           on exit, the energy of the interaction
+         @param dEdR             on exit, -r*dE/dr
+            
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateLJIxn(int atom1, int atom2, RealOpenMM sig6, RealOpenMM eps, RealOpenMM& energy, RealOpenMM& dEdR) const;
+
 
    public:
 
@@ -148,6 +167,19 @@ class ReferenceLJCoulombIxn {
          --------------------------------------------------------------------------------------- */
       
       void setUsePME(RealOpenMM alpha, int meshSize[3]);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Set the force to use a soft-core Lennard-Jones interaction between alchemical and
+         non-alchemical atoms.
+      
+         @param alchemical  alchemical[i] is true if atom i is alchemical
+         @param alpha       the soft-core alpha parameter
+         @param lambda      the current value of lambda_sterics
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setUseSoftcore(const std::vector<bool>& alchemical, RealOpenMM alpha, RealOpenMM lambda);
       
       /**---------------------------------------------------------------------------------------
       
@@ -172,6 +204,26 @@ class ReferenceLJCoulombIxn {
                             RealOpenMM* fixedParameters, std::vector<OpenMM::RealVec>& forces,
                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy, bool includeDirect, bool includeReciprocal) const;
 
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the energy of every direct space interaction that involves at least one atom
+         from a subset.  This is used to find how the energy changes when those atoms move.
+         Ewald summation and PME are not supported.
+      
+         @param numberOfAtoms    number of atoms
+         @param atomCoordinates  atom coordinates
+         @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
+         @param exclusions       atom exclusion indices
+                                 exclusions[atomIndex] contains the list of exclusions for that atom
+         @param subset           the indices of the atoms whose interactions should be included
+         @param totalEnergy      total energy
+      
+         --------------------------------------------------------------------------------------- */
+          
+      void calculateSubsetIxn(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+                              RealOpenMM** atomParameters, std::vector<std::set<int> >& exclusions,
+                              const std::vector<int>& subset, RealOpenMM* totalEnergy) const;
+
 private:
       /**---------------------------------------------------------------------------------------
       
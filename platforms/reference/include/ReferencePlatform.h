@@ -54,6 +54,7 @@ public:
     bool supportsDoublePrecision() const;
     void contextCreated(ContextImpl& context, const std::map<std::string, std::string>& properties) const;
     void contextDestroyed(ContextImpl& context) const;
+    int getNumConcurrentContexts(ContextImpl& context, std::map<std::string, std::string>& properties) const;
 };
 
 class ReferencePlatform::PlatformData {
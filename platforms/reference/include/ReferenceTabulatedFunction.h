@@ -54,10 +54,12 @@ public:
     double evaluate(const double* arguments) const;
     double evaluateDerivative(const double* arguments, const int* derivOrder) const;
     CustomFunction* clone() const;
+    bool getUniformSpline(double& min, double& max, std::vector<double>& coefficients) const;
 private:
     const Continuous1DFunction& function;
-    double min, max;
-    std::vector<double> x, values, derivs;
+    int numIntervals;
+    double min, max, invSpacing;
+    std::vector<double> coefficients;
 };
 
 /**
@@ -70,12 +72,30 @@ public:
     double evaluate(const double* arguments) const;
     double evaluateDerivative(const double* arguments, const int* derivOrder) const;
     CustomFunction* clone() const;
+    /**
+     * Evaluate the function and its gradient at a point.  This is faster than calling evaluate() and
+     * evaluateDerivative() separately, since the cell containing the point only needs to be located once.
+     *
+     * @param arguments   the point at which to evaluate the function
+     * @param gradient    on exit, the two components of the gradient are stored into this
+     * @return the value of the function
+     */
+    double evaluateWithGradient(const double* arguments, double* gradient) const;
+    /**
+     * Evaluate the function and its gradient at many points.
+     *
+     * @param numPoints   the number of points to evaluate
+     * @param arguments   the points at which to evaluate the function, stored as (x0, y0, x1, y1, ...)
+     * @param values      on exit, the function value at each point is stored into this
+     * @param gradients   on exit, the gradient at each point is stored into this, in the same layout as arguments
+     */
+    void evaluateWithGradient(int numPoints, const double* arguments, double* values, double* gradients) const;
 private:
+    const double* findCell(double u, double v, double& da, double& db) const;
     const Continuous2DFunction& function;
     int xsize, ysize;
-    double xmin, xmax, ymin, ymax;
-    std::vector<double> x, y, values;
-    std::vector<std::vector<double> > c;
+    double xmin, xmax, ymin, ymax, xscale, yscale;
+    std::vector<double> c;
 };
 
 /**
@@ -88,12 +108,30 @@ public:
     double evaluate(const double* arguments) const;
     double evaluateDerivative(const double* arguments, const int* derivOrder) const;
     CustomFunction* clone() const;
+    /**
+     * Evaluate the function and its gradient at a point.  This is faster than calling evaluate() and
+     * evaluateDerivative() separately, since the cell containing the point only needs to be located once.
+     *
+     * @param arguments   the point at which to evaluate the function
+     * @param gradient    on exit, the three components of the gradient are stored into this
+     * @return the value of the function
+     */
+    double evaluateWithGradient(const double* arguments, double* gradient) const;
+    /**
+     * Evaluate the function and its gradient at many points.
+     *
+     * @param numPoints   the number of points to evaluate
+     * @param arguments   the points at which to evaluate the function, stored as (x0, y0, z0, x1, y1, z1, ...)
+     * @param values      on exit, the function value at each point is stored into this
+     * @param gradients   on exit, the gradient at each point is stored into this, in the same layout as arguments
+     */
+    void evaluateWithGradient(int numPoints, const double* arguments, double* values, double* gradients) const;
 private:
+    const double* findCell(double u, double v, double w, double& da, double& db, double& dc) const;
     const Continuous3DFunction& function;
     int xsize, ysize, zsize;
-    double xmin, xmax, ymin, ymax, zmin, zmax;
-    std::vector<double> x, y, z, values;
-    std::vector<std::vector<double> > c;
+    double xmin, xmax, ymin, ymax, zmin, zmax, xscale, yscale, zscale;
+    std::vector<double> c;
 };
 
 /**
@@ -260,6 +260,48 @@ void ReferenceUpdateStateDataKernel::getForces(ContextImpl& context, std::vector
         forces[i] = Vec3(forceData[i][0], forceData[i][1], forceData[i][2]);
 }
 
+void ReferenceUpdateStateDataKernel::getSubsetPositions(ContextImpl& context, const std::vector<int>& particles, std::vector<Vec3>& positions) {
+    vector<RealVec>& posData = extractPositions(context);
+    positions.resize(particles.size());
+    for (int i = 0; i < (int) particles.size(); ++i) {
+        const RealVec& pos = posData[particles[i]];
+        positions[i] = Vec3(pos[0], pos[1], pos[2]);
+    }
+}
+
+void ReferenceUpdateStateDataKernel::getSubsetVelocities(ContextImpl& context, const std::vector<int>& particles, std::vector<Vec3>& velocities) {
+    vector<RealVec>& velData = extractVelocities(context);
+    velocities.resize(particles.size());
+    for (int i = 0; i < (int) particles.size(); ++i) {
+        const RealVec& vel = velData[particles[i]];
+        velocities[i] = Vec3(vel[0], vel[1], vel[2]);
+    }
+}
+
+void ReferenceUpdateStateDataKernel::copyPositions(ContextImpl& context, const std::vector<int>& particles, double* output, int stride) {
+    copyToArray(extractPositions(context), particles, output, stride);
+}
+
+void ReferenceUpdateStateDataKernel::copyPositions(ContextImpl& context, const std::vector<int>& particles, float* output, int stride) {
+    copyToArray(extractPositions(context), particles, output, stride);
+}
+
+void ReferenceUpdateStateDataKernel::copyVelocities(ContextImpl& context, const std::vector<int>& particles, double* output, int stride) {
+    copyToArray(extractVelocities(context), particles, output, stride);
+}
+
+void ReferenceUpdateStateDataKernel::copyVelocities(ContextImpl& context, const std::vector<int>& particles, float* output, int stride) {
+    copyToArray(extractVelocities(context), particles, output, stride);
+}
+
+void ReferenceUpdateStateDataKernel::copyForces(ContextImpl& context, const std::vector<int>& particles, double* output, int stride) {
+    copyToArray(extractForces(context), particles, output, stride);
+}
+
+void ReferenceUpdateStateDataKernel::copyForces(ContextImpl& context, const std::vector<int>& particles, float* output, int stride) {
+    copyToArray(extractForces(context), particles, output, stride);
+}
+
 void ReferenceUpdateStateDataKernel::getPeriodicBoxVectors(ContextImpl& context, Vec3& a, Vec3& b, Vec3& c) const {
     RealVec* vectors = extractBoxVectors(context);
     a = vectors[0];
@@ -805,17 +847,27 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
     // Build the arrays.
 
     num14 = nb14s.size();
+    exception14Index.resize(force.getNumExceptions(), -1);
+    for (int i = 0; i < num14; i++)
+        exception14Index[nb14s[i]] = i;
     bonded14IndexArray = allocateIntArray(num14, 2);
     bonded14ParamArray = allocateRealArray(num14, 3);
     particleParamArray = allocateRealArray(numParticles, 3);
+    particleCharges.resize(numParticles);
+    alchemical.resize(numParticles);
     for (int i = 0; i < numParticles; ++i) {
         double charge, radius, depth;
         force.getParticleParameters(i, charge, radius, depth);
         particleParamArray[i][0] = static_cast<RealOpenMM>(0.5*radius);
         particleParamArray[i][1] = static_cast<RealOpenMM>(2.0*sqrt(depth));
         particleParamArray[i][2] = static_cast<RealOpenMM>(charge);
+        particleCharges[i] = static_cast<RealOpenMM>(charge);
+        alchemical[i] = force.isParticleAlchemical(i);
     }
+    hasAlchemicalParticles = (force.getNumAlchemicalParticles() > 0);
+    softcoreAlpha = static_cast<RealOpenMM>(force.getSoftcoreAlpha());
     this->exclusions = exclusions;
+    exceptionChargeProds.resize(num14);
     for (int i = 0; i < num14; ++i) {
         int particle1, particle2;
         double charge, radius, depth;
@@ -825,6 +877,7 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
         bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
         bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
+        exceptionChargeProds[i] = static_cast<RealOpenMM>(charge);
     }
     nonbondedMethod = CalcNonbondedForceKernel::NonbondedMethod(force.getNonbondedMethod());
     nonbondedCutoff = (RealOpenMM) force.getCutoffDistance();
@@ -848,10 +901,59 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         ewaldAlpha = (RealOpenMM) alpha;
     }
     rfDielectric = (RealOpenMM)force.getReactionFieldDielectric();
-    if (force.getUseDispersionCorrection())
+    if (force.getUseDispersionCorrection()) {
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(system, force);
+        decoupledDispersionCoefficient = (hasAlchemicalParticles ? NonbondedForceImpl::calcDispersionCorrection(system, force, 0.0) : dispersionCoefficient);
+    }
     else
-        dispersionCoefficient = 0.0;
+        dispersionCoefficient = decoupledDispersionCoefficient = 0.0;
+}
+
+bool ReferenceCalcNonbondedForceKernel::initializeFromKernel(const System& system, const NonbondedForce& force, const CalcNonbondedForceKernel& originalKernel) {
+    const ReferenceCalcNonbondedForceKernel& original = dynamic_cast<const ReferenceCalcNonbondedForceKernel&>(originalKernel);
+
+    // Copy the exclusions and parameters.
+
+    numParticles = original.numParticles;
+    num14 = original.num14;
+    exclusions = original.exclusions;
+    exception14Index = original.exception14Index;
+    bonded14IndexArray = allocateIntArray(num14, 2);
+    bonded14ParamArray = allocateRealArray(num14, 3);
+    particleParamArray = allocateRealArray(numParticles, 3);
+    for (int i = 0; i < num14; i++) {
+        for (int j = 0; j < 2; j++)
+            bonded14IndexArray[i][j] = original.bonded14IndexArray[i][j];
+        for (int j = 0; j < 3; j++)
+            bonded14ParamArray[i][j] = original.bonded14ParamArray[i][j];
+    }
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++)
+            particleParamArray[i][j] = original.particleParamArray[i][j];
+    particleCharges = original.particleCharges;
+    exceptionChargeProds = original.exceptionChargeProds;
+    alchemical = original.alchemical;
+    hasAlchemicalParticles = original.hasAlchemicalParticles;
+    softcoreAlpha = original.softcoreAlpha;
+
+    // Copy the other parameters, including the ones that are expensive to compute.
+
+    nonbondedMethod = original.nonbondedMethod;
+    nonbondedCutoff = original.nonbondedCutoff;
+    useSwitchingFunction = original.useSwitchingFunction;
+    if (useSwitchingFunction)
+        switchingDistance = original.switchingDistance;
+    neighborList = (nonbondedMethod == NoCutoff ? NULL : new NeighborList());
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        ewaldAlpha = original.ewaldAlpha;
+    for (int i = 0; i < 3; i++) {
+        kmax[i] = original.kmax[i];
+        gridSize[i] = original.gridSize[i];
+    }
+    rfDielectric = original.rfDielectric;
+    dispersionCoefficient = original.dispersionCoefficient;
+    decoupledDispersionCoefficient = original.decoupledDispersionCoefficient;
+    return true;
 }
 
 double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
@@ -879,6 +981,7 @@ double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool inc
         clj.setUsePME(ewaldAlpha, gridSize);
     if (useSwitchingFunction)
         clj.setUseSwitchingFunction(switchingDistance);
+    RealOpenMM lambdaSterics = setupAlchemicalParameters(context, clj);
     clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal);
     if (includeDirect) {
         ReferenceBondForce refBondForce;
@@ -886,12 +989,74 @@ double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool inc
         refBondForce.calculateForce(num14, bonded14IndexArray, posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14);
         if (periodic || ewald || pme) {
             RealVec* boxVectors = extractBoxVectors(context);
-            energy += dispersionCoefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
+            RealOpenMM coefficient = decoupledDispersionCoefficient+lambdaSterics*(dispersionCoefficient-decoupledDispersionCoefficient);
+            energy += coefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
         }
     }
     return energy;
 }
 
+bool ReferenceCalcNonbondedForceKernel::computeEnergyChange(ContextImpl& context, const vector<int>& particles, const vector<Vec3>& newPositions,
+        bool includeDirect, bool includeReciprocal, double& energyChange) {
+    if (nonbondedMethod == Ewald || nonbondedMethod == PME)
+        return false;
+    energyChange = 0.0;
+    if (!includeDirect)
+        return true;
+    vector<RealVec>& posData = extractPositions(context);
+    vector<RealVec> movedPosData = posData;
+    vector<bool> isMoved(numParticles, false);
+    for (int i = 0; i < (int) particles.size(); i++) {
+        movedPosData[particles[i]] = RealVec(newPositions[i][0], newPositions[i][1], newPositions[i][2]);
+        isMoved[particles[i]] = true;
+    }
+    ReferenceLJCoulombIxn clj;
+    NeighborList emptyList;
+    if (nonbondedMethod != NoCutoff)
+        clj.setUseCutoff(nonbondedCutoff, emptyList, rfDielectric);
+    if (nonbondedMethod == CutoffPeriodic)
+        clj.setPeriodic(extractBoxVectors(context));
+    if (useSwitchingFunction)
+        clj.setUseSwitchingFunction(switchingDistance);
+    setupAlchemicalParameters(context, clj);
+
+    // Compute the interactions involving the moved particles before and after the move.
+
+    RealOpenMM oldEnergy = 0, newEnergy = 0;
+    clj.calculateSubsetIxn(numParticles, posData, particleParamArray, exclusions, particles, &oldEnergy);
+    clj.calculateSubsetIxn(numParticles, movedPosData, particleParamArray, exclusions, particles, &newEnergy);
+    ReferenceLJCoulomb14 nonbonded14;
+    vector<RealVec> forces(numParticles);
+    for (int i = 0; i < num14; i++)
+        if (isMoved[bonded14IndexArray[i][0]] || isMoved[bonded14IndexArray[i][1]]) {
+            nonbonded14.calculateBondIxn(bonded14IndexArray[i], posData, bonded14ParamArray[i], forces, &oldEnergy);
+            nonbonded14.calculateBondIxn(bonded14IndexArray[i], movedPosData, bonded14ParamArray[i], forces, &newEnergy);
+        }
+    energyChange = newEnergy-oldEnergy;
+    return true;
+}
+
+RealOpenMM ReferenceCalcNonbondedForceKernel::setupAlchemicalParameters(ContextImpl& context, ReferenceLJCoulombIxn& clj) {
+    if (!hasAlchemicalParticles)
+        return 1;
+
+    // Scale the charges of alchemical particles, and use soft-core Lennard-Jones for their interactions.
+
+    RealOpenMM lambdaSterics = (RealOpenMM) context.getParameter(NonbondedForce::LambdaSterics());
+    RealOpenMM lambdaElectrostatics = (RealOpenMM) context.getParameter(NonbondedForce::LambdaElectrostatics());
+    for (int i = 0; i < numParticles; i++)
+        particleParamArray[i][2] = (alchemical[i] ? lambdaElectrostatics*particleCharges[i] : particleCharges[i]);
+    for (int i = 0; i < num14; i++) {
+        bonded14ParamArray[i][2] = exceptionChargeProds[i];
+        if (alchemical[bonded14IndexArray[i][0]])
+            bonded14ParamArray[i][2] *= lambdaElectrostatics;
+        if (alchemical[bonded14IndexArray[i][1]])
+            bonded14ParamArray[i][2] *= lambdaElectrostatics;
+    }
+    clj.setUseSoftcore(alchemical, softcoreAlpha, lambdaSterics);
+    return lambdaSterics;
+}
+
 void ReferenceCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context, const NonbondedForce& force) {
     if (force.getNumParticles() != numParticles)
         throw OpenMMException("updateParametersInContext: The number of particles has changed");
@@ -905,6 +1070,9 @@ void ReferenceCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& con
     }
     if (nb14s.size() != num14)
         throw OpenMMException("updateParametersInContext: The number of non-excluded exceptions has changed");
+    for (int i = 0; i < numParticles; ++i)
+        if (force.isParticleAlchemical(i) != alchemical[i])
+            throw OpenMMException("updateParametersInContext: The set of alchemical particles has changed");
 
     // Record the values.
 
@@ -914,6 +1082,7 @@ void ReferenceCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& con
         particleParamArray[i][0] = static_cast<RealOpenMM>(0.5*radius);
         particleParamArray[i][1] = static_cast<RealOpenMM>(2.0*sqrt(depth));
         particleParamArray[i][2] = static_cast<RealOpenMM>(charge);
+        particleCharges[i] = static_cast<RealOpenMM>(charge);
     }
     for (int i = 0; i < num14; ++i) {
         int particle1, particle2;
@@ -924,13 +1093,69 @@ void ReferenceCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& con
         bonded14ParamArray[i][0] = static_cast<RealOpenMM>(radius);
         bonded14ParamArray[i][1] = static_cast<RealOpenMM>(4.0*depth);
         bonded14ParamArray[i][2] = static_cast<RealOpenMM>(charge);
+        exceptionChargeProds[i] = static_cast<RealOpenMM>(charge);
     }
+    exception14Index.assign(force.getNumExceptions(), -1);
+    for (int i = 0; i < num14; i++)
+        exception14Index[nb14s[i]] = i;
     
     // Recompute the coefficient for the dispersion correction.
 
     NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
-    if (force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME))
+    if (force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME)) {
         dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+        decoupledDispersionCoefficient = (hasAlchemicalParticles ? NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force, 0.0) : dispersionCoefficient);
+    }
+}
+
+void ReferenceCalcNonbondedForceKernel::copyChangedParametersToContext(ContextImpl& context, const NonbondedForce& force, const vector<int>& particles, const vector<int>& exceptions) {
+    if (force.getNumParticles() != numParticles)
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    if (force.getNumExceptions() != (int) exception14Index.size())
+        throw OpenMMException("updateParametersInContext: The number of exceptions has changed");
+
+    // Record the values.
+
+    bool ljChanged = false;
+    for (int i = 0; i < (int) particles.size(); i++) {
+        int index = particles[i];
+        if (force.isParticleAlchemical(index) != alchemical[index])
+            throw OpenMMException("updateParametersInContext: The set of alchemical particles has changed");
+        double charge, radius, depth;
+        force.getParticleParameters(index, charge, radius, depth);
+        RealOpenMM halfSigma = static_cast<RealOpenMM>(0.5*radius);
+        RealOpenMM twoSqrtEps = static_cast<RealOpenMM>(2.0*sqrt(depth));
+        if (particleParamArray[index][0] != halfSigma || particleParamArray[index][1] != twoSqrtEps)
+            ljChanged = true;
+        particleParamArray[index][0] = halfSigma;
+        particleParamArray[index][1] = twoSqrtEps;
+        particleParamArray[index][2] = static_cast<RealOpenMM>(charge);
+        particleCharges[index] = static_cast<RealOpenMM>(charge);
+    }
+    for (int i = 0; i < (int) exceptions.size(); i++) {
+        int particle1, particle2;
+        double charge, radius, depth;
+        force.getExceptionParameters(exceptions[i], particle1, particle2, charge, radius, depth);
+        int index = exception14Index[exceptions[i]];
+        if ((charge != 0.0 || depth != 0.0) != (index != -1))
+            throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        if (index == -1)
+            continue;
+        bonded14IndexArray[index][0] = particle1;
+        bonded14IndexArray[index][1] = particle2;
+        bonded14ParamArray[index][0] = static_cast<RealOpenMM>(radius);
+        bonded14ParamArray[index][1] = static_cast<RealOpenMM>(4.0*depth);
+        bonded14ParamArray[index][2] = static_cast<RealOpenMM>(charge);
+        exceptionChargeProds[index] = static_cast<RealOpenMM>(charge);
+    }
+
+    // The dispersion correction only needs to be recomputed if Lennard-Jones parameters changed.
+
+    NonbondedForce::NonbondedMethod method = force.getNonbondedMethod();
+    if (ljChanged && force.getUseDispersionCorrection() && (method == NonbondedForce::CutoffPeriodic || method == NonbondedForce::Ewald || method == NonbondedForce::PME)) {
+        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+        decoupledDispersionCoefficient = (hasAlchemicalParticles ? NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force, 0.0) : dispersionCoefficient);
+    }
 }
 
 ReferenceCalcCustomNonbondedForceKernel::~ReferenceCalcCustomNonbondedForceKernel() {
@@ -1003,6 +1228,7 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
         forceCopy = new CustomNonbondedForce(force);
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -1019,6 +1245,45 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
     }
 }
 
+bool ReferenceCalcCustomNonbondedForceKernel::initializeFromKernel(const System& system, const CustomNonbondedForce& force, const CalcCustomNonbondedForceKernel& originalKernel) {
+    const ReferenceCalcCustomNonbondedForceKernel& original = dynamic_cast<const ReferenceCalcCustomNonbondedForceKernel&>(originalKernel);
+
+    // Copy the exclusions and parameters.
+
+    numParticles = original.numParticles;
+    exclusions = original.exclusions;
+    int numParameters = original.parameterNames.size();
+    particleParamArray = allocateRealArray(numParticles, numParameters);
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[i][j] = original.particleParamArray[i][j];
+    nonbondedMethod = original.nonbondedMethod;
+    nonbondedCutoff = original.nonbondedCutoff;
+    useSwitchingFunction = original.useSwitchingFunction;
+    if (useSwitchingFunction)
+        switchingDistance = original.switchingDistance;
+    neighborList = (nonbondedMethod == NoCutoff ? NULL : new NeighborList());
+
+    // Copying a CompiledExpression shares its compiled code, so the expressions do not need to be parsed again.
+
+    energyExpression = original.energyExpression;
+    forceExpression = original.forceExpression;
+    parameterNames = original.parameterNames;
+    globalParameterNames = original.globalParameterNames;
+    globalParamValues = original.globalParamValues;
+    interactionGroups = original.interactionGroups;
+
+    // Copy the long range correction, along with the integrals that have been cached for it.
+
+    if (original.forceCopy != NULL)
+        forceCopy = new CustomNonbondedForce(*original.forceCopy);
+    longRangeCorrectionData = original.longRangeCorrectionData;
+    hasInitializedLongRangeCorrection = original.hasInitializedLongRangeCorrection;
+    if (hasInitializedLongRangeCorrection)
+        longRangeCoefficient = original.longRangeCoefficient;
+    return true;
+}
+
 double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
     vector<RealVec>& posData = extractPositions(context);
     vector<RealVec>& forceData = extractForces(context);
@@ -1052,7 +1317,7 @@ double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bo
     // Add in the long range correction.
     
     if (!hasInitializedLongRangeCorrection || (globalParamsChanged && forceCopy != NULL)) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner());
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner());
         hasInitializedLongRangeCorrection = true;
     }
     energy += longRangeCoefficient/(boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2]);
@@ -1077,7 +1342,32 @@ void ReferenceCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImp
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner());
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner());
+        hasInitializedLongRangeCorrection = true;
+        *forceCopy = force;
+    }
+}
+
+void ReferenceCalcCustomNonbondedForceKernel::copyChangedParametersToContext(ContextImpl& context, const CustomNonbondedForce& force, const vector<int>& particles) {
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerParticleParameters();
+    vector<double> parameters;
+    for (int i = 0; i < (int) particles.size(); ++i) {
+        force.getParticleParameters(particles[i], parameters);
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[particles[i]][j] = static_cast<RealOpenMM>(parameters[j]);
+    }
+    
+    // If necessary, recompute the long range correction.
+    
+    if (forceCopy != NULL && particles.size() > 0) {
+        CustomNonbondedForceImpl::prepareLongRangeCorrection(force, longRangeCorrectionData);
+        longRangeCoefficient = CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner());
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
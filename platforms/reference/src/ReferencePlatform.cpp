@@ -34,6 +34,7 @@
 #include "ReferenceKernelFactory.h"
 #include "ReferenceKernels.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/hardware.h"
 #include "SimTKOpenMMRealType.h"
 #include "RealVec.h"
 #include <vector>
@@ -92,6 +93,12 @@ void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
     delete data;
 }
 
+int ReferencePlatform::getNumConcurrentContexts(ContextImpl& context, map<string, string>& properties) const {
+    // Each Context only ever uses one thread, so independent configurations are always best evaluated in parallel.
+
+    return getNumProcessors();
+}
+
 ReferencePlatform::PlatformData::PlatformData(const System& system) : time(0.0), stepCount(0), numParticles(system.getNumParticles()) {
     positions = new vector<RealVec>(numParticles);
     velocities = new vector<RealVec>(numParticles);
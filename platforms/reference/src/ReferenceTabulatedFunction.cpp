@@ -32,6 +32,7 @@
 #include "ReferenceTabulatedFunction.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/SplineFitter.h"
+#include <algorithm>
 
 #ifdef _MSC_VER
 
@@ -72,12 +73,27 @@ extern "C" OPENMM_EXPORT CustomFunction* createReferenceTabulatedFunction(const
 }
 
 ReferenceContinuous1DFunction::ReferenceContinuous1DFunction(const Continuous1DFunction& function) : function(function) {
+    vector<double> values, derivs;
     function.getFunctionParameters(values, min, max);
     int numValues = values.size();
-    x.resize(numValues);
+    vector<double> x(numValues);
     for (int i = 0; i < numValues; i++)
         x[i] = min+i*(max-min)/(numValues-1);
     SplineFitter::createNaturalSpline(x, values, derivs);
+
+    // The knots are uniformly spaced, so the interval containing a point can be found directly instead of by
+    // searching.  Store the spline as a cubic polynomial in the fractional position within each interval.
+
+    numIntervals = numValues-1;
+    invSpacing = numIntervals/(max-min);
+    double scale = (max-min)*(max-min)/(6.0*numIntervals*numIntervals);
+    coefficients.resize(4*numIntervals);
+    for (int i = 0; i < numIntervals; i++) {
+        coefficients[4*i] = values[i];
+        coefficients[4*i+1] = values[i+1]-values[i]-scale*(2*derivs[i]+derivs[i+1]);
+        coefficients[4*i+2] = 3*scale*derivs[i];
+        coefficients[4*i+3] = scale*(derivs[i+1]-derivs[i]);
+    }
 }
 
 int ReferenceContinuous1DFunction::getNumArguments() const {
@@ -88,14 +104,29 @@ double ReferenceContinuous1DFunction::evaluate(const double* arguments) const {
     double t = arguments[0];
     if (t < min || t > max)
         return 0.0;
-    return SplineFitter::evaluateSpline(x, values, derivs, t);
+    double s = (t-min)*invSpacing;
+    int index = std::min(numIntervals-1, (int) s);
+    double f = s-index;
+    const double* c = &coefficients[4*index];
+    return c[0]+f*(c[1]+f*(c[2]+f*c[3]));
 }
 
 double ReferenceContinuous1DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
     double t = arguments[0];
     if (t < min || t > max)
         return 0.0;
-    return SplineFitter::evaluateSplineDerivative(x, values, derivs, t);
+    double s = (t-min)*invSpacing;
+    int index = std::min(numIntervals-1, (int) s);
+    double f = s-index;
+    const double* c = &coefficients[4*index];
+    return (c[1]+f*(2*c[2]+3*c[3]*f))*invSpacing;
+}
+
+bool ReferenceContinuous1DFunction::getUniformSpline(double& min, double& max, vector<double>& coefficients) const {
+    min = this->min;
+    max = this->max;
+    coefficients = this->coefficients;
+    return true;
 }
 
 CustomFunction* ReferenceContinuous1DFunction::clone() const {
@@ -103,20 +134,40 @@ CustomFunction* ReferenceContinuous1DFunction::clone() const {
 }
 
 ReferenceContinuous2DFunction::ReferenceContinuous2DFunction(const Continuous2DFunction& function) : function(function) {
+    vector<double> values;
     function.getFunctionParameters(xsize, ysize, values, xmin, xmax, ymin, ymax);
-    x.resize(xsize);
-    y.resize(ysize);
+    vector<double> x(xsize), y(ysize);
     for (int i = 0; i < xsize; i++)
         x[i] = xmin+i*(xmax-xmin)/(xsize-1);
     for (int i = 0; i < ysize; i++)
         y[i] = ymin+i*(ymax-ymin)/(ysize-1);
-    SplineFitter::create2DNaturalSpline(x, y, values, c);
+    vector<vector<double> > coeff;
+    SplineFitter::create2DNaturalSpline(x, y, values, coeff);
+
+    // Store the coefficients for all cells in a single array, so the ones for any point can be found directly.
+
+    xscale = (xsize-1)/(xmax-xmin);
+    yscale = (ysize-1)/(ymax-ymin);
+    c.resize(16*coeff.size());
+    for (int i = 0; i < (int) coeff.size(); i++)
+        for (int j = 0; j < 16; j++)
+            c[16*i+j] = coeff[i][j];
 }
 
 int ReferenceContinuous2DFunction::getNumArguments() const {
     return 2;
 }
 
+const double* ReferenceContinuous2DFunction::findCell(double u, double v, double& da, double& db) const {
+    double s = (u-xmin)*xscale;
+    double t = (v-ymin)*yscale;
+    int i = std::min(xsize-2, (int) s);
+    int j = std::min(ysize-2, (int) t);
+    da = s-i;
+    db = t-j;
+    return &c[16*(i+(xsize-1)*j)];
+}
+
 double ReferenceContinuous2DFunction::evaluate(const double* arguments) const {
     double u = arguments[0];
     if (u < xmin || u > xmax)
@@ -124,47 +175,94 @@ double ReferenceContinuous2DFunction::evaluate(const double* arguments) const {
     double v = arguments[1];
     if (v < ymin || v > ymax)
         return 0.0;
-    return SplineFitter::evaluate2DSpline(x, y, values, c, u, v);
+    double da, db;
+    const double* coeff = findCell(u, v, da, db);
+    double value = 0;
+    for (int i = 3; i >= 0; i--)
+        value = da*value + ((coeff[i*4+3]*db + coeff[i*4+2])*db + coeff[i*4+1])*db + coeff[i*4+0];
+    return value;
 }
 
 double ReferenceContinuous2DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
-    double u = arguments[0];
-    if (u < xmin || u > xmax)
-        return 0.0;
-    double v = arguments[1];
-    if (v < ymin || v > ymax)
-        return 0.0;
-    double dx, dy;
-    SplineFitter::evaluate2DSplineDerivatives(x, y, values, c, u, v, dx, dy);
+    double gradient[2];
+    evaluateWithGradient(arguments, gradient);
     if (derivOrder[0] == 1 && derivOrder[1] == 0)
-        return dx;
+        return gradient[0];
     if (derivOrder[0] == 0 && derivOrder[1] == 1)
-        return dy;
+        return gradient[1];
     throw OpenMMException("ReferenceContinuous2DFunction: Unsupported derivative order");
 }
 
+double ReferenceContinuous2DFunction::evaluateWithGradient(const double* arguments, double* gradient) const {
+    double u = arguments[0];
+    double v = arguments[1];
+    if (u < xmin || u > xmax || v < ymin || v > ymax) {
+        gradient[0] = gradient[1] = 0.0;
+        return 0.0;
+    }
+    double da, db;
+    const double* coeff = findCell(u, v, da, db);
+    double value = 0, dx = 0, dy = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = da*value + ((coeff[i*4+3]*db + coeff[i*4+2])*db + coeff[i*4+1])*db + coeff[i*4+0];
+        dx = db*dx + (3.0*coeff[i+3*4]*da + 2.0*coeff[i+2*4])*da + coeff[i+1*4];
+        dy = da*dy + (3.0*coeff[i*4+3]*db + 2.0*coeff[i*4+2])*db + coeff[i*4+1];
+    }
+    gradient[0] = dx*xscale;
+    gradient[1] = dy*yscale;
+    return value;
+}
+
+void ReferenceContinuous2DFunction::evaluateWithGradient(int numPoints, const double* arguments, double* values, double* gradients) const {
+    for (int i = 0; i < numPoints; i++)
+        values[i] = evaluateWithGradient(&arguments[2*i], &gradients[2*i]);
+}
+
 CustomFunction* ReferenceContinuous2DFunction::clone() const {
     return new ReferenceContinuous2DFunction(function);
 }
 
 ReferenceContinuous3DFunction::ReferenceContinuous3DFunction(const Continuous3DFunction& function) : function(function) {
+    vector<double> values;
     function.getFunctionParameters(xsize, ysize, zsize, values, xmin, xmax, ymin, ymax, zmin, zmax);
-    x.resize(xsize);
-    y.resize(ysize);
-    z.resize(zsize);
+    vector<double> x(xsize), y(ysize), z(zsize);
     for (int i = 0; i < xsize; i++)
         x[i] = xmin+i*(xmax-xmin)/(xsize-1);
     for (int i = 0; i < ysize; i++)
         y[i] = ymin+i*(ymax-ymin)/(ysize-1);
     for (int i = 0; i < zsize; i++)
         z[i] = zmin+i*(zmax-zmin)/(zsize-1);
-    SplineFitter::create3DNaturalSpline(x, y, z, values, c);
+    vector<vector<double> > coeff;
+    SplineFitter::create3DNaturalSpline(x, y, z, values, coeff);
+
+    // Store the coefficients for all cells in a single array, so the ones for any point can be found directly.
+
+    xscale = (xsize-1)/(xmax-xmin);
+    yscale = (ysize-1)/(ymax-ymin);
+    zscale = (zsize-1)/(zmax-zmin);
+    c.resize(64*coeff.size());
+    for (int i = 0; i < (int) coeff.size(); i++)
+        for (int j = 0; j < 64; j++)
+            c[64*i+j] = coeff[i][j];
 }
 
 int ReferenceContinuous3DFunction::getNumArguments() const {
     return 3;
 }
 
+const double* ReferenceContinuous3DFunction::findCell(double u, double v, double w, double& da, double& db, double& dc) const {
+    double s = (u-xmin)*xscale;
+    double t = (v-ymin)*yscale;
+    double r = (w-zmin)*zscale;
+    int i = std::min(xsize-2, (int) s);
+    int j = std::min(ysize-2, (int) t);
+    int k = std::min(zsize-2, (int) r);
+    da = s-i;
+    db = t-j;
+    dc = r-k;
+    return &c[64*(i+(xsize-1)*(j+(ysize-1)*k))];
+}
+
 double ReferenceContinuous3DFunction::evaluate(const double* arguments) const {
     double u = arguments[0];
     if (u < xmin || u > xmax)
@@ -175,30 +273,66 @@ double ReferenceContinuous3DFunction::evaluate(const double* arguments) const {
     double w = arguments[2];
     if (w < zmin || w > zmax)
         return 0.0;
-    return SplineFitter::evaluate3DSpline(x, y, z, values, c, u, v, w);
+    double da, db, dc;
+    const double* coeff = findCell(u, v, w, da, db, dc);
+    double value[] = {0, 0, 0, 0};
+    for (int i = 3; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            int base = 4*i + 16*j;
+            value[j] = db*value[j] + ((coeff[base+3]*da + coeff[base+2])*da + coeff[base+1])*da + coeff[base];
+        }
+    }
+    return value[0] + dc*(value[1] + dc*(value[2] + dc*value[3]));
 }
 
 double ReferenceContinuous3DFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
-    double u = arguments[0];
-    if (u < xmin || u > xmax)
-        return 0.0;
-    double v = arguments[1];
-    if (v < ymin || v > ymax)
-        return 0.0;
-    double w = arguments[2];
-    if (w < zmin || w > zmax)
-        return 0.0;
-    double dx, dy, dz;
-    SplineFitter::evaluate3DSplineDerivatives(x, y, z, values, c, u, v, w, dx, dy, dz);
+    double gradient[3];
+    evaluateWithGradient(arguments, gradient);
     if (derivOrder[0] == 1 && derivOrder[1] == 0 && derivOrder[2] == 0)
-        return dx;
+        return gradient[0];
     if (derivOrder[0] == 0 && derivOrder[1] == 1 && derivOrder[2] == 0)
-        return dy;
+        return gradient[1];
     if (derivOrder[0] == 0 && derivOrder[1] == 0 && derivOrder[2] == 1)
-        return dz;
+        return gradient[2];
     throw OpenMMException("ReferenceContinuous3DFunction: Unsupported derivative order");
 }
 
+double ReferenceContinuous3DFunction::evaluateWithGradient(const double* arguments, double* gradient) const {
+    double u = arguments[0];
+    double v = arguments[1];
+    double w = arguments[2];
+    if (u < xmin || u > xmax || v < ymin || v > ymax || w < zmin || w > zmax) {
+        gradient[0] = gradient[1] = gradient[2] = 0.0;
+        return 0.0;
+    }
+    double da, db, dc;
+    const double* coeff = findCell(u, v, w, da, db, dc);
+
+    // The value and the derivative with respect to z share the same polynomials in x and y.
+
+    double value[] = {0, 0, 0, 0};
+    double derivx[] = {0, 0, 0, 0};
+    double derivy[] = {0, 0, 0, 0};
+    for (int i = 3; i >= 0; i--) {
+        for (int j = 0; j < 4; j++) {
+            int base = 4*i + 16*j;
+            derivx[j] = db*derivx[j] + (3.0*coeff[base+3]*da + 2.0*coeff[base+2])*da + coeff[base+1];
+            value[j] = db*value[j] + ((coeff[base+3]*da + coeff[base+2])*da + coeff[base+1])*da + coeff[base];
+            base = i + 16*j;
+            derivy[j] = da*derivy[j] + (3.0*coeff[base+12]*db + 2.0*coeff[base+8])*db + coeff[base+4];
+        }
+    }
+    gradient[0] = (derivx[0] + dc*(derivx[1] + dc*(derivx[2] + dc*derivx[3])))*xscale;
+    gradient[1] = (derivy[0] + dc*(derivy[1] + dc*(derivy[2] + dc*derivy[3])))*yscale;
+    gradient[2] = (value[1] + dc*(2.0*value[2] + 3.0*dc*value[3]))*zscale;
+    return value[0] + dc*(value[1] + dc*(value[2] + dc*value[3]));
+}
+
+void ReferenceContinuous3DFunction::evaluateWithGradient(int numPoints, const double* arguments, double* values, double* gradients) const {
+    for (int i = 0; i < numPoints; i++)
+        values[i] = evaluateWithGradient(&arguments[3*i], &gradients[3*i]);
+}
+
 CustomFunction* ReferenceContinuous3DFunction::clone() const {
     return new ReferenceContinuous3DFunction(function);
 }
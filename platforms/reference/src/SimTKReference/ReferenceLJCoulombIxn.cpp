@@ -47,7 +47,7 @@ using namespace OpenMM;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false) {
+ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), softcore(false) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -163,6 +163,24 @@ void ReferenceLJCoulombIxn::setUseSwitchingFunction(RealOpenMM distance) {
       pme = true;
   }
 
+  /**---------------------------------------------------------------------------------------
+
+     Set the force to use a soft-core Lennard-Jones interaction between alchemical and
+     non-alchemical atoms.
+
+     @param alchemical  alchemical[i] is true if atom i is alchemical
+     @param alpha       the soft-core alpha parameter
+     @param lambda      the current value of lambda_sterics
+
+     --------------------------------------------------------------------------------------- */
+
+  void ReferenceLJCoulombIxn::setUseSoftcore(const vector<bool>& alchemical, RealOpenMM alpha, RealOpenMM lambda) {
+      this->alchemical = &alchemical;
+      softcoreAlpha = alpha;
+      softcoreLambda = lambda;
+      softcore = true;
+  }
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Ewald ixn
@@ -385,8 +403,9 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
                   sig2     *= sig2;
        RealOpenMM sig6      = sig2*sig2*sig2;
        RealOpenMM eps       = atomParameters[ii][EpsIndex]*atomParameters[jj][EpsIndex];
-                  dEdR     += switchValue*eps*(twelve*sig6 - six)*sig6*inverseR*inverseR;
-       vdwEnergy = eps*(sig6-one)*sig6;
+       RealOpenMM vdwDEdR;
+       calculateLJIxn(ii, jj, sig6, eps, vdwEnergy, vdwDEdR);
+                  dEdR     += switchValue*vdwDEdR*inverseR*inverseR;
        if (useSwitch) {
            dEdR -= vdwEnergy*switchDeriv*inverseR;
            vdwEnergy *= switchValue;
@@ -508,6 +527,49 @@ void ReferenceLJCoulombIxn::calculatePairIxn(int numberOfAtoms, vector<RealVec>&
    }
 }
 
+  /**---------------------------------------------------------------------------------------
+
+     Calculate the energy of every direct space interaction that involves at least one atom
+     from a subset.  Ewald summation and PME are not supported.
+
+     @param numberOfAtoms    number of atoms
+     @param atomCoordinates  atom coordinates
+     @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
+     @param exclusions       atom exclusion indices
+                             exclusions[atomIndex] contains the list of exclusions for that atom
+     @param subset           the indices of the atoms whose interactions should be included
+     @param totalEnergy      total energy
+
+     --------------------------------------------------------------------------------------- */
+
+void ReferenceLJCoulombIxn::calculateSubsetIxn(int numberOfAtoms, vector<RealVec>& atomCoordinates,
+                                               RealOpenMM** atomParameters, vector<set<int> >& exclusions,
+                                               const vector<int>& subset, RealOpenMM* totalEnergy) const {
+    vector<bool> inSubset(numberOfAtoms, false);
+    for (int i = 0; i < (int) subset.size(); i++)
+        inSubset[subset[i]] = true;
+    vector<RealVec> forces(numberOfAtoms);
+    RealOpenMM deltaR[ReferenceForce::LastDeltaRIndex];
+    for (int i = 0; i < (int) subset.size(); i++) {
+        int ii = subset[i];
+        for (int jj = 0; jj < numberOfAtoms; jj++) {
+            // Interactions within the subset are only counted once.
+
+            if (jj == ii || (inSubset[jj] && jj < ii) || exclusions[ii].find(jj) != exclusions[ii].end())
+                continue;
+            if (cutoff) {
+                if (periodic)
+                    ReferenceForce::getDeltaRPeriodic(atomCoordinates[jj], atomCoordinates[ii], periodicBoxVectors, deltaR);
+                else
+                    ReferenceForce::getDeltaR(atomCoordinates[jj], atomCoordinates[ii], deltaR);
+                if (deltaR[ReferenceForce::RIndex] >= cutoffDistance)
+                    continue;
+            }
+            calculateOneIxn(ii, jj, atomCoordinates, atomParameters, forces, NULL, totalEnergy);
+        }
+    }
+}
+
   /**---------------------------------------------------------------------------------------
 
      Calculate LJ Coulomb pair ixn between two atoms
@@ -572,13 +634,14 @@ void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<RealVec>& ato
     RealOpenMM sig6      = sig2*sig2*sig2;
 
     RealOpenMM eps       = atomParameters[ii][EpsIndex]*atomParameters[jj][EpsIndex];
-    RealOpenMM dEdR      = switchValue*eps*(twelve*sig6 - six)*sig6;
+    RealOpenMM energy, dEdR;
+    calculateLJIxn(ii, jj, sig6, eps, energy, dEdR);
+    dEdR *= switchValue;
     if (cutoff)
         dEdR += (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*(inverseR-2.0f*krf*r2));
     else
         dEdR += (RealOpenMM) (ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR);
     dEdR     *= inverseR*inverseR;
-    RealOpenMM energy = eps*(sig6-one)*sig6;
     if (useSwitch) {
         dEdR -= energy*switchDeriv*inverseR;
         energy *= switchValue;
@@ -606,3 +669,17 @@ void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<RealVec>& ato
     }
   }
 
+void ReferenceLJCoulombIxn::calculateLJIxn(int ii, int jj, RealOpenMM sig6, RealOpenMM eps, RealOpenMM& energy, RealOpenMM& dEdR) const {
+    if (softcore && (*alchemical)[ii] != (*alchemical)[jj]) {
+        // Use the soft-core form: E = lambda*eps*x*(x-1), where x = 1/(alpha*(1-lambda) + (r/sigma)^6).
+
+        RealOpenMM shift = softcoreAlpha*(1-softcoreLambda);
+        RealOpenMM x = 1/(shift+1/sig6);
+        energy = softcoreLambda*eps*x*(x-1);
+        dEdR = 6*softcoreLambda*eps*x*(2*x-1)*(1-shift*x);
+    }
+    else {
+        energy = eps*(sig6-1)*sig6;
+        dEdR = eps*(12*sig6-6)*sig6;
+    }
+}
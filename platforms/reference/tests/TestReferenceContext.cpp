@@ -0,0 +1,635 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2015 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the reference implementation of the Context level APIs for evaluating energies.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "ReferencePlatform.h"
+#include "openmm/CustomBondForce.h"
+#include "openmm/CustomNonbondedForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/MonteCarloBarostat.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const double TOL = 1e-5;
+
+/**
+ * Build a box of diatomic molecules.  The first molecule is alchemical, and a CustomBondForce in
+ * force group 1 depends on a second global parameter.
+ */
+void createSystem(System& system, vector<Vec3>& positions) {
+    const int numMolecules = 20;
+    const double boxSize = 2.5;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    CustomBondForce* custom = new CustomBondForce("scale*k*(r-0.1)^2");
+    custom->addGlobalParameter("scale", 1.0);
+    custom->addPerBondParameter("k");
+    custom->setForceGroup(1);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(0.4, 0.3, 0.5);
+        nonbonded->addParticle(-0.4, 0.25, 0.4);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        bonds->addBond(2*i, 2*i+1, 0.1, 1000.0);
+        vector<double> params(1, 100.0*(i+1));
+        custom->addBond(2*i, 2*i+1, params);
+        Vec3 pos(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.11, 0, 0));
+    }
+    nonbonded->setParticleAlchemical(0, true);
+    nonbonded->setParticleAlchemical(1, true);
+    system.addForce(nonbonded);
+    system.addForce(bonds);
+    system.addForce(custom);
+}
+
+void testEnergiesAtParameters() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setParameter(NonbondedForce::LambdaSterics(), 0.6);
+    vector<double> values;
+    values.push_back(0.0);
+    values.push_back(0.25);
+    values.push_back(0.5);
+    values.push_back(1.0);
+    for (int groups = 1; groups < 4; groups++) {
+        // Vary a parameter of the NonbondedForce.
+
+        vector<double> energies = context.computeEnergiesAtParameters(NonbondedForce::LambdaElectrostatics(), values, groups);
+        ASSERT_EQUAL(values.size(), energies.size());
+        ASSERT_EQUAL(1.0, context.getParameter(NonbondedForce::LambdaElectrostatics()));
+        for (int i = 0; i < (int) values.size(); i++) {
+            context.setParameter(NonbondedForce::LambdaElectrostatics(), values[i]);
+            double expected = context.getState(State::Energy, false, groups).getPotentialEnergy();
+            ASSERT_EQUAL_TOL(expected, energies[i], TOL);
+        }
+        context.setParameter(NonbondedForce::LambdaElectrostatics(), 1.0);
+
+        // Vary a parameter of the CustomBondForce.
+
+        energies = context.computeEnergiesAtParameters("scale", values, groups);
+        ASSERT_EQUAL(1.0, context.getParameter("scale"));
+        for (int i = 0; i < (int) values.size(); i++) {
+            context.setParameter("scale", values[i]);
+            double expected = context.getState(State::Energy, false, groups).getPotentialEnergy();
+            ASSERT_EQUAL_TOL(expected, energies[i], TOL);
+        }
+        context.setParameter("scale", 1.0);
+    }
+
+    // The forces should still be correct after computing the energies.
+
+    State state1 = context.getState(State::Forces);
+    context.computeEnergiesAtParameters("scale", values);
+    State state2 = context.getState(State::Forces);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], TOL);
+
+    // An unknown parameter should throw an exception.
+
+    bool threwException = false;
+    try {
+        context.computeEnergiesAtParameters("unknown", values);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testEnergiesByGroup() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    NonbondedForce* nonbonded = dynamic_cast<NonbondedForce*>(&system.getForce(0));
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setReciprocalSpaceForceGroup(3);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    State state1 = context.getState(State::Forces);
+    for (int groups = 1; groups < 16; groups++) {
+        vector<double> energies = context.computeEnergiesByGroup(groups);
+        ASSERT_EQUAL(32, energies.size());
+        for (int i = 0; i < 32; i++) {
+            double expected = ((groups&(1<<i)) == 0 ? 0.0 : context.getState(State::Energy, false, 1<<i).getPotentialEnergy());
+            ASSERT_EQUAL_TOL(expected, energies[i], TOL);
+        }
+    }
+    ASSERT(context.computeEnergiesByGroup()[3] != 0.0);
+
+    // The forces should still be correct after computing the energies.
+
+    State state2 = context.getState(State::Forces);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], TOL);
+}
+
+/**
+ * Compute the energy and forces of a Context in a second Context, so the results are never taken from a cache.
+ */
+void checkAgainstFreshContext(Context& context, const System& system) {
+    ReferencePlatform platform;
+    VerletIntegrator integrator(0.001);
+    Context fresh(system, integrator, platform);
+    State state = context.getState(State::Positions | State::Forces | State::Energy | State::Parameters);
+    fresh.setPositions(state.getPositions());
+    Vec3 a, b, c;
+    state.getPeriodicBoxVectors(a, b, c);
+    fresh.setPeriodicBoxVectors(a, b, c);
+    for (map<string, double>::const_iterator iter = state.getParameters().begin(); iter != state.getParameters().end(); ++iter)
+        fresh.setParameter(iter->first, iter->second);
+    State expected = fresh.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(expected.getPotentialEnergy(), state.getPotentialEnergy(), TOL);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(expected.getForces()[i], state.getForces()[i], TOL);
+}
+
+void testEnergiesOfConfigurations() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    State initialState = context.getState(State::Forces);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(1, sfmt);
+    vector<vector<Vec3> > configurations(5, positions);
+    for (int i = 0; i < (int) configurations.size(); i++)
+        for (int j = 0; j < (int) positions.size(); j++)
+            configurations[i][j] += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.02;
+    for (int groups = 1; groups < 4; groups++) {
+        vector<double> energies = context.computeEnergies(configurations, groups);
+        ASSERT_EQUAL(configurations.size(), energies.size());
+        ReferencePlatform platform2;
+        VerletIntegrator integrator2(0.001);
+        Context context2(system, integrator2, platform2);
+        for (int i = 0; i < (int) configurations.size(); i++) {
+            context2.setPositions(configurations[i]);
+            ASSERT_EQUAL_TOL(context2.getState(State::Energy, false, groups).getPotentialEnergy(), energies[i], TOL);
+        }
+    }
+
+    // The positions and forces of the Context should be unchanged.
+
+    State finalState = context.getState(State::Positions | State::Forces);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        ASSERT_EQUAL_VEC(positions[i], finalState.getPositions()[i], 0.0);
+        ASSERT_EQUAL_VEC(initialState.getForces()[i], finalState.getForces()[i], TOL);
+    }
+
+    // A configuration with the wrong number of particles should throw an exception.
+
+    configurations[2].pop_back();
+    bool threwException = false;
+    try {
+        context.computeEnergies(configurations);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testCachedResults() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    checkAgainstFreshContext(context, system);
+
+    // Asking again should give identical results.
+
+    State state1 = context.getState(State::Energy | State::Forces);
+    State state2 = context.getState(State::Energy | State::Forces);
+    ASSERT_EQUAL(state1.getPotentialEnergy(), state2.getPotentialEnergy());
+    ASSERT_EQUAL(state1.getKineticEnergy(), state2.getKineticEnergy());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 0.0);
+
+    // Each kind of change should invalidate the cached results.
+
+    integrator.step(5);
+    checkAgainstFreshContext(context, system);
+    positions[0] += Vec3(0.05, 0, 0);
+    context.setPositions(positions);
+    checkAgainstFreshContext(context, system);
+    context.setParameter("scale", 0.5);
+    checkAgainstFreshContext(context, system);
+    context.setPeriodicBoxVectors(Vec3(2.6, 0, 0), Vec3(0, 2.6, 0), Vec3(0, 0, 2.6));
+    checkAgainstFreshContext(context, system);
+    double energy = context.getState(State::Energy).getPotentialEnergy();
+    HarmonicBondForce& bonds = dynamic_cast<HarmonicBondForce&>(system.getForce(1));
+    bonds.setBondParameters(0, 0, 1, 0.1, 5000.0);
+    bonds.updateParametersInContext(context);
+    ASSERT(context.getState(State::Energy).getPotentialEnergy() != energy);
+    checkAgainstFreshContext(context, system);
+}
+
+void testCopyToArrays() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setVelocitiesToTemperature(300.0);
+    integrator.step(2);
+    State state = context.getState(State::Positions | State::Velocities | State::Forces);
+    int numParticles = system.getNumParticles();
+
+    // Copy all particles, packed.
+
+    vector<double> output(3*numParticles);
+    context.copyPositions(&output[0]);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getPositions()[i], Vec3(output[3*i], output[3*i+1], output[3*i+2]), 0.0);
+    context.copyForces(&output[0]);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], Vec3(output[3*i], output[3*i+1], output[3*i+2]), 0.0);
+
+    // Copy a subset of particles in single precision with a stride of 4.
+
+    vector<int> particles;
+    particles.push_back(7);
+    particles.push_back(2);
+    particles.push_back(30);
+    vector<float> subset(4*particles.size(), -1.0f);
+    context.copyVelocities(&subset[0], particles, 4);
+    for (int i = 0; i < (int) particles.size(); i++) {
+        ASSERT_EQUAL_VEC(state.getVelocities()[particles[i]], Vec3(subset[4*i], subset[4*i+1], subset[4*i+2]), 1e-6);
+        ASSERT_EQUAL(-1.0f, subset[4*i+3]);
+    }
+    context.copyPositions(&subset[0], particles, 4);
+    for (int i = 0; i < (int) particles.size(); i++)
+        ASSERT_EQUAL_VEC(state.getPositions()[particles[i]], Vec3(subset[4*i], subset[4*i+1], subset[4*i+2]), 1e-6);
+    context.copyForces(&subset[0], particles, 4);
+    for (int i = 0; i < (int) particles.size(); i++)
+        ASSERT_EQUAL_VEC(state.getForces()[particles[i]], Vec3(subset[4*i], subset[4*i+1], subset[4*i+2]), 1e-4);
+
+    // Invalid arguments should throw exceptions.
+
+    particles.push_back(numParticles);
+    bool threwException = false;
+    try {
+        context.copyPositions(&output[0], particles);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    threwException = false;
+    try {
+        context.copyPositions(&output[0], vector<int>(), 2);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testStepAsync() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+
+    // Taking steps in chunks on a background thread should give the same trajectory as taking them directly.
+
+    context2.stepAsync(5, State::Positions | State::Energy);
+    for (int i = 0; i < 3; i++) {
+        State asyncState = context2.waitForSteps();
+        if (i < 2)
+            context2.stepAsync(5, State::Positions | State::Energy);
+        integrator1.step(5);
+        State state = context1.getState(State::Positions | State::Energy);
+        ASSERT_EQUAL_TOL(state.getTime(), asyncState.getTime(), 1e-10);
+        ASSERT_EQUAL_TOL(state.getPotentialEnergy(), asyncState.getPotentialEnergy(), TOL);
+        for (int j = 0; j < system.getNumParticles(); j++)
+            ASSERT_EQUAL_VEC(state.getPositions()[j], asyncState.getPositions()[j], TOL);
+    }
+
+    // Waiting without starting, or starting twice, should throw exceptions.
+
+    bool threwException = false;
+    try {
+        context2.waitForSteps();
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    context2.stepAsync(1);
+    threwException = false;
+    try {
+        context2.stepAsync(1);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    context2.waitForSteps();
+
+    // Accessing the state of the Context while steps are running should throw an exception.
+
+    context2.stepAsync(10);
+    for (int i = 0; i < 5; i++) {
+        threwException = false;
+        try {
+            if (i == 0)
+                context2.setPositions(positions);
+            else if (i == 1)
+                context2.getState(State::Energy);
+            else if (i == 2)
+                context2.setParameter("scale", 2.0);
+            else if (i == 3)
+                dynamic_cast<NonbondedForce&>(system.getForce(0)).updateParametersInContext(context2);
+            else
+                context2.computeEnergies(vector<vector<Vec3> >(1, positions));
+        }
+        catch (const OpenMMException& ex) {
+            threwException = true;
+        }
+        ASSERT(threwException);
+    }
+    State asyncState = context2.waitForSteps();
+    ASSERT_EQUAL_TOL(asyncState.getTime(), context2.getState(State::Energy).getTime(), 1e-10);
+    ASSERT_EQUAL(1.0, context2.getParameter("scale"));
+
+    // Deleting a Context while steps are running should wait for them to finish.
+
+    context1.stepAsync(20);
+}
+
+void testEnergyChange() {
+    ReferencePlatform platform;
+    NonbondedForce::NonbondedMethod methods[] = {NonbondedForce::NoCutoff, NonbondedForce::CutoffNonPeriodic, NonbondedForce::CutoffPeriodic, NonbondedForce::PME};
+    for (int m = 0; m < 4; m++) {
+        System system;
+        vector<Vec3> positions;
+        createSystem(system, positions);
+        NonbondedForce* nonbonded = dynamic_cast<NonbondedForce*>(&system.getForce(0));
+        nonbonded->setNonbondedMethod(methods[m]);
+        nonbonded->setUseSwitchingFunction(true);
+        nonbonded->setSwitchingDistance(0.8);
+        nonbonded->addException(1, 2, 0.1, 0.3, 0.2);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform);
+        context.setPositions(positions);
+        context.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+        context.setParameter(NonbondedForce::LambdaSterics(), 0.6);
+        State initialState = context.getState(State::Forces);
+
+        // Move one alchemical particle and one molecule.
+
+        vector<int> particles;
+        particles.push_back(0);
+        particles.push_back(2);
+        particles.push_back(3);
+        vector<Vec3> newPositions;
+        newPositions.push_back(positions[0]+Vec3(0.05, -0.1, 0.02));
+        newPositions.push_back(positions[2]+Vec3(0.3, 0.2, -0.1));
+        newPositions.push_back(positions[3]+Vec3(0.3, 0.2, -0.1));
+        vector<Vec3> movedPositions = positions;
+        for (int i = 0; i < (int) particles.size(); i++)
+            movedPositions[particles[i]] = newPositions[i];
+        VerletIntegrator integrator2(0.001);
+        Context context2(system, integrator2, platform);
+        context2.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+        context2.setParameter(NonbondedForce::LambdaSterics(), 0.6);
+        for (int groups = 1; groups < 4; groups++) {
+            context2.setPositions(positions);
+            double oldEnergy = context2.getState(State::Energy, false, groups).getPotentialEnergy();
+            context2.setPositions(movedPositions);
+            double newEnergy = context2.getState(State::Energy, false, groups).getPotentialEnergy();
+            ASSERT_EQUAL_TOL(newEnergy-oldEnergy, context.computeEnergyChange(particles, newPositions, groups), TOL);
+        }
+
+        // The positions and forces of the Context should be unchanged.
+
+        State finalState = context.getState(State::Positions | State::Forces);
+        for (int i = 0; i < system.getNumParticles(); i++) {
+            ASSERT_EQUAL_VEC(positions[i], finalState.getPositions()[i], 0.0);
+            ASSERT_EQUAL_VEC(initialState.getForces()[i], finalState.getForces()[i], TOL);
+        }
+    }
+}
+
+void testClone() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    system.addForce(new MonteCarloBarostat(1.0, 300.0, 1));
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    context1.setVelocitiesToTemperature(300.0);
+    context1.setParameter("scale", 0.5);
+    context1.setParameter(NonbondedForce::LambdaElectrostatics(), 0.3);
+    context1.setPeriodicBoxVectors(Vec3(2.6, 0, 0), Vec3(0, 2.5, 0), Vec3(0, 0, 2.4));
+    integrator1.step(5);
+
+    // The clone should start out in the same state as the original.
+
+    VerletIntegrator integrator2(0.001);
+    Context* context2 = context1.clone(integrator2);
+    ASSERT(&context2->getSystem() == &system);
+    ASSERT(&context2->getPlatform() == &context1.getPlatform());
+    ASSERT_EQUAL(context1.getMolecules().size(), context2->getMolecules().size());
+    int types = State::Positions | State::Velocities | State::Energy | State::Forces | State::Parameters;
+    State state1 = context1.getState(types);
+    State state2 = context2->getState(types);
+    ASSERT_EQUAL(state1.getTime(), state2.getTime());
+    ASSERT_EQUAL(state1.getParameters().size(), state2.getParameters().size());
+    for (map<string, double>::const_iterator iter = state1.getParameters().begin(); iter != state1.getParameters().end(); ++iter)
+        ASSERT_EQUAL(iter->second, state2.getParameters().find(iter->first)->second);
+    Vec3 box1[3], box2[3];
+    state1.getPeriodicBoxVectors(box1[0], box1[1], box1[2]);
+    state2.getPeriodicBoxVectors(box2[0], box2[1], box2[2]);
+    for (int i = 0; i < 3; i++)
+        ASSERT_EQUAL_VEC(box1[i], box2[i], 0.0);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), TOL);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        ASSERT_EQUAL_VEC(state1.getPositions()[i], state2.getPositions()[i], 0.0);
+        ASSERT_EQUAL_VEC(state1.getVelocities()[i], state2.getVelocities()[i], 0.0);
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], TOL);
+    }
+
+    // The two Contexts should be independent of each other.
+
+    integrator2.step(5);
+    state1 = context1.getState(State::Positions);
+    ASSERT_EQUAL(state2.getTime(), state1.getTime());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state2.getPositions()[i], state1.getPositions()[i], 0.0);
+    delete context2;
+    integrator1.step(5);
+
+    // A Context with steps running cannot be cloned.
+
+    context1.stepAsync(1);
+    bool threwException = false;
+    try {
+        context1.clone(integrator2);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    context1.waitForSteps();
+}
+
+void testCloneParameters() {
+    ReferencePlatform platform;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions);
+    NonbondedForce* nonbonded = dynamic_cast<NonbondedForce*>(&system.getForce(0));
+    HarmonicBondForce* bonds = dynamic_cast<HarmonicBondForce*>(&system.getForce(1));
+    bonds->setForceGroup(2);
+    CustomNonbondedForce* custom = new CustomNonbondedForce("a1*a2/r^6");
+    custom->addPerParticleParameter("a");
+    custom->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    custom->setCutoffDistance(1.0);
+    custom->setUseLongRangeCorrection(true);
+    custom->setForceGroup(3);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        custom->addParticle(vector<double>(1, 0.01*(i%3+1)));
+    for (int i = 0; i < system.getNumParticles()/2; i++)
+        custom->addExclusion(2*i, 2*i+1);
+    system.addForce(custom);
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+
+    // Change parameters in the first Context.
+
+    nonbonded->setParticleParameters(2, 0.8, 0.3, 0.5);
+    nonbonded->updateParametersInContext(context1);
+    custom->setParticleParameters(2, vector<double>(1, 0.05));
+    custom->updateParametersInContext(context1);
+    double nonbondedEnergy = context1.getState(State::Energy, false, 1<<0).getPotentialEnergy();
+    double customEnergy = context1.getState(State::Energy, false, 1<<3).getPotentialEnergy();
+
+    // Make further changes that are not applied to it, then clone it.  The nonbonded forces should be copied
+    // from the original Context, while the bonds should be initialized from the System.  Cloning must not
+    // modify the original Context.
+
+    double bondEnergy = context1.getState(State::Energy, false, 1<<2).getPotentialEnergy();
+    double totalEnergy = context1.getState(State::Energy).getPotentialEnergy();
+    nonbonded->setParticleParameters(2, -0.8, 0.3, 0.5);
+    custom->setParticleParameters(2, vector<double>(1, 0.5));
+    bonds->setBondParameters(0, 0, 1, 0.12, 2000.0);
+    VerletIntegrator integrator2(0.001);
+    Context* context2 = context1.clone(integrator2);
+    ASSERT_EQUAL_TOL(nonbondedEnergy, context2->getState(State::Energy, false, 1<<0).getPotentialEnergy(), TOL);
+    ASSERT_EQUAL_TOL(customEnergy, context2->getState(State::Energy, false, 1<<3).getPotentialEnergy(), TOL);
+    ASSERT_EQUAL_TOL(nonbondedEnergy, context1.getState(State::Energy, false, 1<<0).getPotentialEnergy(), TOL);
+    ASSERT_EQUAL_TOL(customEnergy, context1.getState(State::Energy, false, 1<<3).getPotentialEnergy(), TOL);
+    ASSERT_EQUAL_TOL(bondEnergy, context1.getState(State::Energy, false, 1<<2).getPotentialEnergy(), TOL);
+    ASSERT_EQUAL_TOL(totalEnergy, context1.getState(State::Energy).getPotentialEnergy(), TOL);
+    VerletIntegrator integrator3(0.001);
+    Context context3(system, integrator3, platform);
+    context3.setPositions(positions);
+    ASSERT(fabs(bondEnergy-context3.getState(State::Energy, false, 1<<2).getPotentialEnergy()) > 1e-3);
+    ASSERT_EQUAL_TOL(context3.getState(State::Energy, false, 1<<2).getPotentialEnergy(), context2->getState(State::Energy, false, 1<<2).getPotentialEnergy(), TOL);
+
+    // The clone should respond to later parameter changes just like a new Context.
+
+    nonbonded->updateParametersInContext(*context2);
+    custom->updateParametersInContext(*context2);
+    State state2 = context2->getState(State::Energy | State::Forces);
+    State state3 = context3.getState(State::Energy | State::Forces);
+    ASSERT_EQUAL_TOL(state3.getPotentialEnergy(), state2.getPotentialEnergy(), TOL);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state3.getForces()[i], state2.getForces()[i], TOL);
+    delete context2;
+}
+
+int main() {
+    try {
+        testEnergiesAtParameters();
+        testEnergiesByGroup();
+        testEnergiesOfConfigurations();
+        testCachedResults();
+        testCopyToArrays();
+        testStepAsync();
+        testEnergyChange();
+        testClone();
+        testCloneParameters();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
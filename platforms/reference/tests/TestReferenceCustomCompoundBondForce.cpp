@@ -39,12 +39,14 @@
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
 #include "ReferencePlatform.h"
+#include "ReferenceTabulatedFunction.h"
 #include "openmm/CustomCompoundBondForce.h"
 #include "openmm/HarmonicAngleForce.h"
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/PeriodicTorsionForce.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
+#include "openmm/internal/SplineFitter.h"
 #include "sfmt/SFMT.h"
 #include <iostream>
 #include <vector>
@@ -271,6 +273,80 @@ void testContinuous3DFunction() {
     }
 }
 
+/**
+ * Compare the values and gradients computed by the reference tabulated functions to the ones computed by SplineFitter.
+ */
+void testTabulatedFunctionGradients() {
+    const int xsize = 7;
+    const int ysize = 8;
+    const int zsize = 9;
+    const double xmin = 0.4, xmax = 1.1;
+    const double ymin = 0.0, ymax = 0.9;
+    const double zmin = 0.2, zmax = 1.3;
+    vector<double> x(xsize), y(ysize), z(zsize);
+    for (int i = 0; i < xsize; i++)
+        x[i] = xmin+i*(xmax-xmin)/(xsize-1);
+    for (int i = 0; i < ysize; i++)
+        y[i] = ymin+i*(ymax-ymin)/(ysize-1);
+    for (int i = 0; i < zsize; i++)
+        z[i] = zmin+i*(zmax-zmin)/(zsize-1);
+    vector<double> table2(xsize*ysize), table3(xsize*ysize*zsize);
+    for (int i = 0; i < xsize; i++)
+        for (int j = 0; j < ysize; j++) {
+            table2[i+xsize*j] = sin(3*x[i])*cos(2*y[j]);
+            for (int k = 0; k < zsize; k++)
+                table3[i+xsize*j+xsize*ysize*k] = sin(3*x[i])*cos(2*y[j])*(1+z[k]*z[k]);
+        }
+    Continuous2DFunction function2(xsize, ysize, table2, xmin, xmax, ymin, ymax);
+    Continuous3DFunction function3(xsize, ysize, zsize, table3, xmin, xmax, ymin, ymax, zmin, zmax);
+    ReferenceContinuous2DFunction reference2(function2);
+    ReferenceContinuous3DFunction reference3(function3);
+    vector<vector<double> > c2, c3;
+    SplineFitter::create2DNaturalSpline(x, y, table2, c2);
+    SplineFitter::create3DNaturalSpline(x, y, z, table3, c3);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    const int numPoints = 50;
+    vector<double> points2(2*numPoints), points3(3*numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        points2[2*i] = points3[3*i] = xmin+(xmax-xmin)*genrand_real1(sfmt);
+        points2[2*i+1] = points3[3*i+1] = ymin+(ymax-ymin)*genrand_real1(sfmt);
+        points3[3*i+2] = zmin+(zmax-zmin)*genrand_real1(sfmt);
+    }
+    points2[0] = points3[0] = xmax;
+    points2[1] = points3[1] = ymax;
+    points3[2] = zmax;
+    vector<double> values(numPoints), gradients(3*numPoints);
+    reference2.evaluateWithGradient(numPoints, &points2[0], &values[0], &gradients[0]);
+    for (int i = 0; i < numPoints; i++) {
+        double u = points2[2*i], v = points2[2*i+1];
+        double dx, dy;
+        SplineFitter::evaluate2DSplineDerivatives(x, y, table2, c2, u, v, dx, dy);
+        ASSERT_EQUAL_TOL(SplineFitter::evaluate2DSpline(x, y, table2, c2, u, v), values[i], 1e-10);
+        ASSERT_EQUAL_TOL(values[i], reference2.evaluate(&points2[2*i]), 1e-10);
+        ASSERT_EQUAL_TOL(dx, gradients[2*i], 1e-10);
+        ASSERT_EQUAL_TOL(dy, gradients[2*i+1], 1e-10);
+    }
+    reference3.evaluateWithGradient(numPoints, &points3[0], &values[0], &gradients[0]);
+    for (int i = 0; i < numPoints; i++) {
+        double u = points3[3*i], v = points3[3*i+1], w = points3[3*i+2];
+        double dx, dy, dz;
+        SplineFitter::evaluate3DSplineDerivatives(x, y, z, table3, c3, u, v, w, dx, dy, dz);
+        ASSERT_EQUAL_TOL(SplineFitter::evaluate3DSpline(x, y, z, table3, c3, u, v, w), values[i], 1e-10);
+        ASSERT_EQUAL_TOL(values[i], reference3.evaluate(&points3[3*i]), 1e-10);
+        ASSERT_EQUAL_TOL(dx, gradients[3*i], 1e-10);
+        ASSERT_EQUAL_TOL(dy, gradients[3*i+1], 1e-10);
+        ASSERT_EQUAL_TOL(dz, gradients[3*i+2], 1e-10);
+    }
+    
+    // Points outside the range should give zero.
+    
+    double outside[] = {xmax+0.1, 0.5*(ymin+ymax), 0.5*(zmin+zmax)};
+    double gradient[] = {1, 1, 1};
+    ASSERT_EQUAL(0.0, reference3.evaluateWithGradient(outside, gradient));
+    ASSERT_EQUAL_VEC(Vec3(0, 0, 0), Vec3(gradient[0], gradient[1], gradient[2]), 0);
+}
+
 void testMultipleBonds() {
     // Two compound bonds using Urey-Bradley example from API doc
     ReferencePlatform platform;
@@ -325,6 +401,7 @@ int main() {
         testPositionDependence();
         testContinuous2DFunction();
         testContinuous3DFunction();
+        testTabulatedFunctionGradients();
         testMultipleBonds();
     }
     catch(const exception& e) {
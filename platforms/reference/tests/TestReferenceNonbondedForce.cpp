@@ -37,6 +37,7 @@
 #include "openmm/Context.h"
 #include "ReferencePlatform.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
 #include "SimTKOpenMMRealType.h"
@@ -559,6 +560,124 @@ void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testSoftcore() {
+    ReferencePlatform platform;
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.01);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->addParticle(0.5, 1.2, 1);
+    nonbonded->addParticle(-0.7, 1.4, 2);
+    nonbonded->addParticle(0.0, 1.0, 0.0);
+    nonbonded->addException(0, 2, 0.3, 0.5, 0.2);
+    nonbonded->setParticleAlchemical(0, true);
+    nonbonded->setSoftcoreAlpha(0.4);
+    system.addForce(nonbonded);
+    Context context(system, integrator, platform);
+    const double lambdaSterics = 0.3, lambdaElectrostatics = 0.6;
+    context.setParameter(NonbondedForce::LambdaSterics(), lambdaSterics);
+    context.setParameter(NonbondedForce::LambdaElectrostatics(), lambdaElectrostatics);
+    vector<Vec3> positions(3);
+    positions[0] = Vec3(0, 0, 0);
+    positions[2] = Vec3(0, 0.6, 0);
+    double eps = 4.0*SQRT_TWO;
+    double exceptionEnergy = ONE_4PI_EPS0*lambdaElectrostatics*0.3/0.6 + 4*0.2*(std::pow(0.5/0.6, 12.0)-std::pow(0.5/0.6, 6.0));
+    for (double r = 0.2; r < 3.0; r += 0.4) {
+        positions[1] = Vec3(r, 0, 0);
+        context.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        
+        // See if the energy is correct.
+        
+        double x = 1.0/(0.4*(1-lambdaSterics)+std::pow(r/1.3, 6.0));
+        double expectedEnergy = lambdaSterics*eps*x*(x-1) + ONE_4PI_EPS0*lambdaElectrostatics*0.5*(-0.7)/r;
+        ASSERT_EQUAL_TOL(expectedEnergy+exceptionEnergy, state.getPotentialEnergy(), TOL);
+        
+        // See if the force is the gradient of the energy.
+        
+        double delta = 1e-3;
+        positions[1] = Vec3(r-delta, 0, 0);
+        context.setPositions(positions);
+        double e1 = context.getState(State::Energy).getPotentialEnergy();
+        positions[1] = Vec3(r+delta, 0, 0);
+        context.setPositions(positions);
+        double e2 = context.getState(State::Energy).getPotentialEnergy();
+        ASSERT_EQUAL_TOL((e2-e1)/(2*delta), -state.getForces()[1][0], 1e-3);
+    }
+}
+
+void testUpdateSomeParameters(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    ReferencePlatform platform;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseDispersionCorrection(true);
+    vector<Vec3> positions;
+    const int gridSize = 5;
+    const double spacing = boxSize/gridSize;
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.3, 0.4);
+        nonbonded->addParticle(0.5, 0.2, 0.3);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        Vec3 pos(spacing*(i%gridSize), spacing*((i/gridSize)%gridSize), spacing*(i/(gridSize*gridSize)));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(0.1, 0, 0));
+    }
+    for (int i = 0; i < 10; i++)
+        nonbonded->addException(2*i, 2*i+2, 0.1, 0.3, 0.2);
+    nonbonded->setParticleAlchemical(0, true);
+    nonbonded->setParticleAlchemical(1, true);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context1.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+    context2.setParameter(NonbondedForce::LambdaElectrostatics(), 0.5);
+    context2.getState(State::Energy);
+
+    // Change a few particles and exceptions, and copy them over to one Context in full and to the other
+    // just the ones that changed.
+
+    vector<int> particles, exceptions;
+    particles.push_back(0);
+    particles.push_back(7);
+    nonbonded->setParticleParameters(0, 0.3, 0.3, 0.4);
+    nonbonded->setParticleParameters(7, -0.2, 0.25, 0.5);
+    exceptions.push_back(numMolecules+1);
+    nonbonded->setExceptionParameters(numMolecules+1, 2, 4, -0.2, 0.35, 0.1);
+    nonbonded->updateParametersInContext(context1);
+    nonbonded->updateParametersInContext(context2, particles, exceptions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+
+    // An exception cannot be changed between excluded and non-excluded.
+
+    nonbonded->setExceptionParameters(0, 0, 1, 0.1, 1.0, 0.0);
+    exceptions[0] = 0;
+    bool threwException = false;
+    try {
+        nonbonded->updateParametersInContext(context2, particles, exceptions);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 int main() {
     try {
         testCoulomb();
@@ -571,6 +690,10 @@ int main() {
         testDispersionCorrection();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
+        testSoftcore();
+        testUpdateSomeParameters(NonbondedForce::NoCutoff);
+        testUpdateSomeParameters(NonbondedForce::CutoffPeriodic);
+        testUpdateSomeParameters(NonbondedForce::PME);
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -45,7 +45,6 @@ using namespace std;
 static const int PME_ORDER = 5;
 
 bool CpuCalcPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcPmeReciprocalForceKernel::numThreads = 0;
 
 static void spreadCharge(int start, int end, float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
     float temp[4];
@@ -332,28 +331,65 @@ static void interpolateForces(int start, int end, float* posq, float* force, flo
     }
 }
 
-class CpuCalcPmeReciprocalForceKernel::ThreadData {
+class CpuCalcPmeReciprocalForceKernel::ComputeTask : public ThreadPool::Task {
 public:
+    ComputeTask(CpuCalcPmeReciprocalForceKernel& owner) : owner(owner) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        owner.runWorkerThread(threads, threadIndex);
+    }
     CpuCalcPmeReciprocalForceKernel& owner;
-    int index;
-    float* tempGrid;
-    ThreadData(CpuCalcPmeReciprocalForceKernel& owner, int index) : owner(owner), index(index), tempGrid(NULL) {
+};
+
+#ifdef OPENMM_FFTW_HAS_THREADS_CALLBACK
+/**
+ * FFTW lets us supply the function that executes its parallel loops.  We use this to run the FFTs
+ * on the same ThreadPool as the rest of the calculation, rather than having FFTW create its own
+ * threads.  The pool is looked up through a thread specific key, since the callback is global but
+ * different kernels may be executing FFTs on different threads at the same time.
+ */
+static pthread_key_t fftThreadPoolKey;
+
+class FftwLoopTask : public ThreadPool::Task {
+public:
+    FftwLoopTask(void* (*work)(char*), char* jobdata, size_t elementSize, int numJobs) :
+            work(work), jobdata(jobdata), elementSize(elementSize), numJobs(numJobs) {
     }
+    void execute(ThreadPool& threads, int threadIndex) {
+        for (int i = threadIndex; i < numJobs; i += threads.getNumThreads())
+            work(jobdata+i*elementSize);
+    }
+    void* (*work)(char*);
+    char* jobdata;
+    size_t elementSize;
+    int numJobs;
 };
 
-static void* threadBody(void* args) {
-    CpuCalcPmeReciprocalForceKernel::ThreadData& data = *reinterpret_cast<CpuCalcPmeReciprocalForceKernel::ThreadData*>(args);
-    data.owner.runThread(data.index);
-    if (data.tempGrid != NULL)
-        fftwf_free(data.tempGrid);
-    delete &data;
+static void fftwParallelLoop(void* (*work)(char*), char* jobdata, size_t elementSize, int numJobs, void* data) {
+    ThreadPool* threads = reinterpret_cast<ThreadPool*>(pthread_getspecific(fftThreadPoolKey));
+    if (threads == NULL) {
+        for (int i = 0; i < numJobs; i++)
+            work(jobdata+i*elementSize);
+        return;
+    }
+    FftwLoopTask task(work, jobdata, elementSize, numJobs);
+    threads->execute(task);
+    threads->waitForThreads();
+}
+#endif
+
+static void* mainThreadBody(void* args) {
+    reinterpret_cast<CpuCalcPmeReciprocalForceKernel*>(args)->runMainThread();
     return 0;
 }
 
 void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha) {
     if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
         fftwf_init_threads();
+#ifdef OPENMM_FFTW_HAS_THREADS_CALLBACK
+        pthread_key_create(&fftThreadPoolKey, NULL);
+        fftwf_threads_set_callback(fftwParallelLoop, NULL);
+#endif
         hasInitializedThreads = true;
     }
     gridx = findFFTDimension(xsize, false);
@@ -363,31 +399,17 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
     this->alpha = alpha;
     force.resize(4*numParticles);
     recipEterm.resize(gridx*gridy*gridz);
-    
-    // Initialize threads.
-    
     pthread_cond_init(&startCondition, NULL);
     pthread_cond_init(&endCondition, NULL);
-    pthread_cond_init(&mainThreadStartCondition, NULL);
-    pthread_cond_init(&mainThreadEndCondition, NULL);
     pthread_mutex_init(&lock, NULL);
-    thread.resize(numThreads);
-    for (int i = 0; i < numThreads; i++) {
-        ThreadData* data = new ThreadData(*this, i);
-        threadData.push_back(data);
-        pthread_create(&thread[i], NULL, threadBody, data);
-        data->tempGrid = (float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3));
-    }
-    pthread_create(&mainThread, NULL, threadBody, new ThreadData(*this, -1));
     
-    // Initialize FFTW.
+    // Allocate the grids.  The first thread spreads charge directly into the real space grid,
+    // so it does not need a temporary grid of its own.  The FFT plans are created the first
+    // time the calculation is performed, once we know how many threads will be executing it.
     
-    realGrid = threadData[0]->tempGrid;
+    realGrid = (float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3));
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
-    hasCreatedPlan = true;
+    tempGrid.push_back(realGrid);
     
     // Initialize the b-spline moduli.
 
@@ -446,19 +468,22 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
 }
 
 CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
-    isDeleted = true;
-    pthread_mutex_lock(&lock);
-    pthread_cond_broadcast(&startCondition);
-    pthread_cond_broadcast(&mainThreadStartCondition);
-    pthread_mutex_unlock(&lock);
-    for (int i = 0; i < (int) thread.size(); i++)
-        pthread_join(thread[i], NULL);
-    pthread_join(mainThread, NULL);
-    pthread_mutex_destroy(&lock);
-    pthread_cond_destroy(&startCondition);
-    pthread_cond_destroy(&endCondition);
-    pthread_cond_destroy(&mainThreadStartCondition);
-    pthread_cond_destroy(&mainThreadEndCondition);
+    if (hasCreatedMainThread) {
+        pthread_mutex_lock(&lock);
+        isDeleted = true;
+        pthread_cond_signal(&startCondition);
+        pthread_mutex_unlock(&lock);
+        pthread_join(mainThread, NULL);
+    }
+    if (realGrid != NULL) {
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&startCondition);
+        pthread_cond_destroy(&endCondition);
+    }
+    if (ownThreads != NULL)
+        delete ownThreads;
+    for (int i = 0; i < (int) tempGrid.size(); i++)
+        fftwf_free(tempGrid[i]);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
     if (hasCreatedPlan) {
@@ -467,100 +492,119 @@ CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
     }
 }
 
-void CpuCalcPmeReciprocalForceKernel::runThread(int index) {
-    if (index == -1) {
-        // This is the main thread that coordinates all the other ones.
-        
-        pthread_mutex_lock(&lock);
-        while (true) {
-            // Wait for the signal to start.
-            
-            pthread_cond_wait(&mainThreadStartCondition, &lock);
-            if (isDeleted)
-                break;
-            posq = io->getPosq();
-            advanceThreads(); // Signal threads to perform charge spreading.
-            advanceThreads(); // Signal threads to sum the charge grids.
-            fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
-            if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2])
-                advanceThreads(); // Signal threads to compute the reciprocal scale factors.
-            if (includeEnergy)
-                advanceThreads(); // Signal threads to compute energy.
-            advanceThreads(); // Signal threads to perform reciprocal convolution.
-            fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
-            advanceThreads(); // Signal threads to interpolate forces.
-            isFinished = true;
-            lastBoxVectors[0] = periodicBoxVectors[0];
-            lastBoxVectors[1] = periodicBoxVectors[1];
-            lastBoxVectors[2] = periodicBoxVectors[2];
-            pthread_cond_signal(&mainThreadEndCondition);
-        }
+void CpuCalcPmeReciprocalForceKernel::runMainThread() {
+    pthread_mutex_lock(&lock);
+    while (true) {
+        // Wait for the signal to start.
+
+        while (isFinished && !isDeleted)
+            pthread_cond_wait(&startCondition, &lock);
+        if (isDeleted)
+            break;
         pthread_mutex_unlock(&lock);
+        computeReciprocal(*ownThreads);
+        pthread_mutex_lock(&lock);
+        isFinished = true;
+        pthread_cond_signal(&endCondition);
     }
-    else {
-        // This is a worker thread.
-        
-        int particleStart = (index*numParticles)/numThreads;
-        int particleEnd = ((index+1)*numParticles)/numThreads;
-        int gridxStart = (index*gridx)/numThreads;
-        int gridxEnd = ((index+1)*gridx)/numThreads;
-        int gridSize = (gridx*gridy*gridz+3)/4;
-        int gridStart = 4*((index*gridSize)/numThreads);
-        int gridEnd = 4*(((index+1)*gridSize)/numThreads);
-        while (true) {
-            threadWait();
-            if (isDeleted)
-                break;
-            spreadCharge(particleStart, particleEnd, posq, threadData[index]->tempGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
-            threadWait();
-            int numGrids = threadData.size();
+    pthread_mutex_unlock(&lock);
+}
+
+void CpuCalcPmeReciprocalForceKernel::computeReciprocal(ThreadPool& threads) {
+    int numThreads = threads.getNumThreads();
+    while ((int) tempGrid.size() < numThreads)
+        tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
+    threadEnergy.resize(numThreads);
+    if (!hasCreatedPlan) {
+        fftwf_plan_with_nthreads(numThreads);
+        forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
+        backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+        hasCreatedPlan = true;
+    }
+#ifdef OPENMM_FFTW_HAS_THREADS_CALLBACK
+    pthread_setspecific(fftThreadPoolKey, &threads);
+#endif
+    posq = io->getPosq();
+    boxVectorsChanged = (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]);
+    executePhase(threads, SpreadCharge);
+    executePhase(threads, SumGrids);
+    fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
+    if (includeEnergy) {
+        executePhase(threads, ComputeEnergy);
+        for (int i = 0; i < numThreads; i++)
+            energy += threadEnergy[i];
+    }
+    if (includeForces) {
+        // The energy is computed directly from the transformed charge grid, so the convolution,
+        // the backward FFT, and the force interpolation are only needed for forces.
+
+        if (boxVectorsChanged)
+            executePhase(threads, ComputeEterm);
+        executePhase(threads, Convolution);
+        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+        executePhase(threads, InterpolateForces);
+        lastBoxVectors[0] = periodicBoxVectors[0];
+        lastBoxVectors[1] = periodicBoxVectors[1];
+        lastBoxVectors[2] = periodicBoxVectors[2];
+    }
+#ifdef OPENMM_FFTW_HAS_THREADS_CALLBACK
+    pthread_setspecific(fftThreadPoolKey, NULL);
+#endif
+}
+
+void CpuCalcPmeReciprocalForceKernel::executePhase(ThreadPool& threads, Phase phase) {
+    this->phase = phase;
+    ComputeTask task(*this);
+    threads.execute(task);
+    threads.waitForThreads();
+}
+
+void CpuCalcPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+    int numThreads = threads.getNumThreads();
+    switch (phase) {
+        case SpreadCharge: {
+            int particleStart = (index*numParticles)/numThreads;
+            int particleEnd = ((index+1)*numParticles)/numThreads;
+            spreadCharge(particleStart, particleEnd, posq, tempGrid[index], gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
+            break;
+        }
+        case SumGrids: {
+            int gridSize = (gridx*gridy*gridz+3)/4;
+            int gridStart = 4*((index*gridSize)/numThreads);
+            int gridEnd = 4*(((index+1)*gridSize)/numThreads);
             for (int i = gridStart; i < gridEnd; i += 4) {
                 fvec4 sum(&realGrid[i]);
-                for (int j = 1; j < numGrids; j++)
-                    sum += fvec4(&threadData[j]->tempGrid[i]);
+                for (int j = 1; j < numThreads; j++)
+                    sum += fvec4(&tempGrid[j][i]);
                 sum.store(&realGrid[i]);
             }
-            threadWait();
-            if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
-                computeReciprocalEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
-                threadWait();
-            }
-            if (includeEnergy) {
-                double threadEnergy = reciprocalEnergy(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
-                pthread_mutex_lock(&lock);
-                energy += threadEnergy;
-                pthread_mutex_unlock(&lock);
-                threadWait();
-            }
-            reciprocalConvolution(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, recipEterm);
-            threadWait();
+            break;
+        }
+        case ComputeEterm:
+            computeReciprocalEterm((index*gridx)/numThreads, ((index+1)*gridx)/numThreads, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
+            break;
+        case ComputeEnergy:
+            threadEnergy[index] = reciprocalEnergy((index*gridx)/numThreads, ((index+1)*gridx)/numThreads, complexGrid, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
+            break;
+        case Convolution:
+            reciprocalConvolution((index*gridx)/numThreads, ((index+1)*gridx)/numThreads, complexGrid, gridx, gridy, gridz, recipEterm);
+            break;
+        case InterpolateForces: {
+            int particleStart = (index*numParticles)/numThreads;
+            int particleEnd = ((index+1)*numParticles)/numThreads;
             interpolateForces(particleStart, particleEnd, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors);
+            break;
         }
     }
 }
 
-void CpuCalcPmeReciprocalForceKernel::threadWait() {
-    pthread_mutex_lock(&lock);
-    waitCount++;
-    pthread_cond_signal(&endCondition);
-    pthread_cond_wait(&startCondition, &lock);
-    pthread_mutex_unlock(&lock);
-}
-
-void CpuCalcPmeReciprocalForceKernel::advanceThreads() {
-    waitCount = 0;
-    pthread_cond_broadcast(&startCondition);
-    while (waitCount < numThreads) {
-        pthread_cond_wait(&endCondition, &lock);
-    }
-}
-
-void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) {
+void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy, bool includeForces) {
     this->io = &io;
     this->periodicBoxVectors[0] = periodicBoxVectors[0];
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
     this->periodicBoxVectors[2] = periodicBoxVectors[2];
     this->includeEnergy = includeEnergy;
+    this->includeForces = includeForces;
     energy = 0.0;
 
     // Invert the box vectors.
@@ -571,21 +615,35 @@ void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* perio
     recipBoxVectors[1] = Vec3(-periodicBoxVectors[1][0]*periodicBoxVectors[2][2], periodicBoxVectors[0][0]*periodicBoxVectors[2][2], 0)*scale;
     recipBoxVectors[2] = Vec3(periodicBoxVectors[1][0]*periodicBoxVectors[2][1]-periodicBoxVectors[1][1]*periodicBoxVectors[2][0], -periodicBoxVectors[0][0]*periodicBoxVectors[2][1], periodicBoxVectors[0][0]*periodicBoxVectors[1][1])*scale;
 
-    // Do the calculation.
+    // If the caller provided a ThreadPool, do the calculation on it right now.
+
+    ThreadPool* threads = io.getThreadPool();
+    if (threads != NULL) {
+        computeReciprocal(*threads);
+        return;
+    }
 
+    // Otherwise, do the calculation asynchronously on our own threads.
+
+    if (!hasCreatedMainThread) {
+        ownThreads = new ThreadPool();
+        pthread_create(&mainThread, NULL, mainThreadBody, this);
+        hasCreatedMainThread = true;
+    }
     pthread_mutex_lock(&lock);
     isFinished = false;
-    pthread_cond_signal(&mainThreadStartCondition);
+    pthread_cond_signal(&startCondition);
     pthread_mutex_unlock(&lock);
 }
 
 double CpuCalcPmeReciprocalForceKernel::finishComputation(IO& io) {
     pthread_mutex_lock(&lock);
     while (!isFinished) {
-        pthread_cond_wait(&mainThreadEndCondition, &lock);
+        pthread_cond_wait(&endCondition, &lock);
     }
     pthread_mutex_unlock(&lock);
-    io.setForce(&force[0]);
+    if (includeForces)
+        io.setForce(&force[0]);
     return energy;
 }
 
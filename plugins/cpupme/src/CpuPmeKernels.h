@@ -35,6 +35,7 @@
 #include "internal/windowsExportPme.h"
 #include "openmm/kernels.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
 #include <fftw3.h>
 #include <pthread.h>
 #include <vector>
@@ -44,13 +45,18 @@ namespace OpenMM {
 /**
  * This is an optimized CPU implementation of CalcPmeReciprocalForceKernel.  It is both
  * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ *
+ * If the IO object passed to beginComputation() provides a ThreadPool, the calculation is
+ * performed synchronously on that pool's worker threads, so no additional threads are created.
+ * Otherwise the kernel creates its own ThreadPool and performs the calculation asynchronously,
+ * allowing it to overlap with other work done by the caller.
  */
 
 class OPENMM_EXPORT_PME CpuCalcPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
-    class ThreadData;
+    class ComputeTask;
     CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
+            hasCreatedPlan(false), hasCreatedMainThread(false), isFinished(true), isDeleted(false), realGrid(NULL), complexGrid(NULL), ownThreads(NULL) {
     }
     /**
      * Initialize the kernel.
@@ -69,8 +75,9 @@ public:
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
      * @param includeEnergy       true if potential energy should be computed
+     * @param includeForces       true if forces should be computed
      */
-    void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy);
+    void beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy, bool includeForces=true);
     /**
      * Finish computing the force and energy.
      * 
@@ -79,51 +86,60 @@ public:
      */
     double finishComputation(IO& io);
     /**
-     * This routine contains the code executed by each thread.
+     * This routine contains the code executed by the background thread when the calculation
+     * is being performed asynchronously.
      */
-    void runThread(int index);
+    void runMainThread();
+    /**
+     * This routine contains the code executed by each worker thread for the current phase
+     * of the calculation.
+     */
+    void runWorkerThread(ThreadPool& threads, int index);
     /**
      * Get whether the current CPU supports all features needed by this kernel.
      */
     static bool isProcessorSupported();
 private:
     /**
-     * This is called by the worker threads to wait until the master thread instructs them to advance.
+     * The phases of the calculation that are executed in parallel by the worker threads.
+     */
+    enum Phase {SpreadCharge, SumGrids, ComputeEterm, ComputeEnergy, Convolution, InterpolateForces};
+    /**
+     * Perform the complete calculation, using the specified ThreadPool for the parallel phases.
      */
-    void threadWait();
+    void computeReciprocal(ThreadPool& threads);
     /**
-     * This is called by the master thread to instruct all the worker threads to advance.
+     * Have every worker thread execute one phase of the calculation, and wait until they finish.
      */
-    void advanceThreads();
+    void executePhase(ThreadPool& threads, Phase phase);
     /**
      * Select a size for one grid dimension that FFTW can handle efficiently.
      */
     int findFFTDimension(int minimum, bool isZ);
     static bool hasInitializedThreads;
-    static int numThreads;
     int gridx, gridy, gridz, numParticles;
     double alpha;
-    bool hasCreatedPlan, isFinished, isDeleted;
+    bool hasCreatedPlan, hasCreatedMainThread, isFinished, isDeleted;
     std::vector<float> force;
     std::vector<float> bsplineModuli[3];
     std::vector<float> recipEterm;
+    std::vector<float*> tempGrid;
+    std::vector<double> threadEnergy;
     Vec3 lastBoxVectors[3];
     float* realGrid;
     fftwf_complex* complexGrid;
     fftwf_plan forwardFFT, backwardFFT;
-    int waitCount;
     pthread_cond_t startCondition, endCondition;
-    pthread_cond_t mainThreadStartCondition, mainThreadEndCondition;
     pthread_mutex_t lock;
     pthread_t mainThread;
-    std::vector<pthread_t> thread;
-    std::vector<ThreadData*> threadData;
+    ThreadPool* ownThreads;
     // The following variables are used to store information about the calculation currently being performed.
     IO* io;
+    Phase phase;
     float energy;
     float* posq;
     Vec3 periodicBoxVectors[3], recipBoxVectors[3];
-    bool includeEnergy;
+    bool includeEnergy, includeForces, boxVectorsChanged;
 };
 
 } // namespace OpenMM
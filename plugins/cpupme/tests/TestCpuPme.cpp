@@ -40,6 +40,7 @@
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ThreadPool.h"
 #include "../src/CpuPmeKernels.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
@@ -51,17 +52,23 @@ using namespace std;
 
 class IO : public CalcPmeReciprocalForceKernel::IO {
 public:
+    IO() : threads(NULL) {
+    }
     vector<float> posq;
     float* force;
+    ThreadPool* threads;
     float* getPosq() {
         return &posq[0];
     }
     void setForce(float* force) {
         this->force = force;
     }
+    ThreadPool* getThreadPool() {
+        return threads;
+    }
 };
 
-void testPME(bool triclinic) {
+void testPME(bool triclinic, ThreadPool* threads) {
     // Create a cloud of random point charges.
 
     const int numParticles = 51;
@@ -111,6 +118,7 @@ void testPME(bool triclinic) {
     NonbondedForceImpl::calcPMEParameters(system, *force, alpha, gridx, gridy, gridz);
     CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
     IO io;
+    io.threads = threads;
     double sumSquaredCharges = 0;
     for (int i = 0; i < numParticles; i++) {
         io.posq.push_back(positions[i][0]);
@@ -123,11 +131,20 @@ void testPME(bool triclinic) {
     }
     double ewaldSelfEnergy = -ONE_4PI_EPS0*alpha*sumSquaredCharges/sqrt(M_PI);
     pme.initialize(gridx, gridy, gridz, numParticles, alpha);
+
+    // Computing only the energy should not produce any forces.  Do it first, so the full
+    // calculation below also checks that skipping the forces leaves the kernel in a valid state.
+
+    io.force = NULL;
+    pme.beginComputation(io, boxVectors, true, false);
+    double energyOnly = pme.finishComputation(io);
+    ASSERT(io.force == NULL);
     pme.beginComputation(io, boxVectors, true);
     double energy = pme.finishComputation(io);
     
     // See if they match.
     
+    ASSERT_EQUAL_TOL(energy, energyOnly, 1e-5);
     ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), energy+ewaldSelfEnergy, 1e-3);
     for (int i = 0; i < numParticles; i++)
         ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
@@ -139,8 +156,11 @@ int main(int argc, char* argv[]) {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
-        testPME(false);
-        testPME(true);
+        testPME(false, NULL);
+        testPME(true, NULL);
+        ThreadPool threads(3);
+        testPME(false, &threads);
+        testPME(true, &threads);
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
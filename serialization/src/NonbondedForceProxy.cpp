@@ -60,11 +60,14 @@ void NonbondedForceProxy::serialize(const void* object, SerializationNode& node)
     node.setIntProperty("ny", ny);
     node.setIntProperty("nz", nz);
     node.setIntProperty("recipForceGroup", force.getReciprocalSpaceForceGroup());
+    node.setDoubleProperty("softcoreAlpha", force.getSoftcoreAlpha());
     SerializationNode& particles = node.createChildNode("Particles");
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge, sigma, epsilon;
         force.getParticleParameters(i, charge, sigma, epsilon);
-        particles.createChildNode("Particle").setDoubleProperty("q", charge).setDoubleProperty("sig", sigma).setDoubleProperty("eps", epsilon);
+        SerializationNode& particle = particles.createChildNode("Particle").setDoubleProperty("q", charge).setDoubleProperty("sig", sigma).setDoubleProperty("eps", epsilon);
+        if (force.isParticleAlchemical(i))
+            particle.setBoolProperty("alch", true);
     }
     SerializationNode& exceptions = node.createChildNode("Exceptions");
     for (int i = 0; i < force.getNumExceptions(); i++) {
@@ -94,10 +97,12 @@ void* NonbondedForceProxy::deserialize(const SerializationNode& node) const {
         int nz = node.getIntProperty("nz", 0);
         force->setPMEParameters(alpha, nx, ny, nz);
         force->setReciprocalSpaceForceGroup(node.getIntProperty("recipForceGroup", -1));
+        force->setSoftcoreAlpha(node.getDoubleProperty("softcoreAlpha", 0.5));
         const SerializationNode& particles = node.getChildNode("Particles");
         for (int i = 0; i < (int) particles.getChildren().size(); i++) {
             const SerializationNode& particle = particles.getChildren()[i];
             force->addParticle(particle.getDoubleProperty("q"), particle.getDoubleProperty("sig"), particle.getDoubleProperty("eps"));
+            force->setParticleAlchemical(i, particle.getBoolProperty("alch", false));
         }
         const SerializationNode& exceptions = node.getChildNode("Exceptions");
         for (int i = 0; i < (int) exceptions.getChildren().size(); i++) {
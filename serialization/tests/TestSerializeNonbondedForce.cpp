@@ -56,6 +56,8 @@ void testSerialization() {
     force.addParticle(1, 0.1, 0.01);
     force.addParticle(0.5, 0.2, 0.02);
     force.addParticle(-0.5, 0.3, 0.03);
+    force.setParticleAlchemical(1, true);
+    force.setSoftcoreAlpha(0.3);
     force.addException(0, 1, 2, 0.5, 0.1);
     force.addException(1, 2, 0.2, 0.4, 0.2);
 
@@ -76,6 +78,7 @@ void testSerialization() {
     ASSERT_EQUAL(force.getEwaldErrorTolerance(), force2.getEwaldErrorTolerance());
     ASSERT_EQUAL(force.getReactionFieldDielectric(), force2.getReactionFieldDielectric());
     ASSERT_EQUAL(force.getUseDispersionCorrection(), force2.getUseDispersionCorrection());
+    ASSERT_EQUAL(force.getSoftcoreAlpha(), force2.getSoftcoreAlpha());
     ASSERT_EQUAL(force.getNumParticles(), force2.getNumParticles());
     double alpha2;
     int nx2, ny2, nz2;
@@ -92,6 +95,7 @@ void testSerialization() {
         ASSERT_EQUAL(charge1, charge2);
         ASSERT_EQUAL(sigma1, sigma2);
         ASSERT_EQUAL(epsilon1, epsilon2);
+        ASSERT_EQUAL(force.isParticleAlchemical(i), force2.isParticleAlchemical(i));
     }
     ASSERT_EQUAL(force.getNumExceptions(), force2.getNumExceptions());
     for (int i = 0; i < force.getNumExceptions(); i++) {
@@ -0,0 +1,171 @@
+#include "../libraries/lepton/include/Lepton.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace Lepton;
+using namespace std;
+
+/**
+ * This program measures how quickly Lepton can evaluate a set of expressions typical of custom forces, using each
+ * of its evaluation methods: the ExpressionProgram interpreter, the scalar JIT compiler (CompiledExpression), and the
+ * vector JIT compiler (CompiledVectorExpression).  It is not run as part of the test suite.
+ *
+ * Each expression depends on a distance r, which is varied between evaluations, and on a few parameters which are
+ * held fixed.  Each measurement is repeated several times, and the fastest one is reported, so that other activity
+ * on the machine does not distort the comparison.  The reported time is in nanoseconds per evaluation.
+ */
+
+struct Benchmark {
+    string name;
+    string expression;
+    map<string, double> parameters;
+};
+
+static const int numValues = 1024;
+static const int numRepetitions = 5;
+
+static double getTime() {
+    return clock()/(double) CLOCKS_PER_SEC;
+}
+
+static double timeProgram(const ParsedExpression& expression, const Benchmark& benchmark, const vector<double>& r, int iterations) {
+    ExpressionProgram program = expression.createProgram();
+    map<string, double> variables = benchmark.parameters;
+    double sum = 0.0;
+    double time = 0.0;
+    for (int repetition = 0; repetition < numRepetitions; repetition++) {
+        double start = getTime();
+        for (int i = 0; i < iterations; i++)
+            for (int j = 0; j < numValues; j++) {
+                variables["r"] = r[j];
+                sum += program.evaluate(variables);
+            }
+        double elapsed = getTime()-start;
+        if (repetition == 0 || elapsed < time)
+            time = elapsed;
+    }
+    if (sum == 1.2345)
+        printf(" ");
+    return 1e9*time/(iterations*numValues);
+}
+
+static double timeCompiled(const ParsedExpression& expression, const Benchmark& benchmark, const vector<double>& r, int iterations) {
+    CompiledExpression compiled = expression.createCompiledExpression();
+    for (map<string, double>::const_iterator iter = benchmark.parameters.begin(); iter != benchmark.parameters.end(); ++iter)
+        if (compiled.getVariables().find(iter->first) != compiled.getVariables().end())
+            compiled.getVariableReference(iter->first) = iter->second;
+    double& rvar = compiled.getVariableReference("r");
+    double sum = 0.0;
+    double time = 0.0;
+    for (int repetition = 0; repetition < numRepetitions; repetition++) {
+        double start = getTime();
+        for (int i = 0; i < iterations; i++)
+            for (int j = 0; j < numValues; j++) {
+                rvar = r[j];
+                sum += compiled.evaluate();
+            }
+        double elapsed = getTime()-start;
+        if (repetition == 0 || elapsed < time)
+            time = elapsed;
+    }
+    if (sum == 1.2345)
+        printf(" ");
+    return 1e9*time/(iterations*numValues);
+}
+
+static double timeVector(const ParsedExpression& expression, const Benchmark& benchmark, const vector<double>& r, int iterations, int width) {
+    CompiledVectorExpression compiled = expression.createCompiledVectorExpression(width);
+    for (map<string, double>::const_iterator iter = benchmark.parameters.begin(); iter != benchmark.parameters.end(); ++iter)
+        if (compiled.getVariables().find(iter->first) != compiled.getVariables().end()) {
+            float* values = compiled.getVariablePointer(iter->first);
+            for (int k = 0; k < width; k++)
+                values[k] = (float) iter->second;
+        }
+    float* rvar = compiled.getVariablePointer("r");
+    float sum = 0.0f;
+    double time = 0.0;
+    for (int repetition = 0; repetition < numRepetitions; repetition++) {
+        double start = getTime();
+        for (int i = 0; i < iterations; i++)
+            for (int j = 0; j < numValues; j += width) {
+                for (int k = 0; k < width; k++)
+                    rvar[k] = (float) r[j+k];
+                const float* result = compiled.evaluate();
+                for (int k = 0; k < width; k++)
+                    sum += result[k];
+            }
+        double elapsed = getTime()-start;
+        if (repetition == 0 || elapsed < time)
+            time = elapsed;
+    }
+    if (sum == 1.2345f)
+        printf(" ");
+    return 1e9*time/(iterations*numValues);
+}
+
+int main(int argc, char* argv[]) {
+    vector<Benchmark> benchmarks;
+    Benchmark b;
+    b.name = "Lennard-Jones";
+    b.expression = "4*epsilon*((sigma/r)^12-(sigma/r)^6)";
+    b.parameters["sigma"] = 0.3;
+    b.parameters["epsilon"] = 0.5;
+    benchmarks.push_back(b);
+    b.name = "Soft-core LJ";
+    b.expression = "4*epsilon*lambda*x*(x-1); x = 1/(0.5*(1-lambda)^2 + (r/sigma)^6)";
+    b.parameters["lambda"] = 0.7;
+    benchmarks.push_back(b);
+    b.name = "Switched LJ";
+    b.expression = "4*epsilon*((sigma/r)^12-(sigma/r)^6)*sw; sw = 1-step(r-rs)*s^3*(10-15*s+6*s^2); s = (r-rs)/(rc-rs)";
+    b.parameters["rs"] = 0.8;
+    b.parameters["rc"] = 1.0;
+    benchmarks.push_back(b);
+    b.name = "Screened Coulomb";
+    b.expression = "138.935456*q*erfc(alpha*r)/r";
+    b.parameters.clear();
+    b.parameters["q"] = -0.4;
+    b.parameters["alpha"] = 3.1;
+    benchmarks.push_back(b);
+    b.name = "Buckingham";
+    b.expression = "A*exp(-B*r)-C/r^6";
+    b.parameters["A"] = 1e5;
+    b.parameters["B"] = 30.0;
+    b.parameters["C"] = 1e-3;
+    benchmarks.push_back(b);
+    b.name = "Morse";
+    b.expression = "D*(1-exp(-a*(r-r0)))^2";
+    b.parameters["D"] = 400.0;
+    b.parameters["a"] = 20.0;
+    b.parameters["r0"] = 0.15;
+    benchmarks.push_back(b);
+    b.name = "Periodic";
+    b.expression = "k*(1+cos(3*r*10-phi0))+k2*sin(r)^2";
+    b.parameters["k"] = 2.0;
+    b.parameters["k2"] = 1.5;
+    b.parameters["phi0"] = 0.4;
+    benchmarks.push_back(b);
+    b.name = "Log";
+    b.expression = "-kT*log(1+exp(-(r-r0)/w))";
+    b.parameters["kT"] = 2.49;
+    b.parameters["w"] = 0.05;
+    benchmarks.push_back(b);
+    int iterations = (argc > 1 ? atoi(argv[1]) : 2000);
+    vector<double> r(numValues);
+    for (int i = 0; i < numValues; i++)
+        r[i] = 0.25+0.75*i/numValues;
+    printf("%-18s %12s %12s %12s %12s\n", "Expression", "Interpreter", "JIT", "Vector(4)", "Vector(8)");
+    for (int i = 0; i < (int) benchmarks.size(); i++) {
+        ParsedExpression expression = Parser::parse(benchmarks[i].expression).optimize();
+        printf("%-18s %12.2f %12.2f %12.2f %12.2f\n", benchmarks[i].name.c_str(),
+                timeProgram(expression, benchmarks[i], r, iterations/10),
+                timeCompiled(expression, benchmarks[i], r, iterations),
+                timeVector(expression, benchmarks[i], r, iterations, 4),
+                timeVector(expression, benchmarks[i], r, iterations, 8));
+    }
+    return 0;
+}
@@ -1,13 +1,16 @@
 #include "../libraries/lepton/include/Lepton.h"
 
+#include <algorithm>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <vector>
 
 using namespace Lepton;
 using namespace std;
 
 #define ASSERT_EQUAL_TOL(expected, found, tol) {double _scale_ = std::fabs(expected) > 1.0 ? std::fabs(expected) : 1.0; if (!(std::fabs((expected)-(found))/_scale_ <= (tol))) throw exception();};
+#define ASSERT_SAME_VALUE(expected, found, tol) {if (!((expected) == (found) || ((expected) != (expected) && (found) != (found)) || std::fabs(((expected)-(found))/(expected)) <= (tol))) throw exception();};
 
 /**
  * This is a custom function equal to f(x,y) = 2*x*y.
@@ -36,6 +39,51 @@ class ExampleFunction : public CustomFunction {
     }
 };
 
+/**
+ * This is a custom function defined as a cubic spline with four intervals on [0, 2].  It reports its coefficients,
+ * so CompiledExpression evaluates it inline.
+ */
+
+class SplineFunction : public CustomFunction {
+public:
+    SplineFunction() {
+        double c[] = {1.0, -0.5, 0.25, 0.1, 0.85, 0.3, -0.2, 0.05, 1.0, 0.0, 0.4, -0.3, 1.1, 0.5, 0.1, 0.2};
+        coefficients.assign(c, c+16);
+    }
+    int getNumArguments() const {
+        return 1;
+    }
+    double evaluate(const double* arguments) const {
+        double x = arguments[0];
+        if (x < 0.0 || x > 2.0)
+            return 0.0;
+        int index = std::min(3, (int) (2*x));
+        double t = 2*x-index;
+        const double* c = &coefficients[4*index];
+        return c[0]+t*(c[1]+t*(c[2]+t*c[3]));
+    }
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const {
+        double x = arguments[0];
+        if (derivOrder[0] != 1 || x < 0.0 || x > 2.0)
+            return 0.0;
+        int index = std::min(3, (int) (2*x));
+        double t = 2*x-index;
+        const double* c = &coefficients[4*index];
+        return 2*(c[1]+t*(2*c[2]+3*t*c[3]));
+    }
+    CustomFunction* clone() const {
+        return new SplineFunction();
+    }
+    bool getUniformSpline(double& min, double& max, vector<double>& coefficients) const {
+        min = 0.0;
+        max = 2.0;
+        coefficients = this->coefficients;
+        return true;
+    }
+private:
+    vector<double> coefficients;
+};
+
 /**
  * Verify that an expression gives the correct value.
  */
@@ -102,6 +150,23 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     value = compiled.evaluate();
     ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
 
+    // Create a CompiledVectorExpression of each allowed width and see if every element gives the same result.
+
+    const vector<int>& widths = CompiledVectorExpression::getAllowedWidths();
+    for (int w = 0; w < (int) widths.size(); w++) {
+        int width = widths[w];
+        CompiledVectorExpression vectorCompiled = parsed.createCompiledVectorExpression(width);
+        if (vectorCompiled.getVariables().find("x") != vectorCompiled.getVariables().end())
+            for (int i = 0; i < width; i++)
+                vectorCompiled.getVariablePointer("x")[i] = x;
+        if (vectorCompiled.getVariables().find("y") != vectorCompiled.getVariables().end())
+            for (int i = 0; i < width; i++)
+                vectorCompiled.getVariablePointer("y")[i] = y;
+        const float* vectorValue = vectorCompiled.evaluate();
+        for (int i = 0; i < width; i++)
+            ASSERT_EQUAL_TOL(expectedValue, vectorValue[i], 1e-5);
+    }
+
     // Make sure that variable renaming works.
 
     variables.clear();
@@ -113,6 +178,247 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
 }
 
+/**
+ * Verify that each element of a CompiledVectorExpression is computed independently of the others,
+ * both when setting the variables directly and when evaluating a batch of arbitrary length.
+ */
+
+void verifyVectorEvaluation(const string& expression) {
+    ParsedExpression parsed = Parser::parse(expression);
+    const int count = 21;
+    vector<float> xvalues(count), yvalues(count), results(count);
+    for (int i = 0; i < count; i++) {
+        xvalues[i] = 0.1f*(i+1);
+        yvalues[i] = 2.0f-0.15f*i;
+    }
+    const vector<int>& widths = CompiledVectorExpression::getAllowedWidths();
+    for (int w = 0; w < (int) widths.size(); w++) {
+        int width = widths[w];
+        CompiledVectorExpression compiled = parsed.createCompiledVectorExpression(width);
+        ASSERT_EQUAL_TOL(width, compiled.getWidth(), 0);
+        float* x = compiled.getVariablePointer("x");
+        float* y = compiled.getVariablePointer("y");
+        for (int i = 0; i < width; i++) {
+            x[i] = xvalues[i];
+            y[i] = yvalues[i];
+        }
+        const float* value = compiled.evaluate();
+        map<string, double> variables;
+        for (int i = 0; i < width; i++) {
+            variables["x"] = xvalues[i];
+            variables["y"] = yvalues[i];
+            ASSERT_EQUAL_TOL(parsed.evaluate(variables), value[i], 1e-5);
+        }
+
+        // Evaluate a batch whose length is not a multiple of the width.  Variables are in alphabetical order.
+
+        const float* inputs[] = {&xvalues[0], &yvalues[0]};
+        compiled.evaluate(inputs, &results[0], count);
+        for (int i = 0; i < count; i++) {
+            variables["x"] = xvalues[i];
+            variables["y"] = yvalues[i];
+            ASSERT_EQUAL_TOL(parsed.evaluate(variables), results[i], 1e-5);
+        }
+
+        // Copying it should produce an independent, working expression.
+
+        CompiledVectorExpression copy = compiled;
+        for (int i = 0; i < width; i++) {
+            copy.getVariablePointer("x")[i] = xvalues[0];
+            copy.getVariablePointer("y")[i] = yvalues[0];
+        }
+        variables["x"] = xvalues[0];
+        variables["y"] = yvalues[0];
+        ASSERT_EQUAL_TOL(parsed.evaluate(variables), copy.evaluate()[width-1], 1e-5);
+    }
+}
+
+/**
+ * Verify that a function the JIT compiler can compute inline gives accurate results, including for special
+ * values and for arguments outside the range the inline code handles.
+ */
+
+void verifyInlineFunction(const string& expression, double (*function)(double), const vector<double>& values) {
+    ParsedExpression parsed = Parser::parse(expression);
+    CompiledExpression compiled = parsed.createCompiledExpression();
+    double& x = compiled.getVariableReference("x");
+    const vector<int>& widths = CompiledVectorExpression::getAllowedWidths();
+    for (int i = 0; i < (int) values.size(); i++) {
+        double expected = function(values[i]);
+        x = values[i];
+        ASSERT_SAME_VALUE(expected, compiled.evaluate(), 1e-14);
+
+        // Check the vector version.  Put the value in a different element each time.
+
+        if (std::fabs(values[i]) > 1e30)
+            continue;
+        float floatValue = (float) values[i];
+        float floatExpected = (float) function(floatValue);
+        for (int w = 0; w < (int) widths.size(); w++) {
+            CompiledVectorExpression vectorCompiled = parsed.createCompiledVectorExpression(widths[w]);
+            float* vectorX = vectorCompiled.getVariablePointer("x");
+            for (int j = 0; j < widths[w]; j++)
+                vectorX[j] = 1.0f;
+            int index = i%widths[w];
+            vectorX[index] = floatValue;
+            ASSERT_SAME_VALUE(floatExpected, vectorCompiled.evaluate()[index], 1e-6);
+        }
+    }
+}
+
+double power6(double x) {
+    return std::pow(x, 6.0);
+}
+
+double powerMinus12(double x) {
+    return std::pow(x, -12.0);
+}
+
+void testInlineFunctions() {
+    double inf = numeric_limits<double>::infinity();
+    double nan = numeric_limits<double>::quiet_NaN();
+    double expValues[] = {-1000.0, -745.5, -708.9, -87.0, -3.7, -1e-3, 0.0, 1e-20, 0.5, 2.3, 88.5, 709.7, 1000.0, -inf, inf, nan};
+    verifyInlineFunction("exp(x)", std::exp, vector<double>(expValues, expValues+sizeof(expValues)/sizeof(double)));
+    double logValues[] = {0.0, -1.0, 1e-310, 1e-300, 1e-30, 0.3, 0.99999, 1.0, 1.00001, 1.5, 2.5, 1e30, 1e300, inf, -inf, nan};
+    verifyInlineFunction("log(x)", std::log, vector<double>(logValues, logValues+sizeof(logValues)/sizeof(double)));
+    double trigValues[] = {0.0, 1e-12, -0.3, 0.7853, 1.5707963, 2.0, -3.1415926, 4.0, 100.5, -12345.6, 99999.0, 1e6, -1e12, inf, nan};
+    vector<double> trig(trigValues, trigValues+sizeof(trigValues)/sizeof(double));
+    verifyInlineFunction("sin(x)", std::sin, trig);
+    verifyInlineFunction("cos(x)", std::cos, trig);
+    verifyInlineFunction("tan(x)", std::tan, trig);
+    double erfValues[] = {0.0, -1e-300, 1e-12, 0.2, -0.25, 0.5, 0.84375, -0.8437, 0.9, 1.25, -2.0, 3.1, 5.9, -6.1, 9.0, 27.0, 30.0, inf, -inf, nan};
+    vector<double> errorFunction(erfValues, erfValues+sizeof(erfValues)/sizeof(double));
+    verifyInlineFunction("erf(x)", erf, errorFunction);
+    verifyInlineFunction("erfc(x)", erfc, errorFunction);
+    double powerValues[] = {0.1, 0.5, 1.0, 1.7, -2.3, 10.0};
+    vector<double> power(powerValues, powerValues+sizeof(powerValues)/sizeof(double));
+    verifyInlineFunction("x^6", power6, power);
+    verifyInlineFunction("x^-12", powerMinus12, power);
+}
+
+/**
+ * Verify that a CompiledExpression or CompiledVectorExpression built from an expression and its derivatives computes
+ * all of them correctly.
+ */
+void verifyMultipleOutputs(const string& expression) {
+    ParsedExpression parsed = Parser::parse(expression);
+    vector<ParsedExpression> expressions;
+    expressions.push_back(parsed);
+    expressions.push_back(parsed.differentiate("x"));
+    expressions.push_back(parsed.differentiate("y"));
+    expressions.push_back(parsed.differentiate("x").differentiate("y"));
+    CompiledExpression compiled(expressions);
+    ASSERT_EQUAL_TOL(4, compiled.getNumOutputs(), 0);
+    map<string, double> variables;
+    for (int i = 0; i < 5; i++) {
+        variables["x"] = 0.3+0.4*i;
+        variables["y"] = 1.7-0.2*i;
+        compiled.getVariableReference("x") = variables["x"];
+        compiled.getVariableReference("y") = variables["y"];
+        double value = compiled.evaluate();
+        ASSERT_EQUAL_TOL(parsed.evaluate(variables), value, 1e-10);
+        for (int j = 0; j < (int) expressions.size(); j++)
+            ASSERT_EQUAL_TOL(expressions[j].evaluate(variables), compiled.getOutputValue(j), 1e-10);
+    }
+
+    // A copy should compute the same outputs.
+
+    CompiledExpression copy = compiled;
+    copy.getVariableReference("x") = variables["x"];
+    copy.getVariableReference("y") = variables["y"];
+    copy.evaluate();
+    for (int j = 0; j < (int) expressions.size(); j++)
+        ASSERT_EQUAL_TOL(expressions[j].evaluate(variables), copy.getOutputValue(j), 1e-10);
+
+    // A CompiledVectorExpression should compute all of them for every element.
+
+    const vector<int>& widths = CompiledVectorExpression::getAllowedWidths();
+    for (int w = 0; w < (int) widths.size(); w++) {
+        CompiledVectorExpression vectorCompiled(expressions, widths[w]);
+        ASSERT_EQUAL_TOL(4, vectorCompiled.getNumOutputs(), 0);
+        float* x = vectorCompiled.getVariablePointer("x");
+        float* y = vectorCompiled.getVariablePointer("y");
+        for (int i = 0; i < widths[w]; i++) {
+            x[i] = 0.3f+0.1f*i;
+            y[i] = 1.7f-0.1f*i;
+        }
+        const float* value = vectorCompiled.evaluate();
+        for (int i = 0; i < widths[w]; i++) {
+            variables["x"] = x[i];
+            variables["y"] = y[i];
+            ASSERT_EQUAL_TOL(parsed.evaluate(variables), value[i], 1e-5);
+            for (int j = 0; j < (int) expressions.size(); j++)
+                ASSERT_EQUAL_TOL(expressions[j].evaluate(variables), vectorCompiled.getOutputValues(j)[i], 1e-5);
+        }
+    }
+}
+
+/**
+ * Compiled code may be shared between CompiledExpressions that perform the same operations.  Verify that each one
+ * still uses its own variables, and that expressions differing only slightly are not confused.
+ */
+void testSharedCompiledCode() {
+    CompiledExpression exp1 = Parser::parse("x*2+y").createCompiledExpression();
+    CompiledExpression exp2 = Parser::parse("a*2+b").createCompiledExpression();
+    CompiledExpression exp3 = exp1;
+    CompiledExpression exp4 = Parser::parse("x*2.0000000000000004+y").createCompiledExpression();
+    exp1.getVariableReference("x") = 1.0;
+    exp1.getVariableReference("y") = 2.0;
+    exp2.getVariableReference("a") = 3.0;
+    exp2.getVariableReference("b") = 4.0;
+    exp3.getVariableReference("x") = 5.0;
+    exp3.getVariableReference("y") = 6.0;
+    exp4.getVariableReference("x") = 1e16;
+    exp4.getVariableReference("y") = 0.0;
+    ASSERT_EQUAL_TOL(4.0, exp1.evaluate(), 1e-15);
+    ASSERT_EQUAL_TOL(10.0, exp2.evaluate(), 1e-15);
+    ASSERT_EQUAL_TOL(16.0, exp3.evaluate(), 1e-15);
+    ASSERT_EQUAL_TOL(4.0, exp1.evaluate(), 1e-15);
+    CompiledExpression& exp3Ref = exp3;
+    exp3 = exp3Ref;
+    ASSERT_EQUAL_TOL(16.0, exp3.evaluate(), 1e-15);
+    if (exp4.evaluate() == 2e16)
+        throw exception();
+    {
+        // Once every copy has been deleted, compiling the expression again must still work.
+
+        CompiledExpression exp5 = Parser::parse("sin(x)-y^3").createCompiledExpression();
+        CompiledExpression exp6 = exp5;
+    }
+    CompiledExpression exp7 = Parser::parse("sin(x)-y^3").createCompiledExpression();
+    exp7.getVariableReference("x") = 0.5;
+    exp7.getVariableReference("y") = 2.0;
+    ASSERT_EQUAL_TOL(sin(0.5)-8.0, exp7.evaluate(), 1e-14);
+}
+
+/**
+ * Verify that a custom function defined as a uniform spline is evaluated correctly by compiled code, both inside
+ * and outside its range.
+ */
+void testUniformSpline() {
+    map<string, CustomFunction*> functions;
+    SplineFunction spline;
+    functions["spline"] = &spline;
+    ParsedExpression exp = Parser::parse("3*spline(x)+y", functions);
+    ParsedExpression deriv = exp.differentiate("x").optimize();
+    CompiledExpression compiled = exp.createCompiledExpression();
+    CompiledExpression compiledDeriv = deriv.createCompiledExpression();
+    map<string, double> variables;
+    variables["y"] = 0.5;
+    compiled.getVariableReference("y") = 0.5;
+    for (int i = 0; i <= 60; i++) {
+        double x = -0.5+0.05*i;
+        variables["x"] = x;
+        compiled.getVariableReference("x") = x;
+        compiledDeriv.getVariableReference("x") = x;
+        ASSERT_EQUAL_TOL(exp.evaluate(variables), compiled.evaluate(), 1e-14);
+        ASSERT_EQUAL_TOL(deriv.evaluate(variables), compiledDeriv.evaluate(), 1e-14);
+    }
+    variables["x"] = 2.0;
+    compiled.getVariableReference("x") = 2.0;
+    ASSERT_EQUAL_TOL(3*(1.1+0.5+0.1+0.2)+0.5, compiled.evaluate(), 1e-14);
+}
+
 /**
  * Confirm that a parse error gets thrown.
  */
@@ -249,6 +555,16 @@ int main() {
         verifyEvaluation("step(x-3)+y*step(x)", 2.0, 3.0, 3.0);
         verifyEvaluation("floor(x)", -2.1, 3.0, -3.0);
         verifyEvaluation("ceil(x)", -2.1, 3.0, -2.0);
+        verifyVectorEvaluation("x^2+y*x-3/y");
+        verifyVectorEvaluation("sin(x)*exp(-y)+log(x)");
+        verifyVectorEvaluation("step(x-0.75)*abs(y)+delta(x-0.5)+min(x, y)-max(x, 2*y)");
+        verifyVectorEvaluation("sqrt(x)+recip(y)+cube(y-x)+atan(x/y)");
+        testInlineFunctions();
+        verifyMultipleOutputs("x^2*exp(-y*x)+sin(x*y)");
+        verifyMultipleOutputs("4*y*(x^-12-x^-6)+erfc(x)/x");
+        verifyMultipleOutputs("x+y");
+        testSharedCompiledCode();
+        testUniformSpline();
         verifyInvalidExpression("1..2");
         verifyInvalidExpression("1*(2+3");
         verifyInvalidExpression("5++4");
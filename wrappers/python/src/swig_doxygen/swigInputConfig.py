@@ -92,6 +92,12 @@ SKIP_METHODS = [('State',),
                 ('Context',  'setState'),
                 ('Context',  'createCheckpoint'),
                 ('Context',  'loadCheckpoint'),
+                ('Context',  'copyPositions'),
+                ('Context',  'copyVelocities'),
+                ('Context',  'copyForces'),
+                ('Context',  'waitForSteps'),
+                ('Context',  'computeEnergies'),
+                ('Context',  'clone'),
                 ('CudaPlatform',),
                 ('Force',    'Force'),
                 ('ParticleParameterInfo',),
@@ -100,6 +106,7 @@ SKIP_METHODS = [('State',),
                 ('Platform', 'registerStreamFactory'),
                 ('Platform', 'contextCreated'),
                 ('Platform', 'contextDestroyed'),
+                ('Platform', 'getNumConcurrentContexts'),
                 ('Platform', 'createKernel'),
                 ('Platform', 'registerKernelFactory'),
                 ('IntegrateRPMDStepKernel',),
@@ -25,6 +25,20 @@
     return _convertStateToLists(state);
   }
 
+  PyObject *_waitForStepsAsLists() {
+    State state;
+    PyThreadState* _savePythonThreadState = PyEval_SaveThread();
+    try {
+        state = self->waitForSteps();
+    }
+    catch (...) {
+        PyEval_RestoreThread(_savePythonThreadState);
+        throw;
+    }
+    PyEval_RestoreThread(_savePythonThreadState);
+    return _convertStateToLists(state);
+  }
+
 
   %pythoncode {
     def getState(self,
@@ -83,6 +97,26 @@
                       periodicBoxVectorsList=periodicBoxVectorsList,
                       paramMap=paramMap)
         return state
+
+    def waitForSteps(self):
+        """
+        waitForSteps(self) -> State
+
+        Wait for the time steps started by stepAsync() to finish.  If an exception was thrown while taking the
+        steps, it is rethrown by this method.
+
+        Returns: a State recorded immediately after the last step, containing the data types that were passed
+        to stepAsync()
+        """
+        (simTime, periodicBoxVectorsList, energy, coordList, velList,
+         forceList, paramMap) = self._waitForStepsAsLists()
+        return State(simTime=simTime,
+                     energy=energy,
+                     coordList=coordList,
+                     velList=velList,
+                     forceList=forceList,
+                     periodicBoxVectorsList=periodicBoxVectorsList,
+                     paramMap=paramMap)
   
     def setState(self, state):
         """
@@ -144,6 +178,105 @@ Parameters:
     stream << checkpoint;
     self->loadCheckpoint(stream);
   }
+
+  void _copyToBuffer(PyObject* output, int dataType, const std::vector<int>& particles, int groups) {
+    // Write directly into any object that supports the buffer protocol, such as a NumPy array.  It must be
+    // two dimensional with at least three columns, and contain double or single precision values.
+
+    Py_buffer view;
+    if (PyObject_GetBuffer(output, &view, PyBUF_RECORDS) != 0) {
+        PyErr_Clear();
+        throw OpenMMException("The output must be a writable array, such as a NumPy array");
+    }
+    int numRequested = (particles.size() == 0 ? self->getSystem().getNumParticles() : particles.size());
+    std::string format = (view.format == NULL ? "B" : view.format);
+    char type = format[format.size()-1];
+    bool valid = (view.ndim == 2 && view.shape[0] >= numRequested && view.shape[1] >= 3 && view.strides[1] == view.itemsize &&
+                  view.strides[0] > 0 && view.strides[0]%view.itemsize == 0 &&
+                  ((type == 'd' && view.itemsize == sizeof(double)) || (type == 'f' && view.itemsize == sizeof(float))));
+    if (!valid) {
+        PyBuffer_Release(&view);
+        throw OpenMMException("The output must be an array of float64 or float32 with one row of at least three elements for each requested particle");
+    }
+    int stride = view.strides[0]/view.itemsize;
+    PyThreadState* _savePythonThreadState = PyEval_SaveThread();
+    try {
+        if (type == 'd') {
+            double* data = (double*) view.buf;
+            if (dataType == 0)
+                self->copyPositions(data, particles, stride);
+            else if (dataType == 1)
+                self->copyVelocities(data, particles, stride);
+            else
+                self->copyForces(data, particles, stride, groups);
+        }
+        else {
+            float* data = (float*) view.buf;
+            if (dataType == 0)
+                self->copyPositions(data, particles, stride);
+            else if (dataType == 1)
+                self->copyVelocities(data, particles, stride);
+            else
+                self->copyForces(data, particles, stride, groups);
+        }
+    }
+    catch (...) {
+        PyEval_RestoreThread(_savePythonThreadState);
+        PyBuffer_Release(&view);
+        throw;
+    }
+    PyEval_RestoreThread(_savePythonThreadState);
+    PyBuffer_Release(&view);
+  }
+
+  %pythoncode {
+    def copyPositions(self, output, particles=[]):
+        """
+        copyPositions(self, output, particles=[])
+
+        Copy the positions of some or all particles (in nm) directly into an array supplied by the caller.  This
+        avoids creating a State, and if only a subset of particles is needed, avoids retrieving all the others.
+        Positions are not translated into the periodic box.
+
+        Parameters:
+         - output (array) a writable two dimensional array of float64 or float32, such as a NumPy array, with one row
+           for each requested particle.  The position of the i'th requested particle is written to the first three
+           elements of row i.
+         - particles (list=[]) the indices of the particles to copy.  If this is empty, all particles are copied.
+        """
+        self._copyToBuffer(output, 0, particles, -1)
+
+    def copyVelocities(self, output, particles=[]):
+        """
+        copyVelocities(self, output, particles=[])
+
+        Copy the velocities of some or all particles (in nm/ps) directly into an array supplied by the caller.
+
+        Parameters:
+         - output (array) a writable two dimensional array of float64 or float32, such as a NumPy array, with one row
+           for each requested particle.  The velocity of the i'th requested particle is written to the first three
+           elements of row i.
+         - particles (list=[]) the indices of the particles to copy.  If this is empty, all particles are copied.
+        """
+        self._copyToBuffer(output, 1, particles, -1)
+
+    def copyForces(self, output, particles=[], groups=-1):
+        """
+        copyForces(self, output, particles=[], groups=-1)
+
+        Copy the forces on some or all particles (in kJ/mol/nm) directly into an array supplied by the caller.  The
+        forces are computed if necessary, exactly as by getState().
+
+        Parameters:
+         - output (array) a writable two dimensional array of float64 or float32, such as a NumPy array, with one row
+           for each requested particle.  The force on the i'th requested particle is written to the first three
+           elements of row i.
+         - particles (list=[]) the indices of the particles to copy.  If this is empty, all particles are copied.
+         - groups (int=-1) a set of bit flags for which force groups to include.  Group i will be included if
+           (groups&(1<<i)) != 0.  The default value includes all groups.
+        """
+        self._copyToBuffer(output, 2, particles, groups)
+  }
 }
 
 %extend OpenMM::RPMDIntegrator {
@@ -55,6 +55,37 @@ class TestNumpyCompatibility(unittest.TestCase):
                                              output.value_in_unit(unit.angstroms / unit.femtoseconds))
     
     
+    def test_copyPositions(self):
+        n_particles = self.simulation.context.getSystem().getNumParticles()
+        input = np.random.randn(n_particles, 3)
+        self.simulation.context.setPositions(input)
+        output = np.zeros((n_particles, 3))
+        self.simulation.context.copyPositions(output)
+        np.testing.assert_array_equal(input, output)
+        subset = np.zeros((2, 4), dtype=np.float32)
+        self.simulation.context.copyPositions(subset, [5, 2])
+        np.testing.assert_array_almost_equal(input[[5, 2]], subset[:,:3], decimal=5)
+        np.testing.assert_array_equal(np.zeros(2), subset[:,3])
+        self.assertRaises(Exception, lambda: self.simulation.context.copyPositions(np.zeros((n_particles-1, 3))))
+        self.assertRaises(Exception, lambda: self.simulation.context.copyPositions(np.zeros((n_particles, 3), dtype=np.int32)))
+
+    def test_copyVelocities(self):
+        n_particles = self.simulation.context.getSystem().getNumParticles()
+        input = np.random.randn(n_particles, 3)
+        self.simulation.context.setVelocities(input)
+        output = np.zeros((n_particles, 3))
+        self.simulation.context.copyVelocities(output)
+        np.testing.assert_array_equal(input, output)
+
+    def test_copyForces(self):
+        n_particles = self.simulation.context.getSystem().getNumParticles()
+        grid = [(i%9, (i//9)%9, i//81) for i in range(n_particles)]
+        self.simulation.context.setPositions(0.3*np.array(grid))
+        expected = self.simulation.context.getState(getForces=True).getForces(asNumpy=True).value_in_unit(unit.kilojoules_per_mole/unit.nanometer)
+        output = np.zeros((n_particles, 3))
+        self.simulation.context.copyForces(output)
+        np.testing.assert_array_almost_equal(expected, output)
+    
     def test_tabulatedFunction(self):
         f = mm.CustomNonbondedForce('g(r)')
     